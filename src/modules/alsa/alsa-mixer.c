@@ -44,8 +44,11 @@
 #include <pulsecore/core-util.h>
 #include <pulsecore/conf-parser.h>
 #include <pulsecore/strbuf.h>
+#include <pulsecore/database.h>
+#include <pulsecore/tagstruct.h>
 
 #include "alsa-mixer.h"
+#include "alsa-probe-cache.h"
 #include "alsa-util.h"
 
 #ifdef HAVE_VALGRIND_MEMCHECK_H
@@ -1051,14 +1054,155 @@ static int element_get_nearest_alsa_dB(snd_mixer_elem_t *me, snd_mixer_selem_cha
     return r;
 }
 
-static int element_set_volume(pa_alsa_element *e, snd_mixer_t *m, const pa_channel_map *cm, pa_cvolume *v, bool deferred_volume, bool write_to_hw) {
+static bool element_has_channel(pa_alsa_element *e, snd_mixer_elem_t *me, snd_mixer_selem_channel_id_t c) {
+    if (e->direction == PA_ALSA_DIRECTION_OUTPUT)
+        return snd_mixer_selem_has_playback_channel(me, c);
+    else
+        return snd_mixer_selem_has_capture_channel(me, c);
+}
+
+/* This doesn't talk to the hardware, ALSA keeps the control values
+ * cached and updates them when it sees a change event */
+static long element_get_raw_volume(pa_alsa_element *e, snd_mixer_elem_t *me, snd_mixer_selem_channel_id_t c) {
+    long value = 0;
+
+    if (e->direction == PA_ALSA_DIRECTION_OUTPUT)
+        snd_mixer_selem_get_playback_volume(me, c, &value);
+    else
+        snd_mixer_selem_get_capture_volume(me, c, &value);
+
+    return value;
+}
+
+/* Writes the volume to channel c, or to all channels at once if all
+ * is true. *value is in dB*100 if the element has dB information, raw
+ * otherwise, and is replaced with what the hardware actually got. */
+static int element_write_volume(pa_alsa_element *e, snd_mixer_elem_t *me, snd_mixer_selem_channel_id_t c, bool all, long *value, bool deferred_volume) {
+    int rounding = e->direction == PA_ALSA_DIRECTION_OUTPUT ? +1 : -1;
+    long step;
+    int r;
+
+    e->path->n_volume_writes++;
+
+    if (e->has_dB && !e->db_fix) {
+        if (deferred_volume) {
+            if ((r = element_get_nearest_alsa_dB(me, c, e->direction, value)) < 0)
+                return r;
+
+            rounding = 0;
+        }
+
+        if (e->direction == PA_ALSA_DIRECTION_OUTPUT) {
+            if (all)
+                r = snd_mixer_selem_set_playback_dB_all(me, *value, rounding);
+            else
+                r = snd_mixer_selem_set_playback_dB(me, c, *value, rounding);
+
+            if (r >= 0 && !deferred_volume)
+                r = snd_mixer_selem_get_playback_dB(me, c, value);
+        } else {
+            if (all)
+                r = snd_mixer_selem_set_capture_dB_all(me, *value, rounding);
+            else
+                r = snd_mixer_selem_set_capture_dB(me, c, *value, rounding);
+
+            if (r >= 0 && !deferred_volume)
+                r = snd_mixer_selem_get_capture_dB(me, c, value);
+        }
+
+        return r;
+    }
+
+    step = e->db_fix ? decibel_fix_get_step(e->db_fix, value, rounding) : *value;
+
+    if (e->direction == PA_ALSA_DIRECTION_OUTPUT) {
+        if (all)
+            r = snd_mixer_selem_set_playback_volume_all(me, step);
+        else
+            r = snd_mixer_selem_set_playback_volume(me, c, step);
+    } else {
+        if (all)
+            r = snd_mixer_selem_set_capture_volume_all(me, step);
+        else
+            r = snd_mixer_selem_set_capture_volume(me, c, step);
+    }
+
+    /* With a dB fix *value has already been replaced with the dB value
+     * of the step, otherwise read back what the driver made of it */
+    if (r >= 0 && !e->db_fix)
+        *value = element_get_raw_volume(e, me, c);
+
+    return r;
+}
+
+/* Doesn't write anything, only asks ALSA what we would get */
+static int element_ask_volume(pa_alsa_element *e, snd_mixer_elem_t *me, long *value) {
+    int rounding = e->direction == PA_ALSA_DIRECTION_OUTPUT ? +1 : -1;
+    long alsa_val;
+    int r;
+
+    pa_assert(e->has_dB);
+
+    if (e->db_fix) {
+        decibel_fix_get_step(e->db_fix, value, rounding);
+        return 0;
+    }
+
+    if (e->direction == PA_ALSA_DIRECTION_OUTPUT) {
+        if ((r = snd_mixer_selem_ask_playback_dB_vol(me, *value, rounding, &alsa_val)) >= 0)
+            r = snd_mixer_selem_ask_playback_vol_dB(me, alsa_val, value);
+    } else {
+        if ((r = snd_mixer_selem_ask_capture_dB_vol(me, *value, rounding, &alsa_val)) >= 0)
+            r = snd_mixer_selem_ask_capture_vol_dB(me, alsa_val, value);
+    }
+
+    return r;
+}
+
+/* ALSA only updates the control values it hands out when the mixer
+ * events are handled. This checks, without handling them, whether there
+ * are any left, i.e. whether somebody may have changed a control since.
+ * The events are handled by whoever polls the mixer, possibly in another
+ * thread, so we must not do that ourselves. */
+static bool mixer_events_pending(snd_mixer_t *m) {
+    struct pollfd *fds;
+    unsigned short revents = 0;
+    int n;
+    bool pending = true;
+
+    if ((n = snd_mixer_poll_descriptors_count(m)) <= 0)
+        return true;
+
+    fds = pa_xnew0(struct pollfd, n);
+
+    if ((n = snd_mixer_poll_descriptors(m, fds, (unsigned) n)) < 0)
+        goto finish;
+
+    if (poll(fds, (nfds_t) n, 0) < 0)
+        goto finish;
+
+    if (snd_mixer_poll_descriptors_revents(m, fds, (unsigned) n, &revents) < 0)
+        goto finish;
+
+    pending = revents != 0;
+
+finish:
+    pa_xfree(fds);
+    return pending;
+}
+
+static int element_set_volume(pa_alsa_element *e, snd_mixer_t *m, const pa_channel_map *cm, pa_cvolume *v, bool deferred_volume, bool write_to_hw, bool use_cache) {
 
     snd_mixer_selem_id_t *sid;
     pa_cvolume rv;
     snd_mixer_elem_t *me;
     snd_mixer_selem_channel_id_t c;
     pa_channel_position_mask_t mask = 0;
-    unsigned k;
+    pa_volume_t requested[SND_MIXER_SCHN_LAST + 1];
+    bool present[SND_MIXER_SCHN_LAST + 1];
+    snd_mixer_selem_channel_id_t first = SND_MIXER_SCHN_UNKNOWN;
+    bool all = true, written_all = false;
+    unsigned k, n = 0;
 
     pa_assert(m);
     pa_assert(e);
@@ -1072,13 +1216,21 @@ static int element_set_volume(pa_alsa_element *e, snd_mixer_t *m, const pa_chann
         return -1;
     }
 
-    pa_cvolume_mute(&rv, cm->channels);
+    /* Without dB information we always write, since we can't ask ALSA
+     * what we would get */
+    if (!e->has_dB)
+        write_to_hw = true;
 
     for (c = 0; c <= SND_MIXER_SCHN_LAST; c++) {
-        int r;
         pa_volume_t f = PA_VOLUME_MUTED;
         bool found = false;
 
+        /* If we call set_playback_volume() without checking first
+         * if the channel is available, ALSA behaves very
+         * strangely and doesn't fail the call */
+        if (!(present[c] = element_has_channel(e, me, c)))
+            continue;
+
         for (k = 0; k < cm->channels; k++)
             if (e->masks[c][e->n_channels-1] & PA_CHANNEL_POSITION_MASK(cm->map[k])) {
                 found = true;
@@ -1093,104 +1245,70 @@ static int element_set_volume(pa_alsa_element *e, snd_mixer_t *m, const pa_chann
             f = pa_cvolume_max(v);
         }
 
-        if (e->has_dB) {
-            long value = to_alsa_dB(f);
-            int rounding;
+        if (n++ == 0)
+            first = c;
+        else if (f != requested[first])
+            all = false;
 
-            if (e->volume_limit >= 0 && value > (e->max_dB * 100))
-                value = e->max_dB * 100;
+        requested[c] = f;
+    }
 
-            if (e->direction == PA_ALSA_DIRECTION_OUTPUT) {
-                /* If we call set_playback_volume() without checking first
-                 * if the channel is available, ALSA behaves very
-                 * strangely and doesn't fail the call */
-                if (snd_mixer_selem_has_playback_channel(me, c)) {
-                    rounding = +1;
-                    if (e->db_fix) {
-                        if (write_to_hw)
-                            r = snd_mixer_selem_set_playback_volume(me, c, decibel_fix_get_step(e->db_fix, &value, rounding));
-                        else {
-                            decibel_fix_get_step(e->db_fix, &value, rounding);
-                            r = 0;
-                        }
+    /* If all channels get the same volume a single write will do */
+    all = all && n > 1;
 
-                    } else {
-                        if (write_to_hw) {
-                            if (deferred_volume) {
-                                if ((r = element_get_nearest_alsa_dB(me, c, PA_ALSA_DIRECTION_OUTPUT, &value)) >= 0)
-                                    r = snd_mixer_selem_set_playback_dB(me, c, value, 0);
-                            } else {
-                                if ((r = snd_mixer_selem_set_playback_dB(me, c, value, rounding)) >= 0)
-                                    r = snd_mixer_selem_get_playback_dB(me, c, &value);
-                           }
-                        } else {
-                            long alsa_val;
-                            if ((r = snd_mixer_selem_ask_playback_dB_vol(me, value, rounding, &alsa_val)) >= 0)
-                                r = snd_mixer_selem_ask_playback_vol_dB(me, alsa_val, &value);
-                        }
-                    }
-                } else
-                    r = -1;
-            } else {
-                if (snd_mixer_selem_has_capture_channel(me, c)) {
-                    rounding = -1;
-                    if (e->db_fix) {
-                        if (write_to_hw)
-                            r = snd_mixer_selem_set_capture_volume(me, c, decibel_fix_get_step(e->db_fix, &value, rounding));
-                        else {
-                            decibel_fix_get_step(e->db_fix, &value, rounding);
-                            r = 0;
-                        }
-
-                    } else {
-                        if (write_to_hw) {
-                            if (deferred_volume) {
-                                if ((r = element_get_nearest_alsa_dB(me, c, PA_ALSA_DIRECTION_INPUT, &value)) >= 0)
-                                    r = snd_mixer_selem_set_capture_dB(me, c, value, 0);
-                            } else {
-                                if ((r = snd_mixer_selem_set_capture_dB(me, c, value, rounding)) >= 0)
-                                    r = snd_mixer_selem_get_capture_dB(me, c, &value);
-                            }
-                        } else {
-                            long alsa_val;
-                            if ((r = snd_mixer_selem_ask_capture_dB_vol(me, value, rounding, &alsa_val)) >= 0)
-                                r = snd_mixer_selem_ask_capture_vol_dB(me, alsa_val, &value);
-                        }
-                    }
-                } else
-                    r = -1;
-            }
+    pa_cvolume_mute(&rv, cm->channels);
 
-            if (r < 0)
-                continue;
+    for (c = 0; c <= SND_MIXER_SCHN_LAST; c++) {
+        int r;
+        long value;
+        pa_volume_t f = requested[c];
 
-            f = from_alsa_dB(value);
+        if (!present[c])
+            continue;
 
+        if (written_all) {
+            e->volume_cache[c] = e->volume_cache[first];
+            e->volume_cache[c].raw = element_get_raw_volume(e, me, c);
+            f = e->volume_cache[c].result;
+            r = 0;
+        } else if (write_to_hw && use_cache &&
+                   pa_alsa_volume_cache_lookup(&e->volume_cache[c], f, deferred_volume, element_get_raw_volume(e, me, c), &f)) {
+            e->path->n_volume_writes_skipped++;
+            r = 0;
         } else {
-            long value;
+            if (e->has_dB) {
+                value = to_alsa_dB(f);
 
-            value = to_alsa_volume(f, e->min_volume, e->max_volume);
+                if (e->volume_limit >= 0 && value > (e->max_dB * 100))
+                    value = e->max_dB * 100;
+            } else
+                value = to_alsa_volume(f, e->min_volume, e->max_volume);
 
-            if (e->direction == PA_ALSA_DIRECTION_OUTPUT) {
-                if (snd_mixer_selem_has_playback_channel(me, c)) {
-                    if ((r = snd_mixer_selem_set_playback_volume(me, c, value)) >= 0)
-                        r = snd_mixer_selem_get_playback_volume(me, c, &value);
-                } else
-                    r = -1;
-            } else {
-                if (snd_mixer_selem_has_capture_channel(me, c)) {
-                    if ((r = snd_mixer_selem_set_capture_volume(me, c, value)) >= 0)
-                        r = snd_mixer_selem_get_capture_volume(me, c, &value);
-                } else
-                    r = -1;
-            }
+            if (write_to_hw)
+                r = element_write_volume(e, me, c, all, &value, deferred_volume);
+            else
+                r = element_ask_volume(e, me, &value);
 
-            if (r < 0)
-                continue;
+            if (r >= 0) {
+                f = e->has_dB ? from_alsa_dB(value) : from_alsa_volume(value, e->min_volume, e->max_volume);
 
-            f = from_alsa_volume(value, e->min_volume, e->max_volume);
+                if (write_to_hw) {
+                    pa_alsa_volume_cache_store(&e->volume_cache[c], requested[c], deferred_volume, f,
+                                               element_get_raw_volume(e, me, c));
+
+                    /* The same write covered the other channels */
+                    if (all) {
+                        e->volume_cache[first] = e->volume_cache[c];
+                        written_all = true;
+                    }
+                }
+            } else if (write_to_hw)
+                pa_alsa_volume_cache_invalidate(&e->volume_cache[c]);
         }
 
+        if (r < 0)
+            continue;
+
         for (k = 0; k < cm->channels; k++)
             if (e->masks[c][e->n_channels-1] & PA_CHANNEL_POSITION_MASK(cm->map[k]))
                 if (rv.values[k] < f)
@@ -1211,6 +1329,8 @@ int pa_alsa_path_set_volume(pa_alsa_path *p, snd_mixer_t *m, const pa_channel_ma
 
     pa_alsa_element *e;
     pa_cvolume rv;
+    unsigned n_writes, n_skipped;
+    bool use_cache;
 
     pa_assert(m);
     pa_assert(p);
@@ -1221,9 +1341,15 @@ int pa_alsa_path_set_volume(pa_alsa_path *p, snd_mixer_t *m, const pa_channel_ma
     if (!p->has_volume)
         return -1;
 
+    /* What ALSA tells us about the controls may be outdated */
+    use_cache = write_to_hw && !mixer_events_pending(m);
+
     rv = *v; /* Remaining adjustment */
     pa_cvolume_reset(v, cm->channels); /* Adjustment done */
 
+    n_writes = p->n_volume_writes;
+    n_skipped = p->n_volume_writes_skipped;
+
     PA_LLIST_FOREACH(e, p->elements) {
         pa_cvolume ev;
 
@@ -1233,22 +1359,54 @@ int pa_alsa_path_set_volume(pa_alsa_path *p, snd_mixer_t *m, const pa_channel_ma
         pa_assert(!p->has_dB || e->has_dB);
 
         ev = rv;
-        if (element_set_volume(e, m, cm, &ev, deferred_volume, write_to_hw) < 0)
+        if (element_set_volume(e, m, cm, &ev, deferred_volume, write_to_hw, use_cache) < 0)
             return -1;
 
         if (!p->has_dB) {
             *v = ev;
-            return 0;
+            break;
         }
 
         pa_sw_cvolume_multiply(v, v, &ev);
         pa_sw_cvolume_divide(&rv, &rv, &ev);
     }
 
+    if (write_to_hw)
+        pa_log_debug("Setting volume on path %s took %u mixer writes, %u skipped (%u and %u in total).",
+                     p->name,
+                     p->n_volume_writes - n_writes, p->n_volume_writes_skipped - n_skipped,
+                     p->n_volume_writes, p->n_volume_writes_skipped);
+
     return 0;
 }
 
-static int element_set_switch(pa_alsa_element *e, snd_mixer_t *m, bool b) {
+/* Like element_get_raw_volume() this only looks at ALSA's cached
+ * control values, see mixer_events_pending() */
+static bool element_switch_is(pa_alsa_element *e, snd_mixer_elem_t *me, bool b) {
+    snd_mixer_selem_channel_id_t c;
+
+    for (c = 0; c <= SND_MIXER_SCHN_LAST; c++) {
+        int value = 0;
+
+        if (!element_has_channel(e, me, c))
+            continue;
+
+        if (e->direction == PA_ALSA_DIRECTION_OUTPUT) {
+            if (snd_mixer_selem_get_playback_switch(me, c, &value) < 0)
+                return false;
+        } else {
+            if (snd_mixer_selem_get_capture_switch(me, c, &value) < 0)
+                return false;
+        }
+
+        if (!value != !b)
+            return false;
+    }
+
+    return true;
+}
+
+static int element_set_switch(pa_alsa_element *e, snd_mixer_t *m, bool b, bool use_cache) {
     snd_mixer_elem_t *me;
     snd_mixer_selem_id_t *sid;
     int r;
@@ -1262,6 +1420,13 @@ static int element_set_switch(pa_alsa_element *e, snd_mixer_t *m, bool b) {
         return -1;
     }
 
+    if (use_cache && element_switch_is(e, me, b)) {
+        e->path->n_switch_writes_skipped++;
+        return 0;
+    }
+
+    e->path->n_switch_writes++;
+
     if (e->direction == PA_ALSA_DIRECTION_OUTPUT)
         r = snd_mixer_selem_set_playback_switch_all(me, b);
     else
@@ -1275,6 +1440,8 @@ static int element_set_switch(pa_alsa_element *e, snd_mixer_t *m, bool b) {
 
 int pa_alsa_path_set_mute(pa_alsa_path *p, snd_mixer_t *m, bool muted) {
     pa_alsa_element *e;
+    unsigned n_writes, n_skipped;
+    bool use_cache;
 
     pa_assert(m);
     pa_assert(p);
@@ -1282,15 +1449,25 @@ int pa_alsa_path_set_mute(pa_alsa_path *p, snd_mixer_t *m, bool muted) {
     if (!p->has_mute)
         return -1;
 
+    use_cache = !mixer_events_pending(m);
+
+    n_writes = p->n_switch_writes;
+    n_skipped = p->n_switch_writes_skipped;
+
     PA_LLIST_FOREACH(e, p->elements) {
 
         if (e->switch_use != PA_ALSA_SWITCH_MUTE)
             continue;
 
-        if (element_set_switch(e, m, !muted) < 0)
+        if (element_set_switch(e, m, !muted, use_cache) < 0)
             return -1;
     }
 
+    pa_log_debug("Setting mute on path %s took %u mixer writes, %u skipped (%u and %u in total).",
+                 p->name,
+                 p->n_switch_writes - n_writes, p->n_switch_writes_skipped - n_skipped,
+                 p->n_switch_writes, p->n_switch_writes_skipped);
+
     return 0;
 }
 
@@ -1368,6 +1545,9 @@ int pa_alsa_path_select(pa_alsa_path *p, pa_alsa_setting *s, snd_mixer_t *m, boo
     pa_log_debug("Activating path %s", p->name);
     pa_alsa_path_dump(p);
 
+    /* The switches are always written here: this is rare, and our own
+     * writes leave events pending anyway */
+
     /* First turn on hw mute if available, to avoid noise
      * when setting the mixer controls. */
     if (p->mute_during_activation) {
@@ -1377,7 +1557,7 @@ int pa_alsa_path_select(pa_alsa_path *p, pa_alsa_setting *s, snd_mixer_t *m, boo
                  * selecting a path, so we ignore the return value.
                  * element_set_switch() will print a warning anyway, so this
                  * won't be a silent failure either. */
-                (void) element_set_switch(e, m, false);
+                (void) element_set_switch(e, m, false, false);
         }
     }
 
@@ -1385,11 +1565,11 @@ int pa_alsa_path_select(pa_alsa_path *p, pa_alsa_setting *s, snd_mixer_t *m, boo
 
         switch (e->switch_use) {
             case PA_ALSA_SWITCH_OFF:
-                r = element_set_switch(e, m, false);
+                r = element_set_switch(e, m, false, false);
                 break;
 
             case PA_ALSA_SWITCH_ON:
-                r = element_set_switch(e, m, true);
+                r = element_set_switch(e, m, true, false);
                 break;
 
             case PA_ALSA_SWITCH_MUTE:
@@ -1426,7 +1606,7 @@ int pa_alsa_path_select(pa_alsa_path *p, pa_alsa_setting *s, snd_mixer_t *m, boo
     if (p->mute_during_activation) {
         PA_LLIST_FOREACH(e, p->elements) {
             if (e->switch_use == PA_ALSA_SWITCH_MUTE) {
-                if (element_set_switch(e, m, !device_is_muted) < 0)
+                if (element_set_switch(e, m, !device_is_muted, false) < 0)
                     return -1;
             }
         }
@@ -3932,14 +4112,17 @@ fail:
     return -1;
 }
 
+/* If mixer_handle is NULL, the mixer is looked up via the mapping's
+ * PCM, which must be open then */
 static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
-                                pa_alsa_direction_t direction, pa_hashmap *used_paths) {
+                                pa_alsa_direction_t direction, pa_hashmap *used_paths,
+                                snd_mixer_t *mixer_handle) {
 
     pa_alsa_path *p;
     void *state;
     snd_pcm_t *pcm_handle;
     pa_alsa_path_set *ps;
-    snd_mixer_t *mixer_handle;
+    bool own_mixer = false;
 
     if (direction == PA_ALSA_DIRECTION_OUTPUT) {
         if (m->output_path_set)
@@ -3956,9 +4139,11 @@ static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
     if (!ps)
         return; /* No paths */
 
-    pa_assert(pcm_handle);
+    if (!mixer_handle && pcm_handle) {
+        mixer_handle = pa_alsa_open_mixer_for_pcm(pcm_handle, NULL);
+        own_mixer = true;
+    }
 
-    mixer_handle = pa_alsa_open_mixer_for_pcm(pcm_handle, NULL);
     if (!mixer_handle) {
         /* Cannot open mixer, remove all entries */
         pa_hashmap_remove_all(ps->paths);
@@ -3974,7 +4159,7 @@ static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
     path_set_condense(ps, mixer_handle);
     path_set_make_path_descriptions_unique(ps);
 
-    if (mixer_handle)
+    if (own_mixer)
         snd_mixer_close(mixer_handle);
 
     PA_HASHMAP_FOREACH(p, ps->paths, state)
@@ -4529,12 +4714,161 @@ static int add_profiles_to_probe(
     return i;
 }
 
+/* Whether a control tells what is plugged into an HDMI or DisplayPort
+ * output. The ELD of the sink decides how many channels its PCM can be
+ * opened with, so a different monitor may support other profiles.
+ * Other jacks don't matter for opening PCMs, and including them would
+ * invalidate the cache whenever headphones are plugged in. */
+static bool is_plug_control(const char *name) {
+    return pa_streq(name, "ELD") ||
+        ((pa_startswith(name, "HDMI") || pa_startswith(name, "DP")) && pa_endswith(name, " Jack"));
+}
+
+static void card_state_add_value(pa_strbuf *buf, snd_ctl_t *ctl, snd_ctl_elem_list_t *list, unsigned i) {
+    snd_ctl_elem_id_t *id;
+    snd_ctl_elem_info_t *info;
+    snd_ctl_elem_value_t *value;
+    const uint8_t *bytes;
+    unsigned k, count;
+
+    snd_ctl_elem_id_alloca(&id);
+    snd_ctl_elem_info_alloca(&info);
+    snd_ctl_elem_value_alloca(&value);
+
+    snd_ctl_elem_list_get_id(list, i, id);
+    snd_ctl_elem_info_set_id(info, id);
+    snd_ctl_elem_value_set_id(value, id);
+
+    if (snd_ctl_elem_info(ctl, info) < 0 || snd_ctl_elem_read(ctl, value) < 0) {
+        pa_strbuf_puts(buf, " ?");
+        return;
+    }
+
+    count = snd_ctl_elem_info_get_count(info);
+
+    switch (snd_ctl_elem_info_get_type(info)) {
+        case SND_CTL_ELEM_TYPE_BOOLEAN:
+            for (k = 0; k < count; k++)
+                pa_strbuf_printf(buf, " %i", snd_ctl_elem_value_get_boolean(value, k));
+            break;
+
+        case SND_CTL_ELEM_TYPE_BYTES:
+            bytes = snd_ctl_elem_value_get_bytes(value);
+            pa_strbuf_puts(buf, " ");
+            for (k = 0; k < count; k++)
+                pa_strbuf_printf(buf, "%02x", bytes[k]);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* Describes what the probe results of the card depend on, for the
+ * probe cache: the card's identity, its controls and what is plugged
+ * into its HDMI and DisplayPort outputs. Returns NULL if the card can't
+ * be looked at, and the key to store the results under in key. */
+static char *probe_cache_card_state(int card_index, char **key) {
+    snd_ctl_t *ctl;
+    snd_ctl_card_info_t *info;
+    snd_ctl_elem_list_t *list = NULL;
+    pa_strbuf *buf;
+    char *dev;
+    unsigned i, n;
+    int err;
+
+    snd_ctl_card_info_alloca(&info);
+
+    dev = pa_sprintf_malloc("hw:%i", card_index);
+    err = snd_ctl_open(&ctl, dev, 0);
+    pa_xfree(dev);
+
+    if (err < 0) {
+        pa_log_debug("Cannot open control device of card %i: %s", card_index, pa_alsa_strerror(err));
+        return NULL;
+    }
+
+    if ((err = snd_ctl_card_info(ctl, info)) < 0 ||
+        (err = snd_ctl_elem_list_malloc(&list)) < 0 ||
+        (err = snd_ctl_elem_list(ctl, list)) < 0 ||
+        (err = snd_ctl_elem_list_alloc_space(list, snd_ctl_elem_list_get_count(list))) < 0 ||
+        (err = snd_ctl_elem_list(ctl, list)) < 0) {
+
+        pa_log_debug("Cannot list controls of card %i: %s", card_index, pa_alsa_strerror(err));
+
+        if (list) {
+            snd_ctl_elem_list_free_space(list);
+            snd_ctl_elem_list_free(list);
+        }
+
+        snd_ctl_close(ctl);
+        return NULL;
+    }
+
+    buf = pa_strbuf_new();
+
+    pa_strbuf_printf(buf, "%s|%s|%s|%s|%s\n",
+                     snd_ctl_card_info_get_driver(info),
+                     snd_ctl_card_info_get_name(info),
+                     snd_ctl_card_info_get_longname(info),
+                     snd_ctl_card_info_get_mixername(info),
+                     snd_ctl_card_info_get_components(info));
+
+    n = snd_ctl_elem_list_get_used(list);
+    for (i = 0; i < n; i++) {
+        const char *name = snd_ctl_elem_list_get_name(list, i);
+
+        pa_strbuf_printf(buf, "%i %u %u %s %u",
+                         (int) snd_ctl_elem_list_get_interface(list, i),
+                         snd_ctl_elem_list_get_device(list, i),
+                         snd_ctl_elem_list_get_subdevice(list, i),
+                         name,
+                         snd_ctl_elem_list_get_index(list, i));
+
+        if (is_plug_control(name))
+            card_state_add_value(buf, ctl, list, i);
+
+        pa_strbuf_puts(buf, "\n");
+    }
+
+    *key = pa_xstrdup(snd_ctl_card_info_get_longname(info));
+
+    snd_ctl_elem_list_free_space(list);
+    snd_ctl_elem_list_free(list);
+    snd_ctl_close(ctl);
+
+    return pa_strbuf_to_string_free(buf);
+}
+
+static void profile_set_probe_paths_cached(pa_alsa_profile_set *ps, pa_hashmap *used_paths, snd_mixer_t *mixer_handle) {
+    pa_alsa_profile *p;
+    pa_alsa_mapping *m;
+    void *state;
+    uint32_t idx;
+
+    PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+        if (!p->supported)
+            continue;
+
+        pa_log_debug("Profile %s supported (cached).", p->name);
+
+        if (p->output_mappings)
+            PA_IDXSET_FOREACH(m, p->output_mappings, idx)
+                mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixer_handle);
+
+        if (p->input_mappings)
+            PA_IDXSET_FOREACH(m, p->input_mappings, idx)
+                mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixer_handle);
+    }
+}
+
 void pa_alsa_profile_set_probe(
         pa_alsa_profile_set *ps,
         const char *dev_id,
         const pa_sample_spec *ss,
         unsigned default_n_fragments,
-        unsigned default_fragment_size_msec) {
+        unsigned default_fragment_size_msec,
+        pa_database *cache) {
 
     bool found_output = false, found_input = false;
 
@@ -4542,6 +4876,11 @@ void pa_alsa_profile_set_probe(
     pa_alsa_profile **pp, **probe_order;
     pa_alsa_mapping *m;
     pa_hashmap *broken_inputs, *broken_outputs, *used_paths;
+    snd_mixer_t *mixer_handle = NULL;
+    char *cache_key = NULL, *card_state = NULL;
+    uint64_t cache_hash = 0;
+    int card_index;
+    bool busy = false;
 
     pa_assert(ps);
     pa_assert(dev_id);
@@ -4550,6 +4889,38 @@ void pa_alsa_profile_set_probe(
     if (ps->probed)
         return;
 
+    /* All mappings live on the same card, so share one mixer for
+     * probing their paths */
+    if ((card_index = snd_card_get_index(dev_id)) >= 0)
+        mixer_handle = pa_alsa_open_mixer(card_index, NULL);
+
+    if (cache && card_index >= 0 && (card_state = probe_cache_card_state(card_index, &cache_key))) {
+        cache_hash = pa_alsa_probe_cache_hash(ps, card_state, ss, default_n_fragments, default_fragment_size_msec);
+        pa_xfree(card_state);
+
+        used_paths = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+        if (pa_alsa_probe_cache_load(ps, cache, cache_key, cache_hash)) {
+            pa_log_info("Using cached probe results for card '%s'.", cache_key);
+
+            profile_set_probe_paths_cached(ps, used_paths, mixer_handle);
+            pa_alsa_profile_set_drop_unsupported(ps);
+
+            paths_drop_unused(ps->input_paths, used_paths);
+            paths_drop_unused(ps->output_paths, used_paths);
+            pa_hashmap_free(used_paths);
+
+            if (mixer_handle)
+                snd_mixer_close(mixer_handle);
+            pa_xfree(cache_key);
+
+            ps->probed = true;
+            return;
+        }
+
+        pa_hashmap_free(used_paths);
+    }
+
     broken_inputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
     broken_outputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
     used_paths = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
@@ -4611,6 +4982,7 @@ void pa_alsa_profile_set_probe(
                                                            SND_PCM_STREAM_PLAYBACK,
                                                            default_n_fragments,
                                                            default_fragment_size_msec))) {
+                        busy |= errno == EBUSY;
                         p->supported = false;
                         if (pa_idxset_size(p->output_mappings) == 1 &&
                             ((!p->input_mappings) || pa_idxset_size(p->input_mappings) == 0)) {
@@ -4632,6 +5004,7 @@ void pa_alsa_profile_set_probe(
                                                           SND_PCM_STREAM_CAPTURE,
                                                           default_n_fragments,
                                                           default_fragment_size_msec))) {
+                        busy |= errno == EBUSY;
                         p->supported = false;
                         if (pa_idxset_size(p->input_mappings) == 1 &&
                             ((!p->output_mappings) || pa_idxset_size(p->output_mappings) == 0)) {
@@ -4654,20 +5027,27 @@ void pa_alsa_profile_set_probe(
             PA_IDXSET_FOREACH(m, p->output_mappings, idx)
                 if (m->output_pcm) {
                     found_output |= !p->fallback_output;
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixer_handle);
                 }
 
         if (p->input_mappings)
             PA_IDXSET_FOREACH(m, p->input_mappings, idx)
                 if (m->input_pcm) {
                     found_input |= !p->fallback_input;
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixer_handle);
                 }
     }
 
     /* Clean up */
     profile_finalize_probing(last, NULL);
 
+    /* Don't remember failure, and don't remember anything if some PCM
+     * was busy: the profiles that need it would stay unsupported */
+    if (cache_key && (found_output || found_input) && !busy)
+        pa_alsa_probe_cache_save(ps, cache, cache_key, cache_hash);
+    else if (cache_key && busy)
+        pa_log_info("Not caching probe results for card '%s', some devices were busy.", cache_key);
+
     pa_alsa_profile_set_drop_unsupported(ps);
 
     paths_drop_unused(ps->input_paths, used_paths);
@@ -4677,6 +5057,10 @@ void pa_alsa_profile_set_probe(
     pa_hashmap_free(used_paths);
     pa_xfree(probe_order);
 
+    if (mixer_handle)
+        snd_mixer_close(mixer_handle);
+    pa_xfree(cache_key);
+
     ps->probed = true;
 }
 
@@ -30,6 +30,7 @@
 
 #include <pulsecore/llist.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/database.h>
 
 typedef struct pa_alsa_fdlist pa_alsa_fdlist;
 typedef struct pa_alsa_mixer_pdata pa_alsa_mixer_pdata;
@@ -47,6 +48,7 @@ typedef struct pa_alsa_port_data pa_alsa_port_data;
 
 #include "alsa-util.h"
 #include "alsa-ucm.h"
+#include "alsa-volume-cache.h"
 
 typedef enum pa_alsa_switch_use {
     PA_ALSA_SWITCH_IGNORE,
@@ -152,6 +154,9 @@ struct pa_alsa_element {
     PA_LLIST_HEAD(pa_alsa_option, options);
 
     pa_alsa_decibel_fix *db_fix;
+
+    /* What we last wrote to each channel */
+    pa_alsa_volume_cache volume_cache[SND_MIXER_SCHN_LAST + 1];
 };
 
 struct pa_alsa_jack {
@@ -207,6 +212,10 @@ struct pa_alsa_path {
     long min_volume, max_volume;
     double min_dB, max_dB;
 
+    /* Mixer writes done and avoided, for the debug output */
+    unsigned n_volume_writes, n_volume_writes_skipped;
+    unsigned n_switch_writes, n_switch_writes_skipped;
+
     /* This is used during parsing only, as a shortcut so that we
      * don't have to iterate the list all the time */
     pa_alsa_element *last_element;
@@ -341,7 +350,8 @@ void pa_alsa_decibel_fix_dump(pa_alsa_decibel_fix *db_fix);
 pa_alsa_mapping *pa_alsa_mapping_get(pa_alsa_profile_set *ps, const char *name);
 
 pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel_map *bonus);
-void pa_alsa_profile_set_probe(pa_alsa_profile_set *ps, const char *dev_id, const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec);
+/* If cache is non-NULL, the results are looked up in and saved to it */
+void pa_alsa_profile_set_probe(pa_alsa_profile_set *ps, const char *dev_id, const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec, pa_database *cache);
 void pa_alsa_profile_set_free(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_drop_unsupported(pa_alsa_profile_set *s);
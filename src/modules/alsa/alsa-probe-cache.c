@@ -0,0 +1,234 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/channelmap.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/strbuf.h>
+#include <pulsecore/tagstruct.h>
+
+#include "alsa-probe-cache.h"
+
+#define PROBE_CACHE_VERSION 2
+
+static uint64_t fnv1a_64(const char *s) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (; *s; s++) {
+        h ^= (uint8_t) *s;
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+uint64_t pa_alsa_probe_cache_hash(
+        pa_alsa_profile_set *ps,
+        const char *card_state,
+        const pa_sample_spec *ss,
+        unsigned default_n_fragments,
+        unsigned default_fragment_size_msec) {
+
+    pa_strbuf *buf;
+    pa_alsa_profile *p;
+    pa_alsa_mapping *m;
+    void *state;
+    char *t;
+    uint64_t hash;
+
+    pa_assert(ps);
+    pa_assert(card_state);
+    pa_assert(ss);
+
+    buf = pa_strbuf_new();
+
+    pa_strbuf_printf(buf, "%u %s\n", PROBE_CACHE_VERSION, PACKAGE_VERSION);
+    pa_strbuf_puts(buf, card_state);
+
+    pa_strbuf_printf(buf, "%s %u %u %u %u\n",
+                     pa_sample_format_to_string(ss->format), ss->rate, ss->channels,
+                     default_n_fragments, default_fragment_size_msec);
+
+    PA_HASHMAP_FOREACH(m, ps->mappings, state) {
+        char cm[PA_CHANNEL_MAP_SNPRINT_MAX];
+        char **d;
+
+        pa_strbuf_printf(buf, "mapping %s %s %i", m->name,
+                         pa_channel_map_snprint(cm, sizeof(cm), &m->channel_map), m->exact_channels);
+
+        for (d = m->device_strings; d && *d; d++)
+            pa_strbuf_printf(buf, " %s", *d);
+
+        pa_strbuf_puts(buf, "\n");
+    }
+
+    PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+        uint32_t idx;
+
+        pa_strbuf_printf(buf, "profile %s %i %i %i", p->name, p->supported, p->fallback_input, p->fallback_output);
+
+        if (p->output_mappings)
+            PA_IDXSET_FOREACH(m, p->output_mappings, idx)
+                pa_strbuf_printf(buf, " out:%s", m->name);
+
+        if (p->input_mappings)
+            PA_IDXSET_FOREACH(m, p->input_mappings, idx)
+                pa_strbuf_printf(buf, " in:%s", m->name);
+
+        pa_strbuf_puts(buf, "\n");
+    }
+
+    t = pa_strbuf_to_string_free(buf);
+    hash = fnv1a_64(t);
+    pa_xfree(t);
+
+    return hash;
+}
+
+/* Parses a cache entry, and if apply is true, also marks profiles and
+ * mappings supported accordingly. Called once without applying to
+ * validate the whole entry first. */
+static bool probe_cache_parse(pa_alsa_profile_set *ps, const pa_datum *data, uint64_t hash, bool apply) {
+    pa_tagstruct *t;
+    uint8_t version;
+    uint64_t h;
+    uint32_t n, i;
+    bool ok = false;
+
+    t = pa_tagstruct_new_fixed(data->data, data->size);
+
+    if (pa_tagstruct_getu8(t, &version) < 0 || version != PROBE_CACHE_VERSION ||
+        pa_tagstruct_getu64(t, &h) < 0 || h != hash)
+        goto finish;
+
+    if (pa_tagstruct_getu32(t, &n) < 0 || n != pa_hashmap_size(ps->profiles))
+        goto finish;
+
+    for (i = 0; i < n; i++) {
+        const char *name;
+        bool supported;
+        pa_alsa_profile *p;
+
+        if (pa_tagstruct_gets(t, &name) < 0 || !name ||
+            pa_tagstruct_get_boolean(t, &supported) < 0 ||
+            !(p = pa_hashmap_get(ps->profiles, name)))
+            goto finish;
+
+        if (apply)
+            p->supported = supported;
+    }
+
+    if (pa_tagstruct_getu32(t, &n) < 0 || n != pa_hashmap_size(ps->mappings))
+        goto finish;
+
+    for (i = 0; i < n; i++) {
+        const char *name;
+        uint32_t supported;
+        pa_channel_map map;
+        pa_alsa_mapping *m;
+
+        if (pa_tagstruct_gets(t, &name) < 0 || !name ||
+            pa_tagstruct_getu32(t, &supported) < 0 ||
+            pa_tagstruct_get_channel_map(t, &map) < 0 ||
+            !pa_channel_map_valid(&map) ||
+            !(m = pa_hashmap_get(ps->mappings, name)))
+            goto finish;
+
+        if (apply) {
+            m->supported = supported;
+            m->channel_map = map;
+        }
+    }
+
+    ok = pa_tagstruct_eof(t);
+
+finish:
+    pa_tagstruct_free(t);
+    return ok;
+}
+
+bool pa_alsa_probe_cache_load(pa_alsa_profile_set *ps, pa_database *cache, const char *key, uint64_t hash) {
+    pa_datum k, data;
+    bool ok;
+
+    pa_assert(ps);
+    pa_assert(cache);
+    pa_assert(key);
+
+    k.data = (void*) key;
+    k.size = strlen(key);
+
+    if (!pa_database_get(cache, &k, &data))
+        return false;
+
+    if ((ok = probe_cache_parse(ps, &data, hash, false)))
+        pa_assert_se(probe_cache_parse(ps, &data, hash, true));
+
+    pa_datum_free(&data);
+
+    return ok;
+}
+
+void pa_alsa_probe_cache_save(pa_alsa_profile_set *ps, pa_database *cache, const char *key, uint64_t hash) {
+    pa_tagstruct *t;
+    pa_datum k, data;
+    pa_alsa_profile *p;
+    pa_alsa_mapping *m;
+    void *state;
+
+    pa_assert(ps);
+    pa_assert(cache);
+    pa_assert(key);
+
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu8(t, PROBE_CACHE_VERSION);
+    pa_tagstruct_putu64(t, hash);
+
+    pa_tagstruct_putu32(t, pa_hashmap_size(ps->profiles));
+    PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+        pa_tagstruct_puts(t, p->name);
+        pa_tagstruct_put_boolean(t, p->supported);
+    }
+
+    pa_tagstruct_putu32(t, pa_hashmap_size(ps->mappings));
+    PA_HASHMAP_FOREACH(m, ps->mappings, state) {
+        pa_tagstruct_puts(t, m->name);
+        pa_tagstruct_putu32(t, m->supported);
+        pa_tagstruct_put_channel_map(t, &m->channel_map);
+    }
+
+    k.data = (void*) key;
+    k.size = strlen(key);
+    data.data = (void*) pa_tagstruct_data(t, &data.size);
+
+    if (pa_database_set(cache, &k, &data, true) < 0)
+        pa_log_warn("Failed to save probe results for card '%s'.", key);
+    else
+        pa_database_sync(cache);
+
+    pa_tagstruct_free(t);
+}
@@ -0,0 +1,55 @@
+#ifndef fooalsaprobecachehfoo
+#define fooalsaprobecachehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/sample.h>
+#include <pulsecore/database.h>
+
+#include "alsa-mixer.h"
+
+/* Probe cache
+ *
+ * Opening every PCM of every candidate profile is by far the slowest
+ * part of setting up a card, so we remember which profiles worked.
+ * The entries are keyed by the card's long name and are only used if
+ * the fingerprint of everything that could affect the result still
+ * matches: the state of the card, the profile set and the parameters we
+ * probe with. Mixer paths are always probed, that only needs the
+ * mixer and the results depend on its current state. */
+
+/* Returns the fingerprint of a probe. card_state describes everything
+ * about the card itself that the result depends on. */
+uint64_t pa_alsa_probe_cache_hash(
+        pa_alsa_profile_set *ps,
+        const char *card_state,
+        const pa_sample_spec *ss,
+        unsigned default_n_fragments,
+        unsigned default_fragment_size_msec);
+
+/* Marks the profiles and mappings of ps supported as stored for key,
+ * if there's an entry with the given fingerprint. Otherwise ps is left
+ * alone and false is returned. */
+bool pa_alsa_probe_cache_load(pa_alsa_profile_set *ps, pa_database *cache, const char *key, uint64_t hash);
+
+/* Stores which profiles and mappings of ps are supported */
+void pa_alsa_probe_cache_save(pa_alsa_profile_set *ps, pa_database *cache, const char *key, uint64_t hash);
+
+#endif
@@ -56,6 +56,8 @@
 #include <modules/reserve-wrap.h>
 
 #include "alsa-util.h"
+#include "alsa-sync-group.h"
+#include "alsa-watermark.h"
 #include "alsa-sink.h"
 
 /* #define DEBUG_TIMING */
@@ -66,19 +68,19 @@
 #define DEFAULT_TSCHED_WATERMARK_USEC (20*PA_USEC_PER_MSEC)        /* 20ms  -- Fill up when only this much is left in the buffer */
 
 #define TSCHED_WATERMARK_INC_STEP_USEC (10*PA_USEC_PER_MSEC)       /* 10ms  -- On underrun, increase watermark by this */
-#define TSCHED_WATERMARK_DEC_STEP_USEC (5*PA_USEC_PER_MSEC)        /* 5ms   -- When everything's great, decrease watermark by this */
-#define TSCHED_WATERMARK_VERIFY_AFTER_USEC (20*PA_USEC_PER_SEC)    /* 20s   -- How long after a drop out recheck if things are good now */
 #define TSCHED_WATERMARK_INC_THRESHOLD_USEC (0*PA_USEC_PER_MSEC)   /* 0ms   -- If the buffer level ever below this threshold, increase the watermark */
-#define TSCHED_WATERMARK_DEC_THRESHOLD_USEC (100*PA_USEC_PER_MSEC) /* 100ms -- If the buffer level didn't drop below this threshold in the verification time, decrease the watermark */
+#define TSCHED_WATERMARK_STATS_INTERVAL_USEC (10*PA_USEC_PER_SEC)  /* 10s   -- How often to log the watermark statistics */
 
 /* Note that TSCHED_WATERMARK_INC_THRESHOLD_USEC == 0 means that we
- * will increase the watermark only if we hit a real underrun. */
+ * will increase the watermark only if we hit a real underrun. Apart
+ * from that the watermark follows pa_alsa_watermark_suggest(). */
 
 #define TSCHED_MIN_SLEEP_USEC (10*PA_USEC_PER_MSEC)                /* 10ms  -- Sleep at least 10ms on each iteration */
 #define TSCHED_MIN_WAKEUP_USEC (4*PA_USEC_PER_MSEC)                /* 4ms   -- Wakeup at least this long before the buffer runs empty*/
 
 #define SMOOTHER_WINDOW_USEC  (10*PA_USEC_PER_SEC)                 /* 10s   -- smoother windows size */
 #define SMOOTHER_ADJUST_USEC  (1*PA_USEC_PER_SEC)                  /* 1s    -- smoother adjust time */
+#define SMOOTHER_ADJUST_TSTAMP_USEC (100*PA_USEC_PER_MSEC)         /* 100ms -- smoother adjust time with audio timestamps */
 
 #define SMOOTHER_MIN_INTERVAL (2*PA_USEC_PER_MSEC)                 /* 2ms   -- min smoother update interval */
 #define SMOOTHER_MAX_INTERVAL (200*PA_USEC_PER_MSEC)               /* 200ms -- max smoother update interval */
@@ -108,6 +110,12 @@ struct userdata {
     pa_alsa_path_set *mixer_path_set;
     pa_alsa_path *mixer_path;
 
+    /* Mixer events tend to come in bursts, e.g. one per element of the
+     * path, but one re-read after the burst is enough */
+    pa_defer_event *mixer_update_event;
+    unsigned n_mixer_events;
+    bool mixer_update_pending;
+
     pa_cvolume hardware_volume;
 
     unsigned int *rates;
@@ -122,17 +130,18 @@ struct userdata {
         min_sleep,
         min_wakeup,
         watermark_inc_step,
-        watermark_dec_step,
         watermark_inc_threshold,
-        watermark_dec_threshold,
         rewind_safeguard;
 
     snd_pcm_uframes_t frames_per_block;
 
-    pa_usec_t watermark_dec_not_before;
     pa_usec_t min_latency_ref;
     pa_usec_t tsched_watermark_usec;
 
+    pa_alsa_watermark *watermark;
+    pa_usec_t render_usec;
+    pa_usec_t watermark_stats_next;
+
     pa_memchunk memchunk;
 
     char *device_name;  /* name of the PCM device */
@@ -142,6 +151,10 @@ struct userdata {
 
     bool first, after_rewind;
 
+    /* Only a member while the PCM is open */
+    pa_alsa_sync_group *sync_group;
+    bool sync_group_joined;
+
     pa_rtpoll_item *alsa_rtpoll_item;
 
     pa_smoother *smoother;
@@ -150,6 +163,10 @@ struct userdata {
     pa_usec_t smoother_interval;
     pa_usec_t last_smoother_update;
 
+    /* Offset between the audio timestamp and our position, in bytes */
+    int64_t audio_tstamp_offset;
+    bool audio_tstamp_offset_valid:1, use_audio_tstamp:1;
+
     pa_idxset *formats;
 
     pa_reserve_wrapper *reserve;
@@ -363,38 +380,46 @@ static void increase_watermark(struct userdata *u) {
     /* When we reach this we're officially fucked! */
 }
 
-static void decrease_watermark(struct userdata *u) {
+static void adjust_watermark(struct userdata *u) {
     size_t old_watermark;
-    pa_usec_t now;
+    pa_usec_t usec;
 
     pa_assert(u);
     pa_assert(u->use_tsched);
 
-    now = pa_rtclock_now();
+    usec = pa_alsa_watermark_suggest(u->watermark, u->tsched_watermark_usec, pa_rtclock_now());
 
-    if (u->watermark_dec_not_before <= 0)
-        goto restart;
-
-    if (u->watermark_dec_not_before > now)
+    if (usec == u->tsched_watermark_usec)
         return;
 
     old_watermark = u->tsched_watermark;
-
-    if (u->tsched_watermark < u->watermark_dec_step)
-        u->tsched_watermark = u->tsched_watermark / 2;
-    else
-        u->tsched_watermark = PA_MAX(u->tsched_watermark / 2, u->tsched_watermark - u->watermark_dec_step);
-
+    u->tsched_watermark = pa_usec_to_bytes(usec, &u->sink->sample_spec);
     fix_tsched_watermark(u);
 
+    /* If the watermark cannot grow any further we leave it to the
+     * next underrun to raise the latency, see increase_watermark() */
     if (old_watermark != u->tsched_watermark)
-        pa_log_info("Decreasing wakeup watermark to %0.2f ms",
+        pa_log_info("%s wakeup watermark to %0.2f ms",
+                    u->tsched_watermark > old_watermark ? "Increasing" : "Decreasing",
                     (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC);
+}
+
+/* Called from IO context */
+static void log_watermark_stats(struct userdata *u, pa_usec_t now) {
+    pa_alsa_watermark_stats stats;
 
-    /* We don't change the latency range*/
+    pa_assert(u);
+
+    if (now < u->watermark_stats_next)
+        return;
 
-restart:
-    u->watermark_dec_not_before = now + TSCHED_WATERMARK_VERIFY_AFTER_USEC;
+    u->watermark_stats_next = now + TSCHED_WATERMARK_STATS_INTERVAL_USEC;
+
+    pa_alsa_watermark_get_stats(u->watermark, &stats);
+
+    pa_log_debug("Wakeup watermark %0.2f ms, %u wakeups used %0.2f ms median, %0.2f ms at the target rate, %u dropouts",
+                 (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC, stats.n_samples,
+                 (double) stats.median / PA_USEC_PER_MSEC, (double) stats.target / PA_USEC_PER_MSEC, stats.n_misses);
 }
 
 static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*process_usec) {
@@ -449,6 +474,10 @@ static int try_recover(struct userdata *u, const char *call, int err) {
 
     u->first = true;
     u->since_start = 0;
+
+    if (u->sync_group_joined)
+        pa_alsa_sync_group_stopped(u->sync_group, u->pcm_handle);
+
     return 0;
 }
 
@@ -479,32 +508,31 @@ static size_t check_left_to_play(struct userdata *u, size_t n_bytes, bool on_tim
     }
 
 #ifdef DEBUG_TIMING
-    pa_log_debug("%0.2f ms left to play; inc threshold = %0.2f ms; dec threshold = %0.2f ms",
+    pa_log_debug("%0.2f ms left to play; inc threshold = %0.2f ms; last render took %0.2f ms",
                  (double) pa_bytes_to_usec(left_to_play, &u->sink->sample_spec) / PA_USEC_PER_MSEC,
                  (double) pa_bytes_to_usec(u->watermark_inc_threshold, &u->sink->sample_spec) / PA_USEC_PER_MSEC,
-                 (double) pa_bytes_to_usec(u->watermark_dec_threshold, &u->sink->sample_spec) / PA_USEC_PER_MSEC);
+                 (double) u->render_usec / PA_USEC_PER_MSEC);
 #endif
 
-    if (u->use_tsched) {
-        bool reset_not_before = true;
+    if (u->use_tsched && !u->first && !u->after_rewind) {
+        if (underrun || left_to_play < u->watermark_inc_threshold) {
+            pa_alsa_watermark_miss(u->watermark, u->tsched_watermark_usec, pa_rtclock_now());
+            increase_watermark(u);
+        } else if (on_timeout) {
+            pa_usec_t left_usec, used;
 
-        if (!u->first && !u->after_rewind) {
-            if (underrun || left_to_play < u->watermark_inc_threshold)
-                increase_watermark(u);
-            else if (left_to_play > u->watermark_dec_threshold) {
-                reset_not_before = false;
+            /* We only learn something if we have actually been woken
+             * up by a timeout. If something else woke us up it's too
+             * easy to fulfill the deadlines... What we needed of the
+             * watermark is how late we woke up plus how long it takes
+             * us to fill the buffer again. */
 
-                /* We decrease the watermark only if have actually
-                 * been woken up by a timeout. If something else woke
-                 * us up it's too easy to fulfill the deadlines... */
+            left_usec = pa_bytes_to_usec(left_to_play, &u->sink->sample_spec);
+            used = left_usec < u->tsched_watermark_usec ? u->tsched_watermark_usec - left_usec : 0;
 
-                if (on_timeout)
-                    decrease_watermark(u);
-            }
+            pa_alsa_watermark_sample(u->watermark, used + u->render_usec);
+            adjust_watermark(u);
         }
-
-        if (reset_not_before)
-            u->watermark_dec_not_before = 0;
     }
 
     return left_to_play;
@@ -862,13 +890,41 @@ static int unix_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
     return work_done ? 1 : 0;
 }
 
+/* The audio timestamp counts from the start of the playback while our
+ * position counts everything since the device was opened, so we need the
+ * offset between the two. The hw_ptr based position may lag behind the
+ * real one but is never ahead of it, hence the largest difference seen
+ * since the start is the best estimate. */
+static int64_t audio_tstamp_position(struct userdata *u, int64_t position, pa_usec_t audio_usec) {
+    int64_t audio_position, offset;
+
+    audio_position = (int64_t) pa_usec_to_bytes(audio_usec, &u->sink->sample_spec);
+    offset = position - audio_position;
+
+    if (!u->audio_tstamp_offset_valid || offset > u->audio_tstamp_offset) {
+        u->audio_tstamp_offset = offset;
+        u->audio_tstamp_offset_valid = true;
+    }
+
+    /* These are a lot less noisy, so the smoother can follow them
+     * more closely */
+    if (!u->use_audio_tstamp) {
+        pa_log_info("Using audio timestamps for latency estimation.");
+        pa_smoother_set_adjust_time(u->smoother, SMOOTHER_ADJUST_TSTAMP_USEC);
+        u->use_audio_tstamp = true;
+    }
+
+    return audio_position + u->audio_tstamp_offset;
+}
+
 static void update_smoother(struct userdata *u) {
     snd_pcm_sframes_t delay = 0;
     int64_t position;
     int err;
-    pa_usec_t now1 = 0, now2;
+    pa_usec_t now1 = 0, now2, audio_usec;
     snd_pcm_status_t *status;
     snd_htimestamp_t htstamp = { 0, 0 };
+    bool have_htstamp;
 
     snd_pcm_status_alloca(&status);
 
@@ -886,7 +942,7 @@ static void update_smoother(struct userdata *u) {
     now1 = pa_timespec_load(&htstamp);
 
     /* Hmm, if the timestamp is 0, then it wasn't set and we take the current time */
-    if (now1 <= 0)
+    if (!(have_htstamp = now1 > 0))
         now1 = pa_rtclock_now();
 
     /* check if the time since the last update is bigger than the interval */
@@ -896,6 +952,12 @@ static void update_smoother(struct userdata *u) {
 
     position = (int64_t) u->write_count - ((int64_t) delay * (int64_t) u->frame_size);
 
+    /* If the driver gives us an audio timestamp taken together with the
+     * system timestamp we use that, it doesn't suffer from the hw_ptr
+     * granularity */
+    if (have_htstamp && pa_alsa_get_audio_tstamp(status, &audio_usec))
+        position = audio_tstamp_position(u, position, audio_usec);
+
     if (PA_UNLIKELY(position < 0))
         position = 0;
 
@@ -941,6 +1003,30 @@ static int build_pollfd(struct userdata *u) {
     return 0;
 }
 
+static void sync_group_join(struct userdata *u) {
+    pa_assert(u);
+    pa_assert(u->pcm_handle);
+
+    if (!u->sync_group || u->sync_group_joined)
+        return;
+
+    /* Not being able to link isn't fatal, we just play unsynchronized */
+    if (pa_alsa_sync_group_join(u->sync_group, u->pcm_handle) < 0)
+        return;
+
+    u->sync_group_joined = true;
+}
+
+static void sync_group_leave(struct userdata *u) {
+    pa_assert(u);
+
+    if (!u->sync_group_joined)
+        return;
+
+    pa_alsa_sync_group_leave(u->sync_group, u->pcm_handle);
+    u->sync_group_joined = false;
+}
+
 /* Called from IO context */
 static int suspend(struct userdata *u) {
     pa_assert(u);
@@ -948,6 +1034,8 @@ static int suspend(struct userdata *u) {
 
     pa_smoother_pause(u->smoother, pa_rtclock_now());
 
+    sync_group_leave(u);
+
     /* Let's suspend -- we don't call snd_pcm_drain() here since that might
      * take awfully long with our long buffer sizes today. */
     snd_pcm_close(u->pcm_handle);
@@ -1039,10 +1127,10 @@ static void reset_watermark(struct userdata *u, size_t tsched_watermark, pa_samp
     u->tsched_watermark = pa_convert_size(tsched_watermark, ss, &u->sink->sample_spec);
 
     u->watermark_inc_step = pa_usec_to_bytes(TSCHED_WATERMARK_INC_STEP_USEC, &u->sink->sample_spec);
-    u->watermark_dec_step = pa_usec_to_bytes(TSCHED_WATERMARK_DEC_STEP_USEC, &u->sink->sample_spec);
-
     u->watermark_inc_threshold = pa_usec_to_bytes_round_up(TSCHED_WATERMARK_INC_THRESHOLD_USEC, &u->sink->sample_spec);
-    u->watermark_dec_threshold = pa_usec_to_bytes_round_up(TSCHED_WATERMARK_DEC_THRESHOLD_USEC, &u->sink->sample_spec);
+
+    /* What we learned about the old buffer doesn't apply to the new one */
+    pa_alsa_watermark_reset(u->watermark);
 
     fix_min_sleep_wakeup(u);
     fix_tsched_watermark(u);
@@ -1131,6 +1219,8 @@ static int unsuspend(struct userdata *u) {
     if (build_pollfd(u) < 0)
         goto fail;
 
+    sync_group_join(u);
+
     u->write_count = 0;
     pa_smoother_reset(u->smoother, pa_rtclock_now(), true);
     u->smoother_interval = SMOOTHER_MIN_INTERVAL;
@@ -1214,6 +1304,19 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
                     ;
             }
 
+            break;
+
+        case PA_SINK_MESSAGE_GET_VOLUME:
+
+            /* Whatever the mixer events reported is read now */
+            if (u->mixer_update_pending) {
+                if (u->n_mixer_events > 1)
+                    pa_log_debug("Coalesced %u mixer events.", u->n_mixer_events);
+
+                u->mixer_update_pending = false;
+                u->n_mixer_events = 0;
+            }
+
             break;
     }
 
@@ -1257,13 +1360,37 @@ static int ctl_mixer_callback(snd_mixer_elem_t *elem, unsigned int mask) {
     }
 
     if (mask & SND_CTL_EVENT_MASK_VALUE) {
-        pa_sink_get_volume(u->sink, true);
-        pa_sink_get_mute(u->sink, true);
+        u->n_mixer_events++;
+        u->core->mainloop->defer_enable(u->mixer_update_event, 1);
     }
 
     return 0;
 }
 
+static void mixer_update_cb(pa_mainloop_api *a, pa_defer_event *e, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    a->defer_enable(e, 0);
+
+    if (u->n_mixer_events > 1)
+        pa_log_debug("Coalesced %u mixer events.", u->n_mixer_events);
+
+    u->n_mixer_events = 0;
+
+    if (!PA_SINK_IS_LINKED(u->sink->state))
+        return;
+
+    if (u->sink->suspend_cause & PA_SUSPEND_SESSION) {
+        pa_sink_set_mixer_dirty(u->sink, true);
+        return;
+    }
+
+    pa_sink_get_volume(u->sink, true);
+    pa_sink_get_mute(u->sink, true);
+}
+
 static int io_mixer_callback(snd_mixer_elem_t *elem, unsigned int mask) {
     struct userdata *u = snd_mixer_elem_get_callback_private(elem);
 
@@ -1278,8 +1405,16 @@ static int io_mixer_callback(snd_mixer_elem_t *elem, unsigned int mask) {
         return 0;
     }
 
-    if (mask & SND_CTL_EVENT_MASK_VALUE)
-        pa_sink_update_volume_and_mute(u->sink);
+    if (mask & SND_CTL_EVENT_MASK_VALUE) {
+        u->n_mixer_events++;
+
+        /* Until the main thread asks us for the volume further
+         * events don't need another update */
+        if (!u->mixer_update_pending) {
+            u->mixer_update_pending = true;
+            pa_sink_update_volume_and_mute(u->sink);
+        }
+    }
 
     return 0;
 }
@@ -1697,6 +1832,26 @@ static int process_rewind(struct userdata *u) {
     return 0;
 }
 
+/* Called from IO context */
+static void start_playback(struct userdata *u) {
+    pa_assert(u);
+    pa_assert(u->first);
+
+    if (u->sync_group_joined) {
+        if (!pa_alsa_sync_group_start(u->sync_group, u->pcm_handle))
+            return;
+    } else {
+        pa_log_info("Starting playback.");
+        snd_pcm_start(u->pcm_handle);
+    }
+
+    u->audio_tstamp_offset_valid = false;
+
+    pa_smoother_resume(u->smoother, pa_rtclock_now(), true);
+
+    u->first = false;
+}
+
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
     unsigned short revents = 0;
@@ -1726,9 +1881,20 @@ static void thread_func(void *userdata) {
         /* Render some data and write it to the dsp */
         if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
             int work_done;
-            pa_usec_t sleep_usec = 0;
+            pa_usec_t sleep_usec = 0, render_start = 0;
             bool on_timeout = pa_rtpoll_timer_elapsed(u->rtpoll);
 
+            /* Another sink of the sync group recovered from an underrun,
+             * which stopped our PCM as well */
+            if (u->sync_group_joined && pa_alsa_sync_group_restart_needed(u->sync_group, u->pcm_handle)) {
+                pa_log_debug("Sync group %s was stopped, restarting.", pa_alsa_sync_group_get_name(u->sync_group));
+                u->first = true;
+                u->since_start = 0;
+            }
+
+            if (u->use_tsched)
+                render_start = pa_rtclock_now();
+
             if (u->use_mmap)
                 work_done = mmap_write(u, &sleep_usec, revents & POLLOUT, on_timeout);
             else
@@ -1737,21 +1903,24 @@ static void thread_func(void *userdata) {
             if (work_done < 0)
                 goto fail;
 
-/*             pa_log_debug("work_done = %i", work_done); */
-
-            if (work_done) {
+            if (u->use_tsched && work_done) {
+                pa_usec_t now = pa_rtclock_now();
 
-                if (u->first) {
-                    pa_log_info("Starting playback.");
-                    snd_pcm_start(u->pcm_handle);
+                /* Remember how long filling up the buffer took, the
+                 * watermark has to cover that next time */
+                u->render_usec = now - render_start;
+                log_watermark_stats(u, now);
+            }
 
-                    pa_smoother_resume(u->smoother, pa_rtclock_now(), true);
+/*             pa_log_debug("work_done = %i", work_done); */
 
-                    u->first = false;
-                }
+            /* In a sync group we might have to wait for the others
+             * even though our buffer is full already */
+            if (u->first && (work_done || u->sync_group_joined))
+                start_playback(u);
 
+            if (work_done && !u->first)
                 update_smoother(u);
-            }
 
             if (u->use_tsched) {
                 pa_usec_t cusec;
@@ -1854,6 +2023,9 @@ static void thread_func(void *userdata) {
                 u->first = true;
                 u->since_start = 0;
                 revents = 0;
+
+                if (u->sync_group_joined)
+                    pa_alsa_sync_group_stopped(u->sync_group, u->pcm_handle);
             } else if (revents && u->use_tsched && pa_log_ratelimit(PA_LOG_DEBUG))
                 pa_log_debug("Wakeup from ALSA!");
 
@@ -2000,6 +2172,9 @@ static int setup_mixer(struct userdata *u, bool ignore_dB) {
             u->mixer_fdl = pa_alsa_fdlist_new();
             mixer_callback = ctl_mixer_callback;
 
+            u->mixer_update_event = u->core->mainloop->defer_new(u->core->mainloop, mixer_update_cb, u);
+            u->core->mainloop->defer_enable(u->mixer_update_event, 0);
+
             if (pa_alsa_fdlist_set_handle(u->mixer_fdl, u->mixer_handle, NULL, u->core->mainloop) < 0) {
                 pa_log("Failed to initialize file descriptor monitoring");
                 return -1;
@@ -2018,12 +2193,13 @@ static int setup_mixer(struct userdata *u, bool ignore_dB) {
 pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_card *card, pa_alsa_mapping *mapping) {
 
     struct userdata *u = NULL;
-    const char *dev_id = NULL, *key, *mod_name;
+    const char *dev_id = NULL, *key, *mod_name, *sync_group;
     pa_sample_spec ss;
     char *thread_name = NULL;
     uint32_t alternate_sample_rate;
     pa_channel_map map;
     uint32_t nfrags, frag_size, buffer_size, tsched_size, tsched_watermark, rewind_safeguard;
+    double target_miss_rate = PA_ALSA_WATERMARK_DEFAULT_MISS_RATE;
     snd_pcm_uframes_t period_frames, buffer_frames, tsched_frames;
     size_t frame_size;
     bool use_mmap = true, b, use_tsched = true, d, ignore_dB = false, namereg_fail = false, deferred_volume = false, set_formats = false, fixed_latency_range = false;
@@ -2119,6 +2295,12 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
         goto fail;
     }
 
+    if (pa_modargs_get_value_double(ma, "tsched_target_miss_rate", &target_miss_rate) < 0 ||
+        target_miss_rate <= 0 || target_miss_rate >= 1) {
+        pa_log("Failed to parse tsched_target_miss_rate argument.");
+        goto fail;
+    }
+
     use_tsched = pa_alsa_may_tsched(use_tsched);
 
     u = pa_xnew0(struct userdata, 1);
@@ -2388,6 +2570,7 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     }
 
     if (u->use_tsched) {
+        u->watermark = pa_alsa_watermark_new(target_miss_rate);
         u->tsched_watermark_ref = tsched_watermark;
         reset_watermark(u, u->tsched_watermark_ref, &ss, false);
     } else
@@ -2398,6 +2581,11 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     if (update_sw_params(u) < 0)
         goto fail;
 
+    if ((sync_group = pa_modargs_get_value(ma, "sync_group", NULL))) {
+        u->sync_group = pa_alsa_sync_group_get(m->core, sync_group);
+        sync_group_join(u);
+    }
+
     if (u->ucm_context) {
         if (u->sink->active_port && pa_alsa_ucm_set_port(u->ucm_context, u->sink->active_port, true) < 0)
             goto fail;
@@ -2502,9 +2690,16 @@ static void userdata_free(struct userdata *u) {
 
     if (u->pcm_handle) {
         snd_pcm_drop(u->pcm_handle);
+        sync_group_leave(u);
         snd_pcm_close(u->pcm_handle);
     }
 
+    if (u->sync_group)
+        pa_alsa_sync_group_unref(u->sync_group);
+
+    if (u->mixer_update_event)
+        u->core->mainloop->defer_free(u->mixer_update_event);
+
     if (u->mixer_fdl)
         pa_alsa_fdlist_free(u->mixer_fdl);
 
@@ -2517,6 +2712,9 @@ static void userdata_free(struct userdata *u) {
     if (u->smoother)
         pa_smoother_free(u->smoother);
 
+    if (u->watermark)
+        pa_alsa_watermark_free(u->watermark);
+
     if (u->formats)
         pa_idxset_free(u->formats, (pa_free_cb_t) pa_format_info_free);
 
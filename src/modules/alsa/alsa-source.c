@@ -51,6 +51,7 @@
 #include <modules/reserve-wrap.h>
 
 #include "alsa-util.h"
+#include "alsa-watermark.h"
 #include "alsa-source.h"
 
 /* #define DEBUG_TIMING */
@@ -61,10 +62,8 @@
 #define DEFAULT_TSCHED_WATERMARK_USEC (20*PA_USEC_PER_MSEC)        /* 20ms */
 
 #define TSCHED_WATERMARK_INC_STEP_USEC (10*PA_USEC_PER_MSEC)       /* 10ms  */
-#define TSCHED_WATERMARK_DEC_STEP_USEC (5*PA_USEC_PER_MSEC)        /* 5ms */
-#define TSCHED_WATERMARK_VERIFY_AFTER_USEC (20*PA_USEC_PER_SEC)    /* 20s */
 #define TSCHED_WATERMARK_INC_THRESHOLD_USEC (0*PA_USEC_PER_MSEC)   /* 0ms */
-#define TSCHED_WATERMARK_DEC_THRESHOLD_USEC (100*PA_USEC_PER_MSEC) /* 100ms */
+#define TSCHED_WATERMARK_STATS_INTERVAL_USEC (10*PA_USEC_PER_SEC)  /* 10s */
 #define TSCHED_WATERMARK_STEP_USEC (10*PA_USEC_PER_MSEC)           /* 10ms */
 
 #define TSCHED_MIN_SLEEP_USEC (10*PA_USEC_PER_MSEC)                /* 10ms */
@@ -72,6 +71,7 @@
 
 #define SMOOTHER_WINDOW_USEC  (10*PA_USEC_PER_SEC)                 /* 10s */
 #define SMOOTHER_ADJUST_USEC  (1*PA_USEC_PER_SEC)                  /* 1s */
+#define SMOOTHER_ADJUST_TSTAMP_USEC (100*PA_USEC_PER_MSEC)         /* 100ms */
 
 #define SMOOTHER_MIN_INTERVAL (2*PA_USEC_PER_MSEC)                 /* 2ms */
 #define SMOOTHER_MAX_INTERVAL (200*PA_USEC_PER_MSEC)               /* 200ms */
@@ -96,6 +96,12 @@ struct userdata {
     pa_alsa_path_set *mixer_path_set;
     pa_alsa_path *mixer_path;
 
+    /* Mixer events tend to come in bursts, e.g. one per element of the
+     * path, but one re-read after the burst is enough */
+    pa_defer_event *mixer_update_event;
+    unsigned n_mixer_events;
+    bool mixer_update_pending;
+
     pa_cvolume hardware_volume;
 
     unsigned int *rates;
@@ -110,16 +116,17 @@ struct userdata {
         min_sleep,
         min_wakeup,
         watermark_inc_step,
-        watermark_dec_step,
-        watermark_inc_threshold,
-        watermark_dec_threshold;
+        watermark_inc_threshold;
 
     snd_pcm_uframes_t frames_per_block;
 
-    pa_usec_t watermark_dec_not_before;
     pa_usec_t min_latency_ref;
     pa_usec_t tsched_watermark_usec;
 
+    pa_alsa_watermark *watermark;
+    pa_usec_t post_usec;
+    pa_usec_t watermark_stats_next;
+
     char *device_name;  /* name of the PCM device */
     char *control_device; /* name of the control device */
 
@@ -134,6 +141,10 @@ struct userdata {
     pa_usec_t smoother_interval;
     pa_usec_t last_smoother_update;
 
+    /* Offset between the audio timestamp and our position, in bytes */
+    int64_t audio_tstamp_offset;
+    bool audio_tstamp_offset_valid:1, use_audio_tstamp:1;
+
     pa_reserve_wrapper *reserve;
     pa_hook_slot *reserve_slot;
     pa_reserve_monitor_wrapper *monitor;
@@ -336,38 +347,44 @@ static void increase_watermark(struct userdata *u) {
     /* When we reach this we're officially fucked! */
 }
 
-static void decrease_watermark(struct userdata *u) {
+static void adjust_watermark(struct userdata *u) {
     size_t old_watermark;
-    pa_usec_t now;
+    pa_usec_t usec;
 
     pa_assert(u);
     pa_assert(u->use_tsched);
 
-    now = pa_rtclock_now();
+    usec = pa_alsa_watermark_suggest(u->watermark, u->tsched_watermark_usec, pa_rtclock_now());
 
-    if (u->watermark_dec_not_before <= 0)
-        goto restart;
-
-    if (u->watermark_dec_not_before > now)
+    if (usec == u->tsched_watermark_usec)
         return;
 
     old_watermark = u->tsched_watermark;
-
-    if (u->tsched_watermark < u->watermark_dec_step)
-        u->tsched_watermark = u->tsched_watermark / 2;
-    else
-        u->tsched_watermark = PA_MAX(u->tsched_watermark / 2, u->tsched_watermark - u->watermark_dec_step);
-
+    u->tsched_watermark = pa_usec_to_bytes(usec, &u->source->sample_spec);
     fix_tsched_watermark(u);
 
     if (old_watermark != u->tsched_watermark)
-        pa_log_info("Decreasing wakeup watermark to %0.2f ms",
+        pa_log_info("%s wakeup watermark to %0.2f ms",
+                    u->tsched_watermark > old_watermark ? "Increasing" : "Decreasing",
                     (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC);
+}
 
-    /* We don't change the latency range*/
+/* Called from IO context */
+static void log_watermark_stats(struct userdata *u, pa_usec_t now) {
+    pa_alsa_watermark_stats stats;
 
-restart:
-    u->watermark_dec_not_before = now + TSCHED_WATERMARK_VERIFY_AFTER_USEC;
+    pa_assert(u);
+
+    if (now < u->watermark_stats_next)
+        return;
+
+    u->watermark_stats_next = now + TSCHED_WATERMARK_STATS_INTERVAL_USEC;
+
+    pa_alsa_watermark_get_stats(u->watermark, &stats);
+
+    pa_log_debug("Wakeup watermark %0.2f ms, %u wakeups used %0.2f ms median, %0.2f ms at the target rate, %u dropouts",
+                 (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC, stats.n_samples,
+                 (double) stats.median / PA_USEC_PER_MSEC, (double) stats.target / PA_USEC_PER_MSEC, stats.n_misses);
 }
 
 static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*process_usec) {
@@ -451,27 +468,28 @@ static size_t check_left_to_record(struct userdata *u, size_t n_bytes, bool on_t
     }
 
 #ifdef DEBUG_TIMING
-    pa_log_debug("%0.2f ms left to record", (double) pa_bytes_to_usec(left_to_record, &u->source->sample_spec) / PA_USEC_PER_MSEC);
+    pa_log_debug("%0.2f ms left to record; last post took %0.2f ms",
+                 (double) pa_bytes_to_usec(left_to_record, &u->source->sample_spec) / PA_USEC_PER_MSEC,
+                 (double) u->post_usec / PA_USEC_PER_MSEC);
 #endif
 
     if (u->use_tsched) {
-        bool reset_not_before = true;
-
-        if (overrun || left_to_record < u->watermark_inc_threshold)
+        if (overrun || left_to_record < u->watermark_inc_threshold) {
+            pa_alsa_watermark_miss(u->watermark, u->tsched_watermark_usec, pa_rtclock_now());
             increase_watermark(u);
-        else if (left_to_record > u->watermark_dec_threshold) {
-            reset_not_before = false;
+        } else if (on_timeout) {
+            pa_usec_t left_usec, used;
 
-            /* We decrease the watermark only if have actually
-             * been woken up by a timeout. If something else woke
-             * us up it's too easy to fulfill the deadlines... */
+            /* We only learn something if we have actually been woken
+             * up by a timeout. If something else woke us up it's too
+             * easy to fulfill the deadlines... */
 
-            if (on_timeout)
-                decrease_watermark(u);
-        }
+            left_usec = pa_bytes_to_usec(left_to_record, &u->source->sample_spec);
+            used = left_usec < u->tsched_watermark_usec ? u->tsched_watermark_usec - left_usec : 0;
 
-        if (reset_not_before)
-            u->watermark_dec_not_before = 0;
+            pa_alsa_watermark_sample(u->watermark, used + u->post_usec);
+            adjust_watermark(u);
+        }
     }
 
     return left_to_record;
@@ -767,13 +785,41 @@ static int unix_read(struct userdata *u, pa_usec_t *sleep_usec, bool polled, boo
     return work_done ? 1 : 0;
 }
 
+/* The audio timestamp counts from the start of the capture while our
+ * position counts everything since the device was opened, so we need the
+ * offset between the two. The hw_ptr based position may lag behind the
+ * real one but is never ahead of it, hence the largest difference seen
+ * since the start is the best estimate. */
+static int64_t audio_tstamp_position(struct userdata *u, int64_t position, pa_usec_t audio_usec) {
+    int64_t audio_position, offset;
+
+    audio_position = (int64_t) pa_usec_to_bytes(audio_usec, &u->source->sample_spec);
+    offset = position - audio_position;
+
+    if (!u->audio_tstamp_offset_valid || offset > u->audio_tstamp_offset) {
+        u->audio_tstamp_offset = offset;
+        u->audio_tstamp_offset_valid = true;
+    }
+
+    /* These are a lot less noisy, so the smoother can follow them
+     * more closely */
+    if (!u->use_audio_tstamp) {
+        pa_log_info("Using audio timestamps for latency estimation.");
+        pa_smoother_set_adjust_time(u->smoother, SMOOTHER_ADJUST_TSTAMP_USEC);
+        u->use_audio_tstamp = true;
+    }
+
+    return audio_position + u->audio_tstamp_offset;
+}
+
 static void update_smoother(struct userdata *u) {
     snd_pcm_sframes_t delay = 0;
-    uint64_t position;
+    int64_t position;
     int err;
-    pa_usec_t now1 = 0, now2;
+    pa_usec_t now1 = 0, now2, audio_usec;
     snd_pcm_status_t *status;
     snd_htimestamp_t htstamp = { 0, 0 };
+    bool have_htstamp;
 
     snd_pcm_status_alloca(&status);
 
@@ -791,7 +837,7 @@ static void update_smoother(struct userdata *u) {
     now1 = pa_timespec_load(&htstamp);
 
     /* Hmm, if the timestamp is 0, then it wasn't set and we take the current time */
-    if (now1 <= 0)
+    if (!(have_htstamp = now1 > 0))
         now1 = pa_rtclock_now();
 
     /* check if the time since the last update is bigger than the interval */
@@ -799,8 +845,18 @@ static void update_smoother(struct userdata *u) {
         if (u->last_smoother_update + u->smoother_interval > now1)
             return;
 
-    position = u->read_count + ((uint64_t) delay * (uint64_t) u->frame_size);
-    now2 = pa_bytes_to_usec(position, &u->source->sample_spec);
+    position = (int64_t) u->read_count + ((int64_t) delay * (int64_t) u->frame_size);
+
+    /* If the driver gives us an audio timestamp taken together with the
+     * system timestamp we use that, it doesn't suffer from the hw_ptr
+     * granularity */
+    if (have_htstamp && pa_alsa_get_audio_tstamp(status, &audio_usec))
+        position = audio_tstamp_position(u, position, audio_usec);
+
+    if (PA_UNLIKELY(position < 0))
+        position = 0;
+
+    now2 = pa_bytes_to_usec((uint64_t) position, &u->source->sample_spec);
 
     pa_smoother_put(u->smoother, now1, now2);
 
@@ -916,10 +972,9 @@ static void reset_watermark(struct userdata *u, size_t tsched_watermark, pa_samp
     u->tsched_watermark = pa_convert_size(tsched_watermark, ss, &u->source->sample_spec);
 
     u->watermark_inc_step = pa_usec_to_bytes(TSCHED_WATERMARK_INC_STEP_USEC, &u->source->sample_spec);
-    u->watermark_dec_step = pa_usec_to_bytes(TSCHED_WATERMARK_DEC_STEP_USEC, &u->source->sample_spec);
-
     u->watermark_inc_threshold = pa_usec_to_bytes_round_up(TSCHED_WATERMARK_INC_THRESHOLD_USEC, &u->source->sample_spec);
-    u->watermark_dec_threshold = pa_usec_to_bytes_round_up(TSCHED_WATERMARK_DEC_THRESHOLD_USEC, &u->source->sample_spec);
+
+    pa_alsa_watermark_reset(u->watermark);
 
     fix_min_sleep_wakeup(u);
     fix_tsched_watermark(u);
@@ -1080,6 +1135,19 @@ static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t off
                     ;
             }
 
+            break;
+
+        case PA_SOURCE_MESSAGE_GET_VOLUME:
+
+            /* Whatever the mixer events reported is read now */
+            if (u->mixer_update_pending) {
+                if (u->n_mixer_events > 1)
+                    pa_log_debug("Coalesced %u mixer events.", u->n_mixer_events);
+
+                u->mixer_update_pending = false;
+                u->n_mixer_events = 0;
+            }
+
             break;
     }
 
@@ -1123,13 +1191,37 @@ static int ctl_mixer_callback(snd_mixer_elem_t *elem, unsigned int mask) {
     }
 
     if (mask & SND_CTL_EVENT_MASK_VALUE) {
-        pa_source_get_volume(u->source, true);
-        pa_source_get_mute(u->source, true);
+        u->n_mixer_events++;
+        u->core->mainloop->defer_enable(u->mixer_update_event, 1);
     }
 
     return 0;
 }
 
+static void mixer_update_cb(pa_mainloop_api *a, pa_defer_event *e, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    a->defer_enable(e, 0);
+
+    if (u->n_mixer_events > 1)
+        pa_log_debug("Coalesced %u mixer events.", u->n_mixer_events);
+
+    u->n_mixer_events = 0;
+
+    if (!PA_SOURCE_IS_LINKED(u->source->state))
+        return;
+
+    if (u->source->suspend_cause & PA_SUSPEND_SESSION) {
+        pa_source_set_mixer_dirty(u->source, true);
+        return;
+    }
+
+    pa_source_get_volume(u->source, true);
+    pa_source_get_mute(u->source, true);
+}
+
 static int io_mixer_callback(snd_mixer_elem_t *elem, unsigned int mask) {
     struct userdata *u = snd_mixer_elem_get_callback_private(elem);
 
@@ -1144,8 +1236,16 @@ static int io_mixer_callback(snd_mixer_elem_t *elem, unsigned int mask) {
         return 0;
     }
 
-    if (mask & SND_CTL_EVENT_MASK_VALUE)
-        pa_source_update_volume_and_mute(u->source);
+    if (mask & SND_CTL_EVENT_MASK_VALUE) {
+        u->n_mixer_events++;
+
+        /* Until the main thread asks us for the volume further
+         * events don't need another update */
+        if (!u->mixer_update_pending) {
+            u->mixer_update_pending = true;
+            pa_source_update_volume_and_mute(u->source);
+        }
+    }
 
     return 0;
 }
@@ -1450,18 +1550,22 @@ static void thread_func(void *userdata) {
         /* Read some data and pass it to the sources */
         if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
             int work_done;
-            pa_usec_t sleep_usec = 0;
+            pa_usec_t sleep_usec = 0, post_start = 0;
             bool on_timeout = pa_rtpoll_timer_elapsed(u->rtpoll);
 
             if (u->first) {
                 pa_log_info("Starting capture.");
                 snd_pcm_start(u->pcm_handle);
+                u->audio_tstamp_offset_valid = false;
 
                 pa_smoother_resume(u->smoother, pa_rtclock_now(), true);
 
                 u->first = false;
             }
 
+            if (u->use_tsched)
+                post_start = pa_rtclock_now();
+
             if (u->use_mmap)
                 work_done = mmap_read(u, &sleep_usec, revents & POLLIN, on_timeout);
             else
@@ -1470,6 +1574,15 @@ static void thread_func(void *userdata) {
             if (work_done < 0)
                 goto fail;
 
+            if (u->use_tsched && work_done) {
+                pa_usec_t now = pa_rtclock_now();
+
+                /* Remember how long reading and posting the data took,
+                 * the watermark has to cover that next time */
+                u->post_usec = now - post_start;
+                log_watermark_stats(u, now);
+            }
+
 /*             pa_log_debug("work_done = %i", work_done); */
 
             if (work_done)
@@ -1699,6 +1812,9 @@ static int setup_mixer(struct userdata *u, bool ignore_dB) {
             u->mixer_fdl = pa_alsa_fdlist_new();
             mixer_callback = ctl_mixer_callback;
 
+            u->mixer_update_event = u->core->mainloop->defer_new(u->core->mainloop, mixer_update_cb, u);
+            u->core->mainloop->defer_enable(u->mixer_update_event, 0);
+
             if (pa_alsa_fdlist_set_handle(u->mixer_fdl, u->mixer_handle, NULL, u->core->mainloop) < 0) {
                 pa_log("Failed to initialize file descriptor monitoring");
                 return -1;
@@ -1723,6 +1839,7 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
     uint32_t alternate_sample_rate;
     pa_channel_map map;
     uint32_t nfrags, frag_size, buffer_size, tsched_size, tsched_watermark;
+    double target_miss_rate = PA_ALSA_WATERMARK_DEFAULT_MISS_RATE;
     snd_pcm_uframes_t period_frames, buffer_frames, tsched_frames;
     size_t frame_size;
     bool use_mmap = true, b, use_tsched = true, d, ignore_dB = false, namereg_fail = false, deferred_volume = false, fixed_latency_range = false;
@@ -1812,6 +1929,12 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
         goto fail;
     }
 
+    if (pa_modargs_get_value_double(ma, "tsched_target_miss_rate", &target_miss_rate) < 0 ||
+        target_miss_rate <= 0 || target_miss_rate >= 1) {
+        pa_log("Failed to parse tsched_target_miss_rate argument.");
+        goto fail;
+    }
+
     use_tsched = pa_alsa_may_tsched(use_tsched);
 
     u = pa_xnew0(struct userdata, 1);
@@ -2061,6 +2184,7 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
                 (double) pa_bytes_to_usec(u->hwbuf_size, &ss) / PA_USEC_PER_MSEC);
 
     if (u->use_tsched) {
+        u->watermark = pa_alsa_watermark_new(target_miss_rate);
         u->tsched_watermark_ref = tsched_watermark;
         reset_watermark(u, u->tsched_watermark_ref, &ss, false);
     }
@@ -2161,6 +2285,9 @@ static void userdata_free(struct userdata *u) {
         snd_pcm_close(u->pcm_handle);
     }
 
+    if (u->mixer_update_event)
+        u->core->mainloop->defer_free(u->mixer_update_event);
+
     if (u->mixer_fdl)
         pa_alsa_fdlist_free(u->mixer_fdl);
 
@@ -2173,6 +2300,9 @@ static void userdata_free(struct userdata *u) {
     if (u->smoother)
         pa_smoother_free(u->smoother);
 
+    if (u->watermark)
+        pa_alsa_watermark_free(u->watermark);
+
     if (u->rates)
         pa_xfree(u->rates);
 
@@ -0,0 +1,336 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/refcnt.h>
+#include <pulsecore/shared.h>
+
+#include "alsa-util.h"
+#include "alsa-sync-group.h"
+
+typedef enum member_state {
+    MEMBER_FILLING,
+    MEMBER_READY,
+    MEMBER_RUNNING
+} member_state_t;
+
+typedef struct member member;
+
+struct member {
+    snd_pcm_t *pcm;
+    member_state_t state;
+    bool linked;
+
+    /* Another member recovered the group, which stopped us as well */
+    bool restart_needed;
+
+    PA_LLIST_FIELDS(member);
+};
+
+struct pa_alsa_sync_group {
+    PA_REFCNT_DECLARE;
+
+    pa_core *core;
+    char *name;
+    char *shared_name;
+
+    const pa_alsa_sync_group_pcm_ops *ops;
+
+    /* Protects the members, which belong to different IO threads */
+    pa_mutex *mutex;
+    PA_LLIST_HEAD(member, members);
+};
+
+static const pa_alsa_sync_group_pcm_ops default_ops = {
+    .link = snd_pcm_link,
+    .unlink = snd_pcm_unlink,
+    .start = snd_pcm_start,
+    .state = snd_pcm_state,
+    .name = snd_pcm_name
+};
+
+pa_alsa_sync_group *pa_alsa_sync_group_get(pa_core *core, const char *name) {
+    pa_alsa_sync_group *g;
+    char *shared_name;
+
+    pa_assert(core);
+    pa_assert(name);
+
+    shared_name = pa_sprintf_malloc("alsa-sync-group-%s", name);
+
+    if ((g = pa_shared_get(core, shared_name))) {
+        pa_xfree(shared_name);
+        PA_REFCNT_INC(g);
+        return g;
+    }
+
+    g = pa_xnew0(pa_alsa_sync_group, 1);
+    PA_REFCNT_INIT(g);
+    g->core = core;
+    g->name = pa_xstrdup(name);
+    g->shared_name = shared_name;
+    g->ops = &default_ops;
+
+    /* Taken by RT IO threads */
+    g->mutex = pa_mutex_new(false, true);
+
+    pa_assert_se(pa_shared_set(core, g->shared_name, g) >= 0);
+
+    return g;
+}
+
+void pa_alsa_sync_group_unref(pa_alsa_sync_group *g) {
+    pa_assert(g);
+    pa_assert(PA_REFCNT_VALUE(g) > 0);
+
+    if (PA_REFCNT_DEC(g) > 0)
+        return;
+
+    /* Everybody needs to leave before closing their PCM */
+    pa_assert(!g->members);
+
+    pa_assert_se(pa_shared_remove(g->core, g->shared_name) >= 0);
+
+    pa_mutex_free(g->mutex);
+    pa_xfree(g->shared_name);
+    pa_xfree(g->name);
+    pa_xfree(g);
+}
+
+const char *pa_alsa_sync_group_get_name(pa_alsa_sync_group *g) {
+    pa_assert(g);
+
+    return g->name;
+}
+
+void pa_alsa_sync_group_set_pcm_ops(pa_alsa_sync_group *g, const pa_alsa_sync_group_pcm_ops *ops) {
+    pa_assert(g);
+    pa_assert(ops);
+    pa_assert(!g->members);
+
+    g->ops = ops;
+}
+
+static member *find_member(pa_alsa_sync_group *g, snd_pcm_t *pcm) {
+    member *m;
+
+    PA_LLIST_FOREACH(m, g->members)
+        if (m->pcm == pcm)
+            return m;
+
+    return NULL;
+}
+
+int pa_alsa_sync_group_join(pa_alsa_sync_group *g, snd_pcm_t *pcm) {
+    member *m, *other;
+    int err;
+
+    pa_assert(g);
+    pa_assert(pcm);
+
+    m = pa_xnew0(member, 1);
+    m->pcm = pcm;
+    m->state = MEMBER_FILLING;
+
+    pa_mutex_lock(g->mutex);
+
+    pa_assert(!find_member(g, pcm));
+
+    /* Linking is transitive, so one link into the group is enough.
+     * Members that had to be started on their own aren't linked
+     * anymore, so prefer one that is. */
+    for (other = g->members; other; other = other->next)
+        if (other->linked)
+            break;
+
+    if (!other)
+        other = g->members;
+
+    if (other) {
+        if ((err = g->ops->link(other->pcm, pcm)) < 0) {
+            pa_mutex_unlock(g->mutex);
+            pa_log("Failed to link %s to sync group %s: %s", g->ops->name(pcm), g->name, pa_alsa_strerror(err));
+            pa_xfree(m);
+            return err;
+        }
+
+        other->linked = m->linked = true;
+    }
+
+    PA_LLIST_PREPEND(member, g->members, m);
+
+    pa_mutex_unlock(g->mutex);
+
+    pa_log_info("Joined sync group %s with %s.", g->name, g->ops->name(pcm));
+
+    return 0;
+}
+
+void pa_alsa_sync_group_leave(pa_alsa_sync_group *g, snd_pcm_t *pcm) {
+    member *m;
+
+    pa_assert(g);
+    pa_assert(pcm);
+
+    pa_mutex_lock(g->mutex);
+
+    pa_assert_se(m = find_member(g, pcm));
+    PA_LLIST_REMOVE(member, g->members, m);
+
+    pa_mutex_unlock(g->mutex);
+
+    if (m->linked)
+        g->ops->unlink(pcm);
+
+    pa_xfree(m);
+}
+
+/* Called with the mutex held */
+static void start_alone(pa_alsa_sync_group *g, member *m) {
+    int err;
+
+    if (m->linked) {
+        pa_log_warn("Can't start %s together with the rest of sync group %s, starting it on its own.",
+                    g->ops->name(m->pcm), g->name);
+
+        g->ops->unlink(m->pcm);
+        m->linked = false;
+    }
+
+    if ((err = g->ops->start(m->pcm)) < 0)
+        pa_log("snd_pcm_start() failed: %s", pa_alsa_strerror(err));
+
+    m->state = MEMBER_RUNNING;
+}
+
+bool pa_alsa_sync_group_start(pa_alsa_sync_group *g, snd_pcm_t *pcm) {
+    member *m, *other;
+    bool others_running = false;
+    int err;
+
+    pa_assert(g);
+    pa_assert(pcm);
+
+    pa_mutex_lock(g->mutex);
+
+    pa_assert_se(m = find_member(g, pcm));
+    m->state = MEMBER_READY;
+
+    /* Somebody else started us together with the rest */
+    if (g->ops->state(pcm) == SND_PCM_STATE_RUNNING) {
+        m->state = MEMBER_RUNNING;
+        goto finish;
+    }
+
+    if (!m->linked) {
+        start_alone(g, m);
+        goto finish;
+    }
+
+    PA_LLIST_FOREACH(other, g->members) {
+        if (other == m || !other->linked)
+            continue;
+
+        if (other->state == MEMBER_FILLING) {
+            pa_mutex_unlock(g->mutex);
+            return false;
+        }
+
+        if (other->state == MEMBER_RUNNING)
+            others_running = true;
+    }
+
+    /* If some of the linked PCMs are running already, e.g. because we
+     * joined while the group was playing, they can't be started as a
+     * group anymore */
+    if (others_running) {
+        start_alone(g, m);
+        goto finish;
+    }
+
+    pa_log_info("Starting sync group %s.", g->name);
+
+    if ((err = g->ops->start(pcm)) < 0) {
+        pa_log_debug("snd_pcm_start() failed: %s", pa_alsa_strerror(err));
+        start_alone(g, m);
+        goto finish;
+    }
+
+    PA_LLIST_FOREACH(other, g->members)
+        if (other->linked)
+            other->state = MEMBER_RUNNING;
+
+finish:
+    pa_mutex_unlock(g->mutex);
+
+    return true;
+}
+
+void pa_alsa_sync_group_stopped(pa_alsa_sync_group *g, snd_pcm_t *pcm) {
+    member *m, *other;
+
+    pa_assert(g);
+    pa_assert(pcm);
+
+    pa_mutex_lock(g->mutex);
+
+    pa_assert_se(m = find_member(g, pcm));
+    m->state = MEMBER_FILLING;
+    m->restart_needed = false;
+
+    /* The others were prepared along with us and have lost what they had
+     * in their buffers, so they have to fill up again, and the group is
+     * started again once everybody did */
+    if (m->linked)
+        PA_LLIST_FOREACH(other, g->members) {
+            if (other == m || !other->linked)
+                continue;
+
+            other->state = MEMBER_FILLING;
+            other->restart_needed = true;
+        }
+
+    pa_mutex_unlock(g->mutex);
+}
+
+bool pa_alsa_sync_group_restart_needed(pa_alsa_sync_group *g, snd_pcm_t *pcm) {
+    member *m;
+    bool r;
+
+    pa_assert(g);
+    pa_assert(pcm);
+
+    pa_mutex_lock(g->mutex);
+
+    pa_assert_se(m = find_member(g, pcm));
+    r = m->restart_needed;
+    m->restart_needed = false;
+
+    pa_mutex_unlock(g->mutex);
+
+    return r;
+}
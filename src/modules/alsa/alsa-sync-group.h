@@ -0,0 +1,79 @@
+#ifndef fooalsasyncgrouphfoo
+#define fooalsasyncgrouphfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <asoundlib.h>
+
+#include <pulsecore/core.h>
+
+/* A sync group links the PCMs of several ALSA sinks with snd_pcm_link(),
+ * so that the kernel starts and stops them together. This only makes
+ * sense for devices that run from the same clock, otherwise they will
+ * drift apart after the start just the same.
+ *
+ * Every sink keeps its own IO thread. Since starting one linked PCM
+ * starts all of them, the group makes sure that this only happens
+ * once every member has filled its buffer. */
+
+typedef struct pa_alsa_sync_group pa_alsa_sync_group;
+
+/* What the group does to the PCMs, the defaults are the snd_pcm_*()
+ * functions of the same names. Replaceable for testing. */
+typedef struct pa_alsa_sync_group_pcm_ops {
+    int (*link)(snd_pcm_t *pcm1, snd_pcm_t *pcm2);
+    int (*unlink)(snd_pcm_t *pcm);
+    int (*start)(snd_pcm_t *pcm);
+    snd_pcm_state_t (*state)(snd_pcm_t *pcm);
+    const char *(*name)(snd_pcm_t *pcm);
+} pa_alsa_sync_group_pcm_ops;
+
+/* Called from main context. Groups are looked up by name and shared
+ * between all sinks of the daemon. */
+pa_alsa_sync_group *pa_alsa_sync_group_get(pa_core *core, const char *name);
+void pa_alsa_sync_group_unref(pa_alsa_sync_group *g);
+
+const char *pa_alsa_sync_group_get_name(pa_alsa_sync_group *g);
+
+/* Only while the group has no members */
+void pa_alsa_sync_group_set_pcm_ops(pa_alsa_sync_group *g, const pa_alsa_sync_group_pcm_ops *ops);
+
+/* The rest may be called from any thread. A PCM is a member while it is
+ * open, i.e. it needs to leave before it is closed. */
+int pa_alsa_sync_group_join(pa_alsa_sync_group *g, snd_pcm_t *pcm);
+void pa_alsa_sync_group_leave(pa_alsa_sync_group *g, snd_pcm_t *pcm);
+
+/* Called once the PCM has been filled up. Returns false as long as some
+ * other member is still filling its buffer, in which case this should
+ * be called again later. Otherwise the PCM is running when this
+ * returns, either because it was started together with the others by
+ * us or because somebody else already did. */
+bool pa_alsa_sync_group_start(pa_alsa_sync_group *g, snd_pcm_t *pcm);
+
+/* The PCM stopped, e.g. because of an underrun, and needs to be filled
+ * up again before it can be started. Recovering a linked PCM prepares
+ * all PCMs linked to it, so this stops the whole group, and the others
+ * are told so by pa_alsa_sync_group_restart_needed(). */
+void pa_alsa_sync_group_stopped(pa_alsa_sync_group *g, snd_pcm_t *pcm);
+
+/* Returns true once after another member stopped the group. The PCM
+ * then needs to be filled up and started again, just as if it had
+ * stopped by itself. */
+bool pa_alsa_sync_group_restart_needed(pa_alsa_sync_group *g, snd_pcm_t *pcm);
+
+#endif
@@ -768,6 +768,7 @@ snd_pcm_t *pa_alsa_open_by_device_string(
 fail:
     pa_xfree(d);
 
+    errno = err < 0 ? -err : EINVAL;
     return NULL;
 }
 
@@ -787,6 +788,7 @@ snd_pcm_t *pa_alsa_open_by_template(
 
     snd_pcm_t *pcm_handle;
     char **i;
+    int err = ENODEV;
 
     for (i = template; *i; i++) {
         char *d;
@@ -810,8 +812,13 @@ snd_pcm_t *pa_alsa_open_by_template(
 
         if (pcm_handle)
             return pcm_handle;
+
+        /* That the device was busy is the more interesting error */
+        if (err != EBUSY)
+            err = errno;
     }
 
+    errno = err;
     return NULL;
 }
 
@@ -1200,6 +1207,20 @@ int pa_alsa_safe_delay(snd_pcm_t *pcm, snd_pcm_status_t *status, snd_pcm_sframes
      * avail, delay and timestamp values in a single kernel call to improve
      * timer-based scheduling */
 
+#if (SND_LIB_VERSION >= ((1<<16)|(0<<8)|29)) /* API additions in 1.0.29 */
+    {
+        snd_pcm_audio_tstamp_config_t config;
+
+        /* Ask for the audio timestamp from the link counter, see
+         * pa_alsa_get_audio_tstamp(). Drivers that don't have one
+         * fall back to deriving it from the hw_ptr. */
+        pa_zero(config);
+        config.type_requested = SND_PCM_AUDIO_TSTAMP_TYPE_LINK;
+        config.report_delay = 0;
+        snd_pcm_status_set_audio_htstamp_config(status, &config);
+    }
+#endif
+
     if ((err = snd_pcm_status(pcm, status)) < 0)
         return err;
 
@@ -1273,6 +1294,32 @@ int pa_alsa_safe_delay(snd_pcm_t *pcm, snd_pcm_status_t *status, snd_pcm_sframes
     return 0;
 }
 
+bool pa_alsa_get_audio_tstamp(snd_pcm_status_t *status, pa_usec_t *audio_usec) {
+#if (SND_LIB_VERSION >= ((1<<16)|(0<<8)|29)) /* API additions in 1.0.29 */
+    snd_pcm_audio_tstamp_report_t report;
+    snd_htimestamp_t htstamp = { 0, 0 };
+
+    pa_assert(status);
+    pa_assert(audio_usec);
+
+    snd_pcm_status_get_audio_htstamp_report(status, &report);
+
+    /* The default and compat timestamps are calculated from the
+     * hw_ptr and hence not any more precise than the delay */
+    if (!report.valid ||
+        report.actual_type == SND_PCM_AUDIO_TSTAMP_TYPE_COMPAT ||
+        report.actual_type == SND_PCM_AUDIO_TSTAMP_TYPE_DEFAULT)
+        return false;
+
+    snd_pcm_status_get_audio_htstamp(status, &htstamp);
+    *audio_usec = pa_timespec_load(&htstamp);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
 int pa_alsa_safe_mmap_begin(snd_pcm_t *pcm, const snd_pcm_channel_area_t **areas, snd_pcm_uframes_t *offset, snd_pcm_uframes_t *frames, size_t hwbuf_size, const pa_sample_spec *ss) {
     int r;
     snd_pcm_uframes_t before;
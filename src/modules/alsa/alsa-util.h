@@ -77,7 +77,7 @@ snd_pcm_t *pa_alsa_open_by_device_id_mapping(
         bool *use_tsched,                 /* modified at return */
         pa_alsa_mapping *mapping);
 
-/* Opens the explicit ALSA device */
+/* Opens the explicit ALSA device. On failure errno is set. */
 snd_pcm_t *pa_alsa_open_by_device_string(
         const char *dir,
         char **dev,                       /* modified at return */
@@ -91,7 +91,8 @@ snd_pcm_t *pa_alsa_open_by_device_string(
         bool *use_tsched,                 /* modified at return */
         bool require_exact_channel_number);
 
-/* Opens the explicit ALSA device with a fallback list */
+/* Opens the explicit ALSA device with a fallback list. On failure errno is
+ * set, to EBUSY if any of the devices was busy. */
 snd_pcm_t *pa_alsa_open_by_template(
         char **template,
         const char *dev_id,
@@ -124,6 +125,11 @@ pa_rtpoll_item* pa_alsa_build_pollfd(snd_pcm_t *pcm, pa_rtpoll *rtpoll);
 
 snd_pcm_sframes_t pa_alsa_safe_avail(snd_pcm_t *pcm, size_t hwbuf_size, const pa_sample_spec *ss);
 int pa_alsa_safe_delay(snd_pcm_t *pcm, snd_pcm_status_t *status, snd_pcm_sframes_t *delay, size_t hwbuf_size, const pa_sample_spec *ss, bool capture);
+/* After pa_alsa_safe_delay(): if the driver reported an audio timestamp
+ * taken from the hardware at the same moment as the status' system
+ * timestamp, returns true and the audio time elapsed since the stream
+ * was started */
+bool pa_alsa_get_audio_tstamp(snd_pcm_status_t *status, pa_usec_t *audio_usec);
 int pa_alsa_safe_mmap_begin(snd_pcm_t *pcm, const snd_pcm_channel_area_t **areas, snd_pcm_uframes_t *offset, snd_pcm_uframes_t *frames, size_t hwbuf_size, const pa_sample_spec *ss);
 
 char *pa_alsa_get_driver_name(int card);
@@ -0,0 +1,52 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+
+#include "alsa-volume-cache.h"
+
+void pa_alsa_volume_cache_store(pa_alsa_volume_cache *c, pa_volume_t requested, bool deferred, pa_volume_t result, long raw) {
+    pa_assert(c);
+
+    c->valid = true;
+    c->deferred = deferred;
+    c->requested = requested;
+    c->result = result;
+    c->raw = raw;
+}
+
+void pa_alsa_volume_cache_invalidate(pa_alsa_volume_cache *c) {
+    pa_assert(c);
+
+    c->valid = false;
+}
+
+bool pa_alsa_volume_cache_lookup(const pa_alsa_volume_cache *c, pa_volume_t requested, bool deferred, long raw, pa_volume_t *result) {
+    pa_assert(c);
+    pa_assert(result);
+
+    /* Deferred writes are rounded differently, see element_write_volume() */
+    if (!c->valid || c->requested != requested || c->deferred != deferred || c->raw != raw)
+        return false;
+
+    *result = c->result;
+    return true;
+}
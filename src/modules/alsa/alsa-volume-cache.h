@@ -0,0 +1,47 @@
+#ifndef fooalsavolumecachehfoo
+#define fooalsavolumecachehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+
+#include <pulse/volume.h>
+
+/* What was last written to one channel of a mixer element, so that the
+ * write can be skipped if the same volume is requested again.
+ *
+ * The raw value is what ALSA reported right after our write. ALSA only
+ * updates its copy of the control values when the mixer events are
+ * handled, so the caller has to make sure that no events are pending
+ * before trusting a lookup, otherwise a change made by somebody else
+ * in the meantime goes unnoticed. */
+typedef struct pa_alsa_volume_cache {
+    bool valid:1;
+    bool deferred:1;
+    pa_volume_t requested, result;
+    long raw;
+} pa_alsa_volume_cache;
+
+void pa_alsa_volume_cache_store(pa_alsa_volume_cache *c, pa_volume_t requested, bool deferred, pa_volume_t result, long raw);
+void pa_alsa_volume_cache_invalidate(pa_alsa_volume_cache *c);
+
+/* Returns true and the volume the write resulted in if writing requested
+ * again would change nothing, given that the control is at raw now */
+bool pa_alsa_volume_cache_lookup(const pa_alsa_volume_cache *c, pa_volume_t requested, bool deferred, long raw, pa_volume_t *result);
+
+#endif
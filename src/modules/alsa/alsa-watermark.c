@@ -0,0 +1,197 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+#include "alsa-watermark.h"
+
+/* Bucket i > 0 covers [BUCKET_BASE * BUCKET_RATIO^(i-1), BUCKET_BASE * BUCKET_RATIO^i),
+ * which gives 0.1ms up to ~1.3s with 20% resolution */
+#define N_BUCKETS 52
+#define BUCKET_BASE_USEC 100
+#define BUCKET_RATIO 1.2
+
+#define HALF_LIFE_SAMPLES 1000        /* Older wakeups count less */
+#define MIN_SAMPLES 32                /* Don't suggest anything before we have seen this many */
+
+#define HEADROOM_USEC (1*PA_USEC_PER_MSEC)
+#define DEC_INTERVAL_USEC (1*PA_USEC_PER_SEC)       /* Decrease at most once per second */
+#define DEC_MAX_FRACTION 5                          /* ... and by at most a fifth */
+#define VERIFY_AFTER_MISS_USEC (20*PA_USEC_PER_SEC) /* Don't decrease for this long after a dropout */
+
+struct pa_alsa_watermark {
+    double target_quantile;
+
+    double buckets[N_BUCKETS];
+    double total, missed;
+
+    /* Instead of decaying all buckets on every sample, new samples
+     * get an ever increasing weight */
+    double weight, growth;
+
+    unsigned n_samples, n_misses;
+    pa_usec_t dec_not_before;
+};
+
+pa_alsa_watermark *pa_alsa_watermark_new(double target_miss_rate) {
+    pa_alsa_watermark *w;
+
+    pa_assert(target_miss_rate > 0 && target_miss_rate < 1);
+
+    w = pa_xnew0(pa_alsa_watermark, 1);
+    w->target_quantile = 1.0 - target_miss_rate;
+    w->growth = pow(2.0, 1.0 / HALF_LIFE_SAMPLES);
+
+    pa_alsa_watermark_reset(w);
+
+    return w;
+}
+
+void pa_alsa_watermark_free(pa_alsa_watermark *w) {
+    pa_assert(w);
+
+    pa_xfree(w);
+}
+
+void pa_alsa_watermark_reset(pa_alsa_watermark *w) {
+    pa_assert(w);
+
+    memset(w->buckets, 0, sizeof(w->buckets));
+    w->total = w->missed = 0;
+    w->weight = 1.0;
+    w->n_samples = 0;
+    w->dec_not_before = 0;
+}
+
+static unsigned bucket_for(pa_usec_t usec) {
+    double i;
+
+    if (usec < BUCKET_BASE_USEC)
+        return 0;
+
+    i = 1 + floor(log((double) usec / BUCKET_BASE_USEC) / log(BUCKET_RATIO));
+
+    return (unsigned) PA_MIN(i, N_BUCKETS - 1);
+}
+
+static pa_usec_t bucket_upper(unsigned i) {
+    return (pa_usec_t) (BUCKET_BASE_USEC * pow(BUCKET_RATIO, i));
+}
+
+static void add(pa_alsa_watermark *w, pa_usec_t usec, double weight) {
+    unsigned i;
+
+    w->weight *= w->growth;
+
+    /* Rescale before we lose precision */
+    if (w->weight > 1e9) {
+        for (i = 0; i < N_BUCKETS; i++)
+            w->buckets[i] /= w->weight;
+
+        w->total /= w->weight;
+        w->missed /= w->weight;
+        w->weight = 1.0;
+    }
+
+    w->buckets[bucket_for(usec)] += w->weight * weight;
+    w->total += w->weight * weight;
+}
+
+static pa_usec_t quantile(pa_alsa_watermark *w, double q) {
+    double sum = 0, limit;
+    unsigned i;
+
+    if (w->total <= 0)
+        return 0;
+
+    limit = q * w->total;
+
+    for (i = 0; i < N_BUCKETS - 1; i++) {
+        sum += w->buckets[i];
+
+        if (sum >= limit)
+            break;
+    }
+
+    return bucket_upper(i);
+}
+
+void pa_alsa_watermark_sample(pa_alsa_watermark *w, pa_usec_t used) {
+    pa_assert(w);
+
+    add(w, used, 1.0);
+    w->n_samples++;
+}
+
+void pa_alsa_watermark_miss(pa_alsa_watermark *w, pa_usec_t watermark, pa_usec_t now) {
+    pa_assert(w);
+
+    /* We don't know how much we would have needed, only that it was
+     * more than we had */
+    add(w, watermark * 2, 1.0);
+    w->missed += w->weight;
+    w->n_misses++;
+
+    /* As long as we stay within the target miss rate a dropout is
+     * nothing to worry about */
+    if (w->missed > w->total * (1.0 - w->target_quantile))
+        w->dec_not_before = now + VERIFY_AFTER_MISS_USEC;
+}
+
+pa_usec_t pa_alsa_watermark_suggest(pa_alsa_watermark *w, pa_usec_t current, pa_usec_t now) {
+    pa_usec_t target;
+
+    pa_assert(w);
+
+    if (w->n_samples < MIN_SAMPLES)
+        return current;
+
+    target = quantile(w, w->target_quantile);
+    target += target / 4 + HEADROOM_USEC;
+
+    if (target > current)
+        return target;
+
+    /* Don't bother with small changes */
+    if (target >= current - current / 10 || now < w->dec_not_before)
+        return current;
+
+    w->dec_not_before = now + DEC_INTERVAL_USEC;
+
+    return PA_MAX(target, current - current / DEC_MAX_FRACTION);
+}
+
+void pa_alsa_watermark_get_stats(pa_alsa_watermark *w, pa_alsa_watermark_stats *stats) {
+    pa_assert(w);
+    pa_assert(stats);
+
+    stats->n_samples = w->n_samples;
+    stats->n_misses = w->n_misses;
+    stats->median = quantile(w, 0.5);
+    stats->target = quantile(w, w->target_quantile);
+}
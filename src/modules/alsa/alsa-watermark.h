@@ -0,0 +1,60 @@
+#ifndef fooalsawatermarkhfoo
+#define fooalsawatermarkhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+
+/* Watermark controller for timer based scheduling.
+ *
+ * On every timer wakeup the sink or source tells us how much of the
+ * watermark it actually needed, i.e. how late it woke up plus how long
+ * it took to render or post the data. We keep a decaying histogram of
+ * these and suggest a watermark that covers all but the given fraction
+ * of wakeups, with some headroom. Increases are suggested right away,
+ * decreases only slowly and not shortly after a dropout. */
+
+typedef struct pa_alsa_watermark pa_alsa_watermark;
+
+typedef struct pa_alsa_watermark_stats {
+    unsigned n_samples;
+    unsigned n_misses;
+    pa_usec_t median;
+    pa_usec_t target; /* At the percentile given by the target miss rate */
+} pa_alsa_watermark_stats;
+
+#define PA_ALSA_WATERMARK_DEFAULT_MISS_RATE 0.001
+
+pa_alsa_watermark *pa_alsa_watermark_new(double target_miss_rate);
+void pa_alsa_watermark_free(pa_alsa_watermark *w);
+
+/* Forget everything, e.g. after the buffer was reconfigured */
+void pa_alsa_watermark_reset(pa_alsa_watermark *w);
+
+/* Record how much of the watermark a timer wakeup used up */
+void pa_alsa_watermark_sample(pa_alsa_watermark *w, pa_usec_t used);
+
+/* Record a dropout that happened at time now */
+void pa_alsa_watermark_miss(pa_alsa_watermark *w, pa_usec_t watermark, pa_usec_t now);
+
+/* Returns the watermark to use from now on, which may be current */
+pa_usec_t pa_alsa_watermark_suggest(pa_alsa_watermark *w, pa_usec_t current, pa_usec_t now);
+
+void pa_alsa_watermark_get_stats(pa_alsa_watermark *w, pa_alsa_watermark_stats *stats);
+
+#endif
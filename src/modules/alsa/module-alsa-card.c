@@ -23,7 +23,9 @@
 
 #include <pulse/xmalloc.h>
 
+#include <pulsecore/core-error.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/database.h>
 #include <pulsecore/i18n.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/queue.h>
@@ -62,6 +64,8 @@ PA_MODULE_USAGE(
         "tsched=<enable system timer based scheduling mode?> "
         "tsched_buffer_size=<buffer size when using timer based scheduling> "
         "tsched_buffer_watermark=<lower fill watermark> "
+        "tsched_target_miss_rate=<fraction of wakeups allowed to use up the watermark> "
+        "sync_group=<name of the group of sinks to start together, for devices sharing a clock> "
         "profile=<profile name> "
         "fixed_latency_range=<disable latency range changes on underrun?> "
         "ignore_dB=<ignore dB information from the device?> "
@@ -69,6 +73,7 @@ PA_MODULE_USAGE(
         "profile_set=<profile set configuration file> "
         "paths_dir=<directory containing the path configuration files> "
         "use_ucm=<load use case manager> "
+        "probe_cache=<reuse profile probing results from earlier runs?> "
 );
 
 static const char* const valid_modargs[] = {
@@ -89,6 +94,8 @@ static const char* const valid_modargs[] = {
     "tsched",
     "tsched_buffer_size",
     "tsched_buffer_watermark",
+    "tsched_target_miss_rate",
+    "sync_group",
     "fixed_latency_range",
     "profile",
     "ignore_dB",
@@ -96,6 +103,7 @@ static const char* const valid_modargs[] = {
     "profile_set",
     "paths_dir",
     "use_ucm",
+    "probe_cache",
     NULL
 };
 
@@ -694,12 +702,13 @@ static pa_hook_result_t source_output_unlink_hook_callback(pa_core *c, pa_source
 
 int pa__init(pa_module *m) {
     pa_card_new_data data;
-    bool ignore_dB = false;
+    bool ignore_dB = false, probe_cache = true;
     struct userdata *u;
     pa_reserve_wrapper *reserve = NULL;
     const char *description;
     const char *profile_str = NULL;
-    char *fn = NULL;
+    char *fn = NULL, *cache_fn;
+    pa_database *cache = NULL;
     bool namereg_fail = false;
 
     pa_alsa_refcnt_inc();
@@ -729,6 +738,11 @@ int pa__init(pa_module *m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(u->modargs, "probe_cache", &probe_cache) < 0) {
+        pa_log("Failed to parse probe_cache argument.");
+        goto fail;
+    }
+
     if (!pa_in_system_mode()) {
         char *rname;
 
@@ -792,7 +806,17 @@ int pa__init(pa_module *m) {
 
     u->profile_set->ignore_dB = ignore_dB;
 
-    pa_alsa_profile_set_probe(u->profile_set, u->device_id, &m->core->default_sample_spec, m->core->default_n_fragments, m->core->default_fragment_size_msec);
+    if (probe_cache && (cache_fn = pa_state_path("alsa-probe-cache", true))) {
+        if (!(cache = pa_database_open(cache_fn, true)))
+            pa_log_info("Failed to open probe cache '%s': %s", cache_fn, pa_cstrerror(errno));
+
+        pa_xfree(cache_fn);
+    }
+
+    pa_alsa_profile_set_probe(u->profile_set, u->device_id, &m->core->default_sample_spec, m->core->default_n_fragments, m->core->default_fragment_size_msec, cache);
+
+    if (cache)
+        pa_database_close(cache);
     pa_alsa_profile_set_dump(u->profile_set);
 
     pa_card_new_data_init(&data);
@@ -52,6 +52,8 @@ PA_MODULE_USAGE(
         "tsched=<enable system timer based scheduling mode?> "
         "tsched_buffer_size=<buffer size when using timer based scheduling> "
         "tsched_buffer_watermark=<lower fill watermark> "
+        "tsched_target_miss_rate=<fraction of wakeups allowed to use up the watermark> "
+        "sync_group=<name of the group of sinks to start together, for devices sharing a clock> "
         "ignore_dB=<ignore dB information from the device?> "
         "control=<name of mixer control> "
         "rewind_safeguard=<number of bytes that cannot be rewound> "
@@ -78,6 +80,8 @@ static const char* const valid_modargs[] = {
     "tsched",
     "tsched_buffer_size",
     "tsched_buffer_watermark",
+    "tsched_target_miss_rate",
+    "sync_group",
     "ignore_dB",
     "control",
     "rewind_safeguard",
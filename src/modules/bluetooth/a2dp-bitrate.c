@@ -0,0 +1,140 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "a2dp-bitrate.h"
+
+/* Queue depths are in packets, times 16 */
+#define QUEUE_SCALE 16
+#define QUEUE_HIGH (3 * QUEUE_SCALE)  /* Decrease if the average queue is longer than this */
+#define QUEUE_LOW (2 * QUEUE_SCALE)   /* Increase only if the queue stays shorter than this, our own packet included */
+
+#define SETTLE_USEC (500 * PA_USEC_PER_MSEC)           /* Let the queue react to a change first */
+#define MISS_SETTLE_USEC (100 * PA_USEC_PER_MSEC)
+#define PROBE_MIN_USEC (2 * PA_USEC_PER_SEC)           /* How long the queue has to stay short before an increase */
+#define PROBE_MAX_USEC (64 * PA_USEC_PER_SEC)
+#define PROBE_FAILED_USEC (5 * PA_USEC_PER_SEC)        /* A decrease this soon after an increase means it didn't work */
+
+struct pa_a2dp_bitrate {
+    unsigned avg_queue;             /* Moving average, scaled by QUEUE_SCALE */
+    unsigned decrease_queue;        /* avg_queue when we last decreased */
+
+    pa_usec_t settle_until;
+    pa_usec_t short_since;          /* The queue has been short since then */
+    pa_usec_t probe_interval;
+    pa_usec_t last_increase;
+    pa_usec_t last_decrease;
+};
+
+pa_a2dp_bitrate *pa_a2dp_bitrate_new(void) {
+    pa_a2dp_bitrate *b;
+
+    b = pa_xnew0(pa_a2dp_bitrate, 1);
+    pa_a2dp_bitrate_reset(b, 0);
+
+    return b;
+}
+
+void pa_a2dp_bitrate_free(pa_a2dp_bitrate *b) {
+    pa_assert(b);
+
+    pa_xfree(b);
+}
+
+void pa_a2dp_bitrate_reset(pa_a2dp_bitrate *b, pa_usec_t now) {
+    pa_assert(b);
+
+    b->avg_queue = b->decrease_queue = 0;
+    b->settle_until = now + SETTLE_USEC;
+    b->short_since = now;
+    b->probe_interval = PROBE_MIN_USEC;
+    b->last_increase = b->last_decrease = 0;
+}
+
+static pa_a2dp_bitrate_action_t decrease(pa_a2dp_bitrate *b, pa_usec_t now, pa_usec_t settle) {
+    /* The link couldn't take the last increase, so wait longer before
+     * the next one */
+    if (b->last_increase > b->last_decrease && now < b->last_increase + PROBE_FAILED_USEC)
+        b->probe_interval = PA_MIN(b->probe_interval * 2, PROBE_MAX_USEC);
+
+    b->last_decrease = now;
+    b->decrease_queue = b->avg_queue;
+    b->settle_until = now + settle;
+    b->short_since = now;
+
+    return PA_A2DP_BITRATE_DECREASE;
+}
+
+pa_a2dp_bitrate_action_t pa_a2dp_bitrate_sample(pa_a2dp_bitrate *b, size_t queued, size_t packet_size, pa_usec_t now) {
+    unsigned q;
+
+    pa_assert(b);
+    pa_assert(packet_size > 0);
+
+    q = (unsigned) PA_MIN(queued * QUEUE_SCALE / packet_size, (size_t) 64 * QUEUE_SCALE);
+    b->avg_queue = (b->avg_queue * 7 + q) / 8;
+
+    if (q >= QUEUE_LOW)
+        b->short_since = now;
+
+    if (now < b->settle_until)
+        return PA_A2DP_BITRATE_KEEP;
+
+    /* After a decrease a long queue takes a while to drain, that's
+     * fine as long as it gets shorter */
+    if (b->avg_queue > QUEUE_HIGH && (b->last_decrease == 0 || b->avg_queue >= b->decrease_queue)) {
+        pa_log_debug("Send queue at %u.%02u packets, reducing bitrate",
+                     b->avg_queue / QUEUE_SCALE, (b->avg_queue % QUEUE_SCALE) * 100 / QUEUE_SCALE);
+        return decrease(b, now, SETTLE_USEC);
+    }
+
+    if (now >= b->short_since + b->probe_interval) {
+        /* The last increase held up, so we can try again sooner */
+        if (b->last_increase > b->last_decrease)
+            b->probe_interval = PA_MAX(b->probe_interval / 2, PROBE_MIN_USEC);
+
+        pa_log_debug("Send queue short for %0.1fs, trying a higher bitrate",
+                     (double) (now - b->short_since) / PA_USEC_PER_SEC);
+
+        b->last_increase = now;
+        b->settle_until = now + SETTLE_USEC;
+        b->short_since = now;
+
+        return PA_A2DP_BITRATE_INCREASE;
+    }
+
+    return PA_A2DP_BITRATE_KEEP;
+}
+
+pa_a2dp_bitrate_action_t pa_a2dp_bitrate_miss(pa_a2dp_bitrate *b, pa_usec_t now) {
+    pa_assert(b);
+
+    /* One decrease per burst of misses is enough */
+    if (now < b->last_decrease + MISS_SETTLE_USEC)
+        return PA_A2DP_BITRATE_KEEP;
+
+    return decrease(b, now, MISS_SETTLE_USEC);
+}
@@ -0,0 +1,54 @@
+#ifndef fooa2dpbitratehfoo
+#define fooa2dpbitratehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+
+/* Closed loop bitrate control for A2DP playback.
+ *
+ * After every packet the sink tells us how many bytes are still queued
+ * in the socket, i.e. what the link hasn't managed to send yet. If the
+ * queue keeps growing we ask for a lower bitrate before the socket
+ * fills up and we have to drop audio; after the queue stayed short for
+ * a while we try a higher bitrate again. Increases that are quickly
+ * followed by a decrease make us wait longer before the next try, so a
+ * link that can't take the higher rate isn't probed all the time. */
+
+typedef struct pa_a2dp_bitrate pa_a2dp_bitrate;
+
+typedef enum pa_a2dp_bitrate_action {
+    PA_A2DP_BITRATE_KEEP,
+    PA_A2DP_BITRATE_DECREASE,
+    PA_A2DP_BITRATE_INCREASE
+} pa_a2dp_bitrate_action_t;
+
+pa_a2dp_bitrate *pa_a2dp_bitrate_new(void);
+void pa_a2dp_bitrate_free(pa_a2dp_bitrate *b);
+
+/* Forget everything, e.g. when the stream is set up again */
+void pa_a2dp_bitrate_reset(pa_a2dp_bitrate *b, pa_usec_t now);
+
+/* Called after a packet of packet_size bytes was written, with the
+ * number of bytes in the socket send queue */
+pa_a2dp_bitrate_action_t pa_a2dp_bitrate_sample(pa_a2dp_bitrate *b, size_t queued, size_t packet_size, pa_usec_t now);
+
+/* Called when the socket was full or we had to skip audio */
+pa_a2dp_bitrate_action_t pa_a2dp_bitrate_miss(pa_a2dp_bitrate *b, pa_usec_t now);
+
+#endif
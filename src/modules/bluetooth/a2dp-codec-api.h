@@ -0,0 +1,69 @@
+#ifndef fooa2dpcodecapihfoo
+#define fooa2dpcodecapihfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulsecore/core.h>
+
+/* What an A2DP codec has to implement. The codec_info returned by
+ * init() is passed to all the other functions, which are called from
+ * the IO thread (or the encoder thread, see a2dp-encoder.h) only. The
+ * packets that go in and out are complete RTP packets. */
+typedef struct pa_a2dp_codec {
+    /* Used in the logs and to look up the codec */
+    const char *name;
+    /* A2DP_CODEC_*, as in the transport configuration */
+    uint8_t id;
+
+    /* Sets up the codec for the configuration BlueZ negotiated and fills
+     * in the sample spec. Returns NULL if the configuration is invalid. */
+    void *(*init)(bool for_encoding, const uint8_t *config, size_t config_size, pa_sample_spec *sample_spec);
+    void (*deinit)(void *codec_info);
+
+    /* Called whenever the stream is set up again, goes back to the
+     * initial bitrate */
+    void (*reset)(void *codec_info);
+
+    /* How many bytes of PCM fit into one packet of the given MTU at the
+     * current bitrate */
+    size_t (*get_block_size)(void *codec_info, size_t link_mtu);
+
+    /* Lowers the bitrate because the link couldn't keep up. Returns the
+     * new block size, or 0 if the bitrate can't go any lower. May be
+     * NULL. */
+    size_t (*reduce_encoder_bitrate)(void *codec_info, size_t write_link_mtu);
+
+    /* Raises the bitrate again after it was reduced. Returns the new
+     * block size, or 0 if the bitrate can't go any higher. May be
+     * NULL. */
+    size_t (*increase_encoder_bitrate)(void *codec_info, size_t write_link_mtu);
+
+    /* Encodes input into one packet, timestamp is in frames. Returns the
+     * packet size, or 0 on failure. *processed is set to the number of
+     * input bytes consumed. */
+    size_t (*encode_buffer)(void *codec_info, uint32_t timestamp, const uint8_t *input, size_t input_size,
+                            uint8_t *output, size_t output_size, size_t *processed);
+
+    /* Decodes one packet. Returns the number of PCM bytes written to
+     * output, or 0 on failure. *processed is set to the number of input
+     * bytes consumed. */
+    size_t (*decode_buffer)(void *codec_info, const uint8_t *input, size_t input_size,
+                            uint8_t *output, size_t output_size, size_t *processed);
+} pa_a2dp_codec;
+
+#endif
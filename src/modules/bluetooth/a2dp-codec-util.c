@@ -0,0 +1,64 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+#include "a2dp-codec-util.h"
+
+extern const pa_a2dp_codec pa_a2dp_codec_sbc;
+
+/* In order of preference */
+static const pa_a2dp_codec *pa_a2dp_codecs[] = {
+    &pa_a2dp_codec_sbc,
+};
+
+unsigned pa_bluetooth_a2dp_codec_count(void) {
+    return PA_ELEMENTSOF(pa_a2dp_codecs);
+}
+
+const pa_a2dp_codec *pa_bluetooth_a2dp_codec_iter(unsigned i) {
+    pa_assert(i < pa_bluetooth_a2dp_codec_count());
+
+    return pa_a2dp_codecs[i];
+}
+
+const pa_a2dp_codec *pa_bluetooth_get_a2dp_codec(const char *name) {
+    unsigned i;
+
+    pa_assert(name);
+
+    for (i = 0; i < pa_bluetooth_a2dp_codec_count(); i++)
+        if (pa_streq(pa_a2dp_codecs[i]->name, name))
+            return pa_a2dp_codecs[i];
+
+    return NULL;
+}
+
+const pa_a2dp_codec *pa_bluetooth_get_a2dp_codec_by_id(uint8_t id) {
+    unsigned i;
+
+    for (i = 0; i < pa_bluetooth_a2dp_codec_count(); i++)
+        if (pa_a2dp_codecs[i]->id == id)
+            return pa_a2dp_codecs[i];
+
+    return NULL;
+}
@@ -0,0 +1,220 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/thread.h>
+
+#include "a2dp-encoder.h"
+
+typedef enum encoder_state {
+    ENCODER_IDLE,
+    ENCODER_ENCODING,
+    ENCODER_DONE
+} encoder_state_t;
+
+struct pa_a2dp_encoder {
+    const pa_a2dp_codec *codec;
+    void *codec_info;
+    int rt_priority;
+
+    pa_thread *thread;
+    pa_mutex *mutex;
+    pa_cond *cond;
+
+    /* Protected by mutex */
+    encoder_state_t state;
+    bool quit;
+    pa_memchunk chunk;
+    uint32_t timestamp;
+    size_t packet_size;
+
+    uint8_t *packet;
+    size_t max_packet_size;
+};
+
+static void thread_func(void *userdata) {
+    pa_a2dp_encoder *e = userdata;
+
+    pa_assert(e);
+
+    if (e->rt_priority > 0)
+        pa_make_realtime(e->rt_priority);
+
+    pa_mutex_lock(e->mutex);
+
+    for (;;) {
+        const uint8_t *p;
+        size_t processed = 0, packet_size;
+
+        while (!e->quit && e->state != ENCODER_ENCODING)
+            pa_cond_wait(e->cond, e->mutex);
+
+        if (e->quit)
+            break;
+
+        /* Nobody touches the block or the packet buffer until we are
+         * done, so we can encode without holding the lock */
+        pa_mutex_unlock(e->mutex);
+
+        p = pa_memblock_acquire_chunk(&e->chunk);
+        packet_size = e->codec->encode_buffer(e->codec_info, e->timestamp, p, e->chunk.length,
+                                              e->packet, e->max_packet_size, &processed);
+        pa_memblock_release(e->chunk.memblock);
+
+        if (packet_size > 0 && processed != e->chunk.length) {
+            pa_log_error("Encoder consumed only %zu of %zu bytes", processed, e->chunk.length);
+            packet_size = 0;
+        }
+
+        pa_mutex_lock(e->mutex);
+
+        e->packet_size = packet_size;
+        e->state = ENCODER_DONE;
+        pa_cond_signal(e->cond, 1);
+    }
+
+    pa_mutex_unlock(e->mutex);
+}
+
+pa_a2dp_encoder *pa_a2dp_encoder_new(const pa_a2dp_codec *codec, void *codec_info, size_t max_packet_size, int rt_priority) {
+    pa_a2dp_encoder *e;
+
+    pa_assert(codec);
+    pa_assert(codec_info);
+    pa_assert(max_packet_size > 0);
+
+    e = pa_xnew0(pa_a2dp_encoder, 1);
+    e->codec = codec;
+    e->codec_info = codec_info;
+    e->rt_priority = rt_priority;
+    e->max_packet_size = max_packet_size;
+    e->packet = pa_xmalloc(max_packet_size);
+    e->state = ENCODER_IDLE;
+    pa_memchunk_reset(&e->chunk);
+
+    /* The IO thread waits on this while the encoder thread holds it */
+    e->mutex = pa_mutex_new(false, true);
+    e->cond = pa_cond_new();
+
+    if (!(e->thread = pa_thread_new("a2dp-encoder", thread_func, e))) {
+        pa_log_error("Failed to create encoder thread");
+        pa_a2dp_encoder_free(e);
+        return NULL;
+    }
+
+    return e;
+}
+
+void pa_a2dp_encoder_free(pa_a2dp_encoder *e) {
+    pa_assert(e);
+
+    if (e->thread) {
+        pa_mutex_lock(e->mutex);
+        e->quit = true;
+        pa_cond_signal(e->cond, 1);
+        pa_mutex_unlock(e->mutex);
+
+        pa_thread_free(e->thread);
+    }
+
+    if (e->chunk.memblock)
+        pa_memblock_unref(e->chunk.memblock);
+
+    pa_cond_free(e->cond);
+    pa_mutex_free(e->mutex);
+    pa_xfree(e->packet);
+    pa_xfree(e);
+}
+
+void pa_a2dp_encoder_submit(pa_a2dp_encoder *e, const pa_memchunk *chunk, uint32_t timestamp) {
+    pa_assert(e);
+    pa_assert(chunk);
+    pa_assert(chunk->memblock);
+
+    pa_mutex_lock(e->mutex);
+
+    pa_assert(e->state == ENCODER_IDLE);
+
+    e->chunk = *chunk;
+    pa_memblock_ref(e->chunk.memblock);
+    e->timestamp = timestamp;
+    e->state = ENCODER_ENCODING;
+    pa_cond_signal(e->cond, 1);
+
+    pa_mutex_unlock(e->mutex);
+}
+
+bool pa_a2dp_encoder_busy(pa_a2dp_encoder *e) {
+    bool busy;
+
+    pa_assert(e);
+
+    pa_mutex_lock(e->mutex);
+    busy = e->state != ENCODER_IDLE;
+    pa_mutex_unlock(e->mutex);
+
+    return busy;
+}
+
+size_t pa_a2dp_encoder_wait(pa_a2dp_encoder *e, const uint8_t **packet, size_t *pcm_length) {
+    size_t packet_size;
+
+    pa_assert(e);
+
+    pa_mutex_lock(e->mutex);
+
+    pa_assert(e->state != ENCODER_IDLE);
+
+    while (e->state == ENCODER_ENCODING)
+        pa_cond_wait(e->cond, e->mutex);
+
+    packet_size = e->packet_size;
+
+    if (packet)
+        *packet = e->packet;
+    if (pcm_length)
+        *pcm_length = e->chunk.length;
+
+    pa_mutex_unlock(e->mutex);
+
+    return packet_size;
+}
+
+void pa_a2dp_encoder_release(pa_a2dp_encoder *e) {
+    pa_assert(e);
+
+    pa_mutex_lock(e->mutex);
+
+    pa_assert(e->state == ENCODER_DONE);
+
+    pa_memblock_unref(e->chunk.memblock);
+    pa_memchunk_reset(&e->chunk);
+    e->packet_size = 0;
+    e->state = ENCODER_IDLE;
+
+    pa_mutex_unlock(e->mutex);
+}
@@ -0,0 +1,57 @@
+#ifndef fooa2dpencoderhfoo
+#define fooa2dpencoderhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulsecore/memchunk.h>
+
+#include "a2dp-codec-api.h"
+
+/* Encodes A2DP packets on a thread of its own, so that the IO thread
+ * can render and write the next packet while the current one is being
+ * encoded. There is at most one packet in flight: submit a block,
+ * wait for its packet, and once the packet was written release it
+ * before submitting the next block.
+ *
+ * The encoder uses codec_info while a block is in flight, so the
+ * caller has to wait for the packet before touching codec_info itself,
+ * e.g. to change the bitrate. */
+
+typedef struct pa_a2dp_encoder pa_a2dp_encoder;
+
+/* If rt_priority is > 0 the encoder thread is made realtime with it */
+pa_a2dp_encoder *pa_a2dp_encoder_new(const pa_a2dp_codec *codec, void *codec_info, size_t max_packet_size, int rt_priority);
+void pa_a2dp_encoder_free(pa_a2dp_encoder *e);
+
+/* Starts encoding the block, timestamp is in frames. Takes a reference
+ * to the memblock. The encoder must not be busy. */
+void pa_a2dp_encoder_submit(pa_a2dp_encoder *e, const pa_memchunk *chunk, uint32_t timestamp);
+
+/* Whether a block was submitted and its packet wasn't released yet */
+bool pa_a2dp_encoder_busy(pa_a2dp_encoder *e);
+
+/* Waits until the submitted block is encoded. Returns the size of the
+ * packet, or 0 if encoding failed. *pcm_length is set to the number of
+ * PCM bytes in the packet. May be called more than once for the same
+ * block. */
+size_t pa_a2dp_encoder_wait(pa_a2dp_encoder *e, const uint8_t **packet, size_t *pcm_length);
+
+/* Drops the packet after it was written */
+void pa_a2dp_encoder_release(pa_a2dp_encoder *e);
+
+#endif
@@ -26,6 +26,7 @@
 #include <errno.h>
 #include <math.h>
 #include <linux/sockios.h>
+#include <sys/ioctl.h>
 #include <arpa/inet.h>
 
 #include <pulse/rtclock.h>
@@ -51,12 +52,14 @@
 #include <sbc/sbc.h>
 
 #include "module-bluez4-device-symdef.h"
+#include "a2dp-bitrate.h"
 #include "a2dp-codecs.h"
 #include "rtp.h"
 #include "bluez4-util.h"
 
 #define BITPOOL_DEC_LIMIT 32
 #define BITPOOL_DEC_STEP 5
+#define BITPOOL_INC_STEP 2
 
 PA_MODULE_AUTHOR("João Paulo Rechi Vita");
 PA_MODULE_DESCRIPTION("BlueZ 4 Bluetooth audio sink and source");
@@ -109,6 +112,10 @@ struct a2dp_info {
     uint16_t seq_num;                    /* Cumulative packet sequence */
     uint8_t min_bitpool;
     uint8_t max_bitpool;
+
+    pa_a2dp_bitrate *bitrate;            /* Adapts the bitpool to the link */
+    int sndbuf;                          /* Socket send buffer size */
+    size_t packet_cost;                  /* What one packet takes up in the send buffer */
 };
 
 struct hsp_info {
@@ -238,6 +245,77 @@ static void a2dp_set_bitpool(struct userdata *u, uint8_t bitpool) {
             FIXED_LATENCY_PLAYBACK_A2DP + pa_bytes_to_usec(u->write_block_size, &u->sample_spec));
 }
 
+static void a2dp_reduce_bitpool(struct userdata *u) {
+    struct a2dp_info *a2dp;
+    uint8_t bitpool;
+
+    pa_assert(u);
+
+    a2dp = &u->a2dp;
+
+    /* Check if bitpool is already at its limit */
+    if (a2dp->sbc.bitpool <= BITPOOL_DEC_LIMIT)
+        return;
+
+    bitpool = a2dp->sbc.bitpool - BITPOOL_DEC_STEP;
+
+    if (bitpool < BITPOOL_DEC_LIMIT)
+        bitpool = BITPOOL_DEC_LIMIT;
+
+    a2dp_set_bitpool(u, bitpool);
+}
+
+static void a2dp_increase_bitpool(struct userdata *u) {
+    struct a2dp_info *a2dp;
+
+    pa_assert(u);
+
+    a2dp = &u->a2dp;
+
+    if (a2dp->sbc.bitpool >= a2dp->max_bitpool)
+        return;
+
+    a2dp_set_bitpool(u, PA_MIN(a2dp->sbc.bitpool + BITPOOL_INC_STEP, a2dp->max_bitpool));
+}
+
+/* from IO thread */
+static void a2dp_change_bitrate(struct userdata *u, pa_a2dp_bitrate_action_t action) {
+    if (action == PA_A2DP_BITRATE_DECREASE)
+        a2dp_reduce_bitpool(u);
+    else if (action == PA_A2DP_BITRATE_INCREASE)
+        a2dp_increase_bitpool(u);
+}
+
+/* from IO thread */
+static void a2dp_update_bitrate(struct userdata *u) {
+    struct a2dp_info *a2dp;
+    int space;
+    size_t queued;
+
+    pa_assert(u);
+
+    a2dp = &u->a2dp;
+
+    if (a2dp->sndbuf <= 0)
+        return;
+
+    /* For Bluetooth sockets SIOCOUTQ tells how much room is left in the
+     * send buffer rather than how much is queued */
+    if (ioctl(u->stream_fd, SIOCOUTQ, &space) < 0)
+        return;
+
+    queued = space < a2dp->sndbuf ? (size_t) (a2dp->sndbuf - space) : 0;
+
+    /* The buffer accounting includes the kernel's overhead per packet.
+     * Right after a write at least our packet is queued, so the smallest
+     * value we see is what a single packet takes up. */
+    if (queued > 0 && (a2dp->packet_cost == 0 || queued < a2dp->packet_cost))
+        a2dp->packet_cost = queued;
+
+    if (a2dp->packet_cost > 0)
+        a2dp_change_bitrate(u, pa_a2dp_bitrate_sample(a2dp->bitrate, queued, a2dp->packet_cost, pa_rtclock_now()));
+}
+
 /* from IO thread, except in SCO over PCM */
 static void bt_transport_config_mtu(struct userdata *u) {
     /* Calculate block sizes */
@@ -291,9 +369,24 @@ static void setup_stream(struct userdata *u) {
 
     pa_log_debug("Stream properly set up, we're ready to roll!");
 
-    if (u->profile == PA_BLUEZ4_PROFILE_A2DP_SINK)
+    if (u->profile == PA_BLUEZ4_PROFILE_A2DP_SINK) {
+        socklen_t len = sizeof(u->a2dp.sndbuf);
+
         a2dp_set_bitpool(u, u->a2dp.max_bitpool);
 
+        if (getsockopt(u->stream_fd, SOL_SOCKET, SO_SNDBUF, &u->a2dp.sndbuf, &len) < 0) {
+            pa_log_warn("Failed to get the socket send buffer size, bitrate only adapts to dropouts: %s",
+                        pa_cstrerror(errno));
+            u->a2dp.sndbuf = 0;
+        }
+
+        u->a2dp.packet_cost = 0;
+
+        if (!u->a2dp.bitrate)
+            u->a2dp.bitrate = pa_a2dp_bitrate_new();
+        pa_a2dp_bitrate_reset(u->a2dp.bitrate, pa_rtclock_now());
+    }
+
     u->rtpoll_item = pa_rtpoll_item_new(u->rtpoll, PA_RTPOLL_NEVER, 1);
     pollfd = pa_rtpoll_item_get_pollfd(u->rtpoll_item, NULL);
     pollfd->fd = u->stream_fd;
@@ -736,11 +829,12 @@ static int a2dp_process_render(struct userdata *u) {
     pa_assert(u->profile == PA_BLUEZ4_PROFILE_A2DP_SINK);
     pa_assert(u->sink);
 
-    /* First, render some data */
-    if (!u->write_memchunk.memblock)
+    /* First, render some data. A block left over from an EAGAIN may be
+     * smaller than write_block_size if the bitrate was reduced since. */
+    if (!u->write_memchunk.memblock) {
         pa_sink_render_full(u->sink, u->write_block_size, &u->write_memchunk);
-
-    pa_assert(u->write_memchunk.length == u->write_block_size);
+        pa_assert(u->write_memchunk.length == u->write_block_size);
+    }
 
     a2dp_prepare_buffer(u);
 
@@ -823,9 +917,11 @@ static int a2dp_process_render(struct userdata *u) {
                 /* Retry right away if we got interrupted */
                 continue;
 
-            else if (errno == EAGAIN)
+            else if (errno == EAGAIN) {
                 /* Hmm, apparently the socket was not writable, give up for now */
+                a2dp_change_bitrate(u, pa_a2dp_bitrate_miss(u->a2dp.bitrate, pa_rtclock_now()));
                 break;
+            }
 
             pa_log_error("Failed to write data to socket: %s", pa_cstrerror(errno));
             ret = -1;
@@ -846,6 +942,8 @@ static int a2dp_process_render(struct userdata *u) {
         pa_memblock_unref(u->write_memchunk.memblock);
         pa_memchunk_reset(&u->write_memchunk);
 
+        a2dp_update_bitrate(u);
+
         ret = 1;
 
         break;
@@ -970,26 +1068,6 @@ static int a2dp_process_push(struct userdata *u) {
     return ret;
 }
 
-static void a2dp_reduce_bitpool(struct userdata *u) {
-    struct a2dp_info *a2dp;
-    uint8_t bitpool;
-
-    pa_assert(u);
-
-    a2dp = &u->a2dp;
-
-    /* Check if bitpool is already at its limit */
-    if (a2dp->sbc.bitpool <= BITPOOL_DEC_LIMIT)
-        return;
-
-    bitpool = a2dp->sbc.bitpool - BITPOOL_DEC_STEP;
-
-    if (bitpool < BITPOOL_DEC_LIMIT)
-        bitpool = BITPOOL_DEC_LIMIT;
-
-    a2dp_set_bitpool(u, bitpool);
-}
-
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
     unsigned do_write = 0;
@@ -1087,7 +1165,7 @@ static void thread_func(void *userdata) {
                                 u->write_index += skip_bytes;
 
                                 if (u->profile == PA_BLUEZ4_PROFILE_A2DP_SINK)
-                                    a2dp_reduce_bitpool(u);
+                                    a2dp_change_bitrate(u, pa_a2dp_bitrate_miss(u->a2dp.bitrate, pa_rtclock_now()));
                             }
                         }
 
@@ -2640,6 +2718,9 @@ void pa__done(pa_module *m) {
 
     sbc_finish(&u->a2dp.sbc);
 
+    if (u->a2dp.bitrate)
+        pa_a2dp_bitrate_free(u->a2dp.bitrate);
+
     if (u->modargs)
         pa_modargs_free(u->modargs);
 
@@ -25,7 +25,8 @@
 #include <errno.h>
 
 #include <arpa/inet.h>
-#include <sbc/sbc.h>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
 
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
@@ -44,7 +45,10 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/time-smoother.h>
 
+#include "a2dp-bitrate.h"
 #include "a2dp-codecs.h"
+#include "a2dp-codec-util.h"
+#include "a2dp-encoder.h"
 #include "bluez5-util.h"
 #include "rtp.h"
 
@@ -55,7 +59,8 @@ PA_MODULE_DESCRIPTION("BlueZ 5 Bluetooth audio sink and source");
 PA_MODULE_VERSION(PACKAGE_VERSION);
 PA_MODULE_LOAD_ONCE(false);
 PA_MODULE_USAGE("path=<device object path>"
-                "autodetect_mtu=<boolean>");
+                "autodetect_mtu=<boolean> "
+                "encoder_thread=<encode A2DP on a separate thread?>");
 
 #define MAX_PLAYBACK_CATCH_UP_USEC (100 * PA_USEC_PER_MSEC)
 #define FIXED_LATENCY_PLAYBACK_A2DP (25 * PA_USEC_PER_MSEC)
@@ -63,13 +68,12 @@ PA_MODULE_USAGE("path=<device object path>"
 #define FIXED_LATENCY_RECORD_A2DP   (25 * PA_USEC_PER_MSEC)
 #define FIXED_LATENCY_RECORD_SCO    (25 * PA_USEC_PER_MSEC)
 
-#define BITPOOL_DEC_LIMIT 32
-#define BITPOOL_DEC_STEP 5
 #define HSP_MAX_GAIN 15
 
 static const char* const valid_modargs[] = {
     "path",
     "autodetect_mtu",
+    "encoder_thread",
     NULL
 };
 
@@ -86,18 +90,6 @@ typedef struct bluetooth_msg {
 PA_DEFINE_PRIVATE_CLASS(bluetooth_msg, pa_msgobject);
 #define BLUETOOTH_MSG(o) (bluetooth_msg_cast(o))
 
-typedef struct sbc_info {
-    sbc_t sbc;                           /* Codec data */
-    bool sbc_initialized;                /* Keep track if the encoder is initialized */
-    size_t codesize, frame_length;       /* SBC Codesize, frame_length. We simply cache those values here */
-    uint16_t seq_num;                    /* Cumulative packet sequence */
-    uint8_t min_bitpool;
-    uint8_t max_bitpool;
-
-    void* buffer;                        /* Codec transfer buffer */
-    size_t buffer_size;                  /* Size of the buffer */
-} sbc_info_t;
-
 struct userdata {
     pa_module *module;
     pa_core *core;
@@ -137,7 +129,19 @@ struct userdata {
     pa_smoother *read_smoother;
     pa_memchunk write_memchunk;
     pa_sample_spec sample_spec;
-    struct sbc_info sbc_info;
+
+    const pa_a2dp_codec *a2dp_codec;
+    void *codec_info;
+    void *buffer;                        /* Codec transfer buffer */
+    size_t buffer_size;                  /* Size of the buffer */
+
+    bool encoder_thread;
+    pa_a2dp_encoder *encoder;
+    size_t write_pending;                /* Rendered, but not written yet */
+
+    pa_a2dp_bitrate *bitrate;
+    int write_sndbuf;                    /* Socket send buffer size */
+    size_t packet_cost;                  /* What one packet takes up in the send buffer */
 };
 
 typedef enum pa_bluetooth_form_factor {
@@ -398,105 +402,142 @@ static void a2dp_prepare_buffer(struct userdata *u) {
 
     pa_assert(u);
 
-    if (u->sbc_info.buffer_size >= min_buffer_size)
+    if (u->buffer_size >= min_buffer_size)
         return;
 
-    u->sbc_info.buffer_size = 2 * min_buffer_size;
-    pa_xfree(u->sbc_info.buffer);
-    u->sbc_info.buffer = pa_xmalloc(u->sbc_info.buffer_size);
+    u->buffer_size = 2 * min_buffer_size;
+    pa_xfree(u->buffer);
+    u->buffer = pa_xmalloc(u->buffer_size);
 }
 
-/* Run from IO thread */
-static int a2dp_process_render(struct userdata *u) {
-    struct sbc_info *sbc_info;
-    struct rtp_header *header;
-    struct rtp_payload *payload;
-    size_t nbytes;
-    void *d;
-    const void *p;
-    size_t to_write, to_encode;
-    unsigned frame_count;
-    int ret = 0;
+/* Run from I/O thread */
+static void a2dp_change_bitrate(struct userdata *u, pa_a2dp_bitrate_action_t action) {
+    size_t block_size;
 
     pa_assert(u);
-    pa_assert(u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK);
-    pa_assert(u->sink);
 
-    /* First, render some data */
-    if (!u->write_memchunk.memblock)
-        pa_sink_render_full(u->sink, u->write_block_size, &u->write_memchunk);
+    if (action == PA_A2DP_BITRATE_DECREASE && !u->a2dp_codec->reduce_encoder_bitrate)
+        return;
+    if (action == PA_A2DP_BITRATE_INCREASE && !u->a2dp_codec->increase_encoder_bitrate)
+        return;
+    if (action == PA_A2DP_BITRATE_KEEP)
+        return;
+
+    /* The encoder thread mustn't be using the codec while we change it */
+    if (u->encoder && pa_a2dp_encoder_busy(u->encoder))
+        pa_a2dp_encoder_wait(u->encoder, NULL, NULL);
+
+    if (action == PA_A2DP_BITRATE_DECREASE)
+        block_size = u->a2dp_codec->reduce_encoder_bitrate(u->codec_info, u->write_link_mtu);
+    else
+        block_size = u->a2dp_codec->increase_encoder_bitrate(u->codec_info, u->write_link_mtu);
+
+    /* Already at the limit */
+    if (block_size == 0)
+        return;
 
-    pa_assert(u->write_memchunk.length == u->write_block_size);
+    u->write_block_size = block_size;
 
-    a2dp_prepare_buffer(u);
+    pa_sink_set_max_request_within_thread(u->sink, u->write_block_size);
+    pa_sink_set_fixed_latency_within_thread(u->sink,
+            FIXED_LATENCY_PLAYBACK_A2DP + pa_bytes_to_usec(u->write_block_size, &u->sample_spec));
+}
 
-    sbc_info = &u->sbc_info;
-    header = sbc_info->buffer;
-    payload = (struct rtp_payload*) ((uint8_t*) sbc_info->buffer + sizeof(*header));
+/* Run from I/O thread */
+static void a2dp_update_bitrate(struct userdata *u) {
+    int space;
+    size_t queued;
 
-    frame_count = 0;
+    pa_assert(u);
 
-    /* Try to create a packet of the full MTU */
+    if (u->write_sndbuf <= 0)
+        return;
 
-    p = (const uint8_t *) pa_memblock_acquire_chunk(&u->write_memchunk);
-    to_encode = u->write_memchunk.length;
+    /* For Bluetooth sockets SIOCOUTQ tells how much room is left in the
+     * send buffer rather than how much is queued */
+    if (ioctl(u->stream_fd, SIOCOUTQ, &space) < 0)
+        return;
 
-    d = (uint8_t*) sbc_info->buffer + sizeof(*header) + sizeof(*payload);
-    to_write = sbc_info->buffer_size - sizeof(*header) - sizeof(*payload);
+    queued = space < u->write_sndbuf ? (size_t) (u->write_sndbuf - space) : 0;
 
-    while (PA_LIKELY(to_encode > 0 && to_write > 0)) {
-        ssize_t written;
-        ssize_t encoded;
+    /* The buffer accounting includes the kernel's overhead per packet.
+     * Right after a write at least our packet is queued, so the smallest
+     * value we see is what a single packet takes up. */
+    if (queued > 0 && (u->packet_cost == 0 || queued < u->packet_cost))
+        u->packet_cost = queued;
 
-        encoded = sbc_encode(&sbc_info->sbc,
-                             p, to_encode,
-                             d, to_write,
-                             &written);
+    if (u->packet_cost > 0)
+        a2dp_change_bitrate(u, pa_a2dp_bitrate_sample(u->bitrate, queued, u->packet_cost, pa_rtclock_now()));
+}
 
-        if (PA_UNLIKELY(encoded <= 0)) {
-            pa_log_error("SBC encoding error (%li)", (long) encoded);
-            pa_memblock_release(u->write_memchunk.memblock);
-            return -1;
-        }
+/* Run from IO thread */
+static void a2dp_submit_block(struct userdata *u) {
+    pa_memchunk memchunk;
 
-        pa_assert_fp((size_t) encoded <= to_encode);
-        pa_assert_fp((size_t) encoded == sbc_info->codesize);
+    pa_assert(u);
+    pa_assert(u->encoder);
 
-        pa_assert_fp((size_t) written <= to_write);
-        pa_assert_fp((size_t) written == sbc_info->frame_length);
+    pa_sink_render_full(u->sink, u->write_block_size, &memchunk);
+    pa_assert(memchunk.length == u->write_block_size);
 
-        p = (const uint8_t*) p + encoded;
-        to_encode -= encoded;
+    pa_a2dp_encoder_submit(u->encoder, &memchunk,
+                           (u->write_index + u->write_pending) / pa_frame_size(&u->sample_spec));
+    u->write_pending += memchunk.length;
 
-        d = (uint8_t*) d + written;
-        to_write -= written;
+    pa_memblock_unref(memchunk.memblock);
+}
 
-        frame_count++;
-    }
+/* Run from IO thread */
+static int a2dp_process_render(struct userdata *u) {
+    const uint8_t *packet;
+    size_t nbytes, pcm_length;
+    int ret = 0;
 
-    pa_memblock_release(u->write_memchunk.memblock);
+    pa_assert(u);
+    pa_assert(u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK);
+    pa_assert(u->sink);
 
-    pa_assert(to_encode == 0);
+    if (u->encoder) {
+        /* Normally the block was submitted after the last write and has
+         * been encoded while we were waiting for the socket */
+        if (!pa_a2dp_encoder_busy(u->encoder))
+            a2dp_submit_block(u);
 
-    PA_ONCE_BEGIN {
-        pa_log_debug("Using SBC encoder implementation: %s", pa_strnull(sbc_get_implementation_info(&sbc_info->sbc)));
-    } PA_ONCE_END;
+        if ((nbytes = pa_a2dp_encoder_wait(u->encoder, &packet, &pcm_length)) == 0)
+            return -1;
+    } else {
+        const uint8_t *p;
+        size_t processed;
+
+        /* First, render some data. A block left over from an EAGAIN may be
+         * smaller than write_block_size if the bitrate was reduced since. */
+        if (!u->write_memchunk.memblock) {
+            pa_sink_render_full(u->sink, u->write_block_size, &u->write_memchunk);
+            pa_assert(u->write_memchunk.length == u->write_block_size);
+        }
 
-    /* write it to the fifo */
-    memset(sbc_info->buffer, 0, sizeof(*header) + sizeof(*payload));
-    header->v = 2;
-    header->pt = 1;
-    header->sequence_number = htons(sbc_info->seq_num++);
-    header->timestamp = htonl(u->write_index / pa_frame_size(&u->sample_spec));
-    header->ssrc = htonl(1);
-    payload->frame_count = frame_count;
+        a2dp_prepare_buffer(u);
+
+        /* Try to create a packet of the full MTU */
+        p = pa_memblock_acquire_chunk(&u->write_memchunk);
+        nbytes = u->a2dp_codec->encode_buffer(u->codec_info, u->write_index / pa_frame_size(&u->sample_spec),
+                                              p, u->write_memchunk.length, u->buffer, u->buffer_size, &processed);
+        pa_memblock_release(u->write_memchunk.memblock);
+
+        if (PA_UNLIKELY(nbytes == 0))
+            return -1;
+
+        pa_assert(processed == u->write_memchunk.length);
 
-    nbytes = (uint8_t*) d - (uint8_t*) sbc_info->buffer;
+        packet = u->buffer;
+        pcm_length = u->write_memchunk.length;
+    }
 
+    /* write it to the fifo */
     for (;;) {
         ssize_t l;
 
-        l = pa_write(u->stream_fd, sbc_info->buffer, nbytes, &u->stream_write_type);
+        l = pa_write(u->stream_fd, packet, nbytes, &u->stream_write_type);
 
         pa_assert(l != 0);
 
@@ -506,9 +547,11 @@ static int a2dp_process_render(struct userdata *u) {
                 /* Retry right away if we got interrupted */
                 continue;
 
-            else if (errno == EAGAIN)
+            else if (errno == EAGAIN) {
                 /* Hmm, apparently the socket was not writable, give up for now */
+                a2dp_change_bitrate(u, pa_a2dp_bitrate_miss(u->bitrate, pa_rtclock_now()));
                 break;
+            }
 
             pa_log_error("Failed to write data to socket: %s", pa_cstrerror(errno));
             ret = -1;
@@ -525,9 +568,20 @@ static int a2dp_process_render(struct userdata *u) {
             break;
         }
 
-        u->write_index += (uint64_t) u->write_memchunk.length;
-        pa_memblock_unref(u->write_memchunk.memblock);
-        pa_memchunk_reset(&u->write_memchunk);
+        u->write_index += (uint64_t) pcm_length;
+
+        a2dp_update_bitrate(u);
+
+        if (u->encoder) {
+            u->write_pending -= pcm_length;
+            pa_a2dp_encoder_release(u->encoder);
+
+            /* Get the next packet going while we wait for the socket */
+            a2dp_submit_block(u);
+        } else {
+            pa_memblock_unref(u->write_memchunk.memblock);
+            pa_memchunk_reset(&u->write_memchunk);
+        }
 
         ret = 1;
 
@@ -553,22 +607,13 @@ static int a2dp_process_push(struct userdata *u) {
     for (;;) {
         bool found_tstamp = false;
         pa_usec_t tstamp;
-        struct sbc_info *sbc_info;
-        struct rtp_header *header;
-        struct rtp_payload *payload;
-        const void *p;
-        void *d;
+        uint8_t *d;
         ssize_t l;
-        size_t to_write, to_decode;
-        size_t total_written = 0;
+        size_t processed, decoded;
 
         a2dp_prepare_buffer(u);
 
-        sbc_info = &u->sbc_info;
-        header = sbc_info->buffer;
-        payload = (struct rtp_payload*) ((uint8_t*) sbc_info->buffer + sizeof(*header));
-
-        l = pa_read(u->stream_fd, sbc_info->buffer, sbc_info->buffer_size, &u->stream_write_type);
+        l = pa_read(u->stream_fd, u->buffer, u->buffer_size, &u->stream_write_type);
 
         if (l <= 0) {
 
@@ -585,7 +630,7 @@ static int a2dp_process_push(struct userdata *u) {
             break;
         }
 
-        pa_assert((size_t) l <= sbc_info->buffer_size);
+        pa_assert((size_t) l <= u->buffer_size);
 
         /* TODO: get timestamp from rtp */
         if (!found_tstamp) {
@@ -593,52 +638,21 @@ static int a2dp_process_push(struct userdata *u) {
             tstamp = pa_rtclock_now();
         }
 
-        p = (uint8_t*) sbc_info->buffer + sizeof(*header) + sizeof(*payload);
-        to_decode = l - sizeof(*header) - sizeof(*payload);
-
         d = pa_memblock_acquire(memchunk.memblock);
-        to_write = memchunk.length = pa_memblock_get_length(memchunk.memblock);
-
-        while (PA_LIKELY(to_decode > 0)) {
-            size_t written;
-            ssize_t decoded;
-
-            decoded = sbc_decode(&sbc_info->sbc,
-                                 p, to_decode,
-                                 d, to_write,
-                                 &written);
-
-            if (PA_UNLIKELY(decoded <= 0)) {
-                pa_log_error("SBC decoding error (%li)", (long) decoded);
-                pa_memblock_release(memchunk.memblock);
-                pa_memblock_unref(memchunk.memblock);
-                return 0;
-            }
-
-            total_written += written;
-
-            /* Reset frame length, it can be changed due to bitpool change */
-            sbc_info->frame_length = sbc_get_frame_length(&sbc_info->sbc);
-
-            pa_assert_fp((size_t) decoded <= to_decode);
-            pa_assert_fp((size_t) decoded == sbc_info->frame_length);
-
-            pa_assert_fp((size_t) written == sbc_info->codesize);
-
-            p = (const uint8_t*) p + decoded;
-            to_decode -= decoded;
+        decoded = u->a2dp_codec->decode_buffer(u->codec_info, u->buffer, l,
+                                               d, pa_memblock_get_length(memchunk.memblock), &processed);
+        pa_memblock_release(memchunk.memblock);
 
-            d = (uint8_t*) d + written;
-            to_write -= written;
+        if (PA_UNLIKELY(decoded == 0)) {
+            pa_memblock_unref(memchunk.memblock);
+            return 0;
         }
 
-        u->read_index += (uint64_t) total_written;
+        u->read_index += (uint64_t) decoded;
         pa_smoother_put(u->read_smoother, tstamp, pa_bytes_to_usec(u->read_index, &u->sample_spec));
         pa_smoother_resume(u->read_smoother, tstamp, true);
 
-        memchunk.length -= to_write;
-
-        pa_memblock_release(memchunk.memblock);
+        memchunk.length = decoded;
 
         pa_source_post(u->source, &memchunk);
 
@@ -651,64 +665,13 @@ static int a2dp_process_push(struct userdata *u) {
     return ret;
 }
 
-/* Run from I/O thread */
-static void a2dp_set_bitpool(struct userdata *u, uint8_t bitpool) {
-    struct sbc_info *sbc_info;
-
-    pa_assert(u);
-
-    sbc_info = &u->sbc_info;
-
-    if (sbc_info->sbc.bitpool == bitpool)
-        return;
-
-    if (bitpool > sbc_info->max_bitpool)
-        bitpool = sbc_info->max_bitpool;
-    else if (bitpool < sbc_info->min_bitpool)
-        bitpool = sbc_info->min_bitpool;
-
-    sbc_info->sbc.bitpool = bitpool;
-
-    sbc_info->codesize = sbc_get_codesize(&sbc_info->sbc);
-    sbc_info->frame_length = sbc_get_frame_length(&sbc_info->sbc);
-
-    pa_log_debug("Bitpool has changed to %u", sbc_info->sbc.bitpool);
-
-    u->read_block_size =
-        (u->read_link_mtu - sizeof(struct rtp_header) - sizeof(struct rtp_payload))
-        / sbc_info->frame_length * sbc_info->codesize;
-
-    u->write_block_size =
-        (u->write_link_mtu - sizeof(struct rtp_header) - sizeof(struct rtp_payload))
-        / sbc_info->frame_length * sbc_info->codesize;
-
-    pa_sink_set_max_request_within_thread(u->sink, u->write_block_size);
-    pa_sink_set_fixed_latency_within_thread(u->sink,
-            FIXED_LATENCY_PLAYBACK_A2DP + pa_bytes_to_usec(u->write_block_size, &u->sample_spec));
-}
-
-/* Run from I/O thread */
-static void a2dp_reduce_bitpool(struct userdata *u) {
-    struct sbc_info *sbc_info;
-    uint8_t bitpool;
-
-    pa_assert(u);
-
-    sbc_info = &u->sbc_info;
-
-    /* Check if bitpool is already at its limit */
-    if (sbc_info->sbc.bitpool <= BITPOOL_DEC_LIMIT)
-        return;
-
-    bitpool = sbc_info->sbc.bitpool - BITPOOL_DEC_STEP;
-
-    if (bitpool < BITPOOL_DEC_LIMIT)
-        bitpool = BITPOOL_DEC_LIMIT;
-
-    a2dp_set_bitpool(u, bitpool);
-}
-
 static void teardown_stream(struct userdata *u) {
+    if (u->encoder) {
+        pa_a2dp_encoder_free(u->encoder);
+        u->encoder = NULL;
+        u->write_pending = 0;
+    }
+
     if (u->rtpoll_item) {
         pa_rtpoll_item_free(u->rtpoll_item);
         u->rtpoll_item = NULL;
@@ -772,13 +735,8 @@ static void transport_config_mtu(struct userdata *u) {
         u->read_block_size = u->read_link_mtu;
         u->write_block_size = u->write_link_mtu;
     } else {
-        u->read_block_size =
-            (u->read_link_mtu - sizeof(struct rtp_header) - sizeof(struct rtp_payload))
-            / u->sbc_info.frame_length * u->sbc_info.codesize;
-
-        u->write_block_size =
-            (u->write_link_mtu - sizeof(struct rtp_header) - sizeof(struct rtp_payload))
-            / u->sbc_info.frame_length * u->sbc_info.codesize;
+        u->read_block_size = u->a2dp_codec->get_block_size(u->codec_info, u->read_link_mtu);
+        u->write_block_size = u->a2dp_codec->get_block_size(u->codec_info, u->write_link_mtu);
     }
 
     if (u->sink) {
@@ -803,6 +761,10 @@ static void setup_stream(struct userdata *u) {
 
     pa_log_info("Transport %s resuming", u->transport->path);
 
+    /* Start over at the highest bitrate */
+    if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK || u->profile == PA_BLUETOOTH_PROFILE_A2DP_SOURCE)
+        u->a2dp_codec->reset(u->codec_info);
+
     transport_config_mtu(u);
 
     pa_make_fd_nonblock(u->stream_fd);
@@ -814,8 +776,29 @@ static void setup_stream(struct userdata *u) {
 
     pa_log_debug("Stream properly set up, we're ready to roll!");
 
-    if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK)
-        a2dp_set_bitpool(u, u->sbc_info.max_bitpool);
+    if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK) {
+        socklen_t len = sizeof(u->write_sndbuf);
+
+        if (getsockopt(u->stream_fd, SOL_SOCKET, SO_SNDBUF, &u->write_sndbuf, &len) < 0) {
+            pa_log_warn("Failed to get the socket send buffer size, bitrate only adapts to dropouts: %s",
+                        pa_cstrerror(errno));
+            u->write_sndbuf = 0;
+        }
+
+        u->packet_cost = 0;
+
+        if (!u->bitrate)
+            u->bitrate = pa_a2dp_bitrate_new();
+        pa_a2dp_bitrate_reset(u->bitrate, pa_rtclock_now());
+    }
+
+    if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK && u->encoder_thread) {
+        a2dp_prepare_buffer(u);
+
+        if (!(u->encoder = pa_a2dp_encoder_new(u->a2dp_codec, u->codec_info, u->buffer_size,
+                                               u->core->realtime_scheduling ? u->core->realtime_priority : 0)))
+            pa_log_warn("Encoding on the IO thread instead");
+    }
 
     u->rtpoll_item = pa_rtpoll_item_new(u->rtpoll, PA_RTPOLL_NEVER, 1);
     pollfd = pa_rtpoll_item_get_pollfd(u->rtpoll_item, NULL);
@@ -1053,7 +1036,7 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
                 wi = pa_bytes_to_usec(u->write_index + u->write_block_size, &u->sample_spec);
             } else {
                 ri = pa_rtclock_now() - u->started_at;
-                wi = pa_bytes_to_usec(u->write_index, &u->sample_spec);
+                wi = pa_bytes_to_usec(u->write_index + u->write_pending, &u->sample_spec);
             }
 
             *((pa_usec_t*) data) = u->sink->thread_info.fixed_latency + wi > ri ? u->sink->thread_info.fixed_latency + wi - ri : 0;
@@ -1158,118 +1141,32 @@ static int add_sink(struct userdata *u) {
 }
 
 /* Run from main thread */
-static void transport_config(struct userdata *u) {
+static int transport_config(struct userdata *u) {
     if (u->profile == PA_BLUETOOTH_PROFILE_HEADSET_HEAD_UNIT || u->profile == PA_BLUETOOTH_PROFILE_HEADSET_AUDIO_GATEWAY) {
         u->sample_spec.format = PA_SAMPLE_S16LE;
         u->sample_spec.channels = 1;
         u->sample_spec.rate = 8000;
     } else {
-        sbc_info_t *sbc_info = &u->sbc_info;
-        a2dp_sbc_t *config;
-
         pa_assert(u->transport);
 
-        u->sample_spec.format = PA_SAMPLE_S16LE;
-        config = (a2dp_sbc_t *) u->transport->config;
-
-        if (sbc_info->sbc_initialized)
-            sbc_reinit(&sbc_info->sbc, 0);
-        else
-            sbc_init(&sbc_info->sbc, 0);
-        sbc_info->sbc_initialized = true;
-
-        switch (config->frequency) {
-            case SBC_SAMPLING_FREQ_16000:
-                sbc_info->sbc.frequency = SBC_FREQ_16000;
-                u->sample_spec.rate = 16000U;
-                break;
-            case SBC_SAMPLING_FREQ_32000:
-                sbc_info->sbc.frequency = SBC_FREQ_32000;
-                u->sample_spec.rate = 32000U;
-                break;
-            case SBC_SAMPLING_FREQ_44100:
-                sbc_info->sbc.frequency = SBC_FREQ_44100;
-                u->sample_spec.rate = 44100U;
-                break;
-            case SBC_SAMPLING_FREQ_48000:
-                sbc_info->sbc.frequency = SBC_FREQ_48000;
-                u->sample_spec.rate = 48000U;
-                break;
-            default:
-                pa_assert_not_reached();
-        }
-
-        switch (config->channel_mode) {
-            case SBC_CHANNEL_MODE_MONO:
-                sbc_info->sbc.mode = SBC_MODE_MONO;
-                u->sample_spec.channels = 1;
-                break;
-            case SBC_CHANNEL_MODE_DUAL_CHANNEL:
-                sbc_info->sbc.mode = SBC_MODE_DUAL_CHANNEL;
-                u->sample_spec.channels = 2;
-                break;
-            case SBC_CHANNEL_MODE_STEREO:
-                sbc_info->sbc.mode = SBC_MODE_STEREO;
-                u->sample_spec.channels = 2;
-                break;
-            case SBC_CHANNEL_MODE_JOINT_STEREO:
-                sbc_info->sbc.mode = SBC_MODE_JOINT_STEREO;
-                u->sample_spec.channels = 2;
-                break;
-            default:
-                pa_assert_not_reached();
+        if (u->codec_info) {
+            u->a2dp_codec->deinit(u->codec_info);
+            u->codec_info = NULL;
         }
 
-        switch (config->allocation_method) {
-            case SBC_ALLOCATION_SNR:
-                sbc_info->sbc.allocation = SBC_AM_SNR;
-                break;
-            case SBC_ALLOCATION_LOUDNESS:
-                sbc_info->sbc.allocation = SBC_AM_LOUDNESS;
-                break;
-            default:
-                pa_assert_not_reached();
-        }
+        /* BlueZ only ever configures SBC for us at this point */
+        u->a2dp_codec = pa_bluetooth_get_a2dp_codec_by_id(A2DP_CODEC_SBC);
+        pa_assert(u->a2dp_codec);
 
-        switch (config->subbands) {
-            case SBC_SUBBANDS_4:
-                sbc_info->sbc.subbands = SBC_SB_4;
-                break;
-            case SBC_SUBBANDS_8:
-                sbc_info->sbc.subbands = SBC_SB_8;
-                break;
-            default:
-                pa_assert_not_reached();
-        }
-
-        switch (config->block_length) {
-            case SBC_BLOCK_LENGTH_4:
-                sbc_info->sbc.blocks = SBC_BLK_4;
-                break;
-            case SBC_BLOCK_LENGTH_8:
-                sbc_info->sbc.blocks = SBC_BLK_8;
-                break;
-            case SBC_BLOCK_LENGTH_12:
-                sbc_info->sbc.blocks = SBC_BLK_12;
-                break;
-            case SBC_BLOCK_LENGTH_16:
-                sbc_info->sbc.blocks = SBC_BLK_16;
-                break;
-            default:
-                pa_assert_not_reached();
+        if (!(u->codec_info = u->a2dp_codec->init(u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK,
+                                                  u->transport->config, u->transport->config_size,
+                                                  &u->sample_spec))) {
+            pa_log_error("Failed to set up the %s codec", u->a2dp_codec->name);
+            return -1;
         }
-
-        sbc_info->min_bitpool = config->min_bitpool;
-        sbc_info->max_bitpool = config->max_bitpool;
-
-        /* Set minimum bitpool for source to get the maximum possible block_size */
-        sbc_info->sbc.bitpool = u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK ? sbc_info->max_bitpool : sbc_info->min_bitpool;
-        sbc_info->codesize = sbc_get_codesize(&sbc_info->sbc);
-        sbc_info->frame_length = sbc_get_frame_length(&sbc_info->sbc);
-
-        pa_log_info("SBC parameters: allocation=%u, subbands=%u, blocks=%u, bitpool=%u",
-                    sbc_info->sbc.allocation, sbc_info->sbc.subbands, sbc_info->sbc.blocks, sbc_info->sbc.bitpool);
     }
+
+    return 0;
 }
 
 /* Run from main thread */
@@ -1294,9 +1191,7 @@ static int setup_transport(struct userdata *u) {
     else if (transport_acquire(u, false) < 0)
         return -1; /* We need to fail here until the interactions with module-suspend-on-idle and alike get improved */
 
-    transport_config(u);
-
-    return 0;
+    return transport_config(u);
 }
 
 /* Run from main thread */
@@ -1450,7 +1345,7 @@ static void thread_func(void *userdata) {
                                 u->write_index += skip_bytes;
 
                                 if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK)
-                                    a2dp_reduce_bitpool(u);
+                                    a2dp_change_bitrate(u, pa_a2dp_bitrate_miss(u->bitrate, pa_rtclock_now()));
                             }
                         }
 
@@ -2216,6 +2111,12 @@ int pa__init(pa_module* m) {
 
     u->device->autodetect_mtu = autodetect_mtu;
 
+    u->encoder_thread = false;
+    if (pa_modargs_get_value_boolean(ma, "encoder_thread", &u->encoder_thread) < 0) {
+        pa_log("Invalid boolean value for encoder_thread parameter");
+        goto fail_free_modargs;
+    }
+
     pa_modargs_free(ma);
 
     u->device_connection_changed_slot =
@@ -2292,11 +2193,14 @@ void pa__done(pa_module *m) {
     if (u->transport_microphone_gain_changed_slot)
         pa_hook_slot_free(u->transport_microphone_gain_changed_slot);
 
-    if (u->sbc_info.buffer)
-        pa_xfree(u->sbc_info.buffer);
+    if (u->buffer)
+        pa_xfree(u->buffer);
+
+    if (u->codec_info)
+        u->a2dp_codec->deinit(u->codec_info);
 
-    if (u->sbc_info.sbc_initialized)
-        sbc_finish(&u->sbc_info.sbc);
+    if (u->bitrate)
+        pa_a2dp_bitrate_free(u->bitrate);
 
     if (u->msg)
         pa_xfree(u->msg);
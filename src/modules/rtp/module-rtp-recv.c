@@ -56,6 +56,7 @@
 #include "module-rtp-recv-symdef.h"
 
 #include "rtp.h"
+#include "rtp-jitter.h"
 #include "sdp.h"
 #include "sap.h"
 
@@ -67,6 +68,7 @@ PA_MODULE_USAGE(
         "sink=<name of the sink> "
         "sap_address=<multicast address to listen on> "
         "latency_msec=<latency in ms> "
+        "min_latency_msec=<lower bound when adapting the latency to the network jitter> "
 );
 
 #define SAP_PORT 9875
@@ -81,6 +83,7 @@ static const char* const valid_modargs[] = {
     "sink",
     "sap_address",
     "latency_msec",
+    "min_latency_msec",
     NULL
 };
 
@@ -93,7 +96,8 @@ struct session {
 
     bool first_packet;
     uint32_t ssrc;
-    uint32_t offset;
+
+    pa_rtp_jitter *jitter;
 
     struct pa_sdp_info sdp_info;
 
@@ -129,6 +133,7 @@ struct userdata {
     int n_sessions;
 
     pa_usec_t latency;
+    pa_usec_t min_latency;
 };
 
 static void session_free(struct session *s);
@@ -155,6 +160,10 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *chunk
     pa_sink_input_assert_ref(i);
     pa_assert_se(s = i->userdata);
 
+    /* Don't wait for missing packets any longer if we'd run empty */
+    if (pa_memblockq_is_readable(s->memblockq) && pa_memblockq_get_length(s->memblockq) < length)
+        pa_rtp_jitter_release(s->jitter, s->memblockq, pa_rtclock_now(), true);
+
     if (pa_memblockq_peek(s->memblockq, chunk) < 0)
         return -1;
 
@@ -198,19 +207,47 @@ static void sink_input_suspend_within_thread(pa_sink_input* i, bool b) {
     pa_sink_input_assert_ref(i);
     pa_assert_se(s = i->userdata);
 
-    if (b)
+    if (b) {
         pa_memblockq_flush_read(s->memblockq);
-    else
+        pa_rtp_jitter_reset(s->jitter);
+    } else
         s->first_packet = false;
 }
 
+/* Called from I/O thread context */
+static void update_intended_latency(struct session *s) {
+    pa_rtp_jitter_stats stats;
+    pa_usec_t latency;
+
+    pa_rtp_jitter_get_stats(s->jitter, &stats);
+
+    pa_log_debug("Jitter %0.2f ms, target delay %0.2f ms, %llu packets received, %llu lost, %llu reordered, %llu late, "
+                 "%llu frames concealed",
+                 (double) stats.jitter / PA_USEC_PER_MSEC, (double) stats.target_delay / PA_USEC_PER_MSEC,
+                 (unsigned long long) stats.packets_received, (unsigned long long) stats.packets_lost,
+                 (unsigned long long) stats.packets_reordered, (unsigned long long) stats.packets_late,
+                 (unsigned long long) stats.frames_concealed);
+
+    latency = PA_CLAMP(stats.target_delay + s->sink_latency, s->userdata->min_latency, s->userdata->latency);
+    latency = PA_MAX(latency, s->sink_latency*2);
+
+    if (latency == s->intended_latency)
+        return;
+
+    pa_log_info("Changing intended latency from %0.2f ms to %0.2f ms",
+                (double) s->intended_latency / PA_USEC_PER_MSEC, (double) latency / PA_USEC_PER_MSEC);
+
+    s->intended_latency = latency;
+    pa_memblockq_set_prebuf(s->memblockq, pa_usec_to_bytes(s->intended_latency - s->sink_latency, &s->sink_input->sample_spec));
+}
+
 /* Called from I/O thread context */
 static int rtpoll_work_cb(pa_rtpoll_item *i) {
     pa_memchunk chunk;
-    int64_t k, j, delta;
     struct timeval now = { 0, 0 };
     struct session *s;
     struct pollfd *p;
+    bool received = false;
 
     pa_assert_se(s = pa_rtpoll_item_get_userdata(i));
 
@@ -226,61 +263,53 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
 
     p->revents = 0;
 
-    if (pa_rtp_recv(&s->rtp_context, &chunk, s->userdata->module->core->mempool, &now) < 0)
-        return 0;
+    /* Take everything that one recvmmsg() call returned */
+    do {
+        if (pa_rtp_recv(&s->rtp_context, &chunk, s->userdata->module->core->mempool, &now) < 0)
+            break;
 
-    if (s->sdp_info.payload != s->rtp_context.payload ||
-        !PA_SINK_IS_OPENED(s->sink_input->sink->thread_info.state)) {
-        pa_memblock_unref(chunk.memblock);
-        return 0;
-    }
+        if (s->sdp_info.payload != s->rtp_context.payload ||
+            !PA_SINK_IS_OPENED(s->sink_input->sink->thread_info.state)) {
+            pa_memblock_unref(chunk.memblock);
+            continue;
+        }
 
-    if (!s->first_packet) {
-        s->first_packet = true;
+        if (!s->first_packet) {
+            s->first_packet = true;
 
-        s->ssrc = s->rtp_context.ssrc;
-        s->offset = s->rtp_context.timestamp;
+            s->ssrc = s->rtp_context.ssrc;
+            pa_rtp_jitter_reset(s->jitter);
 
-        if (s->ssrc == s->userdata->module->core->cookie)
-            pa_log_warn("Detected RTP packet loop!");
-    } else {
-        if (s->ssrc != s->rtp_context.ssrc) {
-            pa_memblock_unref(chunk.memblock);
-            return 0;
+            if (s->ssrc == s->userdata->module->core->cookie)
+                pa_log_warn("Detected RTP packet loop!");
+        } else {
+            if (s->ssrc != s->rtp_context.ssrc) {
+                pa_memblock_unref(chunk.memblock);
+                continue;
+            }
         }
-    }
 
-    /* Check whether there was a timestamp overflow */
-    k = (int64_t) s->rtp_context.timestamp - (int64_t) s->offset;
-    j = (int64_t) 0x100000000LL - (int64_t) s->offset + (int64_t) s->rtp_context.timestamp;
+        if (now.tv_sec == 0) {
+            PA_ONCE_BEGIN {
+                pa_log_warn("Using artificial time instead of timestamp");
+            } PA_ONCE_END;
+            pa_rtclock_get(&now);
+        } else
+            pa_rtclock_from_wallclock(&now);
 
-    if ((k < 0 ? -k : k) < (j < 0 ? -j : j))
-        delta = k;
-    else
-        delta = j;
+        pa_rtp_jitter_put(s->jitter, s->rtp_context.sequence, s->rtp_context.timestamp, &chunk, pa_timeval_load(&now));
+        pa_memblock_unref(chunk.memblock);
 
-    pa_memblockq_seek(s->memblockq, delta * (int64_t) s->rtp_context.frame_size, PA_SEEK_RELATIVE, true);
+        received = true;
+    } while (pa_rtp_recv_pending(&s->rtp_context));
 
-    if (now.tv_sec == 0) {
-        PA_ONCE_BEGIN {
-            pa_log_warn("Using artificial time instead of timestamp");
-        } PA_ONCE_END;
-        pa_rtclock_get(&now);
-    } else
-        pa_rtclock_from_wallclock(&now);
+    if (!received)
+        return 0;
 
-    if (pa_memblockq_push(s->memblockq, &chunk) < 0) {
-        pa_log_warn("Queue overrun");
-        pa_memblockq_seek(s->memblockq, (int64_t) chunk.length, PA_SEEK_RELATIVE, true);
-    }
+    pa_rtp_jitter_release(s->jitter, s->memblockq, pa_timeval_load(&now), false);
 
 /*     pa_log("blocks in q: %u", pa_memblockq_get_nblocks(s->memblockq)); */
 
-    pa_memblock_unref(chunk.memblock);
-
-    /* The next timestamp we expect */
-    s->offset = s->rtp_context.timestamp + (uint32_t) (chunk.length / s->rtp_context.frame_size);
-
     pa_atomic_store(&s->timestamp, (int) now.tv_sec);
 
     if (s->last_rate_update + RATE_UPDATE_INTERVAL < pa_timeval_load(&now)) {
@@ -291,6 +320,9 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
 
         pa_log_debug("Updating sample rate");
 
+        if (s->userdata->min_latency < s->userdata->latency)
+            update_intended_latency(s);
+
         wi = pa_bytes_to_usec((uint64_t) pa_memblockq_get_write_index(s->memblockq), &s->sink_input->sample_spec);
         ri = pa_bytes_to_usec((uint64_t) pa_memblockq_get_read_index(s->memblockq), &s->sink_input->sample_spec);
 
@@ -569,7 +601,7 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
 
     pa_sink_input_get_silence(s->sink_input, &silence);
 
-    s->sink_latency = pa_sink_input_set_requested_latency(s->sink_input, s->intended_latency/2);
+    s->sink_latency = pa_sink_input_set_requested_latency(s->sink_input, u->min_latency/2);
 
     if (s->intended_latency < s->sink_latency*2)
         s->intended_latency = s->sink_latency*2;
@@ -588,6 +620,7 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
     pa_memblock_unref(silence.memblock);
 
     pa_rtp_context_init_recv(&s->rtp_context, fd, pa_frame_size(&s->sdp_info.sample_spec));
+    s->jitter = pa_rtp_jitter_new(&s->sdp_info.sample_spec, u->module->core->mempool, PA_RTP_JITTER_DEFAULT_QUANTILE);
 
     pa_hashmap_put(s->userdata->by_origin, s->sdp_info.origin, s);
     u->n_sessions++;
@@ -621,6 +654,7 @@ static void session_free(struct session *s) {
     s->userdata->n_sessions--;
 
     pa_memblockq_free(s->memblockq);
+    pa_rtp_jitter_free(s->jitter);
     pa_sdp_info_destroy(&s->sdp_info);
     pa_rtp_context_destroy(&s->rtp_context);
 
@@ -701,7 +735,7 @@ int pa__init(pa_module*m) {
     struct sockaddr *sa;
     socklen_t salen;
     const char *sap_address;
-    uint32_t latency_msec;
+    uint32_t latency_msec, min_latency_msec;
     int fd = -1;
 
     pa_assert(m);
@@ -736,6 +770,12 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    min_latency_msec = latency_msec;
+    if (pa_modargs_get_value_u32(ma, "min_latency_msec", &min_latency_msec) < 0 || min_latency_msec < 1 || min_latency_msec > latency_msec) {
+        pa_log("Invalid minimum latency specification");
+        goto fail;
+    }
+
     if ((fd = mcast_socket(sa, salen)) < 0)
         goto fail;
 
@@ -744,6 +784,7 @@ int pa__init(pa_module*m) {
     u->core = m->core;
     u->sink_name = pa_xstrdup(pa_modargs_get_value(ma, "sink", NULL));
     u->latency = (pa_usec_t) latency_msec * PA_USEC_PER_MSEC;
+    u->min_latency = (pa_usec_t) min_latency_msec * PA_USEC_PER_MSEC;
 
     u->sap_event = m->core->mainloop->io_new(m->core->mainloop, fd, PA_IO_EVENT_INPUT, sap_event_cb, u);
     pa_sap_context_init_recv(&u->sap_context, fd);
@@ -116,6 +116,17 @@ struct userdata {
     enum inhibit_auto_suspend inhibit_auto_suspend;
 };
 
+enum {
+    SOURCE_OUTPUT_MESSAGE_GET_SEND_STATS = PA_SOURCE_OUTPUT_MESSAGE_MAX
+};
+
+struct send_stats {
+    uint64_t packets_sent;
+    uint64_t bytes_sent;
+    uint64_t packets_dropped;
+    uint64_t send_calls;
+};
+
 /* Called from I/O thread context */
 static int source_output_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
     struct userdata *u;
@@ -128,6 +139,17 @@ static int source_output_process_msg(pa_msgobject *o, int code, void *data, int6
             /* Fall through, the default handler will add in the extra
              * latency added by the resampler */
             break;
+
+        case SOURCE_OUTPUT_MESSAGE_GET_SEND_STATS: {
+            struct send_stats *stats = data;
+
+            stats->packets_sent = u->rtp_context.packets_sent;
+            stats->bytes_sent = u->rtp_context.bytes_sent;
+            stats->packets_dropped = u->rtp_context.packets_dropped;
+            stats->send_calls = u->rtp_context.send_calls;
+
+            return 0;
+        }
     }
 
     return pa_source_output_process_msg(o, code, data, offset, chunk);
@@ -193,6 +215,24 @@ static void source_output_kill_cb(pa_source_output* o) {
     u->source_output = NULL;
 }
 
+/* Called from main context */
+static void log_send_stats(struct userdata *u) {
+    struct send_stats stats;
+
+    pa_assert(u);
+
+    if (!u->source_output || !PA_SOURCE_OUTPUT_IS_LINKED(u->source_output->state) || !u->source_output->source)
+        return;
+
+    pa_zero(stats);
+    pa_assert_se(pa_asyncmsgq_send(u->source_output->source->asyncmsgq, PA_MSGOBJECT(u->source_output),
+                                   SOURCE_OUTPUT_MESSAGE_GET_SEND_STATS, &stats, 0, NULL) == 0);
+
+    pa_log_debug("Sent %llu packets (%llu bytes) in %llu calls, %llu dropped",
+                 (unsigned long long) stats.packets_sent, (unsigned long long) stats.bytes_sent,
+                 (unsigned long long) stats.send_calls, (unsigned long long) stats.packets_dropped);
+}
+
 static void sap_event_cb(pa_mainloop_api *m, pa_time_event *t, const struct timeval *tv, void *userdata) {
     struct userdata *u = userdata;
 
@@ -201,6 +241,7 @@ static void sap_event_cb(pa_mainloop_api *m, pa_time_event *t, const struct time
     pa_assert(u);
 
     pa_sap_send(&u->sap_context, 0);
+    log_send_stats(u);
 
     pa_core_rttime_restart(u->module->core, t, pa_rtclock_now() + SAP_INTERVAL);
 }
@@ -0,0 +1,416 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/endianmacros.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "rtp-jitter.h"
+
+#define MAX_QUEUED 256                               /* Don't hold back more packets than this */
+#define N_TRANSIT 1024                               /* Packets the target delay is computed from */
+#define MIN_TRANSIT 32                               /* ... and how many we need at least */
+#define UPDATE_INTERVAL 32                           /* Recompute the target delay every this many packets */
+#define DEFAULT_DELAY_USEC (40*PA_USEC_PER_MSEC)     /* Until then, use this */
+#define RESYNC_USEC (1*PA_USEC_PER_SEC)              /* Larger jumps start over */
+#define CONCEAL_FADE_USEC (20*PA_USEC_PER_MSEC)      /* Concealment fades out to silence over this */
+
+struct packet {
+    PA_LLIST_FIELDS(struct packet);
+
+    int64_t timestamp;
+    uint16_t sequence;
+    pa_memchunk chunk;
+};
+
+struct pa_rtp_jitter {
+    pa_sample_spec ss;
+    size_t frame_size;
+    pa_mempool *pool;
+    double quantile;
+
+    bool synced;
+    int64_t next;               /* Timestamp of the next frame we write */
+    uint16_t sequence;          /* ... and the sequence number of the packet before it */
+
+    PA_LLIST_HEAD(struct packet, packets);
+    struct packet *tail;
+    unsigned n_packets;
+
+    /* The last packet written and how much of it we repeated so far */
+    pa_memchunk last;
+    size_t concealed;
+
+    /* Ring buffer of transit times in usec, the timestamps are unwrapped
+     * so these don't jump */
+    int64_t transit[N_TRANSIT];
+    unsigned n_transit, transit_idx;
+    int64_t last_transit;
+    unsigned until_update;
+
+    int64_t min_transit;
+    pa_usec_t delay;            /* The quantile, relative to min_transit */
+    pa_usec_t packet_usec;
+    double jitter;
+
+    pa_rtp_jitter_stats stats;
+};
+
+pa_rtp_jitter *pa_rtp_jitter_new(const pa_sample_spec *ss, pa_mempool *pool, double quantile) {
+    pa_rtp_jitter *j;
+
+    pa_assert(ss);
+    pa_assert(pool);
+    pa_assert(quantile > 0 && quantile <= 1);
+
+    j = pa_xnew0(pa_rtp_jitter, 1);
+    j->ss = *ss;
+    j->frame_size = pa_frame_size(ss);
+    j->pool = pool;
+    j->quantile = quantile;
+
+    PA_LLIST_HEAD_INIT(struct packet, j->packets);
+    pa_memchunk_reset(&j->last);
+
+    pa_rtp_jitter_reset(j);
+
+    return j;
+}
+
+static void drop_packets(pa_rtp_jitter *j) {
+    struct packet *p;
+
+    while ((p = j->packets)) {
+        PA_LLIST_REMOVE(struct packet, j->packets, p);
+        pa_memblock_unref(p->chunk.memblock);
+        pa_xfree(p);
+    }
+
+    j->tail = NULL;
+    j->n_packets = 0;
+}
+
+void pa_rtp_jitter_free(pa_rtp_jitter *j) {
+    pa_assert(j);
+
+    drop_packets(j);
+
+    if (j->last.memblock)
+        pa_memblock_unref(j->last.memblock);
+
+    pa_xfree(j);
+}
+
+void pa_rtp_jitter_reset(pa_rtp_jitter *j) {
+    pa_assert(j);
+
+    drop_packets(j);
+
+    if (j->last.memblock)
+        pa_memblock_unref(j->last.memblock);
+    pa_memchunk_reset(&j->last);
+    j->concealed = 0;
+
+    j->synced = false;
+    j->n_transit = j->transit_idx = 0;
+    j->until_update = 0;
+    j->delay = DEFAULT_DELAY_USEC;
+    j->packet_usec = 0;
+    j->jitter = 0;
+}
+
+static int64_t frames_to_usec(pa_rtp_jitter *j, int64_t frames) {
+    return frames * (int64_t) PA_USEC_PER_SEC / (int64_t) j->ss.rate;
+}
+
+static int64_t usec_to_frames(pa_rtp_jitter *j, pa_usec_t usec) {
+    return (int64_t) (usec * j->ss.rate / PA_USEC_PER_SEC);
+}
+
+static int compare_int64(const void *a, const void *b) {
+    int64_t x = *(const int64_t*) a, y = *(const int64_t*) b;
+
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static void update_delay(pa_rtp_jitter *j) {
+    int64_t sorted[N_TRANSIT];
+
+    memcpy(sorted, j->transit, j->n_transit * sizeof(int64_t));
+    qsort(sorted, j->n_transit, sizeof(int64_t), compare_int64);
+
+    j->min_transit = sorted[0];
+    j->delay = (pa_usec_t) (sorted[(unsigned) ((j->n_transit - 1) * j->quantile)] - sorted[0]);
+}
+
+static void add_transit(pa_rtp_jitter *j, int64_t timestamp, pa_usec_t arrival) {
+    int64_t transit, d;
+
+    transit = (int64_t) arrival - frames_to_usec(j, timestamp);
+
+    if (j->n_transit > 0) {
+        d = transit - j->last_transit;
+
+        /* The sender paused, or either clock jumped */
+        if (d > (int64_t) RESYNC_USEC || d < -(int64_t) RESYNC_USEC) {
+            pa_log_debug("Transit time jumped by %lli ms, starting over", (long long) (d / (int64_t) PA_USEC_PER_MSEC));
+            j->n_transit = j->transit_idx = 0;
+            j->until_update = 0;
+            d = 0;
+        }
+
+        j->jitter += ((double) (d < 0 ? -d : d) - j->jitter) / 16.0;
+    }
+
+    j->last_transit = transit;
+    j->transit[j->transit_idx] = transit;
+    j->transit_idx = (j->transit_idx + 1) % N_TRANSIT;
+
+    if (j->n_transit < N_TRANSIT)
+        j->n_transit++;
+
+    if (j->n_transit == 1)
+        j->min_transit = transit;
+    else if (transit < j->min_transit)
+        j->min_transit = transit;
+
+    if (j->n_transit >= MIN_TRANSIT && j->until_update-- == 0) {
+        update_delay(j);
+        j->until_update = UPDATE_INTERVAL - 1;
+    }
+}
+
+int pa_rtp_jitter_put(pa_rtp_jitter *j, uint16_t sequence, uint32_t timestamp, const pa_memchunk *chunk, pa_usec_t arrival) {
+    struct packet *p, *after;
+    int64_t ts;
+
+    pa_assert(j);
+    pa_assert(chunk);
+    pa_assert(chunk->memblock);
+    pa_assert(chunk->length % j->frame_size == 0);
+
+    if (chunk->length <= 0)
+        return -1;
+
+    if (!j->synced) {
+        j->synced = true;
+        j->next = timestamp;
+        j->sequence = (uint16_t) (sequence - 1);
+    }
+
+    /* Unwrap the timestamp */
+    ts = j->next + (int32_t) (timestamp - (uint32_t) j->next);
+
+    if (ts > j->next + usec_to_frames(j, RESYNC_USEC) || ts < j->next - usec_to_frames(j, RESYNC_USEC)) {
+        /* The sender restarted, don't try to fill the gap */
+        pa_log_debug("Timestamp jumped by %lli frames, starting over", (long long) (ts - j->next));
+        drop_packets(j);
+        j->next = ts;
+        j->sequence = (uint16_t) (sequence - 1);
+    }
+
+    j->stats.packets_received++;
+    add_transit(j, ts, arrival);
+    j->packet_usec = (pa_usec_t) frames_to_usec(j, (int64_t) (chunk->length / j->frame_size));
+
+    if (ts + (int64_t) (chunk->length / j->frame_size) <= j->next) {
+        j->stats.packets_late++;
+        return -1;
+    }
+
+    /* Most packets go to the end */
+    for (after = j->tail; after && after->timestamp > ts; after = after->prev)
+        ;
+
+    if (after && after->timestamp == ts) {
+        j->stats.packets_late++;
+        return -1;
+    }
+
+    if (after != j->tail)
+        j->stats.packets_reordered++;
+
+    p = pa_xnew(struct packet, 1);
+    p->timestamp = ts;
+    p->sequence = sequence;
+    p->chunk = *chunk;
+    pa_memblock_ref(p->chunk.memblock);
+
+    PA_LLIST_INSERT_AFTER(struct packet, j->packets, after, p);
+
+    if (after == j->tail)
+        j->tail = p;
+
+    j->n_packets++;
+
+    return 0;
+}
+
+static void write_chunk(pa_memblockq *q, pa_memchunk *chunk) {
+    if (pa_memblockq_push(q, chunk) < 0) {
+        pa_log_warn("Queue overrun");
+        pa_memblockq_seek(q, (int64_t) chunk->length, PA_SEEK_RELATIVE, true);
+    }
+}
+
+/* Repeats the last packet, fading out over CONCEAL_FADE_USEC. This only
+ * works for linear PCM, for everything else we write silence. */
+static void conceal(pa_rtp_jitter *j, pa_memblockq *q, size_t frames) {
+    size_t fade, last_frames;
+
+    j->stats.frames_concealed += frames;
+
+    fade = (size_t) usec_to_frames(j, CONCEAL_FADE_USEC);
+    last_frames = j->last.length / j->frame_size;
+
+    if (j->last.memblock && (j->ss.format == PA_SAMPLE_S16BE || j->ss.format == PA_SAMPLE_U8)) {
+
+        while (frames > 0 && j->concealed < fade) {
+            pa_memchunk chunk;
+            const uint8_t *src;
+            uint8_t *dst;
+            size_t n, i, k;
+
+            n = PA_MIN(frames, fade - j->concealed);
+            n = PA_MIN(n, last_frames - j->concealed % last_frames);
+
+            chunk.memblock = pa_memblock_new(j->pool, n * j->frame_size);
+            chunk.index = 0;
+            chunk.length = n * j->frame_size;
+
+            src = (const uint8_t*) pa_memblock_acquire_chunk(&j->last) + (j->concealed % last_frames) * j->frame_size;
+            dst = pa_memblock_acquire(chunk.memblock);
+
+            for (i = 0; i < n; i++) {
+                /* Q16 gain, linear */
+                int32_t gain = (int32_t) (((fade - j->concealed - i) << 16) / fade);
+
+                for (k = 0; k < j->ss.channels; k++) {
+                    if (j->ss.format == PA_SAMPLE_S16BE) {
+                        int16_t s;
+
+                        memcpy(&s, src, sizeof(s));
+                        s = PA_INT16_TO_BE((int16_t) ((PA_INT16_FROM_BE(s) * gain) >> 16));
+                        memcpy(dst, &s, sizeof(s));
+                    } else
+                        *dst = (uint8_t) (0x80 + (((*src - 0x80) * gain) >> 16));
+
+                    src += pa_sample_size(&j->ss);
+                    dst += pa_sample_size(&j->ss);
+                }
+            }
+
+            pa_memblock_release(chunk.memblock);
+            pa_memblock_release(j->last.memblock);
+
+            write_chunk(q, &chunk);
+            pa_memblock_unref(chunk.memblock);
+
+            j->concealed += n;
+            frames -= n;
+        }
+    }
+
+    /* The memblockq's silence fills the rest */
+    if (frames > 0)
+        pa_memblockq_seek(q, (int64_t) (frames * j->frame_size), PA_SEEK_RELATIVE, true);
+}
+
+void pa_rtp_jitter_release(pa_rtp_jitter *j, pa_memblockq *q, pa_usec_t now, bool force) {
+    struct packet *p;
+
+    pa_assert(j);
+    pa_assert(q);
+
+    while ((p = j->packets)) {
+        size_t skip;
+
+        if (p->timestamp > j->next) {
+            int64_t deadline;
+            int16_t lost;
+
+            /* We give up on the missing audio when it's later than most
+             * packets are */
+            deadline = frames_to_usec(j, j->next) + j->min_transit + (int64_t) j->delay;
+
+            if (!force && (int64_t) now < deadline && j->n_packets <= MAX_QUEUED)
+                break;
+
+            if ((lost = (int16_t) (p->sequence - j->sequence - 1)) > 0)
+                j->stats.packets_lost += (uint64_t) lost;
+
+            conceal(j, q, (size_t) (p->timestamp - j->next));
+            j->next = p->timestamp;
+        }
+
+        PA_LLIST_REMOVE(struct packet, j->packets, p);
+        if (j->tail == p)
+            j->tail = NULL;
+        j->n_packets--;
+
+        /* Drop what overlaps with audio we already wrote or concealed */
+        skip = (size_t) PA_MIN((int64_t) (p->chunk.length / j->frame_size), j->next - p->timestamp) * j->frame_size;
+
+        if (skip < p->chunk.length) {
+            p->chunk.index += skip;
+            p->chunk.length -= skip;
+
+            write_chunk(q, &p->chunk);
+
+            j->next += (int64_t) (p->chunk.length / j->frame_size);
+            j->sequence = p->sequence;
+
+            if (j->last.memblock)
+                pa_memblock_unref(j->last.memblock);
+            j->last = p->chunk;
+            j->concealed = 0;
+        } else {
+            j->stats.packets_late++;
+            pa_memblock_unref(p->chunk.memblock);
+        }
+
+        pa_xfree(p);
+    }
+}
+
+pa_usec_t pa_rtp_jitter_get_target_delay(pa_rtp_jitter *j) {
+    pa_assert(j);
+
+    /* The packet arrives only once all of it was sent */
+    return j->delay + j->packet_usec;
+}
+
+void pa_rtp_jitter_get_stats(pa_rtp_jitter *j, pa_rtp_jitter_stats *stats) {
+    pa_assert(j);
+    pa_assert(stats);
+
+    *stats = j->stats;
+    stats->jitter = (pa_usec_t) j->jitter;
+    stats->target_delay = pa_rtp_jitter_get_target_delay(j);
+}
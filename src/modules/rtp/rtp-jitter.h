@@ -0,0 +1,74 @@
+#ifndef foortpjitterhfoo
+#define foortpjitterhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/sample.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/memblockq.h>
+#include <pulsecore/memchunk.h>
+
+/* Jitter buffer for received RTP audio.
+ *
+ * Packets are put in in the order they arrive and written to the playback
+ * memblockq in the order of their timestamps. We keep the transit times
+ * (arrival minus media time) of the recent packets, and a missing packet
+ * is waited for until it is later than the given percentile of them. After
+ * that it is considered lost and concealed by repeating the audio before
+ * it with a fade out. The same percentile is suggested as the delay the
+ * playback buffer should have. */
+
+typedef struct pa_rtp_jitter pa_rtp_jitter;
+
+typedef struct pa_rtp_jitter_stats {
+    uint64_t packets_received;
+    uint64_t packets_reordered;
+    uint64_t packets_late;      /* Duplicates, or arrived after they were concealed */
+    uint64_t packets_lost;
+    uint64_t frames_concealed;
+    pa_usec_t jitter;           /* Interarrival jitter as in RFC 3550 */
+    pa_usec_t target_delay;
+} pa_rtp_jitter_stats;
+
+#define PA_RTP_JITTER_DEFAULT_QUANTILE 0.98
+
+pa_rtp_jitter *pa_rtp_jitter_new(const pa_sample_spec *ss, pa_mempool *pool, double quantile);
+void pa_rtp_jitter_free(pa_rtp_jitter *j);
+
+/* Drops all queued packets, the next one starts over */
+void pa_rtp_jitter_reset(pa_rtp_jitter *j);
+
+/* Queues a packet that arrived at the given time (in the time base of
+ * pa_rtclock_now()). Returns -1 if it was dropped as a duplicate or because
+ * it's too late. */
+int pa_rtp_jitter_put(pa_rtp_jitter *j, uint16_t sequence, uint32_t timestamp, const pa_memchunk *chunk, pa_usec_t arrival);
+
+/* Writes everything that is due to q. A missing packet is concealed once
+ * we gave up waiting for it at time now, or right away if force is set,
+ * e.g. because q is about to run empty. */
+void pa_rtp_jitter_release(pa_rtp_jitter *j, pa_memblockq *q, pa_usec_t now, bool force);
+
+/* The delay the playback buffer needs to have on top of the sink latency so
+ * that packets arrive in time */
+pa_usec_t pa_rtp_jitter_get_target_delay(pa_rtp_jitter *j);
+
+void pa_rtp_jitter_get_stats(pa_rtp_jitter *j, pa_rtp_jitter_stats *stats);
+
+#endif
@@ -35,6 +35,10 @@
 #include <sys/uio.h>
 #endif
 
+#ifdef HAVE_NETINET_UDP_H
+#include <netinet/udp.h>
+#endif
+
 #include <pulsecore/core-error.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
@@ -54,20 +58,178 @@ pa_rtp_context* pa_rtp_context_init_send(pa_rtp_context *c, int fd, uint32_t ssr
     c->payload = (uint8_t) (payload & 127U);
     c->frame_size = frame_size;
 
-    c->recv_buf = NULL;
-    c->recv_buf_size = 0;
+    c->recv_batch = NULL;
     pa_memchunk_reset(&c->memchunk);
 
+    c->send_batch = NULL;
+#ifdef UDP_SEGMENT
+    c->use_gso = true;
+#else
+    c->use_gso = false;
+#endif
+    c->packets_sent = c->bytes_sent = c->packets_dropped = c->send_calls = 0;
+
     return c;
 }
 
 #define MAX_IOVECS 16
+#define MAX_PACKETS 64          /* Also the most segments UDP GSO takes */
+#define MAX_GSO_BYTES 65000     /* Has to fit into one IP datagram */
+
+/* The packets of one pa_rtp_send() call, which go out with as few
+ * syscalls as possible */
+struct pa_rtp_send_batch {
+    unsigned n_packets, n_iovecs;
+
+    uint32_t headers[MAX_PACKETS][3];
+    struct iovec iov[MAX_PACKETS * MAX_IOVECS];
+    pa_memblock *mb[MAX_PACKETS * MAX_IOVECS];
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[MAX_PACKETS];
+#else
+    struct msghdr msgs[MAX_PACKETS];
+#endif
+    size_t lengths[MAX_PACKETS];
+};
+
+#ifdef HAVE_SENDMMSG
+#define BATCH_MSGHDR(b, i) (&(b)->msgs[i].msg_hdr)
+#else
+#define BATCH_MSGHDR(b, i) (&(b)->msgs[i])
+#endif
+
+#ifdef UDP_SEGMENT
+/* Sends as many packets as possible, starting at the given one, with a single
+ * sendmsg() and lets the kernel split them. Returns the number of packets
+ * sent, 0 if GSO can't be used for them, or -1 on failure. */
+static int send_batch_gso(pa_rtp_context *c, struct pa_rtp_send_batch *b, unsigned first) {
+    uint8_t control[CMSG_SPACE(sizeof(uint16_t))];
+    struct msghdr m;
+    struct cmsghdr *cm;
+    size_t total = 0;
+    uint16_t segment;
+    unsigned i;
+
+    if (!c->use_gso)
+        return 0;
+
+    /* All segments have to have the same size, only the last one may be
+     * shorter */
+    for (i = first; i < b->n_packets; i++) {
+        if (total + b->lengths[i] > MAX_GSO_BYTES)
+            break;
+
+        total += b->lengths[i];
+
+        if (b->lengths[i] != b->lengths[first]) {
+            if (b->lengths[i] < b->lengths[first])
+                i++;
+            break;
+        }
+    }
+
+    if (i - first < 2)
+        return 0;
+
+    segment = (uint16_t) b->lengths[first];
+
+    pa_zero(m);
+    m.msg_iov = BATCH_MSGHDR(b, first)->msg_iov;
+    m.msg_iovlen = (size_t) (BATCH_MSGHDR(b, i - 1)->msg_iov + BATCH_MSGHDR(b, i - 1)->msg_iovlen - m.msg_iov);
+    m.msg_control = control;
+    m.msg_controllen = sizeof(control);
+
+    cm = CMSG_FIRSTHDR(&m);
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(segment));
+    memcpy(CMSG_DATA(cm), &segment, sizeof(segment));
+
+    c->send_calls++;
+
+    if (sendmsg(c->fd, &m, MSG_DONTWAIT) >= 0)
+        return (int) (i - first);
+
+    if (errno == EINVAL || errno == EIO || errno == ENOPROTOOPT || errno == EOPNOTSUPP) {
+        /* Old kernel, or a device that can't do it */
+        pa_log_info("UDP segmentation offload not available, falling back to one datagram per packet: %s", pa_cstrerror(errno));
+        c->use_gso = false;
+        return 0;
+    }
+
+    return -1;
+}
+#endif
+
+/* Returns the number of packets sent, or -1 if none could be sent */
+static int send_batch(pa_rtp_context *c, struct pa_rtp_send_batch *b) {
+    unsigned sent = 0;
+    int r = 0;
+
+    while (sent < b->n_packets) {
+#ifdef UDP_SEGMENT
+        if ((r = send_batch_gso(c, b, sent)) < 0)
+            break;
+
+        if (r > 0) {
+            sent += (unsigned) r;
+            continue;
+        }
+#endif
+
+        c->send_calls++;
+
+#ifdef HAVE_SENDMMSG
+        if ((r = sendmmsg(c->fd, b->msgs + sent, b->n_packets - sent, MSG_DONTWAIT)) <= 0)
+            break;
+
+        sent += (unsigned) r;
+#else
+        if ((r = sendmsg(c->fd, &b->msgs[sent], MSG_DONTWAIT)) < 0)
+            break;
+
+        sent++;
+#endif
+    }
+
+    return sent > 0 ? (int) sent : r < 0 ? -1 : 0;
+}
+
+static int flush_batch(pa_rtp_context *c, struct pa_rtp_send_batch *b) {
+    unsigned i;
+    int sent, ret;
+
+    if (b->n_packets <= 0)
+        return 0;
+
+    sent = send_batch(c, b);
+
+    if (sent < 0 && errno != EAGAIN && errno != EINTR) /* If the queue is full, just ignore it */
+        pa_log("sendmsg() failed: %s", pa_cstrerror(errno));
+
+    for (i = 0; i < b->n_packets; i++) {
+        if ((int) i < sent) {
+            c->packets_sent++;
+            c->bytes_sent += b->lengths[i];
+        } else
+            c->packets_dropped++;
+    }
+
+    for (i = 0; i < b->n_iovecs; i++)
+        if (b->mb[i]) {
+            pa_memblock_release(b->mb[i]);
+            pa_memblock_unref(b->mb[i]);
+        }
+
+    ret = sent < (int) b->n_packets ? -1 : 0;
+    b->n_packets = b->n_iovecs = 0;
+
+    return ret;
+}
 
 int pa_rtp_send(pa_rtp_context *c, size_t size, pa_memblockq *q) {
-    struct iovec iov[MAX_IOVECS];
-    pa_memblock* mb[MAX_IOVECS];
-    int iov_idx = 1;
-    size_t n = 0;
+    struct pa_rtp_send_batch *b;
+    int ret;
 
     pa_assert(c);
     pa_assert(size > 0);
@@ -76,79 +238,75 @@ int pa_rtp_send(pa_rtp_context *c, size_t size, pa_memblockq *q) {
     if (pa_memblockq_get_length(q) < size)
         return 0;
 
+    if (!(b = c->send_batch))
+        b = c->send_batch = pa_xnew0(struct pa_rtp_send_batch, 1);
+
     for (;;) {
+        struct msghdr *m;
+        unsigned first = b->n_iovecs;
+        size_t n = 0;
         int r;
-        pa_memchunk chunk;
 
-        pa_memchunk_reset(&chunk);
+        /* The header goes first, we fill it in once we know the length */
+        b->iov[b->n_iovecs].iov_base = b->headers[b->n_packets];
+        b->iov[b->n_iovecs].iov_len = sizeof(b->headers[b->n_packets]);
+        b->mb[b->n_iovecs] = NULL;
+        b->n_iovecs++;
 
-        if ((r = pa_memblockq_peek(q, &chunk)) >= 0) {
+        do {
+            pa_memchunk chunk;
 
-            size_t k = n + chunk.length > size ? size - n : chunk.length;
+            pa_memchunk_reset(&chunk);
 
-            pa_assert(chunk.memblock);
+            if ((r = pa_memblockq_peek(q, &chunk)) >= 0) {
 
-            iov[iov_idx].iov_base = pa_memblock_acquire_chunk(&chunk);
-            iov[iov_idx].iov_len = k;
-            mb[iov_idx] = chunk.memblock;
-            iov_idx ++;
+                size_t k = n + chunk.length > size ? size - n : chunk.length;
 
-            n += k;
-            pa_memblockq_drop(q, k);
-        }
+                pa_assert(chunk.memblock);
 
-        pa_assert(n % c->frame_size == 0);
+                b->iov[b->n_iovecs].iov_base = pa_memblock_acquire_chunk(&chunk);
+                b->iov[b->n_iovecs].iov_len = k;
+                b->mb[b->n_iovecs] = chunk.memblock;
+                b->n_iovecs++;
 
-        if (r < 0 || n >= size || iov_idx >= MAX_IOVECS) {
-            uint32_t header[3];
-            struct msghdr m;
-            ssize_t k;
-            int i;
+                n += k;
+                pa_memblockq_drop(q, k);
+            }
 
-            if (n > 0) {
-                header[0] = htonl(((uint32_t) 2 << 30) | ((uint32_t) c->payload << 16) | ((uint32_t) c->sequence));
-                header[1] = htonl(c->timestamp);
-                header[2] = htonl(c->ssrc);
+            pa_assert(n % c->frame_size == 0);
 
-                iov[0].iov_base = (void*)header;
-                iov[0].iov_len = sizeof(header);
+        } while (r >= 0 && n < size && b->n_iovecs - first < MAX_IOVECS);
 
-                m.msg_name = NULL;
-                m.msg_namelen = 0;
-                m.msg_iov = iov;
-                m.msg_iovlen = (size_t) iov_idx;
-                m.msg_control = NULL;
-                m.msg_controllen = 0;
-                m.msg_flags = 0;
+        if (n > 0) {
+            uint32_t *header = b->headers[b->n_packets];
 
-                k = sendmsg(c->fd, &m, MSG_DONTWAIT);
+            header[0] = htonl(((uint32_t) 2 << 30) | ((uint32_t) c->payload << 16) | ((uint32_t) c->sequence));
+            header[1] = htonl(c->timestamp);
+            header[2] = htonl(c->ssrc);
 
-                for (i = 1; i < iov_idx; i++) {
-                    pa_memblock_release(mb[i]);
-                    pa_memblock_unref(mb[i]);
-                }
+            m = BATCH_MSGHDR(b, b->n_packets);
+            pa_zero(*m);
+            m->msg_iov = b->iov + first;
+            m->msg_iovlen = b->n_iovecs - first;
 
-                c->sequence++;
-            } else
-                k = 0;
+            b->lengths[b->n_packets] = sizeof(b->headers[b->n_packets]) + n;
+            b->n_packets++;
 
-            c->timestamp += (unsigned) (n/c->frame_size);
+            c->sequence++;
+        } else
+            /* Nothing to send after all, drop the header again */
+            b->n_iovecs = first;
 
-            if (k < 0) {
-                if (errno != EAGAIN && errno != EINTR) /* If the queue is full, just ignore it */
-                    pa_log("sendmsg() failed: %s", pa_cstrerror(errno));
-                return -1;
-            }
+        c->timestamp += (unsigned) (n/c->frame_size);
 
-            if (r < 0 || pa_memblockq_get_length(q) < size)
-                break;
+        if (b->n_packets >= MAX_PACKETS && (ret = flush_batch(c, b)) < 0)
+            return ret;
 
-            n = 0;
-            iov_idx = 1;
-        }
+        if (r < 0 || pa_memblockq_get_length(q) < size)
+            break;
     }
 
-    return 0;
+    return flush_batch(c, b);
 }
 
 pa_rtp_context* pa_rtp_context_init_recv(pa_rtp_context *c, int fd, size_t frame_size) {
@@ -157,97 +315,142 @@ pa_rtp_context* pa_rtp_context_init_recv(pa_rtp_context *c, int fd, size_t frame
     c->fd = fd;
     c->frame_size = frame_size;
 
-    c->recv_buf_size = 2000;
-    c->recv_buf = pa_xmalloc(c->recv_buf_size);
+    c->recv_batch = NULL;
     pa_memchunk_reset(&c->memchunk);
+
+    c->send_batch = NULL;
+
     return c;
 }
 
-int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct timeval *tstamp) {
-    int size;
-    size_t audio_length;
-    size_t metadata_length;
-    struct msghdr m;
-    struct cmsghdr *cm;
-    struct iovec iov;
-    uint32_t header;
-    unsigned cc;
-    ssize_t r;
-    uint8_t aux[1024];
-    bool found_tstamp = false;
+#ifdef HAVE_RECVMMSG
+#define RECV_BATCH 32
+#else
+#define RECV_BATCH 1
+#endif
 
-    pa_assert(c);
-    pa_assert(chunk);
+#define RECV_SLOT_SIZE 2048
+#define RECV_SLOT_SIZE_MAX 65536
+#define RECV_AUX_SIZE 128
+
+/* The packets we read with one recvmmsg() call, pa_rtp_recv() hands them
+ * out one by one */
+struct pa_rtp_recv_batch {
+    unsigned n_received, next;
+
+    /* slot_size is what the next batch needs, buf_slot_size what buf was
+     * allocated for */
+    size_t slot_size, buf_slot_size;
+    uint8_t *buf;
+
+    struct iovec iov[RECV_BATCH];
+    uint8_t aux[RECV_BATCH][RECV_AUX_SIZE];
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr msgs[RECV_BATCH];
+#else
+    struct msghdr msgs[RECV_BATCH];
+    size_t lengths[RECV_BATCH];
+#endif
+};
+
+#ifdef HAVE_RECVMMSG
+#define RECV_MSGHDR(b, i) (&(b)->msgs[i].msg_hdr)
+#define RECV_LENGTH(b, i) ((size_t) (b)->msgs[i].msg_len)
+#else
+#define RECV_MSGHDR(b, i) (&(b)->msgs[i])
+#define RECV_LENGTH(b, i) ((b)->lengths[i])
+#endif
 
-    pa_memchunk_reset(chunk);
+static int recv_batch(pa_rtp_context *c, struct pa_rtp_recv_batch *b) {
+    int size;
+    unsigned i;
+    int r;
+
+    b->n_received = b->next = 0;
 
     if (ioctl(c->fd, FIONREAD, &size) < 0) {
         pa_log_warn("FIONREAD failed: %s", pa_cstrerror(errno));
-        goto fail;
+        return -1;
     }
 
-    if (size <= 0) {
-        /* size can be 0 due to any of the following reasons:
-         *
-         * 1. Somebody sent us a perfectly valid zero-length UDP packet.
-         * 2. Somebody sent us a UDP packet with a bad CRC.
-         *
-         * It is unknown whether size can actually be less than zero.
-         *
-         * In the first case, the packet has to be read out, otherwise the
-         * kernel will tell us again and again about it, thus preventing
-         * reception of any further packets. So let's just read it out
-         * now and discard it later, when comparing the number of bytes
-         * received (0) with the number of bytes wanted (1, see below).
-         *
-         * In the second case, recvmsg() will fail, thus allowing us to
-         * return the error.
-         *
-         * Just to avoid passing zero-sized memchunks and NULL pointers to
-         * recvmsg(), let's force allocation of at least one byte by setting
-         * size to 1.
-         */
-        size = 1;
+    /* size can be 0 if somebody sent us a perfectly valid zero-length UDP
+     * packet, or one with a bad CRC. In the first case the packet has to
+     * be read out, otherwise the kernel will tell us again and again about
+     * it, so we read it and drop it later because it's too short. In the
+     * second case recvmmsg() fails, which allows us to return the error. */
+
+    /* Only the size of the first packet is known, larger packets later in
+     * the batch are truncated and dropped, see below */
+    while (b->slot_size < (size_t) size)
+        b->slot_size *= 2;
+
+    if (b->slot_size != b->buf_slot_size) {
+        pa_xfree(b->buf);
+        b->buf = pa_xnew(uint8_t, b->slot_size * RECV_BATCH);
+        b->buf_slot_size = b->slot_size;
     }
 
-    if (c->recv_buf_size < (size_t) size) {
-        do
-            c->recv_buf_size *= 2;
-        while (c->recv_buf_size < (size_t) size);
+    for (i = 0; i < RECV_BATCH; i++) {
+        struct msghdr *m = RECV_MSGHDR(b, i);
 
-        c->recv_buf = pa_xrealloc(c->recv_buf, c->recv_buf_size);
+        b->iov[i].iov_base = b->buf + i * b->slot_size;
+        b->iov[i].iov_len = b->slot_size;
+
+        pa_zero(*m);
+        m->msg_iov = &b->iov[i];
+        m->msg_iovlen = 1;
+        m->msg_control = b->aux[i];
+        m->msg_controllen = sizeof(b->aux[i]);
     }
 
-    pa_assert(c->recv_buf_size >= (size_t) size);
+#ifdef HAVE_RECVMMSG
+    r = recvmmsg(c->fd, b->msgs, RECV_BATCH, MSG_DONTWAIT, NULL);
+#else
+    {
+        ssize_t l;
+
+        if ((l = recvmsg(c->fd, &b->msgs[0], MSG_DONTWAIT)) >= 0) {
+            b->lengths[0] = (size_t) l;
+            r = 1;
+        } else
+            r = -1;
+    }
+#endif
 
-    iov.iov_base = c->recv_buf;
-    iov.iov_len = (size_t) size;
+    if (r <= 0) {
+        if (r < 0 && errno != EAGAIN && errno != EINTR)
+            pa_log_warn("recvmsg() failed: %s", pa_cstrerror(errno));
 
-    m.msg_name = NULL;
-    m.msg_namelen = 0;
-    m.msg_iov = &iov;
-    m.msg_iovlen = 1;
-    m.msg_control = aux;
-    m.msg_controllen = sizeof(aux);
-    m.msg_flags = 0;
+        return -1;
+    }
 
-    r = recvmsg(c->fd, &m, 0);
+    b->n_received = (unsigned) r;
 
-    if (r != size) {
-        if (r < 0 && errno != EAGAIN && errno != EINTR)
-            pa_log_warn("recvmsg() failed: %s", r < 0 ? pa_cstrerror(errno) : "size mismatch");
+    return 0;
+}
 
-        goto fail;
+static int parse_packet(pa_rtp_context *c, struct msghdr *m, size_t size, pa_memchunk *chunk, pa_mempool *pool, struct timeval *tstamp) {
+    size_t audio_length;
+    size_t metadata_length;
+    struct cmsghdr *cm;
+    uint8_t *data = m->msg_iov[0].iov_base;
+    uint32_t header;
+    unsigned cc;
+    bool found_tstamp = false;
+
+    if (m->msg_flags & MSG_TRUNC) {
+        pa_log_warn("RTP packet too large.");
+        return -1;
     }
 
     if (size < 12) {
         pa_log_warn("RTP packet too short.");
-        goto fail;
+        return -1;
     }
 
-    memcpy(&header, iov.iov_base, sizeof(uint32_t));
-    memcpy(&c->timestamp, (uint8_t*) iov.iov_base + 4, sizeof(uint32_t));
-    memcpy(&c->ssrc, (uint8_t*) iov.iov_base + 8, sizeof(uint32_t));
+    memcpy(&header, data, sizeof(uint32_t));
+    memcpy(&c->timestamp, data + 4, sizeof(uint32_t));
+    memcpy(&c->ssrc, data + 8, sizeof(uint32_t));
 
     header = ntohl(header);
     c->timestamp = ntohl(c->timestamp);
@@ -255,17 +458,17 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct
 
     if ((header >> 30) != 2) {
         pa_log_warn("Unsupported RTP version.");
-        goto fail;
+        return -1;
     }
 
     if ((header >> 29) & 1) {
         pa_log_warn("RTP padding not supported.");
-        goto fail;
+        return -1;
     }
 
     if ((header >> 28) & 1) {
         pa_log_warn("RTP header extensions not supported.");
-        goto fail;
+        return -1;
     }
 
     cc = (header >> 24) & 0xF;
@@ -274,16 +477,16 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct
 
     metadata_length = 12 + cc * 4;
 
-    if (metadata_length > (unsigned) size) {
+    if (metadata_length > size) {
         pa_log_warn("RTP packet too short. (CSRC)");
-        goto fail;
+        return -1;
     }
 
     audio_length = size - metadata_length;
 
     if (audio_length % c->frame_size != 0) {
         pa_log_warn("Bad RTP packet size.");
-        goto fail;
+        return -1;
     }
 
     if (c->memchunk.length < (unsigned) audio_length) {
@@ -299,7 +502,7 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct
         c->memchunk.length = pa_memblock_get_length(c->memchunk.memblock);
     }
 
-    memcpy(pa_memblock_acquire_chunk(&c->memchunk), c->recv_buf + metadata_length, audio_length);
+    memcpy(pa_memblock_acquire_chunk(&c->memchunk), data + metadata_length, audio_length);
     pa_memblock_release(c->memchunk.memblock);
 
     chunk->memblock = pa_memblock_ref(c->memchunk.memblock);
@@ -314,7 +517,7 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct
         pa_memchunk_reset(&c->memchunk);
     }
 
-    for (cm = CMSG_FIRSTHDR(&m); cm; cm = CMSG_NXTHDR(&m, cm))
+    for (cm = CMSG_FIRSTHDR(m); cm; cm = CMSG_NXTHDR(m, cm))
         if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMP) {
             memcpy(tstamp, CMSG_DATA(cm), sizeof(struct timeval));
             found_tstamp = true;
@@ -327,14 +530,46 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct
     }
 
     return 0;
+}
+
+int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct timeval *tstamp) {
+    struct pa_rtp_recv_batch *b;
+
+    pa_assert(c);
+    pa_assert(chunk);
+
+    pa_memchunk_reset(chunk);
+
+    if (!(b = c->recv_batch)) {
+        b = c->recv_batch = pa_xnew0(struct pa_rtp_recv_batch, 1);
+        b->slot_size = RECV_SLOT_SIZE;
+    }
+
+    if (b->next >= b->n_received && recv_batch(c, b) < 0)
+        return -1;
 
-fail:
-    if (chunk->memblock)
-        pa_memblock_unref(chunk->memblock);
+    /* Skip over anything we can't use in this batch, but don't read
+     * another one */
+    while (b->next < b->n_received) {
+        unsigned i = b->next++;
+
+        if (parse_packet(c, RECV_MSGHDR(b, i), RECV_LENGTH(b, i), chunk, pool, tstamp) >= 0)
+            return 0;
+
+        /* Takes effect with the next batch, recv_batch() reallocates buf */
+        if (RECV_MSGHDR(b, i)->msg_flags & MSG_TRUNC)
+            b->slot_size = PA_MIN(b->slot_size * 2, (size_t) RECV_SLOT_SIZE_MAX);
+    }
 
     return -1;
 }
 
+bool pa_rtp_recv_pending(pa_rtp_context *c) {
+    pa_assert(c);
+
+    return c->recv_batch && c->recv_batch->next < c->recv_batch->n_received;
+}
+
 uint8_t pa_rtp_payload_from_sample_spec(const pa_sample_spec *ss) {
     pa_assert(ss);
 
@@ -416,9 +651,14 @@ void pa_rtp_context_destroy(pa_rtp_context *c) {
     if (c->memchunk.memblock)
         pa_memblock_unref(c->memchunk.memblock);
 
-    pa_xfree(c->recv_buf);
-    c->recv_buf = NULL;
-    c->recv_buf_size = 0;
+    if (c->recv_batch) {
+        pa_xfree(c->recv_batch->buf);
+        pa_xfree(c->recv_batch);
+        c->recv_batch = NULL;
+    }
+
+    pa_xfree(c->send_batch);
+    c->send_batch = NULL;
 }
 
 const char* pa_rtp_format_to_string(pa_sample_format_t f) {
@@ -23,6 +23,7 @@
 #include <inttypes.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <stdbool.h>
 #include <pulsecore/memblockq.h>
 #include <pulsecore/memchunk.h>
 
@@ -34,20 +35,40 @@ typedef struct pa_rtp_context {
     uint8_t payload;
     size_t frame_size;
 
-    uint8_t *recv_buf;
-    size_t recv_buf_size;
+    /* Receiving side only */
+    struct pa_rtp_recv_batch *recv_batch;
     pa_memchunk memchunk;
+
+    /* Sending side only */
+    struct pa_rtp_send_batch *send_batch;
+    bool use_gso;
+
+    uint64_t packets_sent;
+    uint64_t bytes_sent;
+    uint64_t packets_dropped;
+    uint64_t send_calls;
 } pa_rtp_context;
 
 pa_rtp_context* pa_rtp_context_init_send(pa_rtp_context *c, int fd, uint32_t ssrc, uint8_t payload, size_t frame_size);
 
 /* If the memblockq doesn't have a silence memchunk set, then the caller must
- * guarantee that the current read index doesn't point to a hole. */
+ * guarantee that the current read index doesn't point to a hole.
+ *
+ * All packets that are available are sent in one go, with sendmmsg() or UDP
+ * segmentation offload where available. */
 int pa_rtp_send(pa_rtp_context *c, size_t size, pa_memblockq *q);
 
 pa_rtp_context* pa_rtp_context_init_recv(pa_rtp_context *c, int fd, size_t frame_size);
+
+/* Returns the next packet. Packets are read from the socket in batches with
+ * recvmmsg() where available, and a new batch is only read once all packets
+ * of the previous one were returned. Invalid packets are skipped. */
 int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct timeval *tstamp);
 
+/* Whether packets of the last batch are left, i.e. whether pa_rtp_recv()
+ * would return them without reading from the socket */
+bool pa_rtp_recv_pending(pa_rtp_context *c);
+
 void pa_rtp_context_destroy(pa_rtp_context *c);
 
 pa_sample_spec* pa_rtp_sample_spec_fixup(pa_sample_spec *ss);
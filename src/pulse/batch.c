@@ -0,0 +1,440 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+#include <pulse/fork-detect.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/pstream-util.h>
+
+#include "internal.h"
+#include "batch.h"
+
+struct pa_batch {
+    pa_context *context;
+
+    /* The serialized commands, each one as command, length and the
+     * command's arguments as arbitrary data */
+    pa_tagstruct *entries;
+    unsigned n_entries;
+};
+
+pa_batch* pa_batch_new(pa_context *c) {
+    pa_batch *b;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    b = pa_xnew(pa_batch, 1);
+    b->context = pa_context_ref(c);
+    b->entries = pa_tagstruct_new();
+    b->n_entries = 0;
+
+    return b;
+}
+
+void pa_batch_free(pa_batch *b) {
+    pa_assert(b);
+
+    pa_tagstruct_free(b->entries);
+    pa_context_unref(b->context);
+    pa_xfree(b);
+}
+
+unsigned pa_batch_size(pa_batch *b) {
+    pa_assert(b);
+
+    return b->n_entries;
+}
+
+static int add_entry(pa_batch *b, uint32_t command, pa_tagstruct *args) {
+    const uint8_t *data;
+    size_t length;
+
+    if (b->n_entries >= PA_BATCH_MAX_COMMANDS) {
+        pa_tagstruct_free(args);
+        return -pa_context_set_error(b->context, PA_ERR_TOOLARGE);
+    }
+
+    pa_assert_se(data = pa_tagstruct_data(args, &length));
+    pa_assert(length > 0);
+
+    pa_tagstruct_putu32(b->entries, command);
+    pa_tagstruct_putu32(b->entries, (uint32_t) length);
+    pa_tagstruct_put_arbitrary(b->entries, data, length);
+    pa_tagstruct_free(args);
+
+    b->n_entries++;
+    return 0;
+}
+
+static int add_device_volume(pa_batch *b, uint32_t command, uint32_t idx, const char *name, const pa_cvolume *volume) {
+    pa_tagstruct *t = pa_tagstruct_new();
+
+    pa_tagstruct_putu32(t, idx);
+    pa_tagstruct_puts(t, name);
+    pa_tagstruct_put_cvolume(t, volume);
+    return add_entry(b, command, t);
+}
+
+static int add_device_mute(pa_batch *b, uint32_t command, uint32_t idx, const char *name, int mute) {
+    pa_tagstruct *t = pa_tagstruct_new();
+
+    pa_tagstruct_putu32(t, idx);
+    pa_tagstruct_puts(t, name);
+    pa_tagstruct_put_boolean(t, mute);
+    return add_entry(b, command, t);
+}
+
+static int add_object_string(pa_batch *b, uint32_t command, uint32_t idx, const char *name, const char *value) {
+    pa_tagstruct *t = pa_tagstruct_new();
+
+    pa_tagstruct_putu32(t, idx);
+    pa_tagstruct_puts(t, name);
+    pa_tagstruct_puts(t, value);
+    return add_entry(b, command, t);
+}
+
+static int add_default(pa_batch *b, uint32_t command, const char *name) {
+    pa_tagstruct *t = pa_tagstruct_new();
+
+    pa_tagstruct_puts(t, name);
+    return add_entry(b, command, t);
+}
+
+static int add_stream_volume(pa_batch *b, uint32_t command, uint32_t idx, const pa_cvolume *volume) {
+    pa_tagstruct *t = pa_tagstruct_new();
+
+    pa_tagstruct_putu32(t, idx);
+    pa_tagstruct_put_cvolume(t, volume);
+    return add_entry(b, command, t);
+}
+
+static int add_stream_mute(pa_batch *b, uint32_t command, uint32_t idx, int mute) {
+    pa_tagstruct *t = pa_tagstruct_new();
+
+    pa_tagstruct_putu32(t, idx);
+    pa_tagstruct_put_boolean(t, mute);
+    return add_entry(b, command, t);
+}
+
+static int add_move(pa_batch *b, uint32_t command, uint32_t idx, uint32_t device_idx, const char *device_name) {
+    pa_tagstruct *t = pa_tagstruct_new();
+
+    pa_tagstruct_putu32(t, idx);
+    pa_tagstruct_putu32(t, device_idx);
+    pa_tagstruct_puts(t, device_name);
+    return add_entry(b, command, t);
+}
+
+int pa_batch_set_sink_volume_by_index(pa_batch *b, uint32_t idx, const pa_cvolume *volume) {
+    pa_assert(b);
+    pa_assert(volume);
+
+    PA_CHECK_VALIDITY(b->context, pa_cvolume_valid(volume), PA_ERR_INVALID);
+
+    return add_device_volume(b, PA_COMMAND_SET_SINK_VOLUME, idx, NULL, volume);
+}
+
+int pa_batch_set_sink_volume_by_name(pa_batch *b, const char *name, const pa_cvolume *volume) {
+    pa_assert(b);
+    pa_assert(volume);
+
+    PA_CHECK_VALIDITY(b->context, pa_cvolume_valid(volume), PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(b->context, name && *name, PA_ERR_INVALID);
+
+    return add_device_volume(b, PA_COMMAND_SET_SINK_VOLUME, PA_INVALID_INDEX, name, volume);
+}
+
+int pa_batch_set_sink_mute_by_index(pa_batch *b, uint32_t idx, int mute) {
+    pa_assert(b);
+
+    return add_device_mute(b, PA_COMMAND_SET_SINK_MUTE, idx, NULL, mute);
+}
+
+int pa_batch_set_sink_mute_by_name(pa_batch *b, const char *name, int mute) {
+    pa_assert(b);
+
+    PA_CHECK_VALIDITY(b->context, name && *name, PA_ERR_INVALID);
+
+    return add_device_mute(b, PA_COMMAND_SET_SINK_MUTE, PA_INVALID_INDEX, name, mute);
+}
+
+int pa_batch_set_sink_port_by_index(pa_batch *b, uint32_t idx, const char *port) {
+    pa_assert(b);
+
+    PA_CHECK_VALIDITY(b->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(b->context, port && *port, PA_ERR_INVALID);
+
+    return add_object_string(b, PA_COMMAND_SET_SINK_PORT, idx, NULL, port);
+}
+
+int pa_batch_set_sink_port_by_name(pa_batch *b, const char *name, const char *port) {
+    pa_assert(b);
+
+    PA_CHECK_VALIDITY(b->context, name && *name, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(b->context, port && *port, PA_ERR_INVALID);
+
+    return add_object_string(b, PA_COMMAND_SET_SINK_PORT, PA_INVALID_INDEX, name, port);
+}
+
+int pa_batch_set_default_sink(pa_batch *b, const char *name) {
+    pa_assert(b);
+
+    return add_default(b, PA_COMMAND_SET_DEFAULT_SINK, name);
+}
+
+int pa_batch_set_source_volume_by_index(pa_batch *b, uint32_t idx, const pa_cvolume *volume) {
+    pa_assert(b);
+    pa_assert(volume);
+
+    PA_CHECK_VALIDITY(b->context, pa_cvolume_valid(volume), PA_ERR_INVALID);
+
+    return add_device_volume(b, PA_COMMAND_SET_SOURCE_VOLUME, idx, NULL, volume);
+}
+
+int pa_batch_set_source_volume_by_name(pa_batch *b, const char *name, const pa_cvolume *volume) {
+    pa_assert(b);
+    pa_assert(volume);
+
+    PA_CHECK_VALIDITY(b->context, pa_cvolume_valid(volume), PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(b->context, name && *name, PA_ERR_INVALID);
+
+    return add_device_volume(b, PA_COMMAND_SET_SOURCE_VOLUME, PA_INVALID_INDEX, name, volume);
+}
+
+int pa_batch_set_source_mute_by_index(pa_batch *b, uint32_t idx, int mute) {
+    pa_assert(b);
+
+    return add_device_mute(b, PA_COMMAND_SET_SOURCE_MUTE, idx, NULL, mute);
+}
+
+int pa_batch_set_source_mute_by_name(pa_batch *b, const char *name, int mute) {
+    pa_assert(b);
+
+    PA_CHECK_VALIDITY(b->context, name && *name, PA_ERR_INVALID);
+
+    return add_device_mute(b, PA_COMMAND_SET_SOURCE_MUTE, PA_INVALID_INDEX, name, mute);
+}
+
+int pa_batch_set_source_port_by_index(pa_batch *b, uint32_t idx, const char *port) {
+    pa_assert(b);
+
+    PA_CHECK_VALIDITY(b->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(b->context, port && *port, PA_ERR_INVALID);
+
+    return add_object_string(b, PA_COMMAND_SET_SOURCE_PORT, idx, NULL, port);
+}
+
+int pa_batch_set_source_port_by_name(pa_batch *b, const char *name, const char *port) {
+    pa_assert(b);
+
+    PA_CHECK_VALIDITY(b->context, name && *name, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(b->context, port && *port, PA_ERR_INVALID);
+
+    return add_object_string(b, PA_COMMAND_SET_SOURCE_PORT, PA_INVALID_INDEX, name, port);
+}
+
+int pa_batch_set_default_source(pa_batch *b, const char *name) {
+    pa_assert(b);
+
+    return add_default(b, PA_COMMAND_SET_DEFAULT_SOURCE, name);
+}
+
+int pa_batch_set_sink_input_volume(pa_batch *b, uint32_t idx, const pa_cvolume *volume) {
+    pa_assert(b);
+    pa_assert(volume);
+
+    PA_CHECK_VALIDITY(b->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(b->context, pa_cvolume_valid(volume), PA_ERR_INVALID);
+
+    return add_stream_volume(b, PA_COMMAND_SET_SINK_INPUT_VOLUME, idx, volume);
+}
+
+int pa_batch_set_sink_input_mute(pa_batch *b, uint32_t idx, int mute) {
+    pa_assert(b);
+
+    PA_CHECK_VALIDITY(b->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+
+    return add_stream_mute(b, PA_COMMAND_SET_SINK_INPUT_MUTE, idx, mute);
+}
+
+int pa_batch_move_sink_input_by_index(pa_batch *b, uint32_t idx, uint32_t sink_idx) {
+    pa_assert(b);
+
+    PA_CHECK_VALIDITY(b->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(b->context, sink_idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+
+    return add_move(b, PA_COMMAND_MOVE_SINK_INPUT, idx, sink_idx, NULL);
+}
+
+int pa_batch_move_sink_input_by_name(pa_batch *b, uint32_t idx, const char *sink_name) {
+    pa_assert(b);
+
+    PA_CHECK_VALIDITY(b->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(b->context, sink_name && *sink_name, PA_ERR_INVALID);
+
+    return add_move(b, PA_COMMAND_MOVE_SINK_INPUT, idx, PA_INVALID_INDEX, sink_name);
+}
+
+int pa_batch_set_source_output_volume(pa_batch *b, uint32_t idx, const pa_cvolume *volume) {
+    pa_assert(b);
+    pa_assert(volume);
+
+    PA_CHECK_VALIDITY(b->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(b->context, pa_cvolume_valid(volume), PA_ERR_INVALID);
+
+    return add_stream_volume(b, PA_COMMAND_SET_SOURCE_OUTPUT_VOLUME, idx, volume);
+}
+
+int pa_batch_set_source_output_mute(pa_batch *b, uint32_t idx, int mute) {
+    pa_assert(b);
+
+    PA_CHECK_VALIDITY(b->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+
+    return add_stream_mute(b, PA_COMMAND_SET_SOURCE_OUTPUT_MUTE, idx, mute);
+}
+
+int pa_batch_move_source_output_by_index(pa_batch *b, uint32_t idx, uint32_t source_idx) {
+    pa_assert(b);
+
+    PA_CHECK_VALIDITY(b->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(b->context, source_idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+
+    return add_move(b, PA_COMMAND_MOVE_SOURCE_OUTPUT, idx, source_idx, NULL);
+}
+
+int pa_batch_move_source_output_by_name(pa_batch *b, uint32_t idx, const char *source_name) {
+    pa_assert(b);
+
+    PA_CHECK_VALIDITY(b->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(b->context, source_name && *source_name, PA_ERR_INVALID);
+
+    return add_move(b, PA_COMMAND_MOVE_SOURCE_OUTPUT, idx, PA_INVALID_INDEX, source_name);
+}
+
+int pa_batch_set_card_profile_by_index(pa_batch *b, uint32_t idx, const char *profile) {
+    pa_assert(b);
+
+    PA_CHECK_VALIDITY(b->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(b->context, profile && *profile, PA_ERR_INVALID);
+
+    return add_object_string(b, PA_COMMAND_SET_CARD_PROFILE, idx, NULL, profile);
+}
+
+int pa_batch_set_card_profile_by_name(pa_batch *b, const char *name, const char *profile) {
+    pa_assert(b);
+
+    PA_CHECK_VALIDITY(b->context, name && *name, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(b->context, profile && *profile, PA_ERR_INVALID);
+
+    return add_object_string(b, PA_COMMAND_SET_CARD_PROFILE, PA_INVALID_INDEX, name, profile);
+}
+
+static void batch_reply_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_operation *o = userdata;
+    int success = 1;
+    int *errors = NULL;
+    uint32_t n = 0, i;
+
+    pa_assert(pd);
+    pa_assert(o);
+    pa_assert(PA_REFCNT_VALUE(o) >= 1);
+
+    if (!o->context)
+        goto finish;
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(o->context, command, t, false) < 0)
+            goto finish;
+
+        success = 0;
+    } else {
+        if (pa_tagstruct_getu32(t, &n) < 0 ||
+            n != PA_PTR_TO_UINT(o->private)) {
+            pa_context_fail(o->context, PA_ERR_PROTOCOL);
+            goto finish;
+        }
+
+        errors = pa_xnew(int, n);
+
+        for (i = 0; i < n; i++) {
+            uint32_t error;
+
+            if (pa_tagstruct_getu32(t, &error) < 0) {
+                pa_context_fail(o->context, PA_ERR_PROTOCOL);
+                goto finish;
+            }
+
+            errors[i] = (int) error;
+
+            if (error != PA_OK)
+                success = 0;
+        }
+
+        if (!pa_tagstruct_eof(t)) {
+            pa_context_fail(o->context, PA_ERR_PROTOCOL);
+            goto finish;
+        }
+    }
+
+    if (o->callback) {
+        pa_batch_cb_t cb = (pa_batch_cb_t) o->callback;
+        cb(o->context, success, errors, n, o->userdata);
+    }
+
+finish:
+    pa_xfree(errors);
+    pa_operation_done(o);
+    pa_operation_unref(o);
+}
+
+pa_operation* pa_batch_send(pa_batch *b, pa_batch_cb_t cb, void *userdata) {
+    pa_context *c;
+    pa_operation *o;
+    pa_tagstruct *t;
+    uint32_t tag;
+
+    pa_assert(b);
+
+    c = b->context;
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->has_batch, PA_ERR_NOTSUPPORTED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, b->n_entries > 0, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, b->n_entries <= PA_BATCH_MAX_COMMANDS, PA_ERR_TOOLARGE);
+
+    o = pa_operation_new(c, NULL, (pa_operation_cb_t) cb, userdata);
+    o->private = PA_UINT_TO_PTR(b->n_entries);
+
+    t = pa_tagstruct_command(c, PA_COMMAND_BATCH, &tag);
+    pa_tagstruct_putu32(t, b->n_entries);
+    pa_tagstruct_append(t, b->entries);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, batch_reply_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
+
+    pa_tagstruct_free(b->entries);
+    b->entries = pa_tagstruct_new();
+    b->n_entries = 0;
+
+    return o;
+}
@@ -0,0 +1,161 @@
+#ifndef foobatchhfoo
+#define foobatchhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/context.h>
+#include <pulse/volume.h>
+#include <pulse/cdecl.h>
+#include <pulse/version.h>
+
+/** \page batch Batched Commands
+ *
+ * \section overv_sec Overview
+ *
+ * Applications that change many volumes or stream routings at once can
+ * collect these changes in a \ref pa_batch object and send them to the
+ * server in a single request with pa_batch_send(). The server executes
+ * all commands of a batch back to back in one main loop iteration,
+ * without interleaving requests of other clients, and answers with a
+ * single reply that carries one error code per command.
+ *
+ * A batch is not a transaction: if one command fails, the commands
+ * before and after it are still executed. If any command of the batch
+ * is malformed, none is executed.
+ *
+ * The functions that add commands to a batch mirror the corresponding
+ * functions of the \ref introspect API. They return 0 on success or a
+ * negative error code if the arguments are invalid or the batch is full
+ * already, in which case the command is not added.
+ *
+ * Batches require a server that supports them, pa_batch_send() fails
+ * with PA_ERR_NOTSUPPORTED otherwise.
+ */
+
+/** \file
+ * Collect several commands and send them to the server at once.
+ *
+ * See also \subpage batch
+ */
+
+PA_C_DECL_BEGIN
+
+/** Maximum number of commands in a batch. Adding more fails with
+ * PA_ERR_TOOLARGE. \since 11.0 */
+#define PA_BATCH_MAX_COMMANDS 4096U
+
+/** An opaque batch of commands. \since 11.0 */
+typedef struct pa_batch pa_batch;
+
+/** Callback prototype for pa_batch_send(). \a success is non-zero if
+ * all commands succeeded. \a errors holds one error code per command
+ * (0 on success) in the order the commands were added; it is NULL and
+ * \a n is 0 if the batch was rejected as a whole. \since 11.0 */
+typedef void (*pa_batch_cb_t)(pa_context *c, int success, const int *errors, unsigned n, void *userdata);
+
+/** Create a new, empty batch for the given context. \since 11.0 */
+pa_batch* pa_batch_new(pa_context *c);
+
+/** Free a batch. Batches that have already been sent need not be kept
+ * around until the reply arrives. \since 11.0 */
+void pa_batch_free(pa_batch *b);
+
+/** Return the number of commands currently in the batch. \since 11.0 */
+unsigned pa_batch_size(pa_batch *b);
+
+/** Send all commands collected so far as one request. The batch is
+ * empty afterwards and may be reused. \since 11.0 */
+pa_operation* pa_batch_send(pa_batch *b, pa_batch_cb_t cb, void *userdata);
+
+/** Add pa_context_set_sink_volume_by_index() to the batch. \since 11.0 */
+int pa_batch_set_sink_volume_by_index(pa_batch *b, uint32_t idx, const pa_cvolume *volume);
+
+/** Add pa_context_set_sink_volume_by_name() to the batch. \since 11.0 */
+int pa_batch_set_sink_volume_by_name(pa_batch *b, const char *name, const pa_cvolume *volume);
+
+/** Add pa_context_set_sink_mute_by_index() to the batch. \since 11.0 */
+int pa_batch_set_sink_mute_by_index(pa_batch *b, uint32_t idx, int mute);
+
+/** Add pa_context_set_sink_mute_by_name() to the batch. \since 11.0 */
+int pa_batch_set_sink_mute_by_name(pa_batch *b, const char *name, int mute);
+
+/** Add pa_context_set_sink_port_by_index() to the batch. \since 11.0 */
+int pa_batch_set_sink_port_by_index(pa_batch *b, uint32_t idx, const char *port);
+
+/** Add pa_context_set_sink_port_by_name() to the batch. \since 11.0 */
+int pa_batch_set_sink_port_by_name(pa_batch *b, const char *name, const char *port);
+
+/** Add pa_context_set_default_sink() to the batch. \since 11.0 */
+int pa_batch_set_default_sink(pa_batch *b, const char *name);
+
+/** Add pa_context_set_source_volume_by_index() to the batch. \since 11.0 */
+int pa_batch_set_source_volume_by_index(pa_batch *b, uint32_t idx, const pa_cvolume *volume);
+
+/** Add pa_context_set_source_volume_by_name() to the batch. \since 11.0 */
+int pa_batch_set_source_volume_by_name(pa_batch *b, const char *name, const pa_cvolume *volume);
+
+/** Add pa_context_set_source_mute_by_index() to the batch. \since 11.0 */
+int pa_batch_set_source_mute_by_index(pa_batch *b, uint32_t idx, int mute);
+
+/** Add pa_context_set_source_mute_by_name() to the batch. \since 11.0 */
+int pa_batch_set_source_mute_by_name(pa_batch *b, const char *name, int mute);
+
+/** Add pa_context_set_source_port_by_index() to the batch. \since 11.0 */
+int pa_batch_set_source_port_by_index(pa_batch *b, uint32_t idx, const char *port);
+
+/** Add pa_context_set_source_port_by_name() to the batch. \since 11.0 */
+int pa_batch_set_source_port_by_name(pa_batch *b, const char *name, const char *port);
+
+/** Add pa_context_set_default_source() to the batch. \since 11.0 */
+int pa_batch_set_default_source(pa_batch *b, const char *name);
+
+/** Add pa_context_set_sink_input_volume() to the batch. \since 11.0 */
+int pa_batch_set_sink_input_volume(pa_batch *b, uint32_t idx, const pa_cvolume *volume);
+
+/** Add pa_context_set_sink_input_mute() to the batch. \since 11.0 */
+int pa_batch_set_sink_input_mute(pa_batch *b, uint32_t idx, int mute);
+
+/** Add pa_context_move_sink_input_by_index() to the batch. \since 11.0 */
+int pa_batch_move_sink_input_by_index(pa_batch *b, uint32_t idx, uint32_t sink_idx);
+
+/** Add pa_context_move_sink_input_by_name() to the batch. \since 11.0 */
+int pa_batch_move_sink_input_by_name(pa_batch *b, uint32_t idx, const char *sink_name);
+
+/** Add pa_context_set_source_output_volume() to the batch. \since 11.0 */
+int pa_batch_set_source_output_volume(pa_batch *b, uint32_t idx, const pa_cvolume *volume);
+
+/** Add pa_context_set_source_output_mute() to the batch. \since 11.0 */
+int pa_batch_set_source_output_mute(pa_batch *b, uint32_t idx, int mute);
+
+/** Add pa_context_move_source_output_by_index() to the batch. \since 11.0 */
+int pa_batch_move_source_output_by_index(pa_batch *b, uint32_t idx, uint32_t source_idx);
+
+/** Add pa_context_move_source_output_by_name() to the batch. \since 11.0 */
+int pa_batch_move_source_output_by_name(pa_batch *b, uint32_t idx, const char *source_name);
+
+/** Add pa_context_set_card_profile_by_index() to the batch. \since 11.0 */
+int pa_batch_set_card_profile_by_index(pa_batch *b, uint32_t idx, const char *profile);
+
+/** Add pa_context_set_card_profile_by_name() to the batch. \since 11.0 */
+int pa_batch_set_card_profile_by_name(pa_batch *b, const char *name, const char *profile);
+
+PA_C_DECL_END
+
+#endif
@@ -488,6 +488,7 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
             pa_tagstruct *reply;
             bool shm_on_remote = false;
             bool memfd_on_remote = false;
+            uint32_t extensions = 0;
 
             if (pa_tagstruct_getu32(t, &c->version) < 0 ||
                 !pa_tagstruct_eof(t)) {
@@ -512,6 +513,10 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
                 if ((c->version & PA_PROTOCOL_VERSION_MASK) >= 31)
                     memfd_on_remote = !!(c->version & PA_PROTOCOL_FLAG_MEMFD);
 
+                extensions = c->version & PA_PROTOCOL_FLAG_EXTENSIONS;
+                c->has_subscribe_filter = !!(extensions & PA_PROTOCOL_FLAG_SUBSCRIBE_FILTER);
+                c->has_batch = !!(extensions & PA_PROTOCOL_FLAG_BATCH);
+
                 /* Reserve the two most-significant _bytes_ of the version tag
                  * for flags. */
                 c->version &= PA_PROTOCOL_VERSION_MASK;
@@ -540,6 +545,9 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
             pa_log_debug("Negotiated SHM: %s", pa_yes_no(c->do_shm));
             pa_pstream_enable_shm(c->pstream, c->do_shm);
 
+            if (c->do_shm && (extensions & PA_PROTOCOL_FLAG_SHM_BATCHING))
+                pa_pstream_enable_shm_batching(c->pstream);
+
             c->shm_type = PA_MEM_TYPE_PRIVATE;
             if (c->do_shm) {
                 if (c->version >= 31 && memfd_on_remote && c->memfd_on_local) {
@@ -628,9 +636,11 @@ static void setup_context(pa_context *c, pa_iochannel *io) {
 
     /* Starting with protocol version 13 we use the MSB of the version
      * tag for informing the other side if we could do SHM or not.
-     * Starting from version 31, second MSB is used to flag memfd support. */
+     * Starting from version 31, second MSB is used to flag memfd support.
+     * The extensions we support are flagged from the bottom of the range. */
     pa_tagstruct_putu32(t, PA_PROTOCOL_VERSION | (c->do_shm ? PA_PROTOCOL_FLAG_SHM : 0) |
-                        (c->memfd_on_local ? PA_PROTOCOL_FLAG_MEMFD: 0));
+                        (c->memfd_on_local ? PA_PROTOCOL_FLAG_MEMFD: 0) |
+                        PA_PROTOCOL_FLAG_EXTENSIONS);
     pa_tagstruct_put_arbitrary(t, cookie, sizeof(cookie));
 
 #ifdef HAVE_CREDS
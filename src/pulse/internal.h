@@ -55,6 +55,17 @@
 #define PA_PROTOCOL_FLAG_SHM 0x80000000U
 #define PA_PROTOCOL_FLAG_MEMFD 0x40000000U
 
+/* Extensions that are negotiated independently of the protocol version,
+ * so that they can't be mistaken for whatever later versions add. Both
+ * sides announce what they support, and a feature is used only if both
+ * did. These are allocated from the bottom of the flag range. */
+#define PA_PROTOCOL_FLAG_SHM_BATCHING 0x00010000U
+#define PA_PROTOCOL_FLAG_SUBSCRIBE_FILTER 0x00020000U
+#define PA_PROTOCOL_FLAG_BATCH 0x00040000U
+
+#define PA_PROTOCOL_FLAG_EXTENSIONS \
+    (PA_PROTOCOL_FLAG_SHM_BATCHING | PA_PROTOCOL_FLAG_SUBSCRIBE_FILTER | PA_PROTOCOL_FLAG_BATCH)
+
 struct pa_context {
     PA_REFCNT_DECLARE;
 
@@ -95,6 +106,8 @@ struct pa_context {
     bool is_local:1;
     bool do_shm:1;
     bool memfd_on_local:1;
+    bool has_subscribe_filter:1;
+    bool has_batch:1;
     bool server_specified:1;
     bool no_fail:1;
     bool do_autospawn:1;
@@ -27,11 +27,17 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 
 #ifndef HAVE_PIPE
 #include <pulsecore/pipe.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#define USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
@@ -49,6 +55,27 @@
 #include "mainloop.h"
 #include "internal.h"
 
+#define TIME_HEAP_INVALID ((unsigned) -1)
+
+#ifdef USE_EPOLL
+#define MAX_EPOLL_EVENTS 64
+
+struct epoll_slot {
+    pa_io_event *io_events;
+    bool registered;
+    uint32_t events;
+
+    /* The fd may refer to a different file than what we registered, since
+     * it can be closed and reused while io events still point to it. The
+     * kernel drops closed files from the epoll set on its own. */
+    bool add_needed;
+
+    /* Next slot whose events need to be updated, see epoll_flush() */
+    bool dirty;
+    int dirty_next;
+};
+#endif
+
 struct pa_io_event {
     pa_mainloop *mainloop;
     bool dead:1;
@@ -62,6 +89,14 @@ struct pa_io_event {
     pa_io_event_destroy_cb_t destroy_callback;
 
     PA_LLIST_FIELDS(pa_io_event);
+
+#ifdef USE_EPOLL
+    /* Other io events on the same fd */
+    pa_io_event *fd_next;
+
+    /* The value of pa_mainloop.epoll_serial when this was created */
+    unsigned epoll_serial;
+#endif
 };
 
 struct pa_time_event {
@@ -72,6 +107,14 @@ struct pa_time_event {
     bool use_rtclock:1;
     pa_usec_t time;
 
+    /* Position in the time event heap, or TIME_HEAP_INVALID */
+    unsigned heap_idx;
+
+    /* For dispatch_timeout() */
+    unsigned dispatch_serial;
+    bool set_aside:1;
+    pa_time_event *set_aside_next;
+
     pa_time_event_cb_t callback;
     void *userdata;
     pa_time_event_destroy_cb_t destroy_callback;
@@ -105,7 +148,27 @@ struct pa_mainloop {
     unsigned max_pollfds, n_pollfds;
 
     pa_usec_t prepared_timeout;
-    pa_time_event *cached_next_time_event;
+
+    /* Min-heap of the enabled time events, ordered by time */
+    pa_time_event **time_heap;
+    unsigned n_time_heap, max_time_heap;
+    unsigned time_dispatch_serial;
+
+#ifdef USE_EPOLL
+    /* -1 if we fell back to poll() */
+    int epoll_fd;
+    bool polled_with_epoll:1;
+
+    /* Indexed by fd: the io events on it and what we told epoll */
+    struct epoll_slot *epoll_slots;
+    int n_epoll_slots;
+    int epoll_dirty;
+
+    /* Incremented before each epoll_wait() */
+    unsigned epoll_serial;
+
+    struct epoll_event epoll_events[MAX_EPOLL_EVENTS];
+#endif
 
     pa_mainloop_api api;
 
@@ -144,6 +207,251 @@ static pa_io_event_flags_t map_flags_from_libc(short flags) {
         (flags & POLLHUP ? PA_IO_EVENT_HANGUP : 0);
 }
 
+#ifdef USE_EPOLL
+static void epoll_done(pa_mainloop *m) {
+    pa_io_event *e;
+
+    pa_assert(m);
+
+    if (m->epoll_fd >= 0)
+        pa_close(m->epoll_fd);
+    m->epoll_fd = -1;
+
+    pa_xfree(m->epoll_slots);
+    m->epoll_slots = NULL;
+    m->n_epoll_slots = 0;
+    m->epoll_dirty = -1;
+
+    PA_LLIST_FOREACH(e, m->io_events)
+        e->fd_next = NULL;
+}
+
+/* Register the union of what the live io events on the fd want, or
+ * drop the fd from the epoll set if there are none left */
+static void epoll_update(pa_mainloop *m, int fd) {
+    struct epoll_slot *s;
+    struct epoll_event ev;
+    pa_io_event *e;
+    bool used = false;
+
+    pa_assert(m);
+
+    if (m->epoll_fd < 0)
+        return;
+
+    pa_assert(fd >= 0 && fd < m->n_epoll_slots);
+    s = &m->epoll_slots[fd];
+
+    pa_zero(ev);
+    ev.data.fd = fd;
+
+    for (e = s->io_events; e; e = e->fd_next) {
+        if (e->dead)
+            continue;
+
+        /* The EPOLL* flags have the same values as the POLL* ones */
+        ev.events |= (uint32_t) map_flags_to_libc(e->events);
+        used = true;
+    }
+
+    if (!used) {
+        if (s->registered)
+            (void) epoll_ctl(m->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+        s->registered = s->add_needed = false;
+        return;
+    }
+
+    if (s->registered && !s->add_needed && s->events == ev.events)
+        return;
+
+    if (epoll_ctl(m->epoll_fd, s->registered && !s->add_needed ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) < 0) {
+
+        /* The fd might have been closed and reused behind our back */
+        if ((errno != EEXIST && errno != ENOENT) ||
+            epoll_ctl(m->epoll_fd, errno == EEXIST ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) < 0) {
+
+            pa_log_debug("Cannot use epoll for fd %i, falling back to poll(): %s", fd, pa_cstrerror(errno));
+            epoll_done(m);
+            return;
+        }
+    }
+
+    s->registered = true;
+    s->add_needed = false;
+    s->events = ev.events;
+}
+
+/* io events are enabled and disabled a lot, often several times per
+ * iteration, so we only tell the kernel right before sleeping */
+static void epoll_mark_dirty(pa_mainloop *m, int fd, bool add_needed) {
+    struct epoll_slot *s;
+
+    if (m->epoll_fd < 0)
+        return;
+
+    s = &m->epoll_slots[fd];
+    s->add_needed |= add_needed;
+
+    if (s->dirty)
+        return;
+
+    s->dirty = true;
+    s->dirty_next = m->epoll_dirty;
+    m->epoll_dirty = fd;
+}
+
+static void epoll_flush(pa_mainloop *m) {
+
+    while (m->epoll_fd >= 0 && m->epoll_dirty >= 0) {
+        int fd = m->epoll_dirty;
+
+        m->epoll_dirty = m->epoll_slots[fd].dirty_next;
+        m->epoll_slots[fd].dirty = false;
+
+        epoll_update(m, fd);
+    }
+}
+
+static void epoll_add_io_event(pa_mainloop *m, pa_io_event *e) {
+    pa_assert(m);
+    pa_assert(e);
+
+    if (m->epoll_fd < 0)
+        return;
+
+    if (e->fd >= m->n_epoll_slots) {
+        int n = PA_MAX(e->fd + 1, m->n_epoll_slots * 2);
+
+        m->epoll_slots = pa_xrenew(struct epoll_slot, m->epoll_slots, n);
+        memset(m->epoll_slots + m->n_epoll_slots, 0, (n - m->n_epoll_slots) * sizeof(struct epoll_slot));
+        m->n_epoll_slots = n;
+    }
+
+    e->fd_next = m->epoll_slots[e->fd].io_events;
+    m->epoll_slots[e->fd].io_events = e;
+    m->epoll_slots[e->fd].add_needed = true;
+
+    /* Whatever the current epoll_wait() reported for the fd isn't meant
+     * for this one */
+    e->epoll_serial = m->epoll_serial;
+
+    epoll_update(m, e->fd);
+}
+
+static void epoll_remove_io_event(pa_mainloop *m, pa_io_event *e) {
+    pa_io_event **i;
+
+    pa_assert(m);
+    pa_assert(e);
+
+    if (m->epoll_fd < 0)
+        return;
+
+    for (i = &m->epoll_slots[e->fd].io_events; *i; i = &(*i)->fd_next)
+        if (*i == e) {
+            *i = e->fd_next;
+            break;
+        }
+
+    e->fd_next = NULL;
+}
+#endif
+
+/* Time event heap */
+static void time_heap_set(pa_mainloop *m, unsigned idx, pa_time_event *e) {
+    m->time_heap[idx] = e;
+    e->heap_idx = idx;
+}
+
+static void time_heap_sift_up(pa_mainloop *m, unsigned idx) {
+    pa_time_event *e = m->time_heap[idx];
+
+    while (idx > 0) {
+        unsigned parent = (idx - 1) / 2;
+
+        if (m->time_heap[parent]->time <= e->time)
+            break;
+
+        time_heap_set(m, idx, m->time_heap[parent]);
+        idx = parent;
+    }
+
+    time_heap_set(m, idx, e);
+}
+
+static void time_heap_sift_down(pa_mainloop *m, unsigned idx) {
+    pa_time_event *e = m->time_heap[idx];
+
+    for (;;) {
+        unsigned child = idx * 2 + 1;
+
+        if (child >= m->n_time_heap)
+            break;
+
+        if (child + 1 < m->n_time_heap && m->time_heap[child + 1]->time < m->time_heap[child]->time)
+            child++;
+
+        if (e->time <= m->time_heap[child]->time)
+            break;
+
+        time_heap_set(m, idx, m->time_heap[child]);
+        idx = child;
+    }
+
+    time_heap_set(m, idx, e);
+}
+
+static void time_heap_insert(pa_mainloop *m, pa_time_event *e) {
+    pa_assert(e->heap_idx == TIME_HEAP_INVALID);
+
+    if (m->n_time_heap >= m->max_time_heap) {
+        m->max_time_heap = PA_MAX(16U, m->max_time_heap * 2);
+        m->time_heap = pa_xrenew(pa_time_event*, m->time_heap, m->max_time_heap);
+    }
+
+    time_heap_set(m, m->n_time_heap++, e);
+    time_heap_sift_up(m, e->heap_idx);
+}
+
+static void time_heap_remove(pa_mainloop *m, pa_time_event *e) {
+    unsigned idx = e->heap_idx;
+    pa_time_event *last;
+
+    pa_assert(idx < m->n_time_heap);
+    pa_assert(m->time_heap[idx] == e);
+
+    e->heap_idx = TIME_HEAP_INVALID;
+    last = m->time_heap[--m->n_time_heap];
+
+    if (last == e)
+        return;
+
+    time_heap_set(m, idx, last);
+
+    if (idx > 0 && m->time_heap[(idx - 1) / 2]->time > last->time)
+        time_heap_sift_up(m, idx);
+    else
+        time_heap_sift_down(m, idx);
+}
+
+/* Called after e->time changed or e got enabled or disabled */
+static void time_heap_update(pa_mainloop *m, pa_time_event *e) {
+
+    if (!e->enabled) {
+        if (e->heap_idx != TIME_HEAP_INVALID)
+            time_heap_remove(m, e);
+        return;
+    }
+
+    if (e->heap_idx == TIME_HEAP_INVALID)
+        time_heap_insert(m, e);
+    else {
+        time_heap_sift_up(m, e->heap_idx);
+        time_heap_sift_down(m, e->heap_idx);
+    }
+}
+
 /* IO events */
 static pa_io_event* mainloop_io_new(
         pa_mainloop_api *a,
@@ -176,18 +484,25 @@ static pa_io_event* mainloop_io_new(
     m->rebuild_pollfds = true;
     m->n_io_events ++;
 
+#ifdef USE_EPOLL
+    epoll_add_io_event(m, e);
+#endif
+
     pa_mainloop_wakeup(m);
 
     return e;
 }
 
 static void mainloop_io_enable(pa_io_event *e, pa_io_event_flags_t events) {
+    bool reenabled;
+
     pa_assert(e);
     pa_assert(!e->dead);
 
     if (e->events == events)
         return;
 
+    reenabled = !e->events;
     e->events = events;
 
     if (e->pollfd)
@@ -195,6 +510,12 @@ static void mainloop_io_enable(pa_io_event *e, pa_io_event_flags_t events) {
     else
         e->mainloop->rebuild_pollfds = true;
 
+#ifdef USE_EPOLL
+    epoll_mark_dirty(e->mainloop, e->fd, reenabled);
+#else
+    (void) reenabled;
+#endif
+
     pa_mainloop_wakeup(e->mainloop);
 }
 
@@ -208,6 +529,11 @@ static void mainloop_io_free(pa_io_event *e) {
     e->mainloop->n_io_events --;
     e->mainloop->rebuild_pollfds = true;
 
+#ifdef USE_EPOLL
+    /* The fd is likely to be closed right after this */
+    epoll_update(e->mainloop, e->fd);
+#endif
+
     pa_mainloop_wakeup(e->mainloop);
 }
 
@@ -327,19 +653,14 @@ static pa_time_event* mainloop_time_new(
 
     e = pa_xnew0(pa_time_event, 1);
     e->mainloop = m;
+    e->heap_idx = TIME_HEAP_INVALID;
 
     if ((e->enabled = (t != PA_USEC_INVALID))) {
         e->time = t;
         e->use_rtclock = use_rtclock;
 
         m->n_enabled_time_events++;
-
-        if (m->cached_next_time_event) {
-            pa_assert(m->cached_next_time_event->enabled);
-
-            if (t < m->cached_next_time_event->time)
-                m->cached_next_time_event = e;
-        }
+        time_heap_insert(m, e);
     }
 
     e->callback = callback;
@@ -376,15 +697,7 @@ static void mainloop_time_restart(pa_time_event *e, const struct timeval *tv) {
         pa_mainloop_wakeup(e->mainloop);
     }
 
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
-
-    if (e->mainloop->cached_next_time_event && e->enabled) {
-        pa_assert(e->mainloop->cached_next_time_event->enabled);
-
-        if (t < e->mainloop->cached_next_time_event->time)
-            e->mainloop->cached_next_time_event = e;
-    }
+    time_heap_update(e->mainloop, e);
 }
 
 static void mainloop_time_free(pa_time_event *e) {
@@ -400,8 +713,7 @@ static void mainloop_time_free(pa_time_event *e) {
         e->enabled = false;
     }
 
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
+    time_heap_update(e->mainloop, e);
 
     /* no wakeup needed here. Think about it! */
 }
@@ -465,6 +777,25 @@ pa_mainloop *pa_mainloop_new(void) {
 
     m->rebuild_pollfds = true;
 
+#ifdef USE_EPOLL
+    m->epoll_dirty = -1;
+
+    if ((m->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        pa_log_debug("epoll_create1() failed, falling back to poll(): %s", pa_cstrerror(errno));
+    else {
+        struct epoll_event ev;
+
+        pa_zero(ev);
+        ev.events = EPOLLIN;
+        ev.data.fd = m->wakeup_pipe[0];
+
+        if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, m->wakeup_pipe[0], &ev) < 0) {
+            pa_log_debug("Failed to add wakeup pipe to epoll set, falling back to poll(): %s", pa_cstrerror(errno));
+            epoll_done(m);
+        }
+    }
+#endif
+
     m->api = vtable;
     m->api.userdata = m;
 
@@ -491,6 +822,10 @@ static void cleanup_io_events(pa_mainloop *m, bool force) {
                 m->io_events_please_scan--;
             }
 
+#ifdef USE_EPOLL
+            epoll_remove_io_event(m, e);
+#endif
+
             if (e->destroy_callback)
                 e->destroy_callback(&m->api, e, e->userdata);
 
@@ -523,6 +858,7 @@ static void cleanup_time_events(pa_mainloop *m, bool force) {
                 pa_assert(m->n_enabled_time_events > 0);
                 m->n_enabled_time_events--;
                 e->enabled = false;
+                time_heap_update(m, e);
             }
 
             if (e->destroy_callback)
@@ -575,6 +911,11 @@ void pa_mainloop_free(pa_mainloop *m) {
     cleanup_time_events(m, true);
 
     pa_xfree(m->pollfds);
+    pa_xfree(m->time_heap);
+
+#ifdef USE_EPOLL
+    epoll_done(m);
+#endif
 
     pa_close_pipe(m->wakeup_pipe);
 
@@ -661,52 +1002,73 @@ static unsigned dispatch_pollfds(pa_mainloop *m) {
     return r;
 }
 
-static unsigned dispatch_defer(pa_mainloop *m) {
-    pa_defer_event *e;
+#ifdef USE_EPOLL
+static unsigned dispatch_epoll(pa_mainloop *m) {
     unsigned r = 0;
+    int k;
 
-    if (m->n_enabled_defer_events <= 0)
-        return 0;
+    pa_assert(m->poll_func_ret > 0);
 
-    PA_LLIST_FOREACH(e, m->defer_events) {
+    for (k = 0; k < m->poll_func_ret; k++) {
+        int fd = m->epoll_events[k].data.fd;
+        short revents = (short) m->epoll_events[k].events;
+        pa_io_event *e;
 
         if (m->quit)
             break;
 
-        if (e->dead || !e->enabled)
+        if (fd == m->wakeup_pipe[0])
             continue;
 
-        pa_assert(e->callback);
-        e->callback(&m->api, e, e->userdata);
-        r++;
+        /* A callback might have made us give up on epoll */
+        if (m->epoll_fd < 0)
+            break;
+
+        /* Callbacks may free io events, but they are only removed from
+         * the fd's list in scan_dead() */
+        for (e = m->epoll_slots[fd].io_events; e; e = e->fd_next) {
+            short f;
+
+            if (e->dead || e->epoll_serial == m->epoll_serial)
+                continue;
+
+            if (!(f = revents & (map_flags_to_libc(e->events) | POLLERR | POLLHUP)))
+                continue;
+
+            pa_assert(e->callback);
+            e->callback(&m->api, e, e->fd, map_flags_from_libc(f), e->userdata);
+            r++;
+
+            if (m->quit || m->epoll_fd < 0)
+                break;
+        }
     }
 
     return r;
 }
+#endif
 
-static pa_time_event* find_next_time_event(pa_mainloop *m) {
-    pa_time_event *t, *n = NULL;
-    pa_assert(m);
+static unsigned dispatch_defer(pa_mainloop *m) {
+    pa_defer_event *e;
+    unsigned r = 0;
 
-    if (m->cached_next_time_event)
-        return m->cached_next_time_event;
+    if (m->n_enabled_defer_events <= 0)
+        return 0;
 
-    PA_LLIST_FOREACH(t, m->time_events) {
+    PA_LLIST_FOREACH(e, m->defer_events) {
 
-        if (t->dead || !t->enabled)
-            continue;
+        if (m->quit)
+            break;
 
-        if (!n || t->time < n->time) {
-            n = t;
+        if (e->dead || !e->enabled)
+            continue;
 
-            /* Shortcut for time == 0 */
-            if (n->time == 0)
-                break;
-        }
+        pa_assert(e->callback);
+        e->callback(&m->api, e, e->userdata);
+        r++;
     }
 
-    m->cached_next_time_event = n;
-    return n;
+    return r;
 }
 
 static pa_usec_t calc_next_timeout(pa_mainloop *m) {
@@ -716,7 +1078,8 @@ static pa_usec_t calc_next_timeout(pa_mainloop *m) {
     if (m->n_enabled_time_events <= 0)
         return PA_USEC_INVALID;
 
-    pa_assert_se(t = find_next_time_event(m));
+    pa_assert(m->n_time_heap > 0);
+    t = m->time_heap[0];
 
     if (t->time <= 0)
         return 0;
@@ -730,7 +1093,7 @@ static pa_usec_t calc_next_timeout(pa_mainloop *m) {
 }
 
 static unsigned dispatch_timeout(pa_mainloop *m) {
-    pa_time_event *e;
+    pa_time_event *e, *set_aside = NULL;
     pa_usec_t now;
     unsigned r = 0;
     pa_assert(m);
@@ -739,26 +1102,49 @@ static unsigned dispatch_timeout(pa_mainloop *m) {
         return 0;
 
     now = pa_rtclock_now();
+    m->time_dispatch_serial++;
 
-    PA_LLIST_FOREACH(e, m->time_events) {
+    /* Events are dispatched in order of time. An event that a callback
+     * rearms for a time that has already passed is put aside until the
+     * next iteration, so that it can't starve the others. */
+    while (m->n_time_heap > 0 && !m->quit) {
+        struct timeval tv;
 
-        if (m->quit)
+        e = m->time_heap[0];
+
+        if (e->time > now)
             break;
 
-        if (e->dead || !e->enabled)
+        if (e->dispatch_serial == m->time_dispatch_serial) {
+            time_heap_remove(m, e);
+
+            if (!e->set_aside) {
+                e->set_aside = true;
+                e->set_aside_next = set_aside;
+                set_aside = e;
+            }
+
             continue;
+        }
 
-        if (e->time <= now) {
-            struct timeval tv;
-            pa_assert(e->callback);
+        e->dispatch_serial = m->time_dispatch_serial;
 
-            /* Disable time event */
-            mainloop_time_restart(e, NULL);
+        pa_assert(e->callback);
 
-            e->callback(&m->api, e, pa_timeval_rtstore(&tv, e->time, e->use_rtclock), e->userdata);
+        /* Disable time event */
+        mainloop_time_restart(e, NULL);
 
-            r++;
-        }
+        e->callback(&m->api, e, pa_timeval_rtstore(&tv, e->time, e->use_rtclock), e->userdata);
+
+        r++;
+    }
+
+    while ((e = set_aside)) {
+        set_aside = e->set_aside_next;
+        e->set_aside = false;
+
+        if (e->enabled && e->heap_idx == TIME_HEAP_INVALID)
+            time_heap_insert(m, e);
     }
 
     return r;
@@ -782,6 +1168,16 @@ static void clear_wakeup(pa_mainloop *m) {
         ;
 }
 
+/* epoll can't be used with a custom poll function, since that wants
+ * to see the pollfd array */
+static bool use_epoll(pa_mainloop *m) {
+#ifdef USE_EPOLL
+    return m->epoll_fd >= 0 && !m->poll_func;
+#else
+    return false;
+#endif
+}
+
 int pa_mainloop_prepare(pa_mainloop *m, int timeout) {
     pa_assert(m);
     pa_assert(m->state == STATE_PASSIVE);
@@ -794,7 +1190,7 @@ int pa_mainloop_prepare(pa_mainloop *m, int timeout) {
 
     if (m->n_enabled_defer_events <= 0) {
 
-        if (m->rebuild_pollfds)
+        if (m->rebuild_pollfds && !use_epoll(m))
             rebuild_pollfds(m);
 
         m->prepared_timeout = calc_next_timeout(m);
@@ -835,10 +1231,35 @@ int pa_mainloop_poll(pa_mainloop *m) {
 
     m->state = STATE_POLLING;
 
+#ifdef USE_EPOLL
+    m->polled_with_epoll = false;
+
+    if (!m->n_enabled_defer_events && use_epoll(m))
+        epoll_flush(m);
+#endif
+
     if (m->n_enabled_defer_events)
         m->poll_func_ret = 0;
+#ifdef USE_EPOLL
+    else if (use_epoll(m)) {
+        m->polled_with_epoll = true;
+        m->epoll_serial++;
+        m->poll_func_ret = epoll_wait(
+                m->epoll_fd, m->epoll_events, MAX_EPOLL_EVENTS,
+                usec_to_timeout(m->prepared_timeout));
+
+        if (m->poll_func_ret < 0) {
+            if (errno == EINTR)
+                m->poll_func_ret = 0;
+            else
+                pa_log("epoll_wait(): %s", pa_cstrerror(errno));
+        }
+    }
+#endif
     else {
-        pa_assert(!m->rebuild_pollfds);
+        /* We may have given up on epoll since pa_mainloop_prepare() */
+        if (m->rebuild_pollfds)
+            rebuild_pollfds(m);
 
         if (m->poll_func)
             m->poll_func_ret = m->poll_func(
@@ -894,8 +1315,14 @@ int pa_mainloop_dispatch(pa_mainloop *m) {
         if (m->quit)
             goto quit;
 
-        if (m->poll_func_ret > 0)
-            dispatched += dispatch_pollfds(m);
+        if (m->poll_func_ret > 0) {
+#ifdef USE_EPOLL
+            if (m->polled_with_epoll)
+                dispatched += dispatch_epoll(m);
+            else
+#endif
+                dispatched += dispatch_pollfds(m);
+        }
     }
 
     if (m->quit)
@@ -969,6 +1396,15 @@ void pa_mainloop_set_poll_func(pa_mainloop *m, pa_poll_func poll_func, void *use
 
     m->poll_func = poll_func;
     m->poll_func_userdata = userdata;
+
+#ifdef USE_EPOLL
+    /* The poll function gets the pollfd array, keeping the epoll set in
+     * sync would only cost syscalls */
+    if (poll_func && m->epoll_fd >= 0) {
+        epoll_done(m);
+        m->rebuild_pollfds = true;
+    }
+#endif
 }
 
 bool pa_mainloop_is_our_api(pa_mainloop_api *m) {
@@ -21,26 +21,142 @@
 #include <config.h>
 #endif
 
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
 #include <pulse/xmalloc.h>
 #include <pulse/utf8.h>
 
-#include <pulsecore/hashmap.h>
 #include <pulsecore/strbuf.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/refcnt.h>
+#include <pulsecore/proplist-util.h>
 
 #include "proplist.h"
 
+/* A property is a single allocation holding the value (always followed by
+ * a NUL byte) and, unless the key is one of the well-known keys below,
+ * the key string. Properties are immutable once created and reference
+ * counted, so that copying or updating a proplist from another one only
+ * takes references. Setting a property replaces it by a new one. */
 struct property {
-    char *key;
-    void *value;
+    PA_REFCNT_DECLARE;
+    const char *key;
     size_t nbytes;
 };
 
-#define MAKE_HASHMAP(p) ((pa_hashmap*) (p))
-#define MAKE_PROPLIST(p) ((pa_proplist*) (p))
+#define PROPERTY_VALUE(prop) ((uint8_t*) (prop) + PA_ALIGN(sizeof(struct property)))
+#define PROPERTY_KEY_IS_INTERNED(prop) ((prop)->key != (const char*) PROPERTY_VALUE(prop) + (prop)->nbytes + 1)
+
+/* Properties are kept in insertion order in a plain array. Removed
+ * entries are left as NULL until the array is compacted when it runs
+ * full, so that the current entry may be removed while iterating. */
+struct pa_proplist {
+    struct property **properties;
+    unsigned n_properties, n_allocated;
+    unsigned n_entries;
+
+    /* Bumped on every modification, see pa_proplist_get_generation() */
+    unsigned generation;
+};
+
+/* The well-known keys. Properties with these keys point to the strings
+ * here instead of carrying a copy of their key, and lookups for them
+ * compare pointers. Sorted by key string, for bsearch(). */
+static const char * const well_known_keys[] = {
+    PA_PROP_APPLICATION_ICON,
+    PA_PROP_APPLICATION_ICON_NAME,
+    PA_PROP_APPLICATION_ID,
+    PA_PROP_APPLICATION_LANGUAGE,
+    PA_PROP_APPLICATION_NAME,
+    PA_PROP_APPLICATION_PROCESS_BINARY,
+    PA_PROP_APPLICATION_PROCESS_HOST,
+    PA_PROP_APPLICATION_PROCESS_ID,
+    PA_PROP_APPLICATION_PROCESS_MACHINE_ID,
+    PA_PROP_APPLICATION_PROCESS_SESSION_ID,
+    PA_PROP_APPLICATION_PROCESS_USER,
+    PA_PROP_APPLICATION_VERSION,
+    PA_PROP_DEVICE_ACCESS_MODE,
+    PA_PROP_DEVICE_API,
+    PA_PROP_DEVICE_BUFFERING_BUFFER_SIZE,
+    PA_PROP_DEVICE_BUFFERING_FRAGMENT_SIZE,
+    PA_PROP_DEVICE_BUS,
+    PA_PROP_DEVICE_BUS_PATH,
+    PA_PROP_DEVICE_CLASS,
+    PA_PROP_DEVICE_DESCRIPTION,
+    PA_PROP_DEVICE_FORM_FACTOR,
+    PA_PROP_DEVICE_ICON,
+    PA_PROP_DEVICE_ICON_NAME,
+    PA_PROP_DEVICE_INTENDED_ROLES,
+    PA_PROP_DEVICE_MASTER_DEVICE,
+    PA_PROP_DEVICE_PRODUCT_ID,
+    PA_PROP_DEVICE_PRODUCT_NAME,
+    PA_PROP_DEVICE_PROFILE_DESCRIPTION,
+    PA_PROP_DEVICE_PROFILE_NAME,
+    PA_PROP_DEVICE_SERIAL,
+    PA_PROP_DEVICE_STRING,
+    PA_PROP_DEVICE_VENDOR_ID,
+    PA_PROP_DEVICE_VENDOR_NAME,
+    PA_PROP_EVENT_DESCRIPTION,
+    PA_PROP_EVENT_ID,
+    PA_PROP_EVENT_MOUSE_BUTTON,
+    PA_PROP_EVENT_MOUSE_HPOS,
+    PA_PROP_EVENT_MOUSE_VPOS,
+    PA_PROP_EVENT_MOUSE_X,
+    PA_PROP_EVENT_MOUSE_Y,
+    PA_PROP_FILTER_APPLY,
+    PA_PROP_FILTER_SUPPRESS,
+    PA_PROP_FILTER_WANT,
+    PA_PROP_FORMAT_CHANNEL_MAP,
+    PA_PROP_FORMAT_CHANNELS,
+    PA_PROP_FORMAT_RATE,
+    PA_PROP_FORMAT_SAMPLE_FORMAT,
+    PA_PROP_MEDIA_ARTIST,
+    PA_PROP_MEDIA_COPYRIGHT,
+    PA_PROP_MEDIA_FILENAME,
+    PA_PROP_MEDIA_ICON,
+    PA_PROP_MEDIA_ICON_NAME,
+    PA_PROP_MEDIA_LANGUAGE,
+    PA_PROP_MEDIA_NAME,
+    PA_PROP_MEDIA_ROLE,
+    PA_PROP_MEDIA_SOFTWARE,
+    PA_PROP_MEDIA_TITLE,
+    PA_PROP_MODULE_AUTHOR,
+    PA_PROP_MODULE_DESCRIPTION,
+    PA_PROP_MODULE_USAGE,
+    PA_PROP_MODULE_VERSION,
+    PA_PROP_WINDOW_DESKTOP,
+    PA_PROP_WINDOW_HEIGHT,
+    PA_PROP_WINDOW_HPOS,
+    PA_PROP_WINDOW_ICON,
+    PA_PROP_WINDOW_ICON_NAME,
+    PA_PROP_WINDOW_ID,
+    PA_PROP_WINDOW_NAME,
+    PA_PROP_WINDOW_VPOS,
+    PA_PROP_WINDOW_WIDTH,
+    PA_PROP_WINDOW_X,
+    PA_PROP_WINDOW_X11_DISPLAY,
+    PA_PROP_WINDOW_X11_MONITOR,
+    PA_PROP_WINDOW_X11_SCREEN,
+    PA_PROP_WINDOW_X11_XID,
+    PA_PROP_WINDOW_Y,
+};
+
+static int key_compare(const void *a, const void *b) {
+    return strcmp(*(const char * const *) a, *(const char * const *) b);
+}
+
+/* Returns the well-known key equal to key, or NULL */
+static const char *intern_key(const char *key) {
+    const char * const *k;
+
+    if (!(k = bsearch(&key, well_known_keys, PA_ELEMENTSOF(well_known_keys), sizeof(const char *), key_compare)))
+        return NULL;
+
+    return *k;
+}
 
 int pa_proplist_key_valid(const char *key) {
 
@@ -53,29 +169,132 @@ int pa_proplist_key_valid(const char *key) {
     return 1;
 }
 
-static void property_free(struct property *prop) {
+/* Creates a property from a value of nbytes bytes. If data is NULL the
+ * value is left for the caller to fill in. */
+static struct property *property_new(const char *key, const void *data, size_t nbytes) {
+    struct property *prop;
+    const char *interned;
+    size_t key_size;
+
+    interned = intern_key(key);
+    key_size = interned ? 0 : strlen(key) + 1;
+
+    prop = pa_xmalloc(PA_ALIGN(sizeof(struct property)) + nbytes + 1 + key_size);
+    PA_REFCNT_INIT(prop);
+    prop->nbytes = nbytes;
+
+    if (data && nbytes > 0)
+        memcpy(PROPERTY_VALUE(prop), data, nbytes);
+    PROPERTY_VALUE(prop)[nbytes] = 0;
+
+    if (interned)
+        prop->key = interned;
+    else {
+        char *k = (char*) PROPERTY_VALUE(prop) + nbytes + 1;
+
+        memcpy(k, key, key_size);
+        prop->key = k;
+    }
+
+    return prop;
+}
+
+static struct property *property_ref(struct property *prop) {
+    pa_assert(prop);
+    pa_assert(PA_REFCNT_VALUE(prop) >= 1);
+
+    PA_REFCNT_INC(prop);
+    return prop;
+}
+
+static void property_unref(struct property *prop) {
     pa_assert(prop);
+    pa_assert(PA_REFCNT_VALUE(prop) >= 1);
+
+    if (PA_REFCNT_DEC(prop) <= 0)
+        pa_xfree(prop);
+}
+
+/* Returns the position of the property with the given key, or -1 */
+static int find_property(const pa_proplist *p, const char *key) {
+    const char *interned;
+    unsigned i;
+
+    interned = intern_key(key);
+
+    for (i = 0; i < p->n_properties; i++) {
+        struct property *prop = p->properties[i];
+
+        if (!prop)
+            continue;
+
+        if (interned) {
+            if (prop->key == interned)
+                return (int) i;
+        } else if (!PROPERTY_KEY_IS_INTERNED(prop) && pa_streq(prop->key, key))
+            return (int) i;
+    }
+
+    return -1;
+}
+
+static struct property *get_property(const pa_proplist *p, const char *key) {
+    int i;
+
+    if ((i = find_property(p, key)) < 0)
+        return NULL;
+
+    return p->properties[i];
+}
+
+/* Stores prop in the proplist, replacing any property with the same key.
+ * Takes over the reference. */
+static void put_property(pa_proplist *p, struct property *prop) {
+    int i;
+
+    p->generation++;
+
+    if ((i = find_property(p, prop->key)) >= 0) {
+        property_unref(p->properties[i]);
+        p->properties[i] = prop;
+        return;
+    }
+
+    if (p->n_properties >= p->n_allocated) {
+
+        if (p->n_entries < p->n_properties) {
+            unsigned j, k;
+
+            /* Squeeze out the removed entries */
+            for (j = 0, k = 0; j < p->n_properties; j++)
+                if (p->properties[j])
+                    p->properties[k++] = p->properties[j];
+
+            p->n_properties = k;
+        } else {
+            p->n_allocated = PA_MAX(p->n_allocated * 2, 8U);
+            p->properties = pa_xrenew(struct property*, p->properties, p->n_allocated);
+        }
+    }
 
-    pa_xfree(prop->key);
-    pa_xfree(prop->value);
-    pa_xfree(prop);
+    p->properties[p->n_properties++] = prop;
+    p->n_entries++;
 }
 
 pa_proplist* pa_proplist_new(void) {
-    return MAKE_PROPLIST(pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, (pa_free_cb_t) property_free));
+    return pa_xnew0(pa_proplist, 1);
 }
 
 void pa_proplist_free(pa_proplist* p) {
     pa_assert(p);
 
-    pa_hashmap_free(MAKE_HASHMAP(p));
+    pa_proplist_clear(p);
+    pa_xfree(p->properties);
+    pa_xfree(p);
 }
 
 /** Will accept only valid UTF-8 */
 int pa_proplist_sets(pa_proplist *p, const char *key, const char *value) {
-    struct property *prop;
-    bool add = false;
-
     pa_assert(p);
     pa_assert(key);
     pa_assert(value);
@@ -83,26 +302,13 @@ int pa_proplist_sets(pa_proplist *p, const char *key, const char *value) {
     if (!pa_proplist_key_valid(key) || !pa_utf8_valid(value))
         return -1;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = pa_xstrdup(key);
-        add = true;
-    } else
-        pa_xfree(prop->value);
-
-    prop->value = pa_xstrdup(value);
-    prop->nbytes = strlen(value)+1;
-
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    put_property(p, property_new(key, value, strlen(value)+1));
 
     return 0;
 }
 
 /** Will accept only valid UTF-8 */
 static int proplist_setn(pa_proplist *p, const char *key, size_t key_length, const char *value, size_t value_length) {
-    struct property *prop;
-    bool add = false;
     char *k, *v;
 
     pa_assert(p);
@@ -118,20 +324,10 @@ static int proplist_setn(pa_proplist *p, const char *key, size_t key_length, con
         return -1;
     }
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), k))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = k;
-        add = true;
-    } else {
-        pa_xfree(prop->value);
-        pa_xfree(k);
-    }
+    put_property(p, property_new(k, v, strlen(v)+1));
 
-    prop->value = v;
-    prop->nbytes = strlen(v)+1;
-
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    pa_xfree(k);
+    pa_xfree(v);
 
     return 0;
 }
@@ -153,15 +349,17 @@ int pa_proplist_setp(pa_proplist *p, const char *pair) {
 
 static int proplist_sethex(pa_proplist *p, const char *key, size_t key_length, const char *value, size_t value_length) {
     struct property *prop;
-    bool add = false;
     char *k, *v;
-    uint8_t *d;
     size_t dn;
 
     pa_assert(p);
     pa_assert(key);
     pa_assert(value);
 
+    /* Every byte takes two hex digits */
+    if (value_length % 2 != 0)
+        return -1;
+
     k = pa_xstrndup(key, key_length);
 
     if (!pa_proplist_key_valid(k)) {
@@ -170,40 +368,25 @@ static int proplist_sethex(pa_proplist *p, const char *key, size_t key_length, c
     }
 
     v = pa_xstrndup(value, value_length);
-    d = pa_xmalloc(value_length*2+1);
 
-    if ((dn = pa_parsehex(v, d, value_length*2)) == (size_t) -1) {
-        pa_xfree(k);
-        pa_xfree(v);
-        pa_xfree(d);
-        return -1;
-    }
+    prop = property_new(k, NULL, value_length/2);
+    dn = pa_parsehex(v, PROPERTY_VALUE(prop), value_length/2);
 
+    pa_xfree(k);
     pa_xfree(v);
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), k))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = k;
-        add = true;
-    } else {
-        pa_xfree(prop->value);
-        pa_xfree(k);
+    if (dn == (size_t) -1 || dn != value_length/2) {
+        property_unref(prop);
+        return -1;
     }
 
-    d[dn] = 0;
-    prop->value = d;
-    prop->nbytes = dn;
-
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    put_property(p, prop);
 
     return 0;
 }
 
 /** Will accept only valid UTF-8 */
 int pa_proplist_setf(pa_proplist *p, const char *key, const char *format, ...) {
-    struct property *prop;
-    bool add = false;
     va_list ap;
     char *v;
 
@@ -221,18 +404,8 @@ int pa_proplist_setf(pa_proplist *p, const char *key, const char *format, ...) {
     if (!pa_utf8_valid(v))
         goto fail;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = pa_xstrdup(key);
-        add = true;
-    } else
-        pa_xfree(prop->value);
-
-    prop->value = v;
-    prop->nbytes = strlen(v)+1;
-
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    put_property(p, property_new(key, v, strlen(v)+1));
+    pa_xfree(v);
 
     return 0;
 
@@ -242,9 +415,6 @@ fail:
 }
 
 int pa_proplist_set(pa_proplist *p, const char *key, const void *data, size_t nbytes) {
-    struct property *prop;
-    bool add = false;
-
     pa_assert(p);
     pa_assert(key);
     pa_assert(data || nbytes == 0);
@@ -252,27 +422,14 @@ int pa_proplist_set(pa_proplist *p, const char *key, const void *data, size_t nb
     if (!pa_proplist_key_valid(key))
         return -1;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = pa_xstrdup(key);
-        add = true;
-    } else
-        pa_xfree(prop->value);
-
-    prop->value = pa_xmalloc(nbytes+1);
-    if (nbytes > 0)
-        memcpy(prop->value, data, nbytes);
-    ((char*) prop->value)[nbytes] = 0;
-    prop->nbytes = nbytes;
-
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    put_property(p, property_new(key, data, nbytes));
 
     return 0;
 }
 
 const char *pa_proplist_gets(pa_proplist *p, const char *key) {
     struct property *prop;
+    const char *value;
 
     pa_assert(p);
     pa_assert(key);
@@ -280,22 +437,24 @@ const char *pa_proplist_gets(pa_proplist *p, const char *key) {
     if (!pa_proplist_key_valid(key))
         return NULL;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key)))
+    if (!(prop = get_property(p, key)))
         return NULL;
 
     if (prop->nbytes <= 0)
         return NULL;
 
-    if (((char*) prop->value)[prop->nbytes-1] != 0)
+    value = (const char*) PROPERTY_VALUE(prop);
+
+    if (value[prop->nbytes-1] != 0)
         return NULL;
 
-    if (strlen((char*) prop->value) != prop->nbytes-1)
+    if (strlen(value) != prop->nbytes-1)
         return NULL;
 
-    if (!pa_utf8_valid((char*) prop->value))
+    if (!pa_utf8_valid(value))
         return NULL;
 
-    return (char*) prop->value;
+    return value;
 }
 
 int pa_proplist_get(pa_proplist *p, const char *key, const void **data, size_t *nbytes) {
@@ -309,18 +468,17 @@ int pa_proplist_get(pa_proplist *p, const char *key, const void **data, size_t *
     if (!pa_proplist_key_valid(key))
         return -1;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key)))
+    if (!(prop = get_property(p, key)))
         return -1;
 
-    *data = prop->value;
+    *data = PROPERTY_VALUE(prop);
     *nbytes = prop->nbytes;
 
     return 0;
 }
 
 void pa_proplist_update(pa_proplist *p, pa_update_mode_t mode, const pa_proplist *other) {
-    struct property *prop;
-    void *state = NULL;
+    unsigned i;
 
     pa_assert(p);
     pa_assert(mode == PA_UPDATE_SET || mode == PA_UPDATE_MERGE || mode == PA_UPDATE_REPLACE);
@@ -329,27 +487,41 @@ void pa_proplist_update(pa_proplist *p, pa_update_mode_t mode, const pa_proplist
     if (mode == PA_UPDATE_SET)
         pa_proplist_clear(p);
 
-    /* MAKE_HASHMAP turns the const pointer into a non-const pointer, but
-     * that's ok, because we don't modify the hashmap contents. */
-    while ((prop = pa_hashmap_iterate(MAKE_HASHMAP(other), &state, NULL))) {
+    for (i = 0; i < other->n_properties; i++) {
+        struct property *prop = other->properties[i];
+
+        if (!prop)
+            continue;
 
-        if (mode == PA_UPDATE_MERGE && pa_proplist_contains(p, prop->key))
+        if (mode == PA_UPDATE_MERGE && find_property(p, prop->key) >= 0)
             continue;
 
-        pa_assert_se(pa_proplist_set(p, prop->key, prop->value, prop->nbytes) == 0);
+        /* Share the property instead of copying it */
+        put_property(p, property_ref(prop));
     }
 }
 
 int pa_proplist_unset(pa_proplist *p, const char *key) {
+    int i;
+
     pa_assert(p);
     pa_assert(key);
 
     if (!pa_proplist_key_valid(key))
         return -1;
 
-    if (pa_hashmap_remove_and_free(MAKE_HASHMAP(p), key) < 0)
+    if ((i = find_property(p, key)) < 0)
         return -2;
 
+    property_unref(p->properties[i]);
+    p->properties[i] = NULL;
+    p->n_entries--;
+    p->generation++;
+
+    /* Trailing removed entries can go right away */
+    while (p->n_properties > 0 && !p->properties[p->n_properties-1])
+        p->n_properties--;
+
     return 0;
 }
 
@@ -371,13 +543,21 @@ int pa_proplist_unset_many(pa_proplist *p, const char * const keys[]) {
     return n;
 }
 
+/* *state is the position of the next entry to look at, plus one */
 const char *pa_proplist_iterate(pa_proplist *p, void **state) {
-    struct property *prop;
+    unsigned i;
 
-    if (!(prop = pa_hashmap_iterate(MAKE_HASHMAP(p), state, NULL)))
-        return NULL;
+    pa_assert(p);
+    pa_assert(state);
 
-    return prop->key;
+    for (i = *state ? PA_PTR_TO_UINT(*state) - 1 : 0; i < p->n_properties; i++)
+        if (p->properties[i]) {
+            *state = PA_UINT_TO_PTR(i + 2);
+            return p->properties[i]->key;
+        }
+
+    *state = PA_UINT_TO_PTR(i + 1);
+    return NULL;
 }
 
 char *pa_proplist_to_string_sep(pa_proplist *p, const char *sep) {
@@ -626,7 +806,7 @@ pa_proplist *pa_proplist_from_string(const char *s) {
     }
 
 success:
-    return MAKE_PROPLIST(pl);
+    return pl;
 
 fail:
     pa_proplist_free(pl);
@@ -640,25 +820,42 @@ int pa_proplist_contains(pa_proplist *p, const char *key) {
     if (!pa_proplist_key_valid(key))
         return -1;
 
-    if (!(pa_hashmap_get(MAKE_HASHMAP(p), key)))
+    if (find_property(p, key) < 0)
         return 0;
 
     return 1;
 }
 
 void pa_proplist_clear(pa_proplist *p) {
+    unsigned i;
+
     pa_assert(p);
 
-    pa_hashmap_remove_all(MAKE_HASHMAP(p));
+    for (i = 0; i < p->n_properties; i++)
+        if (p->properties[i])
+            property_unref(p->properties[i]);
+
+    p->n_properties = p->n_entries = 0;
+    p->generation++;
 }
 
 pa_proplist* pa_proplist_copy(const pa_proplist *p) {
     pa_proplist *copy;
+    unsigned i;
+
+    copy = pa_proplist_new();
+
+    if (!p || p->n_entries == 0)
+        return copy;
+
+    copy->n_allocated = p->n_entries;
+    copy->properties = pa_xnew(struct property*, copy->n_allocated);
 
-    pa_assert_se(copy = pa_proplist_new());
+    for (i = 0; i < p->n_properties; i++)
+        if (p->properties[i])
+            copy->properties[copy->n_properties++] = property_ref(p->properties[i]);
 
-    if (p)
-        pa_proplist_update(copy, PA_UPDATE_REPLACE, p);
+    copy->n_entries = copy->n_properties;
 
     return copy;
 }
@@ -666,20 +863,23 @@ pa_proplist* pa_proplist_copy(const pa_proplist *p) {
 unsigned pa_proplist_size(pa_proplist *p) {
     pa_assert(p);
 
-    return pa_hashmap_size(MAKE_HASHMAP(p));
+    return p->n_entries;
+}
+
+unsigned pa_proplist_get_generation(const pa_proplist *p) {
+    pa_assert(p);
+
+    return p->generation;
 }
 
 int pa_proplist_isempty(pa_proplist *p) {
     pa_assert(p);
 
-    return pa_hashmap_isempty(MAKE_HASHMAP(p));
+    return p->n_entries == 0;
 }
 
 int pa_proplist_equal(pa_proplist *a, pa_proplist *b) {
-    const void *key = NULL;
-    struct property *a_prop = NULL;
-    struct property *b_prop = NULL;
-    void *state = NULL;
+    unsigned i;
 
     pa_assert(a);
     pa_assert(b);
@@ -690,14 +890,23 @@ int pa_proplist_equal(pa_proplist *a, pa_proplist *b) {
     if (pa_proplist_size(a) != pa_proplist_size(b))
         return 0;
 
-    while ((a_prop = pa_hashmap_iterate(MAKE_HASHMAP(a), &state, &key))) {
-        if (!(b_prop = pa_hashmap_get(MAKE_HASHMAP(b), key)))
+    for (i = 0; i < a->n_properties; i++) {
+        struct property *a_prop = a->properties[i];
+        struct property *b_prop;
+
+        if (!a_prop)
+            continue;
+
+        if (!(b_prop = get_property(b, a_prop->key)))
             return 0;
 
+        if (a_prop == b_prop)
+            continue;
+
         if (a_prop->nbytes != b_prop->nbytes)
             return 0;
 
-        if (memcmp(a_prop->value, b_prop->value, a_prop->nbytes) != 0)
+        if (memcmp(PROPERTY_VALUE(a_prop), PROPERTY_VALUE(b_prop), a_prop->nbytes) != 0)
             return 0;
     }
 
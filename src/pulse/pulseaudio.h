@@ -30,6 +30,7 @@
 #include <pulse/stream.h>
 #include <pulse/introspect.h>
 #include <pulse/subscribe.h>
+#include <pulse/batch.h>
 #include <pulse/scache.h>
 #include <pulse/version.h>
 #include <pulse/error.h>
@@ -50,7 +51,7 @@
  * Include all libpulse header files at once. The following files are
  * included: \ref direction.h, \ref mainloop-api.h, \ref sample.h, \ref def.h,
  * \ref context.h, \ref stream.h, \ref introspect.h, \ref subscribe.h, \ref
- * scache.h, \ref version.h, \ref error.h, \ref channelmap.h, \ref
+ * batch.h, \ref scache.h, \ref version.h, \ref error.h, \ref channelmap.h, \ref
  * operation.h,\ref volume.h, \ref xmalloc.h, \ref utf8.h, \ref
  * thread-mainloop.h, \ref mainloop.h, \ref util.h, \ref proplist.h,
  * \ref timeval.h, \ref rtclock.h and \ref mainloop-signal.h at
@@ -75,6 +75,15 @@ typedef void (*pa_context_subscribe_cb_t)(pa_context *c, pa_subscription_event_t
 /** Enable event notification */
 pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata);
 
+/** Only receive events of the given facility (e.g.
+ * PA_SUBSCRIPTION_EVENT_SINK_INPUT) for the \a n objects whose indexes
+ * are listed in \a idx. Passing \a n = 0 removes the filter again, so
+ * that events for all objects of that facility are delivered. The
+ * filter applies to the current subscription and is reset by
+ * pa_context_subscribe(). Fails with PA_ERR_NOTSUPPORTED if the server
+ * doesn't support subscription filters. \since 11.0 */
+pa_operation* pa_context_subscribe_filter(pa_context *c, pa_subscription_event_type_t facility, const uint32_t *idx, unsigned n, pa_context_success_cb_t cb, void *userdata);
+
 /** Set the context specific call back function that is called whenever the state of the daemon changes */
 void pa_context_set_subscribe_callback(pa_context *c, pa_context_subscribe_cb_t cb, void *userdata);
 
@@ -26,15 +26,20 @@
 
 #include <pulse/xmalloc.h>
 
+#include <pulsecore/atomic.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/fdsem.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/log.h>
 #include <pulsecore/semaphore.h>
-#include <pulsecore/macro.h>
 #include <pulsecore/mutex.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/queue.h>
 
 #include "asyncmsgq.h"
 
+#define ASYNCMSGQ_SIZE 256
+
 PA_STATIC_FLIST_DECLARE(asyncmsgq, 0, pa_xfree);
 PA_STATIC_FLIST_DECLARE(semaphores, 0, (void(*)(void*)) pa_semaphore_free);
 
@@ -46,143 +51,281 @@ struct asyncmsgq_item {
     int64_t offset;
     pa_memchunk memchunk;
     pa_semaphore *semaphore;
-    int ret;
+    int *ret;
+};
+
+/* The ring is a bounded multiple-producer/single-consumer queue. The
+ * sequence number of each cell tells whose turn it is: a writer may
+ * fill the cell for position pos if sequence == pos, the reader may
+ * take it if sequence == pos + 1. Writers claim positions by
+ * advancing write_idx with a CAS, so they never block each other. */
+struct asyncmsgq_cell {
+    pa_atomic_t sequence;
+    struct asyncmsgq_item item;
 };
 
 struct pa_asyncmsgq {
     PA_REFCNT_DECLARE;
-    pa_asyncq *asyncq;
-    pa_mutex *mutex; /* only for the writer side */
+
+    unsigned size;
+    struct asyncmsgq_cell *cells;
+    pa_atomic_t write_idx;
+    unsigned read_idx; /* only for the reader side */
+
+    /* Posted by writers whenever a message has been queued */
+    pa_fdsem *write_fdsem;
+    /* Writers never have to wait for space, this one exists only so
+     * that pa_asyncmsgq_write_fd() has something to return */
+    pa_fdsem *read_fdsem;
+
+    /* Messages that didn't fit into the ring. Once this is non-empty
+     * all writers append here, so that messages from one thread are
+     * never reordered. The reader only looks here when the ring is
+     * empty. This is the only place where we take a lock, and only on
+     * overrun. */
+    pa_mutex *mutex;
+    pa_queue *overflow;
+    pa_atomic_t n_overflow;
 
     struct asyncmsgq_item *current;
+    struct asyncmsgq_cell *current_cell;
 };
 
 pa_asyncmsgq *pa_asyncmsgq_new(unsigned size) {
-    pa_asyncq *asyncq;
     pa_asyncmsgq *a;
+    unsigned i;
 
-    asyncq = pa_asyncq_new(size);
-    if (!asyncq)
-        return NULL;
+    if (!size)
+        size = ASYNCMSGQ_SIZE;
 
-    a = pa_xnew(pa_asyncmsgq, 1);
+    pa_assert(pa_is_power_of_two(size));
+
+    a = pa_xnew0(pa_asyncmsgq, 1);
 
     PA_REFCNT_INIT(a);
-    a->asyncq = asyncq;
+    a->size = size;
+
+    if (!(a->write_fdsem = pa_fdsem_new())) {
+        pa_xfree(a);
+        return NULL;
+    }
+
+    if (!(a->read_fdsem = pa_fdsem_new())) {
+        pa_fdsem_free(a->write_fdsem);
+        pa_xfree(a);
+        return NULL;
+    }
+
+    a->cells = pa_xnew0(struct asyncmsgq_cell, size);
+    for (i = 0; i < size; i++)
+        pa_atomic_store(&a->cells[i].sequence, (int) i);
+
     pa_assert_se(a->mutex = pa_mutex_new(false, true));
-    a->current = NULL;
+    a->overflow = pa_queue_new();
 
     return a;
 }
 
-static void asyncmsgq_free(pa_asyncmsgq *a) {
-    struct asyncmsgq_item *i;
-    pa_assert(a);
+static void item_free_data(struct asyncmsgq_item *i) {
+    if (i->free_cb)
+        i->free_cb(i->userdata);
 
-    while ((i = pa_asyncq_pop(a->asyncq, false))) {
+    if (i->object)
+        pa_msgobject_unref(i->object);
 
-        pa_assert(!i->semaphore);
+    if (i->memchunk.memblock)
+        pa_memblock_unref(i->memchunk.memblock);
+}
 
-        if (i->object)
-            pa_msgobject_unref(i->object);
+static void item_set(struct asyncmsgq_item *i, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk, pa_free_cb_t free_cb) {
+    i->code = code;
+    i->object = object ? pa_msgobject_ref(object) : NULL;
+    i->userdata = (void*) userdata;
+    i->free_cb = free_cb;
+    i->offset = offset;
+    if (chunk) {
+        pa_assert(chunk->memblock);
+        i->memchunk = *chunk;
+        pa_memblock_ref(i->memchunk.memblock);
+    } else
+        pa_memchunk_reset(&i->memchunk);
+    i->semaphore = NULL;
+    i->ret = NULL;
+}
 
-        if (i->memchunk.memblock)
-            pa_memblock_unref(i->memchunk.memblock);
+static struct asyncmsgq_cell *ring_claim(pa_asyncmsgq *a, unsigned *pos) {
 
-        if (i->free_cb)
-            i->free_cb(i->userdata);
+    /* Once something went to the overflow queue everything has to
+     * go there until the reader caught up */
+    if (pa_atomic_load(&a->n_overflow) > 0)
+        return NULL;
 
-        if (pa_flist_push(PA_STATIC_FLIST_GET(asyncmsgq), i) < 0)
-            pa_xfree(i);
+    for (;;) {
+        struct asyncmsgq_cell *cell;
+        unsigned idx, seq;
+        int diff;
+
+        idx = (unsigned) pa_atomic_load(&a->write_idx);
+        cell = &a->cells[idx & (a->size - 1)];
+        seq = (unsigned) pa_atomic_load(&cell->sequence);
+        diff = (int) (seq - idx);
+
+        if (diff == 0) {
+            if (pa_atomic_cmpxchg(&a->write_idx, (int) idx, (int) (idx + 1))) {
+                *pos = idx;
+                return cell;
+            }
+        } else if (diff < 0)
+            /* The reader didn't release this cell yet, we're full */
+            return NULL;
+
+        /* Somebody else claimed this position first, try the next one */
     }
-
-    pa_asyncq_free(a->asyncq, NULL);
-    pa_mutex_free(a->mutex);
-    pa_xfree(a);
 }
 
-pa_asyncmsgq* pa_asyncmsgq_ref(pa_asyncmsgq *q) {
-    pa_assert(PA_REFCNT_VALUE(q) > 0);
+static void ring_publish(pa_asyncmsgq *a, struct asyncmsgq_cell *cell, unsigned pos) {
+    pa_atomic_store(&cell->sequence, (int) (pos + 1));
 
-    PA_REFCNT_INC(q);
-    return q;
+    /* If the reader didn't get past the previous message yet, because
+     * that one is still being written or waiting to be read, it will
+     * be woken up for that one and find ours right after it. */
+    if (a->size > 1) {
+        unsigned seq;
+
+        seq = (unsigned) pa_atomic_load(&a->cells[(pos - 1) & (a->size - 1)].sequence);
+
+        if (seq == pos - 1 || seq == pos)
+            return;
+    }
+
+    pa_fdsem_post(a->write_fdsem);
 }
 
-void pa_asyncmsgq_unref(pa_asyncmsgq* q) {
-    pa_assert(PA_REFCNT_VALUE(q) > 0);
+static void overflow_push(pa_asyncmsgq *a, struct asyncmsgq_item *i) {
 
-    if (PA_REFCNT_DEC(q) <= 0)
-        asyncmsgq_free(q);
+    if (pa_log_ratelimit(PA_LOG_WARN))
+        pa_log_warn("q overrun, queuing locally");
+
+    pa_mutex_lock(a->mutex);
+    pa_queue_push(a->overflow, i);
+    pa_atomic_inc(&a->n_overflow);
+    pa_mutex_unlock(a->mutex);
+
+    pa_fdsem_post(a->write_fdsem);
 }
 
 void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk, pa_free_cb_t free_cb) {
+    struct asyncmsgq_cell *cell;
     struct asyncmsgq_item *i;
+    unsigned pos;
+
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
+    if ((cell = ring_claim(a, &pos))) {
+        item_set(&cell->item, object, code, userdata, offset, chunk, free_cb);
+        ring_publish(a, cell, pos);
+        return;
+    }
+
     if (!(i = pa_flist_pop(PA_STATIC_FLIST_GET(asyncmsgq))))
         i = pa_xnew(struct asyncmsgq_item, 1);
 
-    i->code = code;
-    i->object = object ? pa_msgobject_ref(object) : NULL;
-    i->userdata = (void*) userdata;
-    i->free_cb = free_cb;
-    i->offset = offset;
-    if (chunk) {
-        pa_assert(chunk->memblock);
-        i->memchunk = *chunk;
-        pa_memblock_ref(i->memchunk.memblock);
-    } else
-        pa_memchunk_reset(&i->memchunk);
-    i->semaphore = NULL;
-
-    /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
-    pa_mutex_lock(a->mutex);
-    pa_asyncq_post(a->asyncq, i);
-    pa_mutex_unlock(a->mutex);
+    item_set(i, object, code, userdata, offset, chunk, free_cb);
+    overflow_push(a, i);
 }
 
 int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk) {
-    struct asyncmsgq_item i;
+    struct asyncmsgq_cell *cell;
+    struct asyncmsgq_item i, *item;
+    pa_semaphore *semaphore;
+    unsigned pos;
+    int ret = -1;
+
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
-    i.code = code;
-    i.object = object;
-    i.userdata = (void*) userdata;
-    i.free_cb = NULL;
-    i.ret = -1;
-    i.offset = offset;
+    if (!(semaphore = pa_flist_pop(PA_STATIC_FLIST_GET(semaphores))))
+        semaphore = pa_semaphore_new(0);
+
+    /* We wait for completion, so the caller keeps the references */
+    cell = ring_claim(a, &pos);
+    item = cell ? &cell->item : &i;
+
+    item->code = code;
+    item->object = object;
+    item->userdata = (void*) userdata;
+    item->free_cb = NULL;
+    item->offset = offset;
     if (chunk) {
         pa_assert(chunk->memblock);
-        i.memchunk = *chunk;
+        item->memchunk = *chunk;
     } else
-        pa_memchunk_reset(&i.memchunk);
+        pa_memchunk_reset(&item->memchunk);
+    item->semaphore = semaphore;
+    item->ret = &ret;
 
-    if (!(i.semaphore = pa_flist_pop(PA_STATIC_FLIST_GET(semaphores))))
-        i.semaphore = pa_semaphore_new(0);
+    if (cell)
+        ring_publish(a, cell, pos);
+    else
+        overflow_push(a, &i);
 
-    /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
-    pa_mutex_lock(a->mutex);
-    pa_assert_se(pa_asyncq_push(a->asyncq, &i, true) == 0);
-    pa_mutex_unlock(a->mutex);
+    pa_semaphore_wait(semaphore);
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(semaphores), semaphore) < 0)
+        pa_semaphore_free(semaphore);
+
+    return ret;
+}
+
+/* Returns the cell at the read position if a message is ready there */
+static struct asyncmsgq_cell *ring_peek(pa_asyncmsgq *a) {
+    struct asyncmsgq_cell *cell;
 
-    pa_semaphore_wait(i.semaphore);
+    cell = &a->cells[a->read_idx & (a->size - 1)];
 
-    if (pa_flist_push(PA_STATIC_FLIST_GET(semaphores), i.semaphore) < 0)
-        pa_semaphore_free(i.semaphore);
+    if ((unsigned) pa_atomic_load(&cell->sequence) != a->read_idx + 1)
+        return NULL;
 
-    return i.ret;
+    return cell;
+}
+
+static bool overflow_ready(pa_asyncmsgq *a) {
+
+    /* Only look at the overflow queue when the ring is drained
+     * completely, including cells that have been claimed but not yet
+     * published, otherwise we'd overtake the earlier messages of a
+     * writer */
+    return
+        pa_atomic_load(&a->n_overflow) > 0 &&
+        (unsigned) pa_atomic_load(&a->write_idx) == a->read_idx;
+}
+
+static bool pop(pa_asyncmsgq *a) {
+
+    if ((a->current_cell = ring_peek(a))) {
+        a->current = &a->current_cell->item;
+        return true;
+    }
+
+    if (overflow_ready(a)) {
+        pa_mutex_lock(a->mutex);
+        pa_assert_se(a->current = pa_queue_pop(a->overflow));
+        pa_mutex_unlock(a->mutex);
+        return true;
+    }
+
+    return false;
 }
 
 int pa_asyncmsgq_get(pa_asyncmsgq *a, pa_msgobject **object, int *code, void **userdata, int64_t *offset, pa_memchunk *chunk, bool wait_op) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
     pa_assert(!a->current);
 
-    if (!(a->current = pa_asyncq_pop(a->asyncq, wait_op))) {
-/*         pa_log("failure"); */
-        return -1;
-    }
+    while (!pop(a)) {
+        if (!wait_op)
+            return -1;
 
-/*     pa_log("success"); */
+        pa_fdsem_wait(a->write_fdsem);
+    }
 
     if (code)
         *code = a->current->code;
@@ -208,30 +351,75 @@ int pa_asyncmsgq_get(pa_asyncmsgq *a, pa_msgobject **object, int *code, void **u
     return 0;
 }
 
+static void release(pa_asyncmsgq *a, int ret) {
+    struct asyncmsgq_item *i = a->current;
+    pa_semaphore *semaphore = i->semaphore;
+
+    if (semaphore)
+        *i->ret = ret;
+    else
+        item_free_data(i);
+
+    if (a->current_cell) {
+        /* Hand the cell back to the writers, for the position one
+         * round further */
+        pa_atomic_store(&a->current_cell->sequence, (int) (a->read_idx + a->size));
+        a->read_idx++;
+        a->current_cell = NULL;
+    } else {
+        pa_atomic_dec(&a->n_overflow);
+
+        if (!semaphore)
+            if (pa_flist_push(PA_STATIC_FLIST_GET(asyncmsgq), i) < 0)
+                pa_xfree(i);
+    }
+
+    a->current = NULL;
+
+    /* This must come last, a synchronous item may live on the stack
+     * of the sender */
+    if (semaphore)
+        pa_semaphore_post(semaphore);
+}
+
 void pa_asyncmsgq_done(pa_asyncmsgq *a, int ret) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
     pa_assert(a);
     pa_assert(a->current);
 
-    if (a->current->semaphore) {
-        a->current->ret = ret;
-        pa_semaphore_post(a->current->semaphore);
-    } else {
-
-        if (a->current->free_cb)
-            a->current->free_cb(a->current->userdata);
+    release(a, ret);
+}
 
-        if (a->current->object)
-            pa_msgobject_unref(a->current->object);
+static void asyncmsgq_free(pa_asyncmsgq *a) {
+    pa_assert(a);
 
-        if (a->current->memchunk.memblock)
-            pa_memblock_unref(a->current->memchunk.memblock);
+    pa_assert(!a->current);
 
-        if (pa_flist_push(PA_STATIC_FLIST_GET(asyncmsgq), a->current) < 0)
-            pa_xfree(a->current);
+    while (pop(a)) {
+        pa_assert(!a->current->semaphore);
+        release(a, -1);
     }
 
-    a->current = NULL;
+    pa_queue_free(a->overflow, NULL);
+    pa_mutex_free(a->mutex);
+    pa_fdsem_free(a->read_fdsem);
+    pa_fdsem_free(a->write_fdsem);
+    pa_xfree(a->cells);
+    pa_xfree(a);
+}
+
+pa_asyncmsgq* pa_asyncmsgq_ref(pa_asyncmsgq *q) {
+    pa_assert(PA_REFCNT_VALUE(q) > 0);
+
+    PA_REFCNT_INC(q);
+    return q;
+}
+
+void pa_asyncmsgq_unref(pa_asyncmsgq* q) {
+    pa_assert(PA_REFCNT_VALUE(q) > 0);
+
+    if (PA_REFCNT_DEC(q) <= 0)
+        asyncmsgq_free(q);
 }
 
 int pa_asyncmsgq_wait_for(pa_asyncmsgq *a, int code) {
@@ -284,37 +472,41 @@ int pa_asyncmsgq_process_one(pa_asyncmsgq *a) {
 int pa_asyncmsgq_read_fd(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
-    return pa_asyncq_read_fd(a->asyncq);
+    return pa_fdsem_get(a->write_fdsem);
 }
 
 int pa_asyncmsgq_read_before_poll(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
-    return pa_asyncq_read_before_poll(a->asyncq);
+    for (;;) {
+        if (ring_peek(a) || overflow_ready(a))
+            return -1;
+
+        if (pa_fdsem_before_poll(a->write_fdsem) >= 0)
+            return 0;
+    }
 }
 
 void pa_asyncmsgq_read_after_poll(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
-    pa_asyncq_read_after_poll(a->asyncq);
+    pa_fdsem_after_poll(a->write_fdsem);
 }
 
 int pa_asyncmsgq_write_fd(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
-    return pa_asyncq_write_fd(a->asyncq);
+    return pa_fdsem_get(a->read_fdsem);
 }
 
 void pa_asyncmsgq_write_before_poll(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
-    pa_asyncq_write_before_poll(a->asyncq);
+    /* Nothing to do, writers never wait for the reader */
 }
 
 void pa_asyncmsgq_write_after_poll(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
-
-    pa_asyncq_write_after_poll(a->asyncq);
 }
 
 int pa_asyncmsgq_dispatch(pa_msgobject *object, int code, void *userdata, int64_t offset, pa_memchunk *memchunk) {
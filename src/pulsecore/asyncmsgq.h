@@ -26,13 +26,13 @@
 #include <pulsecore/memchunk.h>
 #include <pulsecore/msgobject.h>
 
-/* A simple asynchronous message queue, based on pa_asyncq. In
- * contrast to pa_asyncq this one is multiple-writer safe, though
- * still not multiple-reader safe. This queue is intended to be used
- * for controlling real-time threads from normal-priority
- * threads. Multiple-writer-safety is accomplished by using a mutex on
- * the writer side. This queue is thus not useful for communication
- * between several real-time threads.
+/* A simple asynchronous message queue. In contrast to pa_asyncq this
+ * one is multiple-writer safe, though still not multiple-reader
+ * safe. This queue is intended to be used for controlling real-time
+ * threads from normal-priority threads. Messages are stored in a
+ * preallocated ring which writers fill without taking a lock. Only
+ * if the ring overruns are further messages queued in a list protected
+ * by a mutex, so writers never wait for the reader.
  *
  * The queue takes messages consisting of:
  *    "Object" for which this messages is intended (may be NULL)
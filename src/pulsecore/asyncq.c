@@ -130,7 +130,28 @@ void pa_asyncq_free(pa_asyncq *l, pa_free_cb_t free_cb) {
     pa_xfree(l);
 }
 
-static int push(pa_asyncq*l, void *p, bool wait_op) {
+/* Wake up the reader for the items that have been pushed since
+ * write_idx was first */
+static void notify_reader(pa_asyncq *l, unsigned first) {
+    pa_atomic_ptr_t *cells;
+
+    if (l->write_idx == first)
+        return;
+
+    cells = PA_ASYNCQ_CELLS(l);
+
+    /* If the reader didn't take the item before the first new one
+     * yet, it is either running or has a wakeup pending already, and
+     * will find the new items without another one. The cell must not
+     * be one of those we just filled, though. */
+    if (l->write_idx - first < l->size &&
+        pa_atomic_ptr_load(&cells[reduce(l, first - 1)]))
+        return;
+
+    pa_fdsem_post(l->write_fdsem);
+}
+
+static int push(pa_asyncq*l, void *p, bool wait_op, unsigned *first) {
     unsigned idx;
     pa_atomic_ptr_t *cells;
 
@@ -149,6 +170,11 @@ static int push(pa_asyncq*l, void *p, bool wait_op) {
 
 /*         pa_log("sleeping on push"); */
 
+        /* Make sure the reader knows about what we pushed so far,
+         * otherwise we might wait for each other */
+        notify_reader(l, *first);
+        *first = l->write_idx;
+
         do {
             pa_fdsem_wait(l->read_fdsem);
         } while (!pa_atomic_ptr_cmpxchg(&cells[idx], NULL, p));
@@ -157,19 +183,17 @@ static int push(pa_asyncq*l, void *p, bool wait_op) {
     _Y;
     l->write_idx++;
 
-    pa_fdsem_post(l->write_fdsem);
-
     return 0;
 }
 
-static bool flush_postq(pa_asyncq *l, bool wait_op) {
+static bool flush_postq(pa_asyncq *l, bool wait_op, unsigned *first) {
     struct localq *q;
 
     pa_assert(l);
 
     while ((q = l->last_localq)) {
 
-        if (push(l, q->data, wait_op) < 0)
+        if (push(l, q->data, wait_op, first) < 0)
             return false;
 
         l->last_localq = q->prev;
@@ -183,13 +207,26 @@ static bool flush_postq(pa_asyncq *l, bool wait_op) {
     return true;
 }
 
-int pa_asyncq_push(pa_asyncq*l, void *p, bool wait_op) {
+unsigned pa_asyncq_push_many(pa_asyncq *l, void * const *p, unsigned n, bool wait_op) {
+    unsigned first, i = 0;
+
     pa_assert(l);
+    pa_assert(p || n == 0);
 
-    if (!flush_postq(l, wait_op))
-        return -1;
+    first = l->write_idx;
+
+    if (flush_postq(l, wait_op, &first))
+        for (; i < n; i++)
+            if (push(l, p[i], wait_op, &first) < 0)
+                break;
+
+    notify_reader(l, first);
+
+    return i;
+}
 
-    return push(l, p, wait_op);
+int pa_asyncq_push(pa_asyncq*l, void *p, bool wait_op) {
+    return pa_asyncq_push_many(l, &p, 1, wait_op) == 1 ? 0 : -1;
 }
 
 void pa_asyncq_post(pa_asyncq*l, void *p) {
@@ -198,9 +235,8 @@ void pa_asyncq_post(pa_asyncq*l, void *p) {
     pa_assert(l);
     pa_assert(p);
 
-    if (flush_postq(l, false))
-        if (pa_asyncq_push(l, p, false) >= 0)
-            return;
+    if (pa_asyncq_push(l, p, false) >= 0)
+        return;
 
     /* OK, we couldn't push anything in the queue. So let's queue it
      * locally and push it later */
@@ -220,39 +256,56 @@ void pa_asyncq_post(pa_asyncq*l, void *p) {
     return;
 }
 
-void* pa_asyncq_pop(pa_asyncq*l, bool wait_op) {
-    unsigned idx;
+unsigned pa_asyncq_pop_many(pa_asyncq *l, void **p, unsigned n, bool wait_op) {
+    unsigned idx, i;
     void *ret;
     pa_atomic_ptr_t *cells;
 
     pa_assert(l);
+    pa_assert(p || n == 0);
 
     cells = PA_ASYNCQ_CELLS(l);
 
-    _Y;
-    idx = reduce(l, l->read_idx);
+    for (i = 0; i < n; i++) {
+        _Y;
+        idx = reduce(l, l->read_idx);
 
-    if (!(ret = pa_atomic_ptr_load(&cells[idx]))) {
+        if (!(ret = pa_atomic_ptr_load(&cells[idx]))) {
 
-        if (!wait_op)
-            return NULL;
+            /* Only wait if we have nothing at all */
+            if (!wait_op || i > 0)
+                break;
 
-/*         pa_log("sleeping on pop"); */
+/*             pa_log("sleeping on pop"); */
 
-        do {
-            pa_fdsem_wait(l->write_fdsem);
-        } while (!(ret = pa_atomic_ptr_load(&cells[idx])));
+            do {
+                pa_fdsem_wait(l->write_fdsem);
+            } while (!(ret = pa_atomic_ptr_load(&cells[idx])));
+        }
+
+        pa_assert(ret);
+
+        /* Guaranteed to succeed if we only have a single reader */
+        pa_assert_se(pa_atomic_ptr_cmpxchg(&cells[idx], ret, NULL));
+
+        _Y;
+        l->read_idx++;
+
+        p[i] = ret;
     }
 
-    pa_assert(ret);
+    /* One wakeup for the whole batch */
+    if (i > 0)
+        pa_fdsem_post(l->read_fdsem);
 
-    /* Guaranteed to succeed if we only have a single reader */
-    pa_assert_se(pa_atomic_ptr_cmpxchg(&cells[idx], ret, NULL));
+    return i;
+}
 
-    _Y;
-    l->read_idx++;
+void* pa_asyncq_pop(pa_asyncq*l, bool wait_op) {
+    void *ret;
 
-    pa_fdsem_post(l->read_fdsem);
+    if (pa_asyncq_pop_many(l, &ret, 1, wait_op) < 1)
+        return NULL;
 
     return ret;
 }
@@ -299,8 +352,13 @@ void pa_asyncq_write_before_poll(pa_asyncq *l) {
     pa_assert(l);
 
     for (;;) {
+        unsigned first = l->write_idx;
+        bool flushed;
+
+        flushed = flush_postq(l, false, &first);
+        notify_reader(l, first);
 
-        if (flush_postq(l, false))
+        if (flushed)
             break;
 
         if (pa_fdsem_before_poll(l->read_fdsem) >= 0) {
@@ -46,6 +46,14 @@ void pa_asyncq_free(pa_asyncq* q, pa_free_cb_t free_cb);
 void* pa_asyncq_pop(pa_asyncq *q, bool wait);
 int pa_asyncq_push(pa_asyncq *q, void *p, bool wait);
 
+/* Like pa_asyncq_pop() and pa_asyncq_push(), but for up to n items at
+ * once, waking up the other side only once. Return the number of
+ * items popped or pushed. If wait is true, pa_asyncq_pop_many() waits
+ * only until at least one item is available, while
+ * pa_asyncq_push_many() waits until all items are pushed. */
+unsigned pa_asyncq_pop_many(pa_asyncq *q, void **p, unsigned n, bool wait);
+unsigned pa_asyncq_push_many(pa_asyncq *q, void * const *p, unsigned n, bool wait);
+
 /* Similar to pa_asyncq_push(), but if the queue is full, postpone the
  * appending of the item locally and delay until
  * pa_asyncq_before_poll_post() is called. */
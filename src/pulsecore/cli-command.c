@@ -379,6 +379,14 @@ static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool
                      (unsigned) pa_atomic_load(&mstat->n_exported),
                      pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) pa_atomic_load(&mstat->exported_size)));
 
+    pa_strbuf_printf(buf, "Memory blocks passed by reference without copying: %u, size: %s.\n",
+                     (unsigned) pa_atomic_load(&mstat->n_zero_copy),
+                     pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) pa_atomic_load(&mstat->zero_copy_size)));
+
+    pa_strbuf_printf(buf, "Memory blocks copied into local memory: %u, size: %s.\n",
+                     (unsigned) pa_atomic_load(&mstat->n_made_local),
+                     pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) pa_atomic_load(&mstat->made_local_size)));
+
     pa_strbuf_printf(buf, "Total sample cache size: %s.\n",
                      pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) pa_scache_total_size(c)));
 
@@ -22,9 +22,12 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 
+#include <pulse/rtclock.h>
 #include <pulse/xmalloc.h>
 
+#include <pulsecore/hashmap.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 
@@ -35,7 +38,17 @@
  * register a callback function that is called whenever an event
  * matching a subscription mask happens. The execution of the callback
  * function is postponed to the next main loop iteration, i.e. is not
- * called from within the stack frame the entity was created in. */
+ * called from within the stack frame the entity was created in.
+ *
+ * Subscriptions may additionally restrict the objects they are
+ * interested in with a per-facility index filter, and may ask for
+ * CHANGE events to be coalesced: the first CHANGE event is delivered
+ * right away and opens a window of coalesce_interval; further CHANGE
+ * events during that window are collapsed into one event per object,
+ * which is delivered when the window closes. NEW and REMOVE events
+ * are never delayed. */
+
+#define N_FACILITIES (PA_SUBSCRIPTION_EVENT_FACILITY_MASK + 1)
 
 struct pa_subscription {
     pa_core *core;
@@ -45,9 +58,20 @@ struct pa_subscription {
     void *userdata;
     pa_subscription_mask_t mask;
 
+    pa_usec_t coalesce_interval;
+    pa_time_event *coalesce_event; /* non-NULL while a coalescing window is open */
+    pa_hashmap *pending_changes; /* struct pending_change -> itself */
+
+    pa_hashmap *filters[N_FACILITIES]; /* index -> non-NULL */
+
     PA_LLIST_FIELDS(pa_subscription);
 };
 
+struct pending_change {
+    pa_subscription_event_type_t type;
+    uint32_t index;
+};
+
 struct pa_subscription_event {
     pa_core *core;
 
@@ -73,6 +97,10 @@ pa_subscription* pa_subscription_new(pa_core *c, pa_subscription_mask_t m, pa_su
     s->callback = callback;
     s->userdata = userdata;
     s->mask = m;
+    s->coalesce_interval = 0;
+    s->coalesce_event = NULL;
+    s->pending_changes = NULL;
+    memset(s->filters, 0, sizeof(s->filters));
 
     PA_LLIST_PREPEND(pa_subscription, c->subscriptions, s);
     return s;
@@ -88,13 +116,178 @@ void pa_subscription_free(pa_subscription*s) {
 }
 
 static void free_subscription(pa_subscription *s) {
+    unsigned i;
+
     pa_assert(s);
     pa_assert(s->core);
 
     PA_LLIST_REMOVE(pa_subscription, s->core->subscriptions, s);
+
+    if (s->coalesce_event)
+        s->core->mainloop->time_free(s->coalesce_event);
+
+    if (s->pending_changes)
+        pa_hashmap_free(s->pending_changes);
+
+    for (i = 0; i < N_FACILITIES; i++)
+        if (s->filters[i])
+            pa_hashmap_free(s->filters[i]);
+
     pa_xfree(s);
 }
 
+static unsigned pending_change_hash_func(const void *p) {
+    const struct pending_change *pc = p;
+
+    return pc->index ^ ((unsigned) (pc->type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) << 28);
+}
+
+static int pending_change_compare_func(const void *a, const void *b) {
+    const struct pending_change *pa = a, *pb = b;
+
+    if (pa->index != pb->index)
+        return pa->index < pb->index ? -1 : 1;
+
+    return (int) (pa->type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) - (int) (pb->type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK);
+}
+
+/* Deliver the CHANGE events collected during the coalescing window
+ * that just ended. If there were any, open a new window right away,
+ * otherwise the next CHANGE event is delivered immediately again. */
+static void coalesce_cb(pa_mainloop_api *m, pa_time_event *e, const struct timeval *t, void *userdata) {
+    pa_subscription *s = userdata;
+    struct pending_change *pc;
+
+    pa_assert(s);
+    pa_assert(s->coalesce_event == e);
+
+    if (s->dead || !s->pending_changes || pa_hashmap_isempty(s->pending_changes)) {
+        m->time_free(s->coalesce_event);
+        s->coalesce_event = NULL;
+        return;
+    }
+
+    pa_core_rttime_restart(s->core, e, pa_rtclock_now() + s->coalesce_interval);
+
+    /* The callback might disable coalescing, which flushes and frees
+     * pending_changes, hence check it on each iteration */
+    while (s->pending_changes && (pc = pa_hashmap_steal_first(s->pending_changes))) {
+        if (!s->dead)
+            s->callback(s->core, pc->type, pc->index, s->userdata);
+
+        pa_xfree(pc);
+    }
+}
+
+/* Set the coalescing interval for CHANGE events, 0 disables coalescing */
+void pa_subscription_set_coalesce_interval(pa_subscription *s, pa_usec_t interval) {
+    struct pending_change *pc;
+
+    pa_assert(s);
+    pa_assert(!s->dead);
+
+    s->coalesce_interval = interval;
+
+    if (interval > 0)
+        return;
+
+    if (s->coalesce_event) {
+        s->core->mainloop->time_free(s->coalesce_event);
+        s->coalesce_event = NULL;
+    }
+
+    if (!s->pending_changes)
+        return;
+
+    /* Don't lose the events that have been held back so far */
+    while ((pc = pa_hashmap_steal_first(s->pending_changes))) {
+        if (!s->dead)
+            s->callback(s->core, pc->type, pc->index, s->userdata);
+
+        pa_xfree(pc);
+    }
+
+    pa_hashmap_free(s->pending_changes);
+    s->pending_changes = NULL;
+}
+
+/* Restrict events of the given facility to the listed object indexes */
+void pa_subscription_set_filter(pa_subscription *s, pa_subscription_event_type_t facility, const uint32_t *indexes, unsigned n) {
+    unsigned i;
+
+    pa_assert(s);
+    pa_assert(!s->dead);
+    pa_assert((facility & ~PA_SUBSCRIPTION_EVENT_FACILITY_MASK) == 0);
+    pa_assert(indexes || n == 0);
+
+    if (s->filters[facility]) {
+        pa_hashmap_free(s->filters[facility]);
+        s->filters[facility] = NULL;
+    }
+
+    if (n == 0)
+        return;
+
+    s->filters[facility] = pa_hashmap_new(NULL, NULL);
+
+    for (i = 0; i < n; i++)
+        pa_hashmap_put(s->filters[facility], PA_UINT32_TO_PTR(indexes[i]), PA_INT_TO_PTR(1));
+}
+
+static bool filter_match(pa_subscription *s, pa_subscription_event_type_t t, uint32_t idx) {
+    pa_hashmap *f;
+
+    f = s->filters[t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK];
+
+    return !f || pa_hashmap_get(f, PA_UINT32_TO_PTR(idx));
+}
+
+/* Hand an event to a single subscription, subject to its coalescing window */
+static void deliver_event(pa_subscription *s, pa_subscription_event_type_t t, uint32_t idx) {
+    struct pending_change key, *pc;
+
+    pa_assert(s);
+
+    if (s->coalesce_interval <= 0) {
+        s->callback(s->core, t, idx, s->userdata);
+        return;
+    }
+
+    key.type = t;
+    key.index = idx;
+
+    switch (t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) {
+
+        case PA_SUBSCRIPTION_EVENT_CHANGE:
+
+            if (s->coalesce_event) {
+                if (!s->pending_changes)
+                    s->pending_changes = pa_hashmap_new_full(pending_change_hash_func, pending_change_compare_func, NULL, pa_xfree);
+                else if (pa_hashmap_get(s->pending_changes, &key))
+                    return;
+
+                pc = pa_xnewdup(struct pending_change, &key, 1);
+                pa_hashmap_put(s->pending_changes, pc, pc);
+                return;
+            }
+
+            s->coalesce_event = pa_core_rttime_new(s->core, pa_rtclock_now() + s->coalesce_interval, coalesce_cb, s);
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_REMOVE:
+
+            /* A pending change for an object that is gone is of no use */
+            if (s->pending_changes)
+                pa_hashmap_remove_and_free(s->pending_changes, &key);
+            break;
+
+        default:
+            break;
+    }
+
+    s->callback(s->core, t, idx, s->userdata);
+}
+
 static void free_event(pa_subscription_event *s) {
     pa_assert(s);
     pa_assert(s->core);
@@ -168,8 +361,8 @@ static void defer_cb(pa_mainloop_api *m, pa_defer_event *de, void *userdata) {
 
         for (s = c->subscriptions; s; s = s->next) {
 
-            if (!s->dead && pa_subscription_match_flags(s->mask, e->type))
-                s->callback(c, e->type, e->index, s->userdata);
+            if (!s->dead && pa_subscription_match_flags(s->mask, e->type) && filter_match(s, e->type, e->index))
+                deliver_event(s, e->type, e->index);
         }
 
 #ifdef DEBUG
@@ -204,8 +397,15 @@ static void sched_event(pa_core *c) {
 /* Append a new subscription event to the subscription event queue and schedule a main loop event */
 void pa_subscription_post(pa_core *c, pa_subscription_event_type_t t, uint32_t idx) {
     pa_subscription_event *e;
+    pa_subscription_post_data data;
     pa_assert(c);
 
+    /* Let caches of object state know right away, even if no one is
+     * subscribed */
+    data.type = t;
+    data.index = idx;
+    pa_hook_fire(&c->hooks[PA_CORE_HOOK_SUBSCRIPTION_POST], &data);
+
     /* No need for queuing subscriptions of no one is listening */
     if (!c->subscriptions)
         return;
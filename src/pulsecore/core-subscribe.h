@@ -26,12 +26,29 @@ typedef struct pa_subscription_event pa_subscription_event;
 #include <pulsecore/core.h>
 #include <pulsecore/native-common.h>
 
+/* Hook data for PA_CORE_HOOK_SUBSCRIPTION_POST, which is fired
+ * synchronously from pa_subscription_post(), i.e. before the event is
+ * dispatched to any subscription */
+typedef struct pa_subscription_post_data {
+    pa_subscription_event_type_t type;
+    uint32_t index;
+} pa_subscription_post_data;
+
 typedef void (*pa_subscription_cb_t)(pa_core *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata);
 
 pa_subscription* pa_subscription_new(pa_core *c, pa_subscription_mask_t m,  pa_subscription_cb_t cb, void *userdata);
 void pa_subscription_free(pa_subscription*s);
 void pa_subscription_free_all(pa_core *c);
 
+/* Rate-limit CHANGE events delivered to this subscription: at most one
+ * CHANGE event per object is delivered per interval. 0 disables
+ * coalescing. */
+void pa_subscription_set_coalesce_interval(pa_subscription *s, pa_usec_t interval);
+
+/* Only deliver events of the given facility for the listed object
+ * indexes. Passing n == 0 removes the filter for that facility. */
+void pa_subscription_set_filter(pa_subscription *s, pa_subscription_event_type_t facility, const uint32_t *indexes, unsigned n);
+
 void pa_subscription_post(pa_core *c, pa_subscription_event_type_t t, uint32_t idx);
 
 #endif
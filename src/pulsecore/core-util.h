@@ -201,6 +201,20 @@ static inline unsigned pa_make_power_of_two(unsigned n) {
     return 1U << (pa_ulog2(n) + 1);
 }
 
+/* Spreads the entropy of a hash value over all bits, in particular over
+ * the low bits that hash tables use to pick a slot (murmur3 finalizer) */
+static inline unsigned pa_mix_hash(unsigned hash) {
+    uint32_t h = (uint32_t) hash;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+
+    return (unsigned) h;
+}
+
 void pa_close_pipe(int fds[2]);
 
 char *pa_readlink(const char *p);
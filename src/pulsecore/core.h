@@ -136,6 +136,7 @@ typedef enum pa_core_hook {
     PA_CORE_HOOK_SAMPLE_CACHE_NEW,
     PA_CORE_HOOK_SAMPLE_CACHE_CHANGED,
     PA_CORE_HOOK_SAMPLE_CACHE_UNLINK,
+    PA_CORE_HOOK_SUBSCRIPTION_POST,
     PA_CORE_HOOK_MAX
 } pa_core_hook_t;
 
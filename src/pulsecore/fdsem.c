@@ -27,6 +27,7 @@
 
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 
 #include <pulsecore/atomic.h>
 #include <pulsecore/log.h>
@@ -43,8 +44,17 @@
 #include <sys/eventfd.h>
 #endif
 
+#if defined(HAVE_LINUX_FUTEX_H) && defined(HAVE_SYS_SYSCALL_H)
+#include <linux/futex.h>
+#define USE_FUTEX
+#endif
+
 #include "fdsem.h"
 
+/* Upper bound for the number of times pa_fdsem_wait() checks the
+ * semaphore before going to sleep */
+#define SPIN_MAX 2048
+
 struct pa_fdsem {
     int fds[2];
 #ifdef HAVE_SYS_EVENTFD_H
@@ -52,8 +62,58 @@ struct pa_fdsem {
 #endif
     int write_type;
     pa_fdsem_data *data;
+
+    /* Threads blocking in pa_fdsem_wait() on a process-private fdsem
+     * sleep on a futex on data->signalled, so that pa_fdsem_post()
+     * only needs a single FUTEX_WAKE instead of an fd write that the
+     * sleeper then has to read back. Waiters in poll() still use the
+     * fd. fdsems in shared memory always use the fd, since the other
+     * end might be an older version that knows nothing about futexes. */
+    bool use_futex;
+    pa_atomic_t futex_waiting;
+
+    /* Adaptive spinning before sleeping: doubled every time spinning
+     * was successful, halved every time it wasn't */
+    int spin, spin_max;
+
+#ifdef FDSEM_DEBUG
+    /* Reads, writes and futex calls made so far */
+    pa_atomic_t n_syscalls;
+#endif
 };
 
+#ifdef FDSEM_DEBUG
+#define count_syscall(f) pa_atomic_inc(&(f)->n_syscalls)
+#else
+#define count_syscall(f) do { } while (0)
+#endif
+
+#ifdef USE_FUTEX
+static void futex_wait(pa_fdsem *f, int value) {
+    count_syscall(f);
+
+    /* EAGAIN (the value changed already) and EINTR are fine, the
+     * caller checks the value again anyway */
+    syscall(SYS_futex, &f->data->signalled.value, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static void futex_wake(pa_fdsem *f) {
+    count_syscall(f);
+    syscall(SYS_futex, &f->data->signalled.value, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+#endif
+
+static void setup_private(pa_fdsem *f) {
+#ifdef USE_FUTEX
+    f->use_futex = true;
+#endif
+    pa_atomic_store(&f->futex_waiting, 0);
+
+    /* Spinning only makes sense if the poster can run in parallel */
+    f->spin_max = pa_ncpus() > 1 ? SPIN_MAX : 0;
+    f->spin = f->spin_max / 16;
+}
+
 pa_fdsem *pa_fdsem_new(void) {
     pa_fdsem *f;
 
@@ -77,6 +137,8 @@ pa_fdsem *pa_fdsem_new(void) {
     pa_atomic_store(&f->data->signalled, 0);
     pa_atomic_store(&f->data->in_pipe, 0);
 
+    setup_private(f);
+
     return f;
 }
 
@@ -146,6 +208,8 @@ static void flush(pa_fdsem *f) {
     do {
         char x[10];
 
+        count_syscall(f);
+
 #ifdef HAVE_SYS_EVENTFD_H
         if (f->efd >= 0) {
             uint64_t u;
@@ -181,6 +245,11 @@ void pa_fdsem_post(pa_fdsem *f) {
 
     if (pa_atomic_cmpxchg(&f->data->signalled, 0, 1)) {
 
+#ifdef USE_FUTEX
+        if (f->use_futex && pa_atomic_load(&f->futex_waiting))
+            futex_wake(f);
+#endif
+
         if (pa_atomic_load(&f->data->waiting)) {
             ssize_t r;
             char x = 'x';
@@ -189,6 +258,8 @@ void pa_fdsem_post(pa_fdsem *f) {
 
             for (;;) {
 
+                count_syscall(f);
+
 #ifdef HAVE_SYS_EVENTFD_H
                 if (f->efd >= 0) {
                     uint64_t u = 1;
@@ -219,6 +290,22 @@ void pa_fdsem_post(pa_fdsem *f) {
     }
 }
 
+/* Returns true if the semaphore got signalled while spinning */
+static bool spin(pa_fdsem *f) {
+    int i;
+
+    for (i = 0; i < f->spin; i++)
+        if (pa_atomic_load(&f->data->signalled) && pa_atomic_cmpxchg(&f->data->signalled, 1, 0)) {
+            int n = f->spin * 2;
+
+            f->spin = PA_MIN(n, f->spin_max);
+            return true;
+        }
+
+    f->spin /= 2;
+    return false;
+}
+
 void pa_fdsem_wait(pa_fdsem *f) {
     pa_assert(f);
 
@@ -227,12 +314,29 @@ void pa_fdsem_wait(pa_fdsem *f) {
     if (pa_atomic_cmpxchg(&f->data->signalled, 1, 0))
         return;
 
+    if (spin(f))
+        return;
+
+#ifdef USE_FUTEX
+    if (f->use_futex) {
+        pa_atomic_inc(&f->futex_waiting);
+
+        while (!pa_atomic_cmpxchg(&f->data->signalled, 1, 0))
+            futex_wait(f, 0);
+
+        pa_assert_se(pa_atomic_dec(&f->futex_waiting) >= 1);
+        return;
+    }
+#endif
+
     pa_atomic_inc(&f->data->waiting);
 
     while (!pa_atomic_cmpxchg(&f->data->signalled, 1, 0)) {
         char x[10];
         ssize_t r;
 
+        count_syscall(f);
+
 #ifdef HAVE_SYS_EVENTFD_H
         if (f->efd >= 0) {
             uint64_t u;
@@ -318,3 +422,11 @@ int pa_fdsem_after_poll(pa_fdsem *f) {
 
     return 0;
 }
+
+#ifdef FDSEM_DEBUG
+unsigned pa_fdsem_get_n_syscalls(pa_fdsem *f) {
+    pa_assert(f);
+
+    return (unsigned) pa_atomic_load(&f->n_syscalls);
+}
+#endif
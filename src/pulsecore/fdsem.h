@@ -50,4 +50,11 @@ int pa_fdsem_get(pa_fdsem *f);
 int pa_fdsem_before_poll(pa_fdsem *f);
 int pa_fdsem_after_poll(pa_fdsem *f);
 
+#ifdef FDSEM_DEBUG
+/* Returns how many syscalls this fdsem made for sleeping and waking up,
+ * not counting any poll() the fd is used in. Only available if built
+ * with FDSEM_DEBUG, to keep the counter out of the fast path. */
+unsigned pa_fdsem_get_n_syscalls(pa_fdsem *f);
+#endif
+
 #endif
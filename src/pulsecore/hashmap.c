@@ -24,22 +24,35 @@
 #include <stdlib.h>
 
 #include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
 #include <pulsecore/idxset.h>
 #include <pulsecore/flist.h>
 #include <pulsecore/macro.h>
 
 #include "hashmap.h"
 
-#define NBUCKETS 127
+/* Entries are kept in a doubly linked list in insertion order, which is
+ * what iteration walks. Lookups go through an open addressing table with
+ * linear probing, which holds the entry pointers together with their
+ * hash values, so that probing rarely has to touch the entries
+ * themselves. The table is grown and shrunk with the number of entries. */
+
+#define MIN_SLOTS 8
 
 struct hashmap_entry {
     void *key;
     void *value;
 
-    struct hashmap_entry *bucket_next, *bucket_previous;
+    unsigned hash;
+
     struct hashmap_entry *iterate_next, *iterate_previous;
 };
 
+struct hashmap_slot {
+    struct hashmap_entry *entry;
+    unsigned hash;
+};
+
 struct pa_hashmap {
     pa_hash_func_t hash_func;
     pa_compare_func_t compare_func;
@@ -47,18 +60,43 @@ struct pa_hashmap {
     pa_free_cb_t key_free_func;
     pa_free_cb_t value_free_func;
 
+    struct hashmap_slot *slots;
+    unsigned n_slots;
+
     struct hashmap_entry *iterate_list_head, *iterate_list_tail;
     unsigned n_entries;
 };
 
-#define BY_HASH(h) ((struct hashmap_entry**) ((uint8_t*) (h) + PA_ALIGN(sizeof(pa_hashmap))))
-
 PA_STATIC_FLIST_DECLARE(entries, 0, pa_xfree);
 
+static void slot_insert(struct hashmap_slot *slots, unsigned n_slots, struct hashmap_entry *e) {
+    unsigned i;
+
+    for (i = e->hash & (n_slots - 1); slots[i].entry; i = (i + 1) & (n_slots - 1))
+        ;
+
+    slots[i].entry = e;
+    slots[i].hash = e->hash;
+}
+
+static void resize(pa_hashmap *h, unsigned n_slots) {
+    struct hashmap_entry *e;
+
+    pa_assert(n_slots >= MIN_SLOTS);
+    pa_assert(h->n_entries < n_slots);
+
+    pa_xfree(h->slots);
+    h->slots = pa_xnew0(struct hashmap_slot, n_slots);
+    h->n_slots = n_slots;
+
+    for (e = h->iterate_list_head; e; e = e->iterate_next)
+        slot_insert(h->slots, h->n_slots, e);
+}
+
 pa_hashmap *pa_hashmap_new_full(pa_hash_func_t hash_func, pa_compare_func_t compare_func, pa_free_cb_t key_free_func, pa_free_cb_t value_free_func) {
     pa_hashmap *h;
 
-    h = pa_xmalloc0(PA_ALIGN(sizeof(pa_hashmap)) + NBUCKETS*sizeof(struct hashmap_entry*));
+    h = pa_xnew0(pa_hashmap, 1);
 
     h->hash_func = hash_func ? hash_func : pa_idxset_trivial_hash_func;
     h->compare_func = compare_func ? compare_func : pa_idxset_trivial_compare_func;
@@ -66,6 +104,9 @@ pa_hashmap *pa_hashmap_new_full(pa_hash_func_t hash_func, pa_compare_func_t comp
     h->key_free_func = key_free_func;
     h->value_free_func = value_free_func;
 
+    h->slots = pa_xnew0(struct hashmap_slot, MIN_SLOTS);
+    h->n_slots = MIN_SLOTS;
+
     h->n_entries = 0;
     h->iterate_list_head = h->iterate_list_tail = NULL;
 
@@ -76,7 +117,36 @@ pa_hashmap *pa_hashmap_new(pa_hash_func_t hash_func, pa_compare_func_t compare_f
     return pa_hashmap_new_full(hash_func, compare_func, NULL, NULL);
 }
 
+/* Removes the entry in slot i, moving the following entries of the probe
+ * sequence back so that no tombstones are needed */
+static void slot_remove(pa_hashmap *h, unsigned i) {
+    unsigned mask = h->n_slots - 1, j = i;
+
+    for (;;) {
+        unsigned k;
+
+        j = (j + 1) & mask;
+
+        if (!h->slots[j].entry)
+            break;
+
+        k = h->slots[j].hash & mask;
+
+        /* Leave the entry where it is if its home slot lies cyclically
+         * in (i, j] */
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+
+        h->slots[i] = h->slots[j];
+        i = j;
+    }
+
+    h->slots[i].entry = NULL;
+}
+
 static void remove_entry(pa_hashmap *h, struct hashmap_entry *e) {
+    unsigned i;
+
     pa_assert(h);
     pa_assert(e);
 
@@ -91,16 +161,11 @@ static void remove_entry(pa_hashmap *h, struct hashmap_entry *e) {
     else
         h->iterate_list_head = e->iterate_next;
 
-    /* Remove from hash table bucket list */
-    if (e->bucket_next)
-        e->bucket_next->bucket_previous = e->bucket_previous;
+    /* Remove from hash table */
+    for (i = e->hash & (h->n_slots - 1); h->slots[i].entry != e; i = (i + 1) & (h->n_slots - 1))
+        pa_assert(h->slots[i].entry);
 
-    if (e->bucket_previous)
-        e->bucket_previous->bucket_next = e->bucket_next;
-    else {
-        unsigned hash = h->hash_func(e->key) % NBUCKETS;
-        BY_HASH(h)[hash] = e->bucket_next;
-    }
+    slot_remove(h, i);
 
     if (h->key_free_func)
         h->key_free_func(e->key);
@@ -110,23 +175,27 @@ static void remove_entry(pa_hashmap *h, struct hashmap_entry *e) {
 
     pa_assert(h->n_entries >= 1);
     h->n_entries--;
+
+    if (h->n_slots > MIN_SLOTS && h->n_entries * 8 < h->n_slots)
+        resize(h, h->n_slots / 2);
 }
 
 void pa_hashmap_free(pa_hashmap *h) {
     pa_assert(h);
 
     pa_hashmap_remove_all(h);
+    pa_xfree(h->slots);
     pa_xfree(h);
 }
 
 static struct hashmap_entry *hash_scan(pa_hashmap *h, unsigned hash, const void *key) {
-    struct hashmap_entry *e;
+    unsigned i;
+
     pa_assert(h);
-    pa_assert(hash < NBUCKETS);
 
-    for (e = BY_HASH(h)[hash]; e; e = e->bucket_next)
-        if (h->compare_func(e->key, key) == 0)
-            return e;
+    for (i = hash & (h->n_slots - 1); h->slots[i].entry; i = (i + 1) & (h->n_slots - 1))
+        if (h->slots[i].hash == hash && h->compare_func(h->slots[i].entry->key, key) == 0)
+            return h->slots[i].entry;
 
     return NULL;
 }
@@ -137,23 +206,24 @@ int pa_hashmap_put(pa_hashmap *h, void *key, void *value) {
 
     pa_assert(h);
 
-    hash = h->hash_func(key) % NBUCKETS;
+    hash = pa_mix_hash(h->hash_func(key));
 
     if (hash_scan(h, hash, key))
         return -1;
 
+    /* Keep the load factor below 3/4 */
+    if ((h->n_entries + 1) * 4 > h->n_slots * 3)
+        resize(h, h->n_slots * 2);
+
     if (!(e = pa_flist_pop(PA_STATIC_FLIST_GET(entries))))
         e = pa_xnew(struct hashmap_entry, 1);
 
     e->key = key;
     e->value = value;
+    e->hash = hash;
 
     /* Insert into hash table */
-    e->bucket_next = BY_HASH(h)[hash];
-    e->bucket_previous = NULL;
-    if (BY_HASH(h)[hash])
-        BY_HASH(h)[hash]->bucket_previous = e;
-    BY_HASH(h)[hash] = e;
+    slot_insert(h->slots, h->n_slots, e);
 
     /* Insert into iteration list */
     e->iterate_previous = h->iterate_list_tail;
@@ -174,14 +244,11 @@ int pa_hashmap_put(pa_hashmap *h, void *key, void *value) {
 }
 
 void* pa_hashmap_get(pa_hashmap *h, const void *key) {
-    unsigned hash;
     struct hashmap_entry *e;
 
     pa_assert(h);
 
-    hash = h->hash_func(key) % NBUCKETS;
-
-    if (!(e = hash_scan(h, hash, key)))
+    if (!(e = hash_scan(h, pa_mix_hash(h->hash_func(key)), key)))
         return NULL;
 
     return e->value;
@@ -189,14 +256,11 @@ void* pa_hashmap_get(pa_hashmap *h, const void *key) {
 
 void* pa_hashmap_remove(pa_hashmap *h, const void *key) {
     struct hashmap_entry *e;
-    unsigned hash;
     void *data;
 
     pa_assert(h);
 
-    hash = h->hash_func(key) % NBUCKETS;
-
-    if (!(e = hash_scan(h, hash, key)))
+    if (!(e = hash_scan(h, pa_mix_hash(h->hash_func(key)), key)))
         return NULL;
 
     data = e->value;
@@ -27,37 +27,130 @@
 #include <string.h>
 
 #include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
 #include <pulsecore/flist.h>
 #include <pulsecore/macro.h>
 
 #include "idxset.h"
 
-#define NBUCKETS 127
+/* Like pa_hashmap, entries are kept in a doubly linked list in insertion
+ * order for iteration. Lookups by data and by index go through two open
+ * addressing tables with linear probing, which are resized together as
+ * the number of entries changes. */
+
+#define MIN_SLOTS 8
 
 struct idxset_entry {
     uint32_t idx;
     void *data;
 
-    struct idxset_entry *data_next, *data_previous;
-    struct idxset_entry *index_next, *index_previous;
+    unsigned data_hash;
+
     struct idxset_entry *iterate_next, *iterate_previous;
 };
 
+struct data_slot {
+    struct idxset_entry *entry;
+    unsigned hash;
+};
+
+struct index_slot {
+    struct idxset_entry *entry;
+    uint32_t idx;
+};
+
 struct pa_idxset {
     pa_hash_func_t hash_func;
     pa_compare_func_t compare_func;
 
     uint32_t current_index;
 
+    struct data_slot *data_slots;
+    struct index_slot *index_slots;
+    unsigned n_slots;
+
     struct idxset_entry *iterate_list_head, *iterate_list_tail;
     unsigned n_entries;
 };
 
-#define BY_DATA(i) ((struct idxset_entry**) ((uint8_t*) (i) + PA_ALIGN(sizeof(pa_idxset))))
-#define BY_INDEX(i) (BY_DATA(i) + NBUCKETS)
-
 PA_STATIC_FLIST_DECLARE(entries, 0, pa_xfree);
 
+static void slots_insert(pa_idxset *s, struct idxset_entry *e) {
+    unsigned mask = s->n_slots - 1, i;
+
+    for (i = e->data_hash & mask; s->data_slots[i].entry; i = (i + 1) & mask)
+        ;
+
+    s->data_slots[i].entry = e;
+    s->data_slots[i].hash = e->data_hash;
+
+    for (i = pa_mix_hash(e->idx) & mask; s->index_slots[i].entry; i = (i + 1) & mask)
+        ;
+
+    s->index_slots[i].entry = e;
+    s->index_slots[i].idx = e->idx;
+}
+
+static void resize(pa_idxset *s, unsigned n_slots) {
+    struct idxset_entry *e;
+
+    pa_assert(n_slots >= MIN_SLOTS);
+    pa_assert(s->n_entries < n_slots);
+
+    pa_xfree(s->data_slots);
+    pa_xfree(s->index_slots);
+    s->data_slots = pa_xnew0(struct data_slot, n_slots);
+    s->index_slots = pa_xnew0(struct index_slot, n_slots);
+    s->n_slots = n_slots;
+
+    for (e = s->iterate_list_head; e; e = e->iterate_next)
+        slots_insert(s, e);
+}
+
+/* The two functions below remove the entry in slot i, moving the
+ * following entries of the probe sequence back so that no tombstones are
+ * needed. An entry stays where it is if its home slot lies cyclically in
+ * (i, j]. */
+#define IN_PROBE_RANGE(i, j, k) ((i) <= (j) ? ((i) < (k) && (k) <= (j)) : ((i) < (k) || (k) <= (j)))
+
+static void data_slot_remove(pa_idxset *s, unsigned i) {
+    unsigned mask = s->n_slots - 1, j = i;
+
+    for (;;) {
+        j = (j + 1) & mask;
+
+        if (!s->data_slots[j].entry)
+            break;
+
+        if (IN_PROBE_RANGE(i, j, s->data_slots[j].hash & mask))
+            continue;
+
+        s->data_slots[i] = s->data_slots[j];
+        i = j;
+    }
+
+    s->data_slots[i].entry = NULL;
+}
+
+static void index_slot_remove(pa_idxset *s, unsigned i) {
+    unsigned mask = s->n_slots - 1, j = i;
+
+    for (;;) {
+        j = (j + 1) & mask;
+
+        if (!s->index_slots[j].entry)
+            break;
+
+        if (IN_PROBE_RANGE(i, j, pa_mix_hash(s->index_slots[j].idx) & mask))
+            continue;
+
+        s->index_slots[i] = s->index_slots[j];
+        i = j;
+    }
+
+    s->index_slots[i].entry = NULL;
+}
+
 unsigned pa_idxset_string_hash_func(const void *p) {
     unsigned hash = 0;
     const char *c;
@@ -83,11 +176,15 @@ int pa_idxset_trivial_compare_func(const void *a, const void *b) {
 pa_idxset* pa_idxset_new(pa_hash_func_t hash_func, pa_compare_func_t compare_func) {
     pa_idxset *s;
 
-    s = pa_xmalloc0(PA_ALIGN(sizeof(pa_idxset)) + NBUCKETS*2*sizeof(struct idxset_entry*));
+    s = pa_xnew0(pa_idxset, 1);
 
     s->hash_func = hash_func ? hash_func : pa_idxset_trivial_hash_func;
     s->compare_func = compare_func ? compare_func : pa_idxset_trivial_compare_func;
 
+    s->data_slots = pa_xnew0(struct data_slot, MIN_SLOTS);
+    s->index_slots = pa_xnew0(struct index_slot, MIN_SLOTS);
+    s->n_slots = MIN_SLOTS;
+
     s->current_index = 0;
     s->n_entries = 0;
     s->iterate_list_head = s->iterate_list_tail = NULL;
@@ -96,6 +193,8 @@ pa_idxset* pa_idxset_new(pa_hash_func_t hash_func, pa_compare_func_t compare_fun
 }
 
 static void remove_entry(pa_idxset *s, struct idxset_entry *e) {
+    unsigned mask, i;
+
     pa_assert(s);
     pa_assert(e);
 
@@ -110,61 +209,64 @@ static void remove_entry(pa_idxset *s, struct idxset_entry *e) {
     else
         s->iterate_list_head = e->iterate_next;
 
+    mask = s->n_slots - 1;
+
     /* Remove from data hash table */
-    if (e->data_next)
-        e->data_next->data_previous = e->data_previous;
-
-    if (e->data_previous)
-        e->data_previous->data_next = e->data_next;
-    else {
-        unsigned hash = s->hash_func(e->data) % NBUCKETS;
-        BY_DATA(s)[hash] = e->data_next;
-    }
+    for (i = e->data_hash & mask; s->data_slots[i].entry != e; i = (i + 1) & mask)
+        pa_assert(s->data_slots[i].entry);
+
+    data_slot_remove(s, i);
 
     /* Remove from index hash table */
-    if (e->index_next)
-        e->index_next->index_previous = e->index_previous;
+    for (i = pa_mix_hash(e->idx) & mask; s->index_slots[i].entry != e; i = (i + 1) & mask)
+        pa_assert(s->index_slots[i].entry);
 
-    if (e->index_previous)
-        e->index_previous->index_next = e->index_next;
-    else
-        BY_INDEX(s)[e->idx % NBUCKETS] = e->index_next;
+    index_slot_remove(s, i);
 
     if (pa_flist_push(PA_STATIC_FLIST_GET(entries), e) < 0)
         pa_xfree(e);
 
     pa_assert(s->n_entries >= 1);
     s->n_entries--;
+
+    if (s->n_slots > MIN_SLOTS && s->n_entries * 8 < s->n_slots)
+        resize(s, s->n_slots / 2);
 }
 
 void pa_idxset_free(pa_idxset *s, pa_free_cb_t free_cb) {
     pa_assert(s);
 
     pa_idxset_remove_all(s, free_cb);
+    pa_xfree(s->data_slots);
+    pa_xfree(s->index_slots);
     pa_xfree(s);
 }
 
 static struct idxset_entry* data_scan(pa_idxset *s, unsigned hash, const void *p) {
-    struct idxset_entry *e;
+    unsigned mask, i;
+
     pa_assert(s);
-    pa_assert(hash < NBUCKETS);
     pa_assert(p);
 
-    for (e = BY_DATA(s)[hash]; e; e = e->data_next)
-        if (s->compare_func(e->data, p) == 0)
-            return e;
+    mask = s->n_slots - 1;
+
+    for (i = hash & mask; s->data_slots[i].entry; i = (i + 1) & mask)
+        if (s->data_slots[i].hash == hash && s->compare_func(s->data_slots[i].entry->data, p) == 0)
+            return s->data_slots[i].entry;
 
     return NULL;
 }
 
-static struct idxset_entry* index_scan(pa_idxset *s, unsigned hash, uint32_t idx) {
-    struct idxset_entry *e;
+static struct idxset_entry* index_scan(pa_idxset *s, uint32_t idx) {
+    unsigned mask, i;
+
     pa_assert(s);
-    pa_assert(hash < NBUCKETS);
 
-    for (e = BY_INDEX(s)[hash]; e; e = e->index_next)
-        if (e->idx == idx)
-            return e;
+    mask = s->n_slots - 1;
+
+    for (i = pa_mix_hash(idx) & mask; s->index_slots[i].entry; i = (i + 1) & mask)
+        if (s->index_slots[i].idx == idx)
+            return s->index_slots[i].entry;
 
     return NULL;
 }
@@ -175,7 +277,7 @@ int pa_idxset_put(pa_idxset*s, void *p, uint32_t *idx) {
 
     pa_assert(s);
 
-    hash = s->hash_func(p) % NBUCKETS;
+    hash = pa_mix_hash(s->hash_func(p));
 
     if ((e = data_scan(s, hash, p))) {
         if (idx)
@@ -184,27 +286,19 @@ int pa_idxset_put(pa_idxset*s, void *p, uint32_t *idx) {
         return -1;
     }
 
+    /* Keep the load factor below 3/4 */
+    if ((s->n_entries + 1) * 4 > s->n_slots * 3)
+        resize(s, s->n_slots * 2);
+
     if (!(e = pa_flist_pop(PA_STATIC_FLIST_GET(entries))))
         e = pa_xnew(struct idxset_entry, 1);
 
     e->data = p;
     e->idx = s->current_index++;
+    e->data_hash = hash;
 
-    /* Insert into data hash table */
-    e->data_next = BY_DATA(s)[hash];
-    e->data_previous = NULL;
-    if (BY_DATA(s)[hash])
-        BY_DATA(s)[hash]->data_previous = e;
-    BY_DATA(s)[hash] = e;
-
-    hash = e->idx % NBUCKETS;
-
-    /* Insert into index hash table */
-    e->index_next = BY_INDEX(s)[hash];
-    e->index_previous = NULL;
-    if (BY_INDEX(s)[hash])
-        BY_INDEX(s)[hash]->index_previous = e;
-    BY_INDEX(s)[hash] = e;
+    /* Insert into hash tables */
+    slots_insert(s, e);
 
     /* Insert into iteration list */
     e->iterate_previous = s->iterate_list_tail;
@@ -228,28 +322,22 @@ int pa_idxset_put(pa_idxset*s, void *p, uint32_t *idx) {
 }
 
 void* pa_idxset_get_by_index(pa_idxset*s, uint32_t idx) {
-    unsigned hash;
     struct idxset_entry *e;
 
     pa_assert(s);
 
-    hash = idx % NBUCKETS;
-
-    if (!(e = index_scan(s, hash, idx)))
+    if (!(e = index_scan(s, idx)))
         return NULL;
 
     return e->data;
 }
 
 void* pa_idxset_get_by_data(pa_idxset*s, const void *p, uint32_t *idx) {
-    unsigned hash;
     struct idxset_entry *e;
 
     pa_assert(s);
 
-    hash = s->hash_func(p) % NBUCKETS;
-
-    if (!(e = data_scan(s, hash, p)))
+    if (!(e = data_scan(s, pa_mix_hash(s->hash_func(p)), p)))
         return NULL;
 
     if (idx)
@@ -260,14 +348,11 @@ void* pa_idxset_get_by_data(pa_idxset*s, const void *p, uint32_t *idx) {
 
 void* pa_idxset_remove_by_index(pa_idxset*s, uint32_t idx) {
     struct idxset_entry *e;
-    unsigned hash;
     void *data;
 
     pa_assert(s);
 
-    hash = idx % NBUCKETS;
-
-    if (!(e = index_scan(s, hash, idx)))
+    if (!(e = index_scan(s, idx)))
         return NULL;
 
     data = e->data;
@@ -278,14 +363,11 @@ void* pa_idxset_remove_by_index(pa_idxset*s, uint32_t idx) {
 
 void* pa_idxset_remove_by_data(pa_idxset*s, const void *data, uint32_t *idx) {
     struct idxset_entry *e;
-    unsigned hash;
     void *r;
 
     pa_assert(s);
 
-    hash = s->hash_func(data) % NBUCKETS;
-
-    if (!(e = data_scan(s, hash, data)))
+    if (!(e = data_scan(s, pa_mix_hash(s->hash_func(data)), data)))
         return NULL;
 
     r = e->data;
@@ -312,15 +394,12 @@ void pa_idxset_remove_all(pa_idxset *s, pa_free_cb_t free_cb) {
 }
 
 void* pa_idxset_rrobin(pa_idxset *s, uint32_t *idx) {
-    unsigned hash;
     struct idxset_entry *e;
 
     pa_assert(s);
     pa_assert(idx);
 
-    hash = *idx % NBUCKETS;
-
-    e = index_scan(s, hash, *idx);
+    e = index_scan(s, *idx);
 
     if (e && e->iterate_next)
         e = e->iterate_next;
@@ -402,7 +481,6 @@ void* pa_idxset_first(pa_idxset *s, uint32_t *idx) {
 
 void *pa_idxset_next(pa_idxset *s, uint32_t *idx) {
     struct idxset_entry *e;
-    unsigned hash;
 
     pa_assert(s);
     pa_assert(idx);
@@ -410,9 +488,7 @@ void *pa_idxset_next(pa_idxset *s, uint32_t *idx) {
     if (*idx == PA_IDXSET_INVALID)
         return NULL;
 
-    hash = *idx % NBUCKETS;
-
-    if ((e = index_scan(s, hash, *idx))) {
+    if ((e = index_scan(s, *idx))) {
 
         e = e->iterate_next;
 
@@ -431,9 +507,7 @@ void *pa_idxset_next(pa_idxset *s, uint32_t *idx) {
 
         for ((*idx)++; *idx < s->current_index; (*idx)++) {
 
-            hash = *idx % NBUCKETS;
-
-            if ((e = index_scan(s, hash, *idx))) {
+            if ((e = index_scan(s, *idx))) {
                 *idx = e->idx;
                 return e->data;
             }
@@ -0,0 +1,169 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/hashmap.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/proplist-util.h>
+
+#include "info-cache.h"
+
+struct entry {
+    /* What the segments were serialized from */
+    uint32_t version;
+    unsigned proplist_generation;
+
+    pa_tagstruct **segments;
+};
+
+struct pa_info_cache {
+    unsigned n_segments;
+
+    /* One hashmap per subscription facility, object index -> struct entry */
+    pa_hashmap *entries[PA_SUBSCRIPTION_EVENT_FACILITY_MASK + 1];
+
+    uint64_t hits, misses;
+};
+
+static void entry_clear(pa_info_cache *c, struct entry *e) {
+    unsigned i;
+
+    for (i = 0; i < c->n_segments; i++)
+        if (e->segments[i]) {
+            pa_tagstruct_free(e->segments[i]);
+            e->segments[i] = NULL;
+        }
+}
+
+static void entry_free(struct entry *e) {
+    pa_xfree(e->segments);
+    pa_xfree(e);
+}
+
+pa_info_cache *pa_info_cache_new(unsigned n_segments) {
+    pa_info_cache *c;
+
+    pa_assert(n_segments > 0);
+
+    c = pa_xnew0(pa_info_cache, 1);
+    c->n_segments = n_segments;
+
+    return c;
+}
+
+void pa_info_cache_free(pa_info_cache *c) {
+    struct entry *e;
+    unsigned i;
+
+    pa_assert(c);
+
+    for (i = 0; i < PA_ELEMENTSOF(c->entries); i++) {
+        if (!c->entries[i])
+            continue;
+
+        while ((e = pa_hashmap_steal_first(c->entries[i]))) {
+            entry_clear(c, e);
+            entry_free(e);
+        }
+
+        pa_hashmap_free(c->entries[i]);
+    }
+
+    pa_xfree(c);
+}
+
+void pa_info_cache_put(
+        pa_info_cache *c,
+        pa_tagstruct *t,
+        pa_subscription_event_type_t facility,
+        uint32_t idx,
+        pa_proplist *proplist,
+        uint32_t version,
+        unsigned segment,
+        pa_info_cache_fill_cb_t fill,
+        void *object,
+        void *userdata) {
+
+    struct entry *e;
+    unsigned generation;
+
+    pa_assert(c);
+    pa_assert(t);
+    pa_assert((facility & ~PA_SUBSCRIPTION_EVENT_FACILITY_MASK) == 0);
+    pa_assert(proplist);
+    pa_assert(segment < c->n_segments);
+    pa_assert(fill);
+
+    generation = pa_proplist_get_generation(proplist);
+
+    if (!c->entries[facility])
+        c->entries[facility] = pa_hashmap_new(NULL, NULL);
+
+    if (!(e = pa_hashmap_get(c->entries[facility], PA_UINT32_TO_PTR(idx)))) {
+        e = pa_xnew0(struct entry, 1);
+        e->segments = pa_xnew0(pa_tagstruct*, c->n_segments);
+        e->version = version;
+        e->proplist_generation = generation;
+        pa_hashmap_put(c->entries[facility], PA_UINT32_TO_PTR(idx), e);
+
+    } else if (e->version != version || e->proplist_generation != generation) {
+        /* Either the proplist was changed without an event, or a client
+         * of another version replaces the data */
+        entry_clear(c, e);
+        e->version = version;
+        e->proplist_generation = generation;
+    }
+
+    if (e->segments[segment])
+        c->hits++;
+    else {
+        c->misses++;
+        e->segments[segment] = pa_tagstruct_new();
+        fill(userdata, e->segments[segment], object);
+    }
+
+    pa_tagstruct_append(t, e->segments[segment]);
+}
+
+void pa_info_cache_invalidate(pa_info_cache *c, pa_subscription_event_type_t facility, uint32_t idx) {
+    struct entry *e;
+
+    pa_assert(c);
+    pa_assert((facility & ~PA_SUBSCRIPTION_EVENT_FACILITY_MASK) == 0);
+
+    if (!c->entries[facility])
+        return;
+
+    if ((e = pa_hashmap_remove(c->entries[facility], PA_UINT32_TO_PTR(idx)))) {
+        entry_clear(c, e);
+        entry_free(e);
+    }
+}
+
+void pa_info_cache_get_stats(pa_info_cache *c, uint64_t *hits, uint64_t *misses) {
+    pa_assert(c);
+    pa_assert(hits);
+    pa_assert(misses);
+
+    *hits = c->hits;
+    *misses = c->misses;
+}
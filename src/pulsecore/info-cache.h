@@ -0,0 +1,65 @@
+#ifndef fooinfocachehfoo
+#define fooinfocachehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/def.h>
+#include <pulse/proplist.h>
+#include <pulsecore/tagstruct.h>
+
+/* Serialized introspection data of the objects of a core, so that info
+ * replies don't serialize the same proplists and port lists over and
+ * over again. Entries are kept per subscription facility and object
+ * index, and consist of segments that the user numbers.
+ *
+ * The owner is expected to invalidate an object's entry whenever a
+ * subscription event is posted for it. Proplists are modified without
+ * posting an event in quite a few places, so entries additionally
+ * remember the generation of the object's proplist, and are dropped
+ * when that changed. */
+
+typedef struct pa_info_cache pa_info_cache;
+
+/* Serializes one segment of object into t */
+typedef void (*pa_info_cache_fill_cb_t)(void *userdata, pa_tagstruct *t, void *object);
+
+pa_info_cache *pa_info_cache_new(unsigned n_segments);
+void pa_info_cache_free(pa_info_cache *c);
+
+/* Appends the given segment of the object to t, serializing it with fill
+ * first unless there's a valid copy. The serialization may depend on the
+ * protocol version, so a different version replaces the cached data. */
+void pa_info_cache_put(
+        pa_info_cache *c,
+        pa_tagstruct *t,
+        pa_subscription_event_type_t facility,
+        uint32_t idx,
+        pa_proplist *proplist,
+        uint32_t version,
+        unsigned segment,
+        pa_info_cache_fill_cb_t fill,
+        void *object,
+        void *userdata);
+
+void pa_info_cache_invalidate(pa_info_cache *c, pa_subscription_event_type_t facility, uint32_t idx);
+
+void pa_info_cache_get_stats(pa_info_cache *c, uint64_t *hits, uint64_t *misses);
+
+#endif
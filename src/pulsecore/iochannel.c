@@ -30,6 +30,10 @@
 #include <sys/un.h>
 #endif
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/core-error.h>
@@ -240,6 +244,56 @@ ssize_t pa_iochannel_write(pa_iochannel*io, const void*data, size_t l) {
     return r;
 }
 
+#ifdef HAVE_SYS_UIO_H
+
+ssize_t pa_iochannel_writev(pa_iochannel*io, const struct iovec *iov, int iovcnt) {
+    ssize_t r;
+
+    pa_assert(io);
+    pa_assert(iov);
+    pa_assert(iovcnt > 0);
+    pa_assert(io->ofd >= 0);
+
+    for (;;) {
+        if (io->ofd_type == 0) {
+            struct msghdr mh;
+
+            /* Like pa_write() we use sendmsg() on sockets to get
+             * MSG_NOSIGNAL, and fall back to writev() otherwise */
+            pa_zero(mh);
+            mh.msg_iov = (struct iovec*) iov;
+            mh.msg_iovlen = iovcnt;
+
+            if ((r = sendmsg(io->ofd, &mh, MSG_NOSIGNAL)) < 0 && errno == ENOTSOCK) {
+                io->ofd_type = 1;
+                continue;
+            }
+        } else
+            r = writev(io->ofd, iov, iovcnt);
+
+        if (r < 0 && errno == EINTR)
+            continue;
+
+        break;
+    }
+
+    if (r < 0) {
+        if (errno != EAGAIN)
+            return r;
+
+        r = 0;
+    }
+
+    /* Like the other write functions, let's get a notification when we
+     * can write more */
+    io->writable = io->hungup = false;
+    enable_events(io);
+
+    return r;
+}
+
+#endif
+
 ssize_t pa_iochannel_read(pa_iochannel*io, void*data, size_t l) {
     ssize_t r;
 
@@ -51,6 +51,14 @@ void pa_iochannel_free(pa_iochannel*io);
 ssize_t pa_iochannel_write(pa_iochannel*io, const void*data, size_t l);
 ssize_t pa_iochannel_read(pa_iochannel*io, void*data, size_t l);
 
+#ifdef HAVE_SYS_UIO_H
+struct iovec;
+
+/* Gathers the buffers described by iov into a single write. Same return
+ * values as pa_iochannel_write(). */
+ssize_t pa_iochannel_writev(pa_iochannel*io, const struct iovec *iov, int iovcnt);
+#endif
+
 #ifdef HAVE_CREDS
 bool pa_iochannel_creds_supported(pa_iochannel *io);
 int pa_iochannel_creds_enable(pa_iochannel *io);
@@ -62,6 +62,9 @@
 #define PA_MEMIMPORT_SLOTS_MAX 160
 #define PA_MEMIMPORT_SEGMENTS_MAX 16
 
+/* Maximum number of blocks released per lock in pa_memexport_process_release_batch() */
+#define PA_MEMEXPORT_RELEASE_BATCH_MAX 64U
+
 struct pa_memblock {
     PA_REFCNT_DECLARE; /* the reference counter */
     pa_mempool *pool;
@@ -707,8 +710,11 @@ static void memblock_wait(pa_memblock *b) {
 
 /* No lock necessary. This function is not multiple caller safe! */
 static void memblock_make_local(pa_memblock *b) {
+    bool imported;
+
     pa_assert(b);
 
+    imported = b->type == PA_MEMBLOCK_IMPORTED;
     pa_atomic_dec(&b->pool->stat.n_allocated_by_type[b->type]);
 
     if (b->length <= b->pool->block_size) {
@@ -740,6 +746,15 @@ static void memblock_make_local(pa_memblock *b) {
 finish:
     pa_atomic_inc(&b->pool->stat.n_allocated_by_type[b->type]);
     pa_atomic_inc(&b->pool->stat.n_accumulated_by_type[b->type]);
+    pa_atomic_inc(&b->pool->stat.n_made_local);
+    pa_atomic_add(&b->pool->stat.made_local_size, (int) b->length);
+
+    /* It got copied after all */
+    if (imported) {
+        pa_atomic_dec(&b->pool->stat.n_zero_copy);
+        pa_atomic_sub(&b->pool->stat.zero_copy_size, (int) b->length);
+    }
+
     memblock_wait(b);
 }
 
@@ -1287,6 +1302,11 @@ pa_memblock* pa_memimport_get(pa_memimport *i, pa_mem_type_t type, uint32_t bloc
 
     stat_add(b);
 
+    /* Counted once per block, later lookups of the same block id are
+     * just more references to it */
+    pa_atomic_inc(&i->pool->stat.n_zero_copy);
+    pa_atomic_add(&i->pool->stat.zero_copy_size, (int) b->length);
+
 finish:
     pa_mutex_unlock(i->mutex);
 
@@ -1362,22 +1382,19 @@ void pa_memexport_free(pa_memexport *e) {
 }
 
 /* Self-locked */
-int pa_memexport_process_release(pa_memexport *e, uint32_t id) {
+/* Should be called locked */
+static pa_memblock *memexport_release_slot(pa_memexport *e, uint32_t id) {
     pa_memblock *b;
 
-    pa_assert(e);
-
-    pa_mutex_lock(e->mutex);
-
     if (id < e->baseidx)
-        goto fail;
+        return NULL;
     id -= e->baseidx;
 
     if (id >= e->n_init)
-        goto fail;
+        return NULL;
 
     if (!e->slots[id].block)
-        goto fail;
+        return NULL;
 
     b = e->slots[id].block;
     e->slots[id].block = NULL;
@@ -1385,10 +1402,11 @@ int pa_memexport_process_release(pa_memexport *e, uint32_t id) {
     PA_LLIST_REMOVE(struct memexport_slot, e->used_slots, &e->slots[id]);
     PA_LLIST_PREPEND(struct memexport_slot, e->free_slots, &e->slots[id]);
 
-    pa_mutex_unlock(e->mutex);
-
-/*     pa_log("Processing release for %u", id); */
+    return b;
+}
 
+/* No lock necessary */
+static void memexport_unref_released(pa_memexport *e, pa_memblock *b) {
     pa_assert(pa_atomic_load(&e->pool->stat.n_exported) > 0);
     pa_assert(pa_atomic_load(&e->pool->stat.exported_size) >= (int) b->length);
 
@@ -1396,13 +1414,61 @@ int pa_memexport_process_release(pa_memexport *e, uint32_t id) {
     pa_atomic_sub(&e->pool->stat.exported_size, (int) b->length);
 
     pa_memblock_unref(b);
+}
 
-    return 0;
+/* Self-locked */
+int pa_memexport_process_release(pa_memexport *e, uint32_t id) {
+    pa_memblock *b;
+
+    pa_assert(e);
 
-fail:
+    pa_mutex_lock(e->mutex);
+    b = memexport_release_slot(e, id);
     pa_mutex_unlock(e->mutex);
 
-    return -1;
+    if (!b)
+        return -1;
+
+/*     pa_log("Processing release for %u", id); */
+
+    memexport_unref_released(e, b);
+
+    return 0;
+}
+
+/* Self-locked. Like pa_memexport_process_release(), but takes the
+ * lock only once per batch of ids. Returns the number of ids that
+ * could not be released. */
+unsigned pa_memexport_process_release_batch(pa_memexport *e, const uint32_t *ids, unsigned n) {
+    pa_memblock *blocks[PA_MEMEXPORT_RELEASE_BATCH_MAX];
+    unsigned n_failed = 0;
+
+    pa_assert(e);
+    pa_assert(ids || n == 0);
+
+    while (n > 0) {
+        unsigned k, n_blocks = 0, m = PA_MIN(n, PA_MEMEXPORT_RELEASE_BATCH_MAX);
+
+        pa_mutex_lock(e->mutex);
+
+        for (k = 0; k < m; k++)
+            if ((blocks[n_blocks] = memexport_release_slot(e, ids[k])))
+                n_blocks++;
+            else
+                n_failed++;
+
+        pa_mutex_unlock(e->mutex);
+
+        /* Unref outside of the lock, since dropping the last
+         * reference of a reexported block calls into the import */
+        for (k = 0; k < n_blocks; k++)
+            memexport_unref_released(e, blocks[k]);
+
+        ids += m;
+        n -= m;
+    }
+
+    return n_failed;
 }
 
 /* Self-locked */
@@ -74,6 +74,17 @@ struct pa_mempool_stat {
     pa_atomic_t n_too_large_for_pool;
     pa_atomic_t n_pool_full;
 
+    /* Blocks (and their total size) that were imported by reference to
+     * shared memory and never had to be copied. Each block is counted
+     * once, and no longer once it's made local. */
+    pa_atomic_t n_zero_copy;
+    pa_atomic_t zero_copy_size;
+
+    /* Blocks (and their total size) that had to be copied into local
+     * memory because the shared or fixed memory they referred to went away */
+    pa_atomic_t n_made_local;
+    pa_atomic_t made_local_size;
+
     pa_atomic_t n_allocated_by_type[PA_MEMBLOCK_TYPE_MAX];
     pa_atomic_t n_accumulated_by_type[PA_MEMBLOCK_TYPE_MAX];
 };
@@ -155,5 +166,6 @@ void pa_memexport_free(pa_memexport *e);
 int pa_memexport_put(pa_memexport *e, pa_memblock *b, pa_mem_type_t *type, uint32_t *block_id,
                      uint32_t *shm_id, size_t *offset, size_t * size);
 int pa_memexport_process_release(pa_memexport *e, uint32_t id);
+unsigned pa_memexport_process_release_batch(pa_memexport *e, const uint32_t *ids, unsigned n);
 
 #endif
@@ -121,6 +121,25 @@ static const pa_calc_stream_volumes_func_t calc_stream_volumes_table[] = {
   [PA_SAMPLE_S24_32BE]  = (pa_calc_stream_volumes_func_t) calc_linear_integer_stream_volumes
 };
 
+/* special case: a single s16ne stream, i.e. just apply the volume while copying */
+static void pa_mix1_s16ne(pa_mix_info streams[], unsigned channels, int16_t *data, unsigned length) {
+    const int16_t *ptr = streams[0].ptr;
+    unsigned channel = 0;
+
+    length /= sizeof(int16_t);
+
+    for (; length > 0; length--) {
+        int32_t sum;
+
+        sum = pa_mult_s16_volume(*ptr++, streams[0].linear[channel].i);
+        sum = PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
+        *data++ = sum;
+
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
 /* special case: mix 2 s16ne streams, 1 channel each */
 static void pa_mix2_ch1_s16ne(pa_mix_info streams[], int16_t *data, unsigned length) {
     const int16_t *ptr0 = streams[0].ptr;
@@ -241,7 +260,9 @@ static void pa_mix_generic_s16ne(pa_mix_info streams[], unsigned nstreams, unsig
 }
 
 static void pa_mix_s16ne_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, int16_t *data, unsigned length) {
-    if (nstreams == 2 && channels == 1)
+    if (nstreams == 1)
+        pa_mix1_s16ne(streams, channels, data, length);
+    else if (nstreams == 2 && channels == 1)
         pa_mix2_ch1_s16ne(streams, data, length);
     else if (nstreams == 2 && channels == 2)
         pa_mix2_ch2_s16ne(streams, data, length);
@@ -628,7 +649,7 @@ size_t pa_mix(
     pa_assert(data);
     pa_assert(length);
     pa_assert(spec);
-    pa_assert(nstreams > 1);
+    pa_assert(nstreams > 0);
 
     if (!volume)
         volume = pa_cvolume_reset(&full_volume, spec->channels);
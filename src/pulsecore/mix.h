@@ -40,6 +40,10 @@ typedef struct pa_mix_info {
     } linear[PA_CHANNELS_MAX];
 } pa_mix_info;
 
+/* Mixes the streams into data, applying their volumes and volume on
+ * top. With a single stream this is a copy with volume applied in the
+ * same pass, which saves the separate pa_volume_memchunk() pass when
+ * the destination is the final buffer anyway. */
 size_t pa_mix(
     pa_mix_info channels[],
     unsigned nchannels,
@@ -187,6 +187,11 @@ enum {
      * BOTH DIRECTIONS */
     PA_COMMAND_REGISTER_MEMFD_SHMID,
 
+    /* Only if both sides announced PA_PROTOCOL_FLAG_SUBSCRIBE_FILTER
+     * resp. PA_PROTOCOL_FLAG_BATCH, see PROTOCOL */
+    PA_COMMAND_SUBSCRIBE_FILTER,
+    PA_COMMAND_BATCH,
+
     PA_COMMAND_MAX
 };
 
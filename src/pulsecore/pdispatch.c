@@ -199,6 +199,10 @@ static const char *command_names[PA_COMMAND_MAX] = {
     /* Supported since protocol v31 (9.0) */
     /* BOTH DIRECTIONS */
     [PA_COMMAND_REGISTER_MEMFD_SHMID] = "REGISTER_MEMFD_SHMID",
+
+    /* Negotiated with protocol flags */
+    [PA_COMMAND_SUBSCRIBE_FILTER] = "SUBSCRIBE_FILTER",
+    [PA_COMMAND_BATCH] = "BATCH",
 };
 
 #endif
@@ -25,4 +25,9 @@
 void pa_init_proplist(pa_proplist *p);
 char *pa_proplist_get_stream_group(pa_proplist *pl, const char *prefix, const char *cache);
 
+/* Returns a counter that changes whenever p is modified, so that data
+ * derived from p can be checked for being current. Implemented in
+ * pulse/proplist.c, since it needs the internals of pa_proplist. */
+unsigned pa_proplist_get_generation(const pa_proplist *p);
+
 #endif
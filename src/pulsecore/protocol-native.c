@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <pulse/batch.h>
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
 #include <pulse/version.h>
@@ -47,6 +48,7 @@
 #include <pulsecore/namereg.h>
 #include <pulsecore/core-scache.h>
 #include <pulsecore/core-subscribe.h>
+#include <pulsecore/info-cache.h>
 #include <pulsecore/log.h>
 #include <pulsecore/mem.h>
 #include <pulsecore/strlist.h>
@@ -69,10 +71,17 @@
 #define MAX_CONNECTIONS 64
 
 #define MAX_MEMBLOCKQ_LENGTH (4*1024*1024) /* 4MB */
+
+/* Initial guess for the size of one introspection record */
+#define DEFAULT_INFO_RECORD_SIZE 512
+
 #define DEFAULT_TLENGTH_MSEC 2000 /* 2s */
 #define DEFAULT_PROCESS_MSEC 20   /* 20ms */
 #define DEFAULT_FRAGSIZE_MSEC DEFAULT_TLENGTH_MSEC
 
+/* Don't accept more indexes than this in a single subscription filter */
+#define MAX_SUBSCRIBE_FILTER_INDEXES 4096
+
 struct pa_native_protocol;
 
 typedef struct record_stream {
@@ -173,6 +182,8 @@ struct pa_native_connection {
     pa_native_options *options;
     bool authorized:1;
     bool is_local:1;
+    bool has_subscribe_filter:1;
+    bool has_batch:1;
     uint32_t version;
     pa_client *client;
     /* R/W mempool, one per client connection, for srbchannel transport.
@@ -203,8 +214,30 @@ struct pa_native_protocol {
     pa_hook hooks[PA_NATIVE_HOOK_MAX];
 
     pa_hashmap *extensions;
+
+    /* Serialized introspection data */
+    pa_info_cache *info_cache;
+    pa_hook_slot *subscription_post_slot;
+
+    /* Average size of one record in the last list reply, per facility,
+     * used to allocate the next reply in one go */
+    size_t info_record_size[PA_SUBSCRIPTION_EVENT_FACILITY_MASK + 1];
+};
+
+/* The parts of an introspection reply that are cached. Only data that
+ * is covered by subscription CHANGE events or lives in the object's
+ * proplist may be cached, so anything else that changes silently
+ * (latencies, formats, module use counts, ...) is always serialized
+ * from scratch. */
+enum info_segment {
+    INFO_SEGMENT_FULL,
+    INFO_SEGMENT_PROPLIST,
+    INFO_SEGMENT_PORTS,
+    INFO_SEGMENT_MAX
 };
 
+typedef void (*info_segment_fill_t)(pa_native_connection *c, pa_tagstruct *t, void *object);
+
 enum {
     SOURCE_OUTPUT_MESSAGE_UPDATE_LATENCY = PA_SOURCE_OUTPUT_MESSAGE_MAX
 };
@@ -1816,6 +1849,27 @@ static void protocol_error(pa_native_connection *c) {
     native_connection_unlink(c);
 }
 
+/* While a batch is executed, the replies to its commands are recorded
+ * here instead of being sent. Commands are only dispatched from the
+ * main loop, so there is at most one batch in progress at a time. */
+static struct batch_reply {
+    pa_pstream *pstream;
+    uint32_t tag;
+    uint32_t error;
+    bool replied;
+} *current_batch_reply = NULL;
+
+static bool capture_batch_reply(pa_pstream *p, uint32_t tag, uint32_t error) {
+    struct batch_reply *r = current_batch_reply;
+
+    if (!r || r->pstream != p || r->tag != tag)
+        return false;
+
+    r->error = error;
+    r->replied = true;
+    return true;
+}
+
 #define CHECK_VALIDITY(pstream, expression, tag, error) do { \
 if (!(expression)) { \
     pa_pstream_send_error((pstream), (tag), (error)); \
@@ -1830,6 +1884,25 @@ if (!(expression)) { \
 } \
 } while(0);
 
+/* Replies of the commands that may be part of a batch, see
+ * command_is_batchable(). Only their handlers use these. */
+static void batch_send_error(pa_pstream *p, uint32_t tag, uint32_t error) {
+    if (!capture_batch_reply(p, tag, error))
+        pa_pstream_send_error(p, tag, error);
+}
+
+static void batch_send_simple_ack(pa_pstream *p, uint32_t tag) {
+    if (!capture_batch_reply(p, tag, PA_OK))
+        pa_pstream_send_simple_ack(p, tag);
+}
+
+#define BATCH_CHECK_VALIDITY(pstream, expression, tag, error) do { \
+if (!(expression)) { \
+    batch_send_error((pstream), (tag), (error)); \
+    return; \
+} \
+} while(0);
+
 static pa_tagstruct *reply_new(uint32_t tag) {
     pa_tagstruct *reply;
 
@@ -2541,6 +2614,7 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
     pa_tagstruct *reply;
     pa_mem_type_t shm_type;
     bool shm_on_remote = false, do_shm;
+    uint32_t extensions = 0;
 
     pa_native_connection_assert_ref(c);
     pa_assert(t);
@@ -2569,6 +2643,10 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
         if ((c->version & PA_PROTOCOL_VERSION_MASK) >= 31)
             memfd_on_remote = !!(c->version & PA_PROTOCOL_FLAG_MEMFD);
 
+        /* Extensions are only announced back to clients that announced
+         * them, older ones don't expect any other flags in the reply. */
+        extensions = c->version & PA_PROTOCOL_FLAG_EXTENSIONS;
+
         /* Reserve the two most-significant _bytes_ of the version tag
          * for flags. */
         c->version &= PA_PROTOCOL_VERSION_MASK;
@@ -2658,6 +2736,14 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
     pa_log_debug("Negotiated SHM: %s", pa_yes_no(do_shm));
     pa_pstream_enable_shm(c->pstream, do_shm);
 
+    /* Block releases and revokes are coalesced into one frame for
+     * clients that announced they know how to handle that. */
+    if (do_shm && (extensions & PA_PROTOCOL_FLAG_SHM_BATCHING))
+        pa_pstream_enable_shm_batching(c->pstream);
+
+    c->has_subscribe_filter = !!(extensions & PA_PROTOCOL_FLAG_SUBSCRIBE_FILTER);
+    c->has_batch = !!(extensions & PA_PROTOCOL_FLAG_BATCH);
+
     /* Do not declare memfd support for 9.0 client libraries (protocol v31).
      *
      * Although they support memfd transport, such 9.0 clients has an iochannel
@@ -2681,7 +2767,7 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
 
     reply = reply_new(tag);
     pa_tagstruct_putu32(reply, PA_PROTOCOL_VERSION | (do_shm ? 0x80000000 : 0) |
-                        (do_memfd ? 0x40000000 : 0));
+                        (do_memfd ? 0x40000000 : 0) | extensions);
 
 #ifdef HAVE_CREDS
 {
@@ -3135,6 +3221,89 @@ static void fixup_sample_spec(pa_native_connection *c, pa_sample_spec *fixed, co
     }
 }
 
+static pa_hook_result_t subscription_post_cb(pa_core *core, pa_subscription_post_data *data, pa_native_protocol *p) {
+    pa_subscription_event_type_t facility;
+
+    pa_assert(data);
+    pa_assert(p);
+
+    facility = data->type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+    pa_info_cache_invalidate(p->info_cache, facility, data->index);
+
+    /* Changes of port availability are only announced for the card,
+     * but the ports are part of the sink and source info as well */
+    if (facility == PA_SUBSCRIPTION_EVENT_CARD) {
+        pa_sink *sink;
+        pa_source *source;
+        uint32_t idx;
+
+        PA_IDXSET_FOREACH(sink, core->sinks, idx)
+            if (sink->card && sink->card->index == data->index)
+                pa_info_cache_invalidate(p->info_cache, PA_SUBSCRIPTION_EVENT_SINK, sink->index);
+
+        PA_IDXSET_FOREACH(source, core->sources, idx)
+            if (source->card && source->card->index == data->index)
+                pa_info_cache_invalidate(p->info_cache, PA_SUBSCRIPTION_EVENT_SOURCE, source->index);
+    }
+
+    return PA_HOOK_OK;
+}
+
+/* Serialize one segment of an introspection reply, reusing the cached
+ * data if the object has not changed since it was last serialized */
+static void put_info_segment(
+        pa_native_connection *c,
+        pa_tagstruct *t,
+        bool cacheable,
+        pa_subscription_event_type_t facility,
+        uint32_t idx,
+        pa_proplist *proplist,
+        enum info_segment segment,
+        info_segment_fill_t fill,
+        void *object) {
+
+    if (!cacheable) {
+        fill(c, t, object);
+        return;
+    }
+
+    pa_info_cache_put(c->protocol->info_cache, t, facility, idx, proplist, c->version, segment,
+                      (pa_info_cache_fill_cb_t) fill, object, c);
+}
+
+static void proplist_fill(pa_native_connection *c, pa_tagstruct *t, void *object) {
+    pa_tagstruct_put_proplist(t, object);
+}
+
+static void device_ports_fill(pa_native_connection *c, pa_tagstruct *t, pa_hashmap *ports, pa_device_port *active_port) {
+    void *state;
+    pa_device_port *p;
+
+    pa_tagstruct_putu32(t, pa_hashmap_size(ports));
+
+    PA_HASHMAP_FOREACH(p, ports, state) {
+        pa_tagstruct_puts(t, p->name);
+        pa_tagstruct_puts(t, p->description);
+        pa_tagstruct_putu32(t, p->priority);
+        if (c->version >= 24)
+            pa_tagstruct_putu32(t, p->available);
+    }
+
+    pa_tagstruct_puts(t, active_port ? active_port->name : NULL);
+}
+
+static void sink_ports_fill(pa_native_connection *c, pa_tagstruct *t, void *object) {
+    pa_sink *sink = object;
+
+    device_ports_fill(c, t, sink->ports, sink->active_port);
+}
+
+static void source_ports_fill(pa_native_connection *c, pa_tagstruct *t, void *object) {
+    pa_source *source = object;
+
+    device_ports_fill(c, t, source->ports, source->active_port);
+}
+
 static void sink_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sink *sink) {
     pa_sample_spec fixed_ss;
 
@@ -3161,7 +3330,8 @@ static void sink_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sin
         PA_TAG_INVALID);
 
     if (c->version >= 13) {
-        pa_tagstruct_put_proplist(t, sink->proplist);
+        put_info_segment(c, t, PA_SINK_IS_LINKED(sink->state), PA_SUBSCRIPTION_EVENT_SINK, sink->index,
+                         sink->proplist, INFO_SEGMENT_PROPLIST, proplist_fill, sink->proplist);
         pa_tagstruct_put_usec(t, pa_sink_get_requested_latency(sink));
     }
 
@@ -3174,22 +3344,9 @@ static void sink_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sin
         pa_tagstruct_putu32(t, sink->card ? sink->card->index : PA_INVALID_INDEX);
     }
 
-    if (c->version >= 16) {
-        void *state;
-        pa_device_port *p;
-
-        pa_tagstruct_putu32(t, pa_hashmap_size(sink->ports));
-
-        PA_HASHMAP_FOREACH(p, sink->ports, state) {
-            pa_tagstruct_puts(t, p->name);
-            pa_tagstruct_puts(t, p->description);
-            pa_tagstruct_putu32(t, p->priority);
-            if (c->version >= 24)
-                pa_tagstruct_putu32(t, p->available);
-        }
-
-        pa_tagstruct_puts(t, sink->active_port ? sink->active_port->name : NULL);
-    }
+    if (c->version >= 16)
+        put_info_segment(c, t, PA_SINK_IS_LINKED(sink->state), PA_SUBSCRIPTION_EVENT_SINK, sink->index,
+                         sink->proplist, INFO_SEGMENT_PORTS, sink_ports_fill, sink);
 
     if (c->version >= 21) {
         uint32_t i;
@@ -3231,7 +3388,8 @@ static void source_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_s
         PA_TAG_INVALID);
 
     if (c->version >= 13) {
-        pa_tagstruct_put_proplist(t, source->proplist);
+        put_info_segment(c, t, PA_SOURCE_IS_LINKED(source->state), PA_SUBSCRIPTION_EVENT_SOURCE, source->index,
+                         source->proplist, INFO_SEGMENT_PROPLIST, proplist_fill, source->proplist);
         pa_tagstruct_put_usec(t, pa_source_get_requested_latency(source));
     }
 
@@ -3244,22 +3402,9 @@ static void source_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_s
         pa_tagstruct_putu32(t, source->card ? source->card->index : PA_INVALID_INDEX);
     }
 
-    if (c->version >= 16) {
-        void *state;
-        pa_device_port *p;
-
-        pa_tagstruct_putu32(t, pa_hashmap_size(source->ports));
-
-        PA_HASHMAP_FOREACH(p, source->ports, state) {
-            pa_tagstruct_puts(t, p->name);
-            pa_tagstruct_puts(t, p->description);
-            pa_tagstruct_putu32(t, p->priority);
-            if (c->version >= 24)
-                pa_tagstruct_putu32(t, p->available);
-        }
-
-        pa_tagstruct_puts(t, source->active_port ? source->active_port->name : NULL);
-    }
+    if (c->version >= 16)
+        put_info_segment(c, t, PA_SOURCE_IS_LINKED(source->state), PA_SUBSCRIPTION_EVENT_SOURCE, source->index,
+                         source->proplist, INFO_SEGMENT_PORTS, source_ports_fill, source);
 
     if (c->version >= 22) {
         uint32_t i;
@@ -3275,7 +3420,9 @@ static void source_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_s
     }
 }
 
-static void client_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_client *client) {
+static void client_info_fill(pa_native_connection *c, pa_tagstruct *t, void *object) {
+    pa_client *client = object;
+
     pa_assert(t);
     pa_assert(client);
 
@@ -3288,7 +3435,12 @@ static void client_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_c
         pa_tagstruct_put_proplist(t, client->proplist);
 }
 
-static void card_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_card *card) {
+static void client_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_client *client) {
+    put_info_segment(c, t, true, PA_SUBSCRIPTION_EVENT_CLIENT, client->index, client->proplist, INFO_SEGMENT_FULL, client_info_fill, client);
+}
+
+static void card_info_fill(pa_native_connection *c, pa_tagstruct *t, void *object) {
+    pa_card *card = object;
     void *state = NULL;
     pa_card_profile *p;
     pa_device_port *port;
@@ -3342,6 +3494,10 @@ static void card_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_car
     }
 }
 
+static void card_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_card *card) {
+    put_info_segment(c, t, card->linked, PA_SUBSCRIPTION_EVENT_CARD, card->index, card->proplist, INFO_SEGMENT_FULL, card_info_fill, card);
+}
+
 static void module_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_module *module) {
     pa_assert(t);
     pa_assert(module);
@@ -3355,7 +3511,8 @@ static void module_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_m
         pa_tagstruct_put_boolean(t, false); /* autoload is obsolete */
 
     if (c->version >= 15)
-        pa_tagstruct_put_proplist(t, module->proplist);
+        put_info_segment(c, t, true, PA_SUBSCRIPTION_EVENT_MODULE, module->index,
+                         module->proplist, INFO_SEGMENT_PROPLIST, proplist_fill, module->proplist);
 }
 
 static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sink_input *s) {
@@ -3390,7 +3547,8 @@ static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t,
     if (c->version >= 11)
         pa_tagstruct_put_boolean(t, s->muted);
     if (c->version >= 13)
-        pa_tagstruct_put_proplist(t, s->proplist);
+        put_info_segment(c, t, PA_SINK_INPUT_IS_LINKED(s->state), PA_SUBSCRIPTION_EVENT_SINK_INPUT, s->index,
+                         s->proplist, INFO_SEGMENT_PROPLIST, proplist_fill, s->proplist);
     if (c->version >= 19)
         pa_tagstruct_put_boolean(t, (pa_sink_input_get_state(s) == PA_SINK_INPUT_CORKED));
     if (c->version >= 20) {
@@ -3430,7 +3588,8 @@ static void source_output_fill_tagstruct(pa_native_connection *c, pa_tagstruct *
     pa_tagstruct_puts(t, pa_resample_method_to_string(pa_source_output_get_resample_method(s)));
     pa_tagstruct_puts(t, s->driver);
     if (c->version >= 13)
-        pa_tagstruct_put_proplist(t, s->proplist);
+        put_info_segment(c, t, PA_SOURCE_OUTPUT_IS_LINKED(s->state), PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT, s->index,
+                         s->proplist, INFO_SEGMENT_PROPLIST, proplist_fill, s->proplist);
     if (c->version >= 19)
         pa_tagstruct_put_boolean(t, (pa_source_output_get_state(s) == PA_SOURCE_OUTPUT_CORKED));
     if (c->version >= 22) {
@@ -3471,7 +3630,8 @@ static void scache_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_s
     pa_tagstruct_puts(t, e->filename);
 
     if (c->version >= 13)
-        pa_tagstruct_put_proplist(t, e->proplist);
+        put_info_segment(c, t, true, PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE, e->index,
+                         e->proplist, INFO_SEGMENT_PROPLIST, proplist_fill, e->proplist);
 }
 
 static void command_get_info(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -3576,6 +3736,10 @@ static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t t
     uint32_t idx;
     void *p;
     pa_tagstruct *reply;
+    pa_subscription_event_type_t facility;
+    size_t header_length, length;
+    unsigned n;
+    uint64_t hits, misses;
 
     pa_native_connection_assert_ref(c);
     pa_assert(t);
@@ -3589,23 +3753,42 @@ static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t t
 
     reply = reply_new(tag);
 
-    if (command == PA_COMMAND_GET_SINK_INFO_LIST)
+    if (command == PA_COMMAND_GET_SINK_INFO_LIST) {
         i = c->protocol->core->sinks;
-    else if (command == PA_COMMAND_GET_SOURCE_INFO_LIST)
+        facility = PA_SUBSCRIPTION_EVENT_SINK;
+    } else if (command == PA_COMMAND_GET_SOURCE_INFO_LIST) {
         i = c->protocol->core->sources;
-    else if (command == PA_COMMAND_GET_CLIENT_INFO_LIST)
+        facility = PA_SUBSCRIPTION_EVENT_SOURCE;
+    } else if (command == PA_COMMAND_GET_CLIENT_INFO_LIST) {
         i = c->protocol->core->clients;
-    else if (command == PA_COMMAND_GET_CARD_INFO_LIST)
+        facility = PA_SUBSCRIPTION_EVENT_CLIENT;
+    } else if (command == PA_COMMAND_GET_CARD_INFO_LIST) {
         i = c->protocol->core->cards;
-    else if (command == PA_COMMAND_GET_MODULE_INFO_LIST)
+        facility = PA_SUBSCRIPTION_EVENT_CARD;
+    } else if (command == PA_COMMAND_GET_MODULE_INFO_LIST) {
         i = c->protocol->core->modules;
-    else if (command == PA_COMMAND_GET_SINK_INPUT_INFO_LIST)
+        facility = PA_SUBSCRIPTION_EVENT_MODULE;
+    } else if (command == PA_COMMAND_GET_SINK_INPUT_INFO_LIST) {
         i = c->protocol->core->sink_inputs;
-    else if (command == PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST)
+        facility = PA_SUBSCRIPTION_EVENT_SINK_INPUT;
+    } else if (command == PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST) {
         i = c->protocol->core->source_outputs;
-    else {
+        facility = PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT;
+    } else {
         pa_assert(command == PA_COMMAND_GET_SAMPLE_INFO_LIST);
         i = c->protocol->core->scache;
+        facility = PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE;
+    }
+
+    n = i ? pa_idxset_size(i) : 0;
+    pa_tagstruct_data(reply, &header_length);
+
+    /* Size the reply up front from what the records took last time, so
+     * that it is built without reallocations in the common case */
+    if (n > 0) {
+        size_t record_size = c->protocol->info_record_size[facility];
+
+        pa_tagstruct_reserve(reply, n * (record_size > 0 ? record_size : DEFAULT_INFO_RECORD_SIZE));
     }
 
     if (i) {
@@ -3631,7 +3814,16 @@ static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t t
         }
     }
 
+    if (n > 0) {
+        pa_tagstruct_data(reply, &length);
+        c->protocol->info_record_size[facility] = (length - header_length + n - 1) / n;
+    }
+
     pa_pstream_send_tagstruct(c->pstream, reply);
+
+    pa_info_cache_get_stats(c->protocol->info_cache, &hits, &misses);
+    pa_log_debug("Introspection cache: %llu hits, %llu misses.",
+                 (unsigned long long) hits, (unsigned long long) misses);
 }
 
 static void command_get_server_info(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -3716,12 +3908,61 @@ static void command_subscribe(pa_pdispatch *pd, uint32_t command, uint32_t tag,
     if (m != 0) {
         c->subscription = pa_subscription_new(c->protocol->core, m, subscription_cb, c);
         pa_assert(c->subscription);
+
+        if (c->options->subscription_coalesce_interval > 0)
+            pa_subscription_set_coalesce_interval(c->subscription, c->options->subscription_coalesce_interval);
     } else
         c->subscription = NULL;
 
     pa_pstream_send_simple_ack(c->pstream, tag);
 }
 
+static void command_subscribe_filter(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    uint32_t facility, n, i;
+    uint32_t *indexes = NULL;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    /* Without the flag the client may mean something else by this
+     * command number, so don't even try to parse it */
+    CHECK_VALIDITY(c->pstream, c->has_subscribe_filter, tag, PA_ERR_NOTSUPPORTED);
+
+    if (pa_tagstruct_getu32(t, &facility) < 0 ||
+        pa_tagstruct_getu32(t, &n) < 0 ||
+        n > MAX_SUBSCRIBE_FILTER_INDEXES) {
+        protocol_error(c);
+        return;
+    }
+
+    if (n > 0)
+        indexes = pa_xnew(uint32_t, n);
+
+    for (i = 0; i < n; i++)
+        if (pa_tagstruct_getu32(t, &indexes[i]) < 0) {
+            pa_xfree(indexes);
+            protocol_error(c);
+            return;
+        }
+
+    if (!pa_tagstruct_eof(t)) {
+        pa_xfree(indexes);
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY_GOTO(c->pstream, c->authorized, tag, PA_ERR_ACCESS, finish);
+    CHECK_VALIDITY_GOTO(c->pstream, (facility & ~PA_SUBSCRIPTION_EVENT_FACILITY_MASK) == 0, tag, PA_ERR_INVALID, finish);
+    CHECK_VALIDITY_GOTO(c->pstream, c->subscription, tag, PA_ERR_BADSTATE, finish);
+
+    pa_subscription_set_filter(c->subscription, facility, indexes, n);
+    pa_pstream_send_simple_ack(c->pstream, tag);
+
+finish:
+    pa_xfree(indexes);
+}
+
 static void command_set_volume(
         pa_pdispatch *pd,
         uint32_t command,
@@ -3751,10 +3992,10 @@ static void command_set_volume(
         return;
     }
 
-    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
-    CHECK_VALIDITY(c->pstream, !name || pa_namereg_is_valid_name_or_wildcard(name, command == PA_COMMAND_SET_SINK_VOLUME ? PA_NAMEREG_SINK : PA_NAMEREG_SOURCE), tag, PA_ERR_INVALID);
-    CHECK_VALIDITY(c->pstream, (idx != PA_INVALID_INDEX) ^ (name != NULL), tag, PA_ERR_INVALID);
-    CHECK_VALIDITY(c->pstream, pa_cvolume_valid(&volume), tag, PA_ERR_INVALID);
+    BATCH_CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    BATCH_CHECK_VALIDITY(c->pstream, !name || pa_namereg_is_valid_name_or_wildcard(name, command == PA_COMMAND_SET_SINK_VOLUME ? PA_NAMEREG_SINK : PA_NAMEREG_SOURCE), tag, PA_ERR_INVALID);
+    BATCH_CHECK_VALIDITY(c->pstream, (idx != PA_INVALID_INDEX) ^ (name != NULL), tag, PA_ERR_INVALID);
+    BATCH_CHECK_VALIDITY(c->pstream, pa_cvolume_valid(&volume), tag, PA_ERR_INVALID);
 
     switch (command) {
 
@@ -3784,31 +4025,31 @@ static void command_set_volume(
             pa_assert_not_reached();
     }
 
-    CHECK_VALIDITY(c->pstream, si || so || sink || source, tag, PA_ERR_NOENTITY);
+    BATCH_CHECK_VALIDITY(c->pstream, si || so || sink || source, tag, PA_ERR_NOENTITY);
 
     client_name = pa_strnull(pa_proplist_gets(c->client->proplist, PA_PROP_APPLICATION_PROCESS_BINARY));
 
     if (sink) {
-        CHECK_VALIDITY(c->pstream, volume.channels == 1 || pa_cvolume_compatible(&volume, &sink->sample_spec), tag, PA_ERR_INVALID);
+        BATCH_CHECK_VALIDITY(c->pstream, volume.channels == 1 || pa_cvolume_compatible(&volume, &sink->sample_spec), tag, PA_ERR_INVALID);
 
         pa_log_debug("Client %s changes volume of sink %s.", client_name, sink->name);
         pa_sink_set_volume(sink, &volume, true, true);
     } else if (source) {
-        CHECK_VALIDITY(c->pstream, volume.channels == 1 || pa_cvolume_compatible(&volume, &source->sample_spec), tag, PA_ERR_INVALID);
+        BATCH_CHECK_VALIDITY(c->pstream, volume.channels == 1 || pa_cvolume_compatible(&volume, &source->sample_spec), tag, PA_ERR_INVALID);
 
         pa_log_debug("Client %s changes volume of source %s.", client_name, source->name);
         pa_source_set_volume(source, &volume, true, true);
     } else if (si) {
-        CHECK_VALIDITY(c->pstream, si->volume_writable, tag, PA_ERR_BADSTATE);
-        CHECK_VALIDITY(c->pstream, volume.channels == 1 || pa_cvolume_compatible(&volume, &si->sample_spec), tag, PA_ERR_INVALID);
+        BATCH_CHECK_VALIDITY(c->pstream, si->volume_writable, tag, PA_ERR_BADSTATE);
+        BATCH_CHECK_VALIDITY(c->pstream, volume.channels == 1 || pa_cvolume_compatible(&volume, &si->sample_spec), tag, PA_ERR_INVALID);
 
         pa_log_debug("Client %s changes volume of sink input %s.",
                      client_name,
                      pa_strnull(pa_proplist_gets(si->proplist, PA_PROP_MEDIA_NAME)));
         pa_sink_input_set_volume(si, &volume, true, true);
     } else if (so) {
-        CHECK_VALIDITY(c->pstream, so->volume_writable, tag, PA_ERR_BADSTATE);
-        CHECK_VALIDITY(c->pstream, volume.channels == 1 || pa_cvolume_compatible(&volume, &so->sample_spec), tag, PA_ERR_INVALID);
+        BATCH_CHECK_VALIDITY(c->pstream, so->volume_writable, tag, PA_ERR_BADSTATE);
+        BATCH_CHECK_VALIDITY(c->pstream, volume.channels == 1 || pa_cvolume_compatible(&volume, &so->sample_spec), tag, PA_ERR_INVALID);
 
         pa_log_debug("Client %s changes volume of source output %s.",
                      client_name,
@@ -3816,7 +4057,7 @@ static void command_set_volume(
         pa_source_output_set_volume(so, &volume, true, true);
     }
 
-    pa_pstream_send_simple_ack(c->pstream, tag);
+    batch_send_simple_ack(c->pstream, tag);
 }
 
 static void command_set_mute(
@@ -3847,9 +4088,9 @@ static void command_set_mute(
         return;
     }
 
-    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
-    CHECK_VALIDITY(c->pstream, !name || pa_namereg_is_valid_name_or_wildcard(name, command == PA_COMMAND_SET_SINK_MUTE ? PA_NAMEREG_SINK : PA_NAMEREG_SOURCE), tag, PA_ERR_INVALID);
-    CHECK_VALIDITY(c->pstream, (idx != PA_INVALID_INDEX) ^ (name != NULL), tag, PA_ERR_INVALID);
+    BATCH_CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    BATCH_CHECK_VALIDITY(c->pstream, !name || pa_namereg_is_valid_name_or_wildcard(name, command == PA_COMMAND_SET_SINK_MUTE ? PA_NAMEREG_SINK : PA_NAMEREG_SOURCE), tag, PA_ERR_INVALID);
+    BATCH_CHECK_VALIDITY(c->pstream, (idx != PA_INVALID_INDEX) ^ (name != NULL), tag, PA_ERR_INVALID);
 
     switch (command) {
 
@@ -3881,7 +4122,7 @@ static void command_set_mute(
             pa_assert_not_reached();
     }
 
-    CHECK_VALIDITY(c->pstream, si || so || sink || source, tag, PA_ERR_NOENTITY);
+    BATCH_CHECK_VALIDITY(c->pstream, si || so || sink || source, tag, PA_ERR_NOENTITY);
 
     client_name = pa_strnull(pa_proplist_gets(c->client->proplist, PA_PROP_APPLICATION_PROCESS_BINARY));
 
@@ -3903,7 +4144,7 @@ static void command_set_mute(
         pa_source_output_set_mute(so, mute, true);
     }
 
-    pa_pstream_send_simple_ack(c->pstream, tag);
+    batch_send_simple_ack(c->pstream, tag);
 }
 
 static void command_cork_playback_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -4338,14 +4579,14 @@ static void command_set_default_sink_or_source(pa_pdispatch *pd, uint32_t comman
         return;
     }
 
-    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
-    CHECK_VALIDITY(c->pstream, !s || pa_namereg_is_valid_name(s), tag, PA_ERR_INVALID);
+    BATCH_CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    BATCH_CHECK_VALIDITY(c->pstream, !s || pa_namereg_is_valid_name(s), tag, PA_ERR_INVALID);
 
     if (command == PA_COMMAND_SET_DEFAULT_SOURCE) {
         pa_source *source;
 
         source = pa_namereg_get(c->protocol->core, s, PA_NAMEREG_SOURCE);
-        CHECK_VALIDITY(c->pstream, source, tag, PA_ERR_NOENTITY);
+        BATCH_CHECK_VALIDITY(c->pstream, source, tag, PA_ERR_NOENTITY);
 
         pa_namereg_set_default_source(c->protocol->core, source);
     } else {
@@ -4353,12 +4594,12 @@ static void command_set_default_sink_or_source(pa_pdispatch *pd, uint32_t comman
         pa_assert(command == PA_COMMAND_SET_DEFAULT_SINK);
 
         sink = pa_namereg_get(c->protocol->core, s, PA_NAMEREG_SINK);
-        CHECK_VALIDITY(c->pstream, sink, tag, PA_ERR_NOENTITY);
+        BATCH_CHECK_VALIDITY(c->pstream, sink, tag, PA_ERR_NOENTITY);
 
         pa_namereg_set_default_sink(c->protocol->core, sink);
     }
 
-    pa_pstream_send_simple_ack(c->pstream, tag);
+    batch_send_simple_ack(c->pstream, tag);
 }
 
 static void command_set_stream_name(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -4517,11 +4758,11 @@ static void command_move_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag
         return;
     }
 
-    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
-    CHECK_VALIDITY(c->pstream, idx != PA_INVALID_INDEX, tag, PA_ERR_INVALID);
+    BATCH_CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    BATCH_CHECK_VALIDITY(c->pstream, idx != PA_INVALID_INDEX, tag, PA_ERR_INVALID);
 
-    CHECK_VALIDITY(c->pstream, !name_device || pa_namereg_is_valid_name_or_wildcard(name_device, command == PA_COMMAND_MOVE_SINK_INPUT ? PA_NAMEREG_SINK : PA_NAMEREG_SOURCE), tag, PA_ERR_INVALID);
-    CHECK_VALIDITY(c->pstream, (idx_device != PA_INVALID_INDEX) ^ (name_device != NULL), tag, PA_ERR_INVALID);
+    BATCH_CHECK_VALIDITY(c->pstream, !name_device || pa_namereg_is_valid_name_or_wildcard(name_device, command == PA_COMMAND_MOVE_SINK_INPUT ? PA_NAMEREG_SINK : PA_NAMEREG_SOURCE), tag, PA_ERR_INVALID);
+    BATCH_CHECK_VALIDITY(c->pstream, (idx_device != PA_INVALID_INDEX) ^ (name_device != NULL), tag, PA_ERR_INVALID);
 
     if (command == PA_COMMAND_MOVE_SINK_INPUT) {
         pa_sink_input *si = NULL;
@@ -4534,10 +4775,10 @@ static void command_move_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag
         else
             sink = pa_namereg_get(c->protocol->core, name_device, PA_NAMEREG_SINK);
 
-        CHECK_VALIDITY(c->pstream, si && sink, tag, PA_ERR_NOENTITY);
+        BATCH_CHECK_VALIDITY(c->pstream, si && sink, tag, PA_ERR_NOENTITY);
 
         if (pa_sink_input_move_to(si, sink, true) < 0) {
-            pa_pstream_send_error(c->pstream, tag, PA_ERR_INVALID);
+            batch_send_error(c->pstream, tag, PA_ERR_INVALID);
             return;
         }
     } else {
@@ -4553,15 +4794,15 @@ static void command_move_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag
         else
             source = pa_namereg_get(c->protocol->core, name_device, PA_NAMEREG_SOURCE);
 
-        CHECK_VALIDITY(c->pstream, so && source, tag, PA_ERR_NOENTITY);
+        BATCH_CHECK_VALIDITY(c->pstream, so && source, tag, PA_ERR_NOENTITY);
 
         if (pa_source_output_move_to(so, source, true) < 0) {
-            pa_pstream_send_error(c->pstream, tag, PA_ERR_INVALID);
+            batch_send_error(c->pstream, tag, PA_ERR_INVALID);
             return;
         }
     }
 
-    pa_pstream_send_simple_ack(c->pstream, tag);
+    batch_send_simple_ack(c->pstream, tag);
 }
 
 static void command_suspend(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -4705,28 +4946,28 @@ static void command_set_card_profile(pa_pdispatch *pd, uint32_t command, uint32_
         return;
     }
 
-    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
-    CHECK_VALIDITY(c->pstream, !name || pa_namereg_is_valid_name(name), tag, PA_ERR_INVALID);
-    CHECK_VALIDITY(c->pstream, (idx != PA_INVALID_INDEX) ^ (name != NULL), tag, PA_ERR_INVALID);
-    CHECK_VALIDITY(c->pstream, profile_name, tag, PA_ERR_INVALID);
+    BATCH_CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    BATCH_CHECK_VALIDITY(c->pstream, !name || pa_namereg_is_valid_name(name), tag, PA_ERR_INVALID);
+    BATCH_CHECK_VALIDITY(c->pstream, (idx != PA_INVALID_INDEX) ^ (name != NULL), tag, PA_ERR_INVALID);
+    BATCH_CHECK_VALIDITY(c->pstream, profile_name, tag, PA_ERR_INVALID);
 
     if (idx != PA_INVALID_INDEX)
         card = pa_idxset_get_by_index(c->protocol->core->cards, idx);
     else
         card = pa_namereg_get(c->protocol->core, name, PA_NAMEREG_CARD);
 
-    CHECK_VALIDITY(c->pstream, card, tag, PA_ERR_NOENTITY);
+    BATCH_CHECK_VALIDITY(c->pstream, card, tag, PA_ERR_NOENTITY);
 
     profile = pa_hashmap_get(card->profiles, profile_name);
 
-    CHECK_VALIDITY(c->pstream, profile, tag, PA_ERR_NOENTITY);
+    BATCH_CHECK_VALIDITY(c->pstream, profile, tag, PA_ERR_NOENTITY);
 
     if ((ret = pa_card_set_profile(card, profile, true)) < 0) {
-        pa_pstream_send_error(c->pstream, tag, -ret);
+        batch_send_error(c->pstream, tag, -ret);
         return;
     }
 
-    pa_pstream_send_simple_ack(c->pstream, tag);
+    batch_send_simple_ack(c->pstream, tag);
 }
 
 static void command_set_sink_or_source_port(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -4746,10 +4987,10 @@ static void command_set_sink_or_source_port(pa_pdispatch *pd, uint32_t command,
         return;
     }
 
-    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
-    CHECK_VALIDITY(c->pstream, !name || pa_namereg_is_valid_name_or_wildcard(name, command == PA_COMMAND_SET_SINK_PORT ? PA_NAMEREG_SINK : PA_NAMEREG_SOURCE), tag, PA_ERR_INVALID);
-    CHECK_VALIDITY(c->pstream, (idx != PA_INVALID_INDEX) ^ (name != NULL), tag, PA_ERR_INVALID);
-    CHECK_VALIDITY(c->pstream, port, tag, PA_ERR_INVALID);
+    BATCH_CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    BATCH_CHECK_VALIDITY(c->pstream, !name || pa_namereg_is_valid_name_or_wildcard(name, command == PA_COMMAND_SET_SINK_PORT ? PA_NAMEREG_SINK : PA_NAMEREG_SOURCE), tag, PA_ERR_INVALID);
+    BATCH_CHECK_VALIDITY(c->pstream, (idx != PA_INVALID_INDEX) ^ (name != NULL), tag, PA_ERR_INVALID);
+    BATCH_CHECK_VALIDITY(c->pstream, port, tag, PA_ERR_INVALID);
 
     if (command == PA_COMMAND_SET_SINK_PORT) {
         pa_sink *sink;
@@ -4759,10 +5000,10 @@ static void command_set_sink_or_source_port(pa_pdispatch *pd, uint32_t command,
         else
             sink = pa_namereg_get(c->protocol->core, name, PA_NAMEREG_SINK);
 
-        CHECK_VALIDITY(c->pstream, sink, tag, PA_ERR_NOENTITY);
+        BATCH_CHECK_VALIDITY(c->pstream, sink, tag, PA_ERR_NOENTITY);
 
         if ((ret = pa_sink_set_port(sink, port, true)) < 0) {
-            pa_pstream_send_error(c->pstream, tag, -ret);
+            batch_send_error(c->pstream, tag, -ret);
             return;
         }
     } else {
@@ -4775,15 +5016,15 @@ static void command_set_sink_or_source_port(pa_pdispatch *pd, uint32_t command,
         else
             source = pa_namereg_get(c->protocol->core, name, PA_NAMEREG_SOURCE);
 
-        CHECK_VALIDITY(c->pstream, source, tag, PA_ERR_NOENTITY);
+        BATCH_CHECK_VALIDITY(c->pstream, source, tag, PA_ERR_NOENTITY);
 
         if ((ret = pa_source_set_port(source, port, true)) < 0) {
-            pa_pstream_send_error(c->pstream, tag, -ret);
+            batch_send_error(c->pstream, tag, -ret);
             return;
         }
     }
 
-    pa_pstream_send_simple_ack(c->pstream, tag);
+    batch_send_simple_ack(c->pstream, tag);
 }
 
 static void command_set_port_latency_offset(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -4826,6 +5067,8 @@ static void command_set_port_latency_offset(pa_pdispatch *pd, uint32_t command,
     pa_pstream_send_simple_ack(c->pstream, tag);
 }
 
+static void command_batch(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+
 static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
     [PA_COMMAND_ERROR] = NULL,
     [PA_COMMAND_TIMEOUT] = NULL,
@@ -4932,9 +5175,139 @@ static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
 
     [PA_COMMAND_REGISTER_MEMFD_SHMID] = command_register_memfd_shmid,
 
+    /* Only for clients that announced PA_PROTOCOL_FLAG_SUBSCRIBE_FILTER
+     * resp. PA_PROTOCOL_FLAG_BATCH */
+    [PA_COMMAND_SUBSCRIBE_FILTER] = command_subscribe_filter,
+    [PA_COMMAND_BATCH] = command_batch,
+
     [PA_COMMAND_EXTENSION] = command_extension
 };
 
+/* Only commands that are answered with nothing but a simple ack or an
+ * error may be part of a batch */
+static bool command_is_batchable(uint32_t command) {
+    switch (command) {
+        case PA_COMMAND_SET_SINK_VOLUME:
+        case PA_COMMAND_SET_SINK_INPUT_VOLUME:
+        case PA_COMMAND_SET_SOURCE_VOLUME:
+        case PA_COMMAND_SET_SOURCE_OUTPUT_VOLUME:
+        case PA_COMMAND_SET_SINK_MUTE:
+        case PA_COMMAND_SET_SINK_INPUT_MUTE:
+        case PA_COMMAND_SET_SOURCE_MUTE:
+        case PA_COMMAND_SET_SOURCE_OUTPUT_MUTE:
+        case PA_COMMAND_SET_DEFAULT_SINK:
+        case PA_COMMAND_SET_DEFAULT_SOURCE:
+        case PA_COMMAND_MOVE_SINK_INPUT:
+        case PA_COMMAND_MOVE_SOURCE_OUTPUT:
+        case PA_COMMAND_SET_CARD_PROFILE:
+        case PA_COMMAND_SET_SINK_PORT:
+        case PA_COMMAND_SET_SOURCE_PORT:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+struct batch_entry {
+    uint32_t command;
+    uint32_t length;
+    const void *data;
+};
+
+/* Execute all commands of a batch back to back, within one main loop
+ * iteration, and answer with a single reply carrying one error code
+ * per command. Nothing is executed unless all commands are valid
+ * batch commands. */
+static void command_batch(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    struct batch_entry *entries;
+    uint32_t *errors;
+    uint32_t n, i;
+    pa_tagstruct *reply;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    CHECK_VALIDITY(c->pstream, c->has_batch, tag, PA_ERR_NOTSUPPORTED);
+
+    if (pa_tagstruct_getu32(t, &n) < 0 || n == 0) {
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY(c->pstream, n <= PA_BATCH_MAX_COMMANDS, tag, PA_ERR_TOOLARGE);
+
+    entries = pa_xnew(struct batch_entry, n);
+
+    for (i = 0; i < n; i++)
+        if (pa_tagstruct_getu32(t, &entries[i].command) < 0 ||
+            pa_tagstruct_getu32(t, &entries[i].length) < 0 ||
+            entries[i].length == 0 ||
+            pa_tagstruct_get_arbitrary(t, &entries[i].data, entries[i].length) < 0) {
+            pa_xfree(entries);
+            protocol_error(c);
+            return;
+        }
+
+    if (!pa_tagstruct_eof(t)) {
+        pa_xfree(entries);
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY_GOTO(c->pstream, c->authorized, tag, PA_ERR_ACCESS, finish);
+
+    for (i = 0; i < n; i++)
+        CHECK_VALIDITY_GOTO(c->pstream, command_is_batchable(entries[i].command), tag, PA_ERR_NOTSUPPORTED, finish);
+
+    pa_assert(!current_batch_reply);
+
+    errors = pa_xnew(uint32_t, n);
+
+    /* A malformed command kicks the client, keep the connection object
+     * around until we notice */
+    pa_native_connection_ref(c);
+
+    for (i = 0; i < n; i++) {
+        struct batch_reply r;
+        pa_tagstruct *sub;
+
+        r.pstream = c->pstream;
+        r.tag = tag;
+        r.error = PA_ERR_INTERNAL;
+        r.replied = false;
+
+        sub = pa_tagstruct_new_fixed(entries[i].data, entries[i].length);
+
+        current_batch_reply = &r;
+        command_table[entries[i].command](pd, entries[i].command, tag, sub, c);
+        current_batch_reply = NULL;
+
+        pa_tagstruct_free(sub);
+
+        if (!c->protocol)
+            goto unref;
+
+        errors[i] = r.replied ? r.error : PA_ERR_INTERNAL;
+    }
+
+    reply = reply_new(tag);
+    pa_tagstruct_putu32(reply, n);
+
+    for (i = 0; i < n; i++)
+        pa_tagstruct_putu32(reply, errors[i]);
+
+    pa_pstream_send_tagstruct(c->pstream, reply);
+
+unref:
+    pa_native_connection_unref(c);
+    pa_xfree(errors);
+
+finish:
+    pa_xfree(entries);
+}
+
 /*** pstream callbacks ***/
 
 static void pstream_packet_callback(pa_pstream *p, pa_packet *packet, pa_cmsg_ancil_data *ancil_data, void *userdata) {
@@ -5231,6 +5604,10 @@ static pa_native_protocol* native_protocol_new(pa_core *c) {
     for (h = 0; h < PA_NATIVE_HOOK_MAX; h++)
         pa_hook_init(&p->hooks[h], p);
 
+    p->info_cache = pa_info_cache_new(INFO_SEGMENT_MAX);
+    p->subscription_post_slot = pa_hook_connect(&c->hooks[PA_CORE_HOOK_SUBSCRIPTION_POST], PA_HOOK_NORMAL,
+                                                (pa_hook_cb_t) subscription_post_cb, p);
+
     pa_assert_se(pa_shared_set(c, "native-protocol", p) >= 0);
 
     return p;
@@ -5276,6 +5653,10 @@ void pa_native_protocol_unref(pa_native_protocol *p) {
 
     pa_hashmap_free(p->extensions);
 
+    pa_hook_slot_free(p->subscription_post_slot);
+
+    pa_info_cache_free(p->info_cache);
+
     pa_assert_se(pa_shared_remove(p->core, "native-protocol") >= 0);
 
     pa_xfree(p);
@@ -5373,6 +5754,7 @@ void pa_native_options_unref(pa_native_options *o) {
 int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
     bool enabled;
     const char *acl;
+    uint32_t msec;
 
     pa_assert(o);
     pa_assert(PA_REFCNT_VALUE(o) >= 1);
@@ -5389,6 +5771,14 @@ int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
         return -1;
     }
 
+    msec = 0;
+    if (pa_modargs_get_value_u32(ma, "subscription-coalesce-msec", &msec) < 0) {
+        pa_log("subscription-coalesce-msec= expects a non-negative integer argument.");
+        return -1;
+    }
+
+    o->subscription_coalesce_interval = (pa_usec_t) msec * PA_USEC_PER_MSEC;
+
     enabled = true;
     if (pa_modargs_get_value_boolean(ma, "auth-group-enable", &enabled) < 0) {
         pa_log("auth-group-enable= expects a boolean argument.");
@@ -30,6 +30,10 @@
 #include <netinet/in.h>
 #endif
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/idxset.h>
@@ -48,6 +52,9 @@
 #define PA_FLAG_SHMDATA_MEMFD_BLOCK         0x20000000LU
 #define PA_FLAG_SHMRELEASE  0x40000000LU
 #define PA_FLAG_SHMREVOKE   0xC0000000LU
+#define PA_FLAG_SHMBATCH    0x10000000LU
+#define PA_FLAG_SHMRELEASE_BATCH (PA_FLAG_SHMRELEASE|PA_FLAG_SHMBATCH)
+#define PA_FLAG_SHMREVOKE_BATCH (PA_FLAG_SHMREVOKE|PA_FLAG_SHMBATCH)
 #define PA_FLAG_SHMMASK     0xFF000000LU
 #define PA_FLAG_SEEKMASK    0x000000FFLU
 #define PA_FLAG_SHMWRITABLE 0x00800000LU
@@ -82,6 +89,14 @@ typedef uint32_t pa_pstream_descriptor[PA_PSTREAM_DESCRIPTOR_MAX];
  */
 #define FRAME_SIZE_MAX_ALLOW (1024*1024*16)
 
+/* On the socket path up to this many queued frames are handed to the
+ * kernel in a single writev() call */
+#define WRITEV_ITEMS_MAX (8)
+
+/* Sockets that cannot carry ancillary data are read through a buffer
+ * of this size, so that several small frames are received per recv() */
+#define READ_BUFFER_SIZE (64*1024)
+
 PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
 
 struct item_info {
@@ -89,7 +104,9 @@ struct item_info {
         PA_PSTREAM_ITEM_PACKET,
         PA_PSTREAM_ITEM_MEMBLOCK,
         PA_PSTREAM_ITEM_SHMRELEASE,
-        PA_PSTREAM_ITEM_SHMREVOKE
+        PA_PSTREAM_ITEM_SHMREVOKE,
+        PA_PSTREAM_ITEM_SHMRELEASE_BATCH,
+        PA_PSTREAM_ITEM_SHMREVOKE_BATCH
     } type;
 
     /* packet info */
@@ -109,6 +126,25 @@ struct item_info {
     uint32_t block_id;
 };
 
+/* Block ids of pending release/revoke frames, kept in network byte
+ * order so that they can be sent as frame payload as they are */
+struct block_id_batch {
+    uint32_t *ids;
+    unsigned n_ids, n_allocated;
+};
+
+struct pstream_write {
+    union {
+        uint8_t minibuf[MINIBUF_SIZE];
+        pa_pstream_descriptor descriptor;
+    };
+    struct item_info* current;
+    void *data;
+    size_t index;
+    int minibuf_validsize;
+    pa_memchunk memchunk;
+};
+
 struct pstream_read {
     pa_pstream_descriptor descriptor;
     pa_memblock *memblock;
@@ -131,20 +167,20 @@ struct pa_pstream {
 
     bool dead;
 
-    struct {
-        union {
-            uint8_t minibuf[MINIBUF_SIZE];
-            pa_pstream_descriptor descriptor;
-        };
-        struct item_info* current;
-        void *data;
-        size_t index;
-        int minibuf_validsize;
-        pa_memchunk memchunk;
-    } write;
+    struct pstream_write write;
+
+    /* Frames that follow 'write' in the same writev() call. They have
+     * been taken off the send queue already and are prepared, but not
+     * (completely) written yet. */
+    struct pstream_write write_ahead[WRITEV_ITEMS_MAX - 1];
+    unsigned n_write_ahead;
 
     struct pstream_read readio, readsrb;
 
+    /* Read buffer for readio, NULL if reads go to the frame directly */
+    uint8_t *read_buffer;
+    size_t read_buffer_index, read_buffer_length;
+
     /* @use_shm: beside copying the full audio data to the other
      * PA end, this pipe supports just sending references of the
      * same audio data blocks if they reside in a SHM pool.
@@ -156,6 +192,12 @@ struct pa_pstream {
     bool use_shm, use_memfd;
     pa_idxset *registered_memfd_ids;
 
+    /* @use_shm_batching: the other end accepts release and revoke
+     * frames carrying several block ids. All ids released or revoked
+     * until the pending frame is written out are coalesced into it. */
+    bool use_shm_batching;
+    struct block_id_batch release_batch, revoke_batch;
+
     pa_memimport *import;
     pa_memexport *export;
 
@@ -254,6 +296,11 @@ static void do_pstream_read_write(pa_pstream *p) {
     } else if (!p->dead && pa_iochannel_is_hungup(p->io))
         goto fail;
 
+    /* Process the frames that are left in the read buffer */
+    while (!p->dead && p->read_buffer_index < p->read_buffer_length)
+        if (do_read(p, &p->readio) < 0)
+            goto fail;
+
     while (!p->dead && pa_iochannel_is_writable(p->io)) {
         int r = do_write(p);
         if (r < 0)
@@ -340,6 +387,13 @@ pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *poo
     /* We do importing unconditionally */
     p->import = pa_memimport_new(p->mempool, memimport_release_cb, p);
 
+#ifdef HAVE_CREDS
+    /* Received fds and credentials have to stay with the frame they were
+     * sent with, hence AF_UNIX sockets keep reading frame by frame */
+    if (pa_iochannel_get_recv_fd(io) != pa_iochannel_get_send_fd(io) || !pa_iochannel_creds_supported(io))
+#endif
+        p->read_buffer = pa_xmalloc(READ_BUFFER_SIZE);
+
     pa_iochannel_socket_set_rcvbuf(io, pa_mempool_block_size_max(p->mempool));
     pa_iochannel_socket_set_sndbuf(io, pa_mempool_block_size_max(p->mempool));
 
@@ -385,6 +439,11 @@ static void item_free(void *item) {
     } else if (i->type == PA_PSTREAM_ITEM_PACKET) {
         pa_assert(i->packet);
         pa_packet_unref(i->packet);
+    } else if (i->type == PA_PSTREAM_ITEM_SHMRELEASE_BATCH ||
+               i->type == PA_PSTREAM_ITEM_SHMREVOKE_BATCH) {
+        /* The packet is only created once the item is written */
+        if (i->packet)
+            pa_packet_unref(i->packet);
     }
 
 #ifdef HAVE_CREDS
@@ -401,6 +460,8 @@ static void item_free(void *item) {
 }
 
 static void pstream_free(pa_pstream *p) {
+    unsigned i;
+
     pa_assert(p);
 
     pa_pstream_unlink(p);
@@ -413,6 +474,15 @@ static void pstream_free(pa_pstream *p) {
     if (p->write.memchunk.memblock)
         pa_memblock_unref(p->write.memchunk.memblock);
 
+    for (i = 0; i < p->n_write_ahead; i++) {
+        item_free(p->write_ahead[i].current);
+
+        if (p->write_ahead[i].memchunk.memblock)
+            pa_memblock_unref(p->write_ahead[i].memchunk.memblock);
+    }
+
+    pa_xfree(p->read_buffer);
+
     if (p->readsrb.memblock)
         pa_memblock_unref(p->readsrb.memblock);
 
@@ -428,6 +498,9 @@ static void pstream_free(pa_pstream *p) {
     if (p->registered_memfd_ids)
         pa_idxset_free(p->registered_memfd_ids, NULL);
 
+    pa_xfree(p->release_batch.ids);
+    pa_xfree(p->revoke_batch.ids);
+
     pa_xfree(p);
 }
 
@@ -512,6 +585,33 @@ void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa
     p->mainloop->defer_enable(p->defer_event, 1);
 }
 
+/* Appends the block id to the batch and queues a batch item if there
+ * is none pending yet. */
+static void send_batched_block_id(pa_pstream *p, struct block_id_batch *b, int type, uint32_t block_id) {
+    struct item_info *item;
+
+    if (b->n_ids >= b->n_allocated) {
+        b->n_allocated = PA_MAX(2 * b->n_allocated, 16U);
+        b->ids = pa_xrenew(uint32_t, b->ids, b->n_allocated);
+    }
+
+    b->ids[b->n_ids++] = htonl(block_id);
+
+    if (b->n_ids > 1)
+        return;
+
+    if (!(item = pa_flist_pop(PA_STATIC_FLIST_GET(items))))
+        item = pa_xnew(struct item_info, 1);
+    item->type = type;
+    item->packet = NULL;
+#ifdef HAVE_CREDS
+    item->with_ancil_data = false;
+#endif
+
+    pa_queue_push(p->send_queue, item);
+    p->mainloop->defer_enable(p->defer_event, 1);
+}
+
 void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
     struct item_info *item;
     pa_assert(p);
@@ -522,6 +622,11 @@ void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
 
 /*     pa_log("Releasing block %u", block_id); */
 
+    if (p->use_shm_batching) {
+        send_batched_block_id(p, &p->release_batch, PA_PSTREAM_ITEM_SHMRELEASE_BATCH, block_id);
+        return;
+    }
+
     if (!(item = pa_flist_pop(PA_STATIC_FLIST_GET(items))))
         item = pa_xnew(struct item_info, 1);
     item->type = PA_PSTREAM_ITEM_SHMRELEASE;
@@ -559,6 +664,11 @@ void pa_pstream_send_revoke(pa_pstream *p, uint32_t block_id) {
         return;
 /*     pa_log("Revoking block %u", block_id); */
 
+    if (p->use_shm_batching) {
+        send_batched_block_id(p, &p->revoke_batch, PA_PSTREAM_ITEM_SHMREVOKE_BATCH, block_id);
+        return;
+    }
+
     if (!(item = pa_flist_pop(PA_STATIC_FLIST_GET(items))))
         item = pa_xnew(struct item_info, 1);
     item->type = PA_PSTREAM_ITEM_SHMREVOKE;
@@ -584,68 +694,93 @@ static void memexport_revoke_cb(pa_memexport *e, uint32_t block_id, void *userda
         pa_pstream_send_revoke(p, block_id);
 }
 
-static void prepare_next_write_item(pa_pstream *p) {
+/* Takes the next item off the send queue and prepares it for writing */
+static void prepare_write_item(pa_pstream *p, struct pstream_write *w) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(w);
 
-    p->write.current = pa_queue_pop(p->send_queue);
+    w->current = pa_queue_pop(p->send_queue);
 
-    if (!p->write.current)
+    if (!w->current)
         return;
-    p->write.index = 0;
-    p->write.data = NULL;
-    p->write.minibuf_validsize = 0;
-    pa_memchunk_reset(&p->write.memchunk);
+    w->index = 0;
+    w->data = NULL;
+    w->minibuf_validsize = 0;
+    pa_memchunk_reset(&w->memchunk);
+
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
+
+    if (w->current->type == PA_PSTREAM_ITEM_SHMRELEASE_BATCH ||
+        w->current->type == PA_PSTREAM_ITEM_SHMREVOKE_BATCH) {
+        struct block_id_batch *b;
+
+        /* Take everything accumulated since the item was queued. Ids
+         * released or revoked from now on go into a new item. */
+        if (w->current->type == PA_PSTREAM_ITEM_SHMRELEASE_BATCH) {
+            b = &p->release_batch;
+            w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE_BATCH);
+        } else {
+            b = &p->revoke_batch;
+            w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE_BATCH);
+        }
 
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
+        pa_assert(b->n_ids > 0);
+        pa_assert(!w->current->packet);
 
-    if (p->write.current->type == PA_PSTREAM_ITEM_PACKET) {
+        w->current->packet = pa_packet_new_data(b->ids, b->n_ids * sizeof(uint32_t));
+        b->n_ids = 0;
+    }
+
+    if (w->current->type == PA_PSTREAM_ITEM_PACKET ||
+        w->current->type == PA_PSTREAM_ITEM_SHMRELEASE_BATCH ||
+        w->current->type == PA_PSTREAM_ITEM_SHMREVOKE_BATCH) {
         size_t plen;
 
-        pa_assert(p->write.current->packet);
+        pa_assert(w->current->packet);
 
-        p->write.data = (void *) pa_packet_data(p->write.current->packet, &plen);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) plen);
+        w->data = (void *) pa_packet_data(w->current->packet, &plen);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) plen);
 
         if (plen <= MINIBUF_SIZE - PA_PSTREAM_DESCRIPTOR_SIZE) {
-            memcpy(&p->write.minibuf[PA_PSTREAM_DESCRIPTOR_SIZE], p->write.data, plen);
-            p->write.minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + plen;
+            memcpy(&w->minibuf[PA_PSTREAM_DESCRIPTOR_SIZE], w->data, plen);
+            w->minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + plen;
         }
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMRELEASE) {
+    } else if (w->current->type == PA_PSTREAM_ITEM_SHMRELEASE) {
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(w->current->block_id);
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMREVOKE) {
+    } else if (w->current->type == PA_PSTREAM_ITEM_SHMREVOKE) {
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(w->current->block_id);
 
     } else {
         uint32_t flags;
         bool send_payload = true;
 
-        pa_assert(p->write.current->type == PA_PSTREAM_ITEM_MEMBLOCK);
-        pa_assert(p->write.current->chunk.memblock);
+        pa_assert(w->current->type == PA_PSTREAM_ITEM_MEMBLOCK);
+        pa_assert(w->current->chunk.memblock);
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(p->write.current->channel);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) p->write.current->offset) >> 32));
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) p->write.current->offset));
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(w->current->channel);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) w->current->offset) >> 32));
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) w->current->offset));
 
-        flags = (uint32_t) (p->write.current->seek_mode & PA_FLAG_SEEKMASK);
+        flags = (uint32_t) (w->current->seek_mode & PA_FLAG_SEEKMASK);
 
         if (p->use_shm) {
             pa_mem_type_t type;
             uint32_t block_id, shm_id;
             size_t offset, length;
-            uint32_t *shm_info = (uint32_t *) &p->write.minibuf[PA_PSTREAM_DESCRIPTOR_SIZE];
+            uint32_t *shm_info = (uint32_t *) &w->minibuf[PA_PSTREAM_DESCRIPTOR_SIZE];
             size_t shm_size = sizeof(uint32_t) * PA_PSTREAM_SHM_MAX;
-            pa_mempool *current_pool = pa_memblock_get_pool(p->write.current->chunk.memblock);
+            pa_mempool *current_pool = pa_memblock_get_pool(w->current->chunk.memblock);
             pa_memexport *current_export;
 
             if (p->mempool == current_pool)
@@ -654,7 +789,7 @@ static void prepare_next_write_item(pa_pstream *p) {
                 pa_assert_se(current_export = pa_memexport_new(current_pool, memexport_revoke_cb, p));
 
             if (pa_memexport_put(current_export,
-                                 p->write.current->chunk.memblock,
+                                 w->current->chunk.memblock,
                                  &type,
                                  &block_id,
                                  &shm_id,
@@ -685,11 +820,11 @@ static void prepare_next_write_item(pa_pstream *p) {
 
                     shm_info[PA_PSTREAM_SHM_BLOCKID] = htonl(block_id);
                     shm_info[PA_PSTREAM_SHM_SHMID] = htonl(shm_id);
-                    shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + p->write.current->chunk.index));
-                    shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
+                    shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + w->current->chunk.index));
+                    shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) w->current->chunk.length);
 
-                    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(shm_size);
-                    p->write.minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + shm_size;
+                    w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(shm_size);
+                    w->minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + shm_size;
                 }
             }
 /*             else */
@@ -702,20 +837,50 @@ static void prepare_next_write_item(pa_pstream *p) {
         }
 
         if (send_payload) {
-            p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
-            p->write.memchunk = p->write.current->chunk;
-            pa_memblock_ref(p->write.memchunk.memblock);
+            w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) w->current->chunk.length);
+            w->memchunk = w->current->chunk;
+            pa_memblock_ref(w->memchunk.memblock);
         }
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
     }
 
+}
+
+static void prepare_next_write_item(pa_pstream *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->n_write_ahead == 0);
+
+    prepare_write_item(p, &p->write);
+
 #ifdef HAVE_CREDS
-    if ((p->send_ancil_data_now = p->write.current->with_ancil_data))
+    if (p->write.current && (p->send_ancil_data_now = p->write.current->with_ancil_data))
         p->write_ancil_data = &p->write.current->ancil_data;
 #endif
 }
 
+/* The first item has been written completely. Free it and move on to
+ * the next prepared item, if any. */
+static void finish_write_item(pa_pstream *p) {
+    pa_assert(p);
+    pa_assert(p->write.current);
+
+    item_free(p->write.current);
+    p->write.current = NULL;
+
+    if (p->write.memchunk.memblock)
+        pa_memblock_unref(p->write.memchunk.memblock);
+
+    pa_memchunk_reset(&p->write.memchunk);
+
+    if (p->n_write_ahead > 0) {
+        p->write = p->write_ahead[0];
+        p->n_write_ahead--;
+        memmove(p->write_ahead, p->write_ahead + 1, p->n_write_ahead * sizeof(struct pstream_write));
+    }
+}
+
 static void check_srbpending(pa_pstream *p) {
     if (!p->is_srbpending)
         return;
@@ -730,6 +895,131 @@ static void check_srbpending(pa_pstream *p) {
         pa_srbchannel_set_callback(p->srb, srb_callback, p);
 }
 
+#ifdef HAVE_SYS_UIO_H
+/* Fills in the iovecs for the unwritten part of a prepared item, at most
+ * two. If the payload is a memblock it is acquired and returned in
+ * *release_memblock. */
+static unsigned write_item_iovecs(struct pstream_write *w, struct iovec *iov, pa_memblock **release_memblock) {
+    size_t length;
+    unsigned n = 0;
+
+    *release_memblock = NULL;
+
+    if (w->minibuf_validsize > 0) {
+        iov[0].iov_base = w->minibuf + w->index;
+        iov[0].iov_len = w->minibuf_validsize - w->index;
+        return 1;
+    }
+
+    if (w->index < PA_PSTREAM_DESCRIPTOR_SIZE) {
+        iov[n].iov_base = (uint8_t*) w->descriptor + w->index;
+        iov[n].iov_len = PA_PSTREAM_DESCRIPTOR_SIZE - w->index;
+        n++;
+    }
+
+    length = ntohl(w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
+
+    if (length > 0) {
+        size_t done = w->index > PA_PSTREAM_DESCRIPTOR_SIZE ? w->index - PA_PSTREAM_DESCRIPTOR_SIZE : 0;
+        void *d;
+
+        pa_assert(w->data || w->memchunk.memblock);
+
+        if (w->data)
+            d = w->data;
+        else {
+            d = pa_memblock_acquire_chunk(&w->memchunk);
+            *release_memblock = w->memchunk.memblock;
+        }
+
+        iov[n].iov_base = (uint8_t*) d + done;
+        iov[n].iov_len = length - done;
+        n++;
+    }
+
+    return n;
+}
+
+/* Writes the current item together with as many of the following queued
+ * items as possible in a single writev() */
+static int do_writev(pa_pstream *p) {
+    struct iovec iov[2 * WRITEV_ITEMS_MAX];
+    pa_memblock *release_memblocks[WRITEV_ITEMS_MAX];
+    unsigned n_iov, n_release = 0, i;
+    size_t l = 0, left;
+    ssize_t r;
+    bool finished = false;
+
+    pa_assert(p);
+    pa_assert(p->write.current);
+    pa_assert(!p->srb);
+
+    /* Items that carry ancillary data need a sendmsg() of their own,
+     * so the batch ends before the next one of those */
+    while (p->n_write_ahead < WRITEV_ITEMS_MAX - 1) {
+        struct item_info *next;
+
+        if (!(next = pa_queue_peek(p->send_queue)))
+            break;
+
+#ifdef HAVE_CREDS
+        if (next->with_ancil_data)
+            break;
+#endif
+
+        prepare_write_item(p, &p->write_ahead[p->n_write_ahead++]);
+    }
+
+    n_iov = write_item_iovecs(&p->write, iov, &release_memblocks[0]);
+    if (release_memblocks[0])
+        n_release++;
+
+    for (i = 0; i < p->n_write_ahead; i++) {
+        n_iov += write_item_iovecs(&p->write_ahead[i], iov + n_iov, &release_memblocks[n_release]);
+        if (release_memblocks[n_release])
+            n_release++;
+    }
+
+    for (i = 0; i < n_iov; i++)
+        l += iov[i].iov_len;
+
+    pa_assert(l > 0);
+
+    r = pa_iochannel_writev(p->io, iov, (int) n_iov);
+
+    for (i = 0; i < n_release; i++)
+        pa_memblock_release(release_memblocks[i]);
+
+    if (r < 0)
+        return -1;
+
+    /* Account the written bytes to the items, in order */
+    left = (size_t) r;
+
+    while (left > 0) {
+        size_t remaining;
+
+        pa_assert(p->write.current);
+
+        remaining = PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - p->write.index;
+
+        if (left < remaining) {
+            p->write.index += left;
+            break;
+        }
+
+        left -= remaining;
+        finish_write_item(p);
+        finished = true;
+    }
+
+    if (finished && p->drain_callback && !pa_pstream_is_pending(p))
+        p->drain_callback(p, p->drain_callback_userdata);
+
+    return (size_t) r == l ? 1 : 0;
+}
+#endif
+
 static int do_write(pa_pstream *p) {
     void *d;
     size_t l;
@@ -748,6 +1038,14 @@ static int do_write(pa_pstream *p) {
         return 0;
     }
 
+#ifdef HAVE_SYS_UIO_H
+#ifdef HAVE_CREDS
+    if (!p->send_ancil_data_now)
+#endif
+        if (!p->srb)
+            return do_writev(p);
+#endif
+
     if (p->write.minibuf_validsize > 0) {
         d = p->write.minibuf + p->write.index;
         l = p->write.minibuf_validsize - p->write.index;
@@ -796,14 +1094,7 @@ static int do_write(pa_pstream *p) {
     p->write.index += (size_t) r;
 
     if (p->write.index >= PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH])) {
-        pa_assert(p->write.current);
-        item_free(p->write.current);
-        p->write.current = NULL;
-
-        if (p->write.memchunk.memblock)
-            pa_memblock_unref(p->write.memchunk.memblock);
-
-        pa_memchunk_reset(&p->write.memchunk);
+        finish_write_item(p);
 
         if (p->drain_callback && !pa_pstream_is_pending(p))
             p->drain_callback(p, p->drain_callback_userdata);
@@ -847,6 +1138,65 @@ static void memblock_complete(pa_pstream *p, struct pstream_read *re) {
         p->receive_memblock_callback_userdata);
 }
 
+/* Handles the payload of a batched SHM release or revoke frame */
+static void process_block_id_batch(pa_pstream *p, bool revoke, pa_packet *packet) {
+    uint32_t ids[64];
+    const uint32_t *data;
+    size_t plen;
+    unsigned n, k;
+
+    data = pa_packet_data(packet, &plen);
+    n = (unsigned) (plen / sizeof(uint32_t));
+
+/*     pa_log("Got %s batch frame for %u blocks", revoke ? "revoke" : "release", n); */
+
+    while (n > 0) {
+        unsigned m = PA_MIN(n, PA_ELEMENTSOF(ids));
+
+        for (k = 0; k < m; k++)
+            ids[k] = ntohl(data[k]);
+
+        if (revoke) {
+            pa_assert(p->import);
+
+            for (k = 0; k < m; k++)
+                pa_memimport_process_revoke(p->import, ids[k]);
+        } else {
+            pa_assert(p->export);
+            pa_memexport_process_release_batch(p->export, ids, m);
+        }
+
+        data += m;
+        n -= m;
+    }
+}
+
+/* Reads from the iochannel through the read buffer. Payloads at least as
+ * large as the buffer are read into place directly. */
+static ssize_t buffered_read(pa_pstream *p, void *d, size_t l) {
+    ssize_t r;
+
+    pa_assert(p->read_buffer);
+
+    if (p->read_buffer_index >= p->read_buffer_length) {
+
+        if (l >= READ_BUFFER_SIZE)
+            return pa_iochannel_read(p->io, d, l);
+
+        if ((r = pa_iochannel_read(p->io, p->read_buffer, READ_BUFFER_SIZE)) <= 0)
+            return r;
+
+        p->read_buffer_index = 0;
+        p->read_buffer_length = (size_t) r;
+    }
+
+    l = PA_MIN(l, p->read_buffer_length - p->read_buffer_index);
+    memcpy(d, p->read_buffer + p->read_buffer_index, l);
+    p->read_buffer_index += l;
+
+    return (ssize_t) l;
+}
+
 static int do_read(pa_pstream *p, struct pstream_read *re) {
     void *d;
     size_t l;
@@ -879,8 +1229,10 @@ static int do_read(pa_pstream *p, struct pstream_read *re) {
                 pa_memblock_release(release_memblock);
             return 1;
         }
-    }
-    else
+    } else if (p->read_buffer) {
+        if ((r = buffered_read(p, d, l)) <= 0)
+            goto fail;
+    } else
 #ifdef HAVE_CREDS
     {
         pa_cmsg_ancil_data b;
@@ -954,7 +1306,19 @@ static int do_read(pa_pstream *p, struct pstream_read *re) {
 
         channel = ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL]);
 
-        if (channel == (uint32_t) -1) {
+        if (flags == PA_FLAG_SHMRELEASE_BATCH || flags == PA_FLAG_SHMREVOKE_BATCH) {
+            size_t plen;
+
+            if (channel != (uint32_t) -1 || length % sizeof(uint32_t) != 0) {
+                pa_log_warn("Received invalid SHM release/revoke batch frame.");
+                return -1;
+            }
+
+            /* Frame is a list of block ids to release or revoke */
+            re->packet = pa_packet_new(length);
+            re->data = (void *) pa_packet_data(re->packet, &plen);
+
+        } else if (channel == (uint32_t) -1) {
             size_t plen;
 
             if (flags != 0) {
@@ -1006,8 +1370,11 @@ static int do_read(pa_pstream *p, struct pstream_read *re) {
             pa_memblock_unref(re->memblock);
 
         } else if (re->packet) {
+            uint32_t flags = ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]);
 
-            if (p->receive_packet_callback)
+            if (flags == PA_FLAG_SHMRELEASE_BATCH || flags == PA_FLAG_SHMREVOKE_BATCH)
+                process_block_id_batch(p, flags == PA_FLAG_SHMREVOKE_BATCH, re->packet);
+            else if (p->receive_packet_callback)
 #ifdef HAVE_CREDS
                 p->receive_packet_callback(p, re->packet, &p->read_ancil_data, p->receive_packet_callback_userdata);
 #else
@@ -1247,6 +1614,16 @@ void pa_pstream_enable_memfd(pa_pstream *p) {
     }
 }
 
+/* The other end understands release and revoke frames carrying more
+ * than one block id (protocol version 33 and newer) */
+void pa_pstream_enable_shm_batching(pa_pstream *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->use_shm);
+
+    p->use_shm_batching = true;
+}
+
 bool pa_pstream_get_shm(pa_pstream *p) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
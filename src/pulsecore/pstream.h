@@ -66,6 +66,7 @@ bool pa_pstream_is_pending(pa_pstream *p);
 
 void pa_pstream_enable_shm(pa_pstream *p, bool enable);
 void pa_pstream_enable_memfd(pa_pstream *p);
+void pa_pstream_enable_shm_batching(pa_pstream *p);
 bool pa_pstream_get_shm(pa_pstream *p);
 bool pa_pstream_get_memfd(pa_pstream *p);
 
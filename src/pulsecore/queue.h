@@ -36,6 +36,10 @@ void pa_queue_free(pa_queue *q, pa_free_cb_t free_func);
 void pa_queue_push(pa_queue *q, void *p);
 void* pa_queue_pop(pa_queue *q);
 
+/* Return the first entry without removing it from the queue, NULL if
+ * the queue is empty */
+void* pa_queue_peek(pa_queue *q);
+
 int pa_queue_isempty(pa_queue *q);
 
 #endif
@@ -26,6 +26,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+#define USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
 
 #include <pulse/xmalloc.h>
 #include <pulse/timeval.h>
@@ -44,10 +51,15 @@
 
 /* #define DEBUG_TIMING */
 
+/* How many messages to dispatch from an asyncmsgq in one go */
+#define MAX_ASYNCMSGQ_DISPATCH 32
+
 struct pa_rtpoll {
     struct pollfd *pollfd, *pollfd2;
     unsigned n_pollfd_alloc, n_pollfd_used;
 
+    /* Timers are set in usec, so this is as precise as the deadline
+     * gets, also when it is handed to the timerfd */
     struct timeval next_elapse;
     bool timer_enabled:1;
 
@@ -62,9 +74,43 @@ struct pa_rtpoll {
     pa_usec_t slept, awake;
 #endif
 
+#ifdef USE_EPOLL
+    /* -1 if we fell back to plain poll() */
+    int epoll_fd;
+
+    int timer_fd;
+    bool timer_armed;
+    struct timeval timer_armed_at;
+
+    /* Registrations, indexed by fd */
+    struct epoll_registration *registrations;
+    int n_registrations;
+
+    /* fd and events of the pollfd array as of the last sync with the
+     * epoll set, and for each entry the next one with the same fd */
+    struct pollfd *synced;
+    unsigned n_synced, n_synced_alloc;
+    int *fd_next;
+    bool sync_needed;
+
+    struct epoll_event *events;
+    unsigned n_events_alloc;
+#endif
+
     PA_LLIST_HEAD(pa_rtpoll_item, items);
 };
 
+#ifdef USE_EPOLL
+struct epoll_registration {
+    bool registered;
+    uint32_t events;
+
+    /* First pollfd entry for this fd, or -1 */
+    int first;
+    uint32_t wanted;
+};
+#endif
+
 struct pa_rtpoll_item {
     pa_rtpoll *rtpoll;
     bool dead;
@@ -84,6 +130,234 @@ struct pa_rtpoll_item {
 
 PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
 
+#ifdef USE_EPOLL
+
+/* Give up on epoll and use poll() from now on */
+static void epoll_done(pa_rtpoll *p) {
+    pa_assert(p);
+
+    if (p->epoll_fd >= 0)
+        pa_close(p->epoll_fd);
+    if (p->timer_fd >= 0)
+        pa_close(p->timer_fd);
+
+    p->epoll_fd = p->timer_fd = -1;
+
+    pa_xfree(p->registrations);
+    p->registrations = NULL;
+    p->n_registrations = 0;
+
+    pa_xfree(p->synced);
+    p->synced = NULL;
+    pa_xfree(p->fd_next);
+    p->fd_next = NULL;
+    p->n_synced = p->n_synced_alloc = 0;
+
+    pa_xfree(p->events);
+    p->events = NULL;
+    p->n_events_alloc = 0;
+}
+
+static void epoll_unregister(pa_rtpoll *p, int fd) {
+    struct epoll_registration *r;
+
+    if (fd < 0 || fd >= p->n_registrations)
+        return;
+
+    r = &p->registrations[fd];
+
+    if (!r->registered)
+        return;
+
+    /* This fails if the fd has been closed already, in which case the
+     * kernel dropped it from the set by itself */
+    (void) epoll_ctl(p->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    r->registered = false;
+}
+
+static int epoll_register(pa_rtpoll *p, int fd, uint32_t events) {
+    struct epoll_registration *r = &p->registrations[fd];
+    struct epoll_event ev;
+
+    pa_zero(ev);
+    ev.events = events;
+    ev.data.fd = fd;
+
+    if (epoll_ctl(p->epoll_fd, r->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) < 0) {
+
+        /* Our idea of what is registered may be stale if the fd was
+         * closed and reused behind our back */
+        if (errno == EEXIST)
+            r->registered = true;
+        else if (errno == ENOENT)
+            r->registered = false;
+        else
+            return -1;
+
+        if (epoll_ctl(p->epoll_fd, r->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) < 0)
+            return -1;
+    }
+
+    r->registered = true;
+    r->events = events;
+
+    return 0;
+}
+
+/* Bring the epoll set in line with the pollfd array. The users of
+ * rtpoll may change fds and events in the array at any time, so we
+ * compare with what we registered the last time, but only issue
+ * syscalls for what actually changed. */
+static int epoll_sync(pa_rtpoll *p) {
+    unsigned k;
+    int fd, max_fd = -1;
+
+    pa_assert(p);
+
+    if (!p->sync_needed && p->n_synced == p->n_pollfd_used) {
+        for (k = 0; k < p->n_pollfd_used; k++)
+            if (p->pollfd[k].fd != p->synced[k].fd ||
+                p->pollfd[k].events != p->synced[k].events)
+                break;
+
+        if (k >= p->n_pollfd_used)
+            return 0;
+    }
+
+    for (k = 0; k < p->n_pollfd_used; k++)
+        max_fd = PA_MAX(max_fd, p->pollfd[k].fd);
+
+    if (max_fd >= p->n_registrations) {
+        int n = PA_MAX(max_fd + 1, p->n_registrations * 2);
+
+        p->registrations = pa_xrenew(struct epoll_registration, p->registrations, n);
+        memset(p->registrations + p->n_registrations, 0, (n - p->n_registrations) * sizeof(struct epoll_registration));
+        p->n_registrations = n;
+    }
+
+    if (p->n_synced_alloc < p->n_pollfd_used) {
+        p->n_synced_alloc = p->n_pollfd_alloc;
+        p->synced = pa_xrenew(struct pollfd, p->synced, p->n_synced_alloc);
+        p->fd_next = pa_xrenew(int, p->fd_next, p->n_synced_alloc);
+    }
+
+    for (fd = 0; fd < p->n_registrations; fd++) {
+        p->registrations[fd].first = -1;
+        p->registrations[fd].wanted = 0;
+    }
+
+    /* Build the chains backwards, so that they're in array order */
+    for (k = p->n_pollfd_used; k > 0; k--) {
+        struct pollfd *f = &p->pollfd[k-1];
+        struct epoll_registration *r;
+
+        p->synced[k-1] = *f;
+        p->fd_next[k-1] = -1;
+
+        if (f->fd < 0)
+            continue;
+
+        r = &p->registrations[f->fd];
+
+        /* The EPOLL* flags have the same values as the POLL* ones */
+        r->wanted |= (uint32_t) (f->events & (POLLIN|POLLPRI|POLLOUT));
+        p->fd_next[k-1] = r->first;
+        r->first = (int) k-1;
+    }
+
+    p->n_synced = p->n_pollfd_used;
+
+    for (fd = 0; fd < p->n_registrations; fd++) {
+        struct epoll_registration *r = &p->registrations[fd];
+
+        if (r->first < 0)
+            epoll_unregister(p, fd);
+        else if (!r->registered || r->events != r->wanted)
+            if (epoll_register(p, fd, r->wanted) < 0) {
+                pa_log_info("Cannot use epoll for fd %i, falling back to poll(): %s", fd, pa_cstrerror(errno));
+                return -1;
+            }
+    }
+
+    if (p->n_events_alloc < p->n_pollfd_used + 1) {
+        p->n_events_alloc = p->n_pollfd_used + 1;
+        p->events = pa_xrenew(struct epoll_event, p->events, p->n_events_alloc);
+    }
+
+    p->sync_needed = false;
+
+    return 0;
+}
+
+static void epoll_arm_timer(pa_rtpoll *p) {
+    struct itimerspec its;
+
+    pa_zero(its);
+
+    if (!p->quit && p->timer_enabled) {
+
+        if (p->timer_armed && pa_timeval_cmp(&p->timer_armed_at, &p->next_elapse) == 0)
+            return;
+
+        its.it_value.tv_sec = p->next_elapse.tv_sec;
+        its.it_value.tv_nsec = p->next_elapse.tv_usec * PA_NSEC_PER_USEC;
+
+        /* A zero value would disarm the timer */
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+            its.it_value.tv_nsec = 1;
+
+        pa_assert_se(timerfd_settime(p->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == 0);
+        p->timer_armed = true;
+        p->timer_armed_at = p->next_elapse;
+
+    } else if (p->timer_armed) {
+        pa_assert_se(timerfd_settime(p->timer_fd, 0, &its, NULL) == 0);
+        p->timer_armed = false;
+    }
+}
+
+/* Like poll() on the pollfd array: returns the number of entries
+ * with non-zero revents, 0 on timeout, or negative on error */
+static int epoll_poll(pa_rtpoll *p) {
+    int n, j, l, r = 0;
+    unsigned k;
+
+    epoll_arm_timer(p);
+
+    n = epoll_wait(p->epoll_fd, p->events, (int) p->n_events_alloc, p->quit ? 0 : -1);
+
+    for (k = 0; k < p->n_pollfd_used; k++)
+        p->pollfd[k].revents = 0;
+
+    for (j = 0; j < n; j++) {
+        int fd = p->events[j].data.fd;
+
+        if (fd == p->timer_fd) {
+            uint64_t expirations;
+
+            (void) pa_read(p->timer_fd, &expirations, sizeof(expirations), NULL);
+            p->timer_armed = false;
+            continue;
+        }
+
+        pa_assert(fd >= 0 && fd < p->n_registrations);
+
+        for (l = p->registrations[fd].first; l >= 0; l = p->fd_next[l]) {
+            struct pollfd *f = &p->pollfd[l];
+            short revents = (short) (p->events[j].events & (uint32_t) (f->events|POLLERR|POLLHUP));
+
+            if (revents && !f->revents)
+                r++;
+
+            f->revents |= revents;
+        }
+    }
+
+    return n < 0 ? n : r;
+}
+
+#endif
+
 pa_rtpoll *pa_rtpoll_new(void) {
     pa_rtpoll *p;
 
@@ -97,6 +371,29 @@ pa_rtpoll *pa_rtpoll_new(void) {
     p->timestamp = pa_rtclock_now();
 #endif
 
+#ifdef USE_EPOLL
+    p->epoll_fd = p->timer_fd = -1;
+
+    if ((p->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+        (p->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) < 0) {
+        pa_log_warn("Failed to set up epoll, falling back to poll(): %s", pa_cstrerror(errno));
+        epoll_done(p);
+    } else {
+        struct epoll_event ev;
+
+        pa_zero(ev);
+        ev.events = EPOLLIN;
+        ev.data.fd = p->timer_fd;
+
+        if (epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, p->timer_fd, &ev) < 0) {
+            pa_log_warn("Failed to add timerfd to epoll set, falling back to poll(): %s", pa_cstrerror(errno));
+            epoll_done(p);
+        }
+    }
+
+    p->sync_needed = true;
+#endif
+
     return p;
 }
 
@@ -152,6 +449,19 @@ static void rtpoll_item_destroy(pa_rtpoll_item *i) {
 
     p = i->rtpoll;
 
+#ifdef USE_EPOLL
+    /* Drop the fds right away, they might get closed and reused before
+     * the next sync */
+    if (p->epoll_fd >= 0 && i->pollfd) {
+        unsigned k;
+
+        for (k = 0; k < i->n_pollfd; k++)
+            epoll_unregister(p, i->pollfd[k].fd);
+
+        p->sync_needed = true;
+    }
+#endif
+
     PA_LLIST_REMOVE(pa_rtpoll_item, p->items, i);
 
     p->n_pollfd_used -= i->n_pollfd;
@@ -171,6 +481,10 @@ void pa_rtpoll_free(pa_rtpoll *p) {
     pa_xfree(p->pollfd);
     pa_xfree(p->pollfd2);
 
+#ifdef USE_EPOLL
+    epoll_done(p);
+#endif
+
     pa_xfree(p);
 }
 
@@ -306,16 +620,24 @@ int pa_rtpoll_run(pa_rtpoll *p) {
 #endif
 
     /* OK, now let's sleep */
-#ifdef HAVE_PPOLL
+#ifdef USE_EPOLL
+    if (p->epoll_fd >= 0 && epoll_sync(p) < 0)
+        epoll_done(p);
+
+    if (p->epoll_fd >= 0)
+        r = epoll_poll(p);
+    else
+#endif
     {
+#ifdef HAVE_PPOLL
         struct timespec ts;
         ts.tv_sec = timeout.tv_sec;
         ts.tv_nsec = timeout.tv_usec * 1000;
         r = ppoll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? &ts : NULL, NULL);
-    }
 #else
-    r = pa_poll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? (int) ((timeout.tv_sec*1000) + (timeout.tv_usec / 1000)) : -1);
+        r = pa_poll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? (int) ((timeout.tv_sec*1000) + (timeout.tv_usec / 1000)) : -1);
 #endif
+    }
 
     p->timer_elapsed = r == 0;
 
@@ -549,26 +871,36 @@ static int asyncmsgq_read_work(pa_rtpoll_item *i) {
     void *data;
     pa_memchunk chunk;
     int64_t offset;
+    unsigned n = 0;
 
     pa_assert(i);
 
-    if (pa_asyncmsgq_get(i->userdata, &object, &code, &data, &offset, &chunk, 0) == 0) {
+    /* Dispatch everything that is queued now rather than one message
+     * per loop iteration, but don't let a flood of messages starve
+     * the rest of the thread */
+    while (n < MAX_ASYNCMSGQ_DISPATCH &&
+           pa_asyncmsgq_get(i->userdata, &object, &code, &data, &offset, &chunk, 0) == 0) {
         int ret;
 
+        n++;
+
         if (!object && code == PA_MESSAGE_SHUTDOWN) {
             pa_asyncmsgq_done(i->userdata, 0);
             /* Requests the loop to exit. Will cause the next iteration of
              * pa_rtpoll_run() to return 0 */
             i->rtpoll->quit = true;
-            return 1;
+            break;
         }
 
         ret = pa_asyncmsgq_dispatch(object, code, data, offset, &chunk);
         pa_asyncmsgq_done(i->userdata, ret);
-        return 1;
+
+        /* The message might have removed us */
+        if (i->dead)
+            break;
     }
 
-    return 0;
+    return n > 0;
 }
 
 pa_rtpoll_item *pa_rtpoll_item_new_asyncmsgq_read(pa_rtpoll *p, pa_rtpoll_priority_t prio, pa_asyncmsgq *q) {
@@ -39,7 +39,12 @@
  * 3) It allows arbitrary functions to be run before entering the
  * actual poll() and after it.
  *
- * Only a single interval timer is supported. */
+ * Only a single interval timer is supported.
+ *
+ * Where available, epoll and a timerfd are used instead of poll(), so
+ * that waking up doesn't get more expensive with the number of fds.
+ * Changes to the pollfd data are still picked up before each sleep,
+ * but an fd should be removed from the rtpoll before it is closed. */
 
 typedef struct pa_rtpoll pa_rtpoll;
 typedef struct pa_rtpoll_item pa_rtpoll_item;
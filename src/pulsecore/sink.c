@@ -1224,8 +1224,22 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
                                     &s->sample_spec,
                                     result->length);
         } else if (!pa_cvolume_is_norm(&volume)) {
-            pa_memchunk_make_writable(result, 0);
-            pa_volume_memchunk(result, &s->sample_spec, &volume);
+            void *ptr;
+
+            /* The input is usually shared, so we would need a copy
+             * anyway; apply the volume while making it */
+            pa_memblock_unref(result->memblock);
+
+            result->memblock = pa_memblock_new(s->core->mempool, result->length);
+            result->index = 0;
+
+            ptr = pa_memblock_acquire(result->memblock);
+            result->length = pa_mix(info, 1,
+                                    ptr, result->length,
+                                    &s->sample_spec,
+                                    &s->thread_info.soft_volume,
+                                    false);
+            pa_memblock_release(result->memblock);
         }
     } else {
         void *ptr;
@@ -1295,22 +1309,27 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
         if (s->thread_info.soft_muted || pa_cvolume_is_muted(&volume))
             pa_silence_memchunk(target, &s->sample_spec);
-        else {
+        else if (pa_cvolume_is_norm(&volume)) {
             pa_memchunk vchunk;
 
             vchunk = info[0].chunk;
-            pa_memblock_ref(vchunk.memblock);
+            vchunk.length = target->length;
 
-            if (vchunk.length > length)
-                vchunk.length = length;
+            pa_memchunk_memcpy(target, &vchunk);
+        } else {
+            void *ptr;
 
-            if (!pa_cvolume_is_norm(&volume)) {
-                pa_memchunk_make_writable(&vchunk, 0);
-                pa_volume_memchunk(&vchunk, &s->sample_spec, &volume);
-            }
+            /* Apply the volume while copying into the target, instead
+             * of copying the input to apply it in a separate pass */
+            ptr = pa_memblock_acquire(target->memblock);
 
-            pa_memchunk_memcpy(target, &vchunk);
-            pa_memblock_unref(vchunk.memblock);
+            target->length = pa_mix(info, 1,
+                                    (uint8_t*) ptr + target->index, target->length,
+                                    &s->sample_spec,
+                                    &s->thread_info.soft_volume,
+                                    false);
+
+            pa_memblock_release(target->memblock);
         }
 
     } else {
@@ -253,6 +253,12 @@ pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p) {
     sr->rb_read.count = &srh->read_count;
     sr->rb_write.count = &srh->write_count;
 
+    /* These always wake up through the eventfd, never through a futex
+     * like process-private fdsems: the peer may be an older version that
+     * would never wake a futex, and both ends only ever wait for the fd
+     * in poll() together with their other fds, so there's nobody that
+     * could sleep on a futex anyway. pa_fdsem_post() only writes the fd
+     * if the reader is actually polling. */
     sr->sem_read = pa_fdsem_new_shm(&srh->read_semdata);
     if (!sr->sem_read)
         goto fail;
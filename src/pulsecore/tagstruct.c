@@ -41,7 +41,7 @@
 
 #define MAX_TAG_SIZE (64*1024)
 #define MAX_APPENDED_SIZE 128
-#define GROW_TAG_SIZE 100
+#define GROW_TAG_SIZE 256
 
 struct pa_tagstruct {
     uint8_t *data;
@@ -97,20 +97,55 @@ void pa_tagstruct_free(pa_tagstruct*t) {
         pa_xfree(t);
 }
 
-static inline void extend(pa_tagstruct*t, size_t l) {
+pa_packet *pa_tagstruct_free_to_packet(pa_tagstruct *t) {
+    pa_packet *packet;
+
     pa_assert(t);
-    pa_assert(t->type != PA_TAGSTRUCT_FIXED);
 
-    if (t->length+l <= t->allocated)
-        return;
+    if (t->type == PA_TAGSTRUCT_DYNAMIC) {
+        /* Hand the buffer over, the packet frees it */
+        packet = pa_packet_new_dynamic(t->data, t->length);
+        t->type = PA_TAGSTRUCT_FIXED;
+    } else
+        packet = pa_packet_new_data(t->data, t->length);
+
+    pa_tagstruct_free(t);
+
+    return packet;
+}
 
+static void resize(pa_tagstruct *t, size_t allocated) {
     if (t->type == PA_TAGSTRUCT_DYNAMIC)
-        t->data = pa_xrealloc(t->data, t->allocated = t->length + l + GROW_TAG_SIZE);
-    else if (t->type == PA_TAGSTRUCT_APPENDED) {
+        t->data = pa_xrealloc(t->data, allocated);
+    else {
+        pa_assert(t->type == PA_TAGSTRUCT_APPENDED);
+
         t->type = PA_TAGSTRUCT_DYNAMIC;
-        t->data = pa_xmalloc(t->allocated = t->length + l + GROW_TAG_SIZE);
+        t->data = pa_xmalloc(allocated);
         memcpy(t->data, t->per_type.appended, t->length);
     }
+
+    t->allocated = allocated;
+}
+
+static inline void extend(pa_tagstruct*t, size_t l) {
+    pa_assert(t);
+    pa_assert(t->type != PA_TAGSTRUCT_FIXED);
+
+    if (PA_LIKELY(t->length+l <= t->allocated))
+        return;
+
+    /* Grow geometrically, so that building a large reply field by
+     * field needs O(log n) reallocations rather than O(n) */
+    resize(t, PA_MAX(t->allocated * 2, t->length + l + GROW_TAG_SIZE));
+}
+
+void pa_tagstruct_reserve(pa_tagstruct *t, size_t l) {
+    pa_assert(t);
+    pa_assert(t->type != PA_TAGSTRUCT_FIXED);
+
+    if (t->length+l > t->allocated)
+        resize(t, t->length + l);
 }
 
 static void write_u8(pa_tagstruct *t, uint8_t u) {
@@ -455,6 +490,14 @@ int pa_tagstruct_eof(pa_tagstruct*t) {
     return t->rindex >= t->length;
 }
 
+void pa_tagstruct_append(pa_tagstruct *t, pa_tagstruct *from) {
+    pa_assert(t);
+    pa_assert(from);
+    pa_assert(t != from);
+
+    write_arbitrary(t, from->data, from->length);
+}
+
 const uint8_t* pa_tagstruct_data(pa_tagstruct*t, size_t *l) {
     pa_assert(t);
     pa_assert(l);
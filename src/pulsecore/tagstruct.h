@@ -31,6 +31,7 @@
 #include <pulse/proplist.h>
 
 #include <pulsecore/macro.h>
+#include <pulsecore/packet.h>
 
 typedef struct pa_tagstruct pa_tagstruct;
 
@@ -64,6 +65,14 @@ pa_tagstruct *pa_tagstruct_new(void);
 pa_tagstruct *pa_tagstruct_new_fixed(const uint8_t* data, size_t length);
 void pa_tagstruct_free(pa_tagstruct*t);
 
+/* Free the tagstruct and return its contents as a packet. The buffer
+ * is handed over to the packet without copying where possible. */
+pa_packet *pa_tagstruct_free_to_packet(pa_tagstruct *t);
+
+/* Make sure at least l more bytes can be written without growing the
+ * buffer again. Use this when the final size can be estimated. */
+void pa_tagstruct_reserve(pa_tagstruct *t, size_t l);
+
 int pa_tagstruct_eof(pa_tagstruct*t);
 const uint8_t* pa_tagstruct_data(pa_tagstruct*t, size_t *l);
 
@@ -85,6 +94,9 @@ void pa_tagstruct_put_proplist(pa_tagstruct *t, pa_proplist *p);
 void pa_tagstruct_put_volume(pa_tagstruct *t, pa_volume_t volume);
 void pa_tagstruct_put_format_info(pa_tagstruct *t, pa_format_info *f);
 
+/* Append the already serialized contents of another tagstruct */
+void pa_tagstruct_append(pa_tagstruct *t, pa_tagstruct *from);
+
 int pa_tagstruct_get(pa_tagstruct *t, ...);
 
 int pa_tagstruct_gets(pa_tagstruct*t, const char **s);
@@ -432,6 +432,17 @@ void pa_smoother_set_time_offset(pa_smoother *s, pa_usec_t offset) {
 #endif
 }
 
+void pa_smoother_set_adjust_time(pa_smoother *s, pa_usec_t adjust_time) {
+    pa_assert(s);
+    pa_assert(adjust_time > 0);
+
+    s->adjust_time = adjust_time;
+
+#ifdef DEBUG_DATA
+    pa_log_debug("adjust_time(%llu)", (unsigned long long) adjust_time);
+#endif
+}
+
 void pa_smoother_pause(pa_smoother *s, pa_usec_t x) {
     pa_assert(s);
 
@@ -47,6 +47,10 @@ pa_usec_t pa_smoother_translate(pa_smoother *s, pa_usec_t x, pa_usec_t y_delay);
 
 void pa_smoother_set_time_offset(pa_smoother *s, pa_usec_t x_offset);
 
+/* Changes how quickly the estimation follows new data. Useful when it
+ * turns out that the data is a lot less noisy than expected. */
+void pa_smoother_set_adjust_time(pa_smoother *s, pa_usec_t x_adjust_time);
+
 void pa_smoother_pause(pa_smoother *s, pa_usec_t x);
 void pa_smoother_resume(pa_smoother *s, pa_usec_t x, bool abrupt);
 
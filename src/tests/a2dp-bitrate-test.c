@@ -0,0 +1,246 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/timeval.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include <modules/bluetooth/a2dp-bitrate.h>
+
+/* SBC with 8 subbands, 16 blocks, joint stereo at 44.1kHz, sent over
+ * a link with the usual MTU. The steps are the ones the modules use. */
+#define LINK_MTU 895
+#define RTP_OVERHEAD 13
+#define CODESIZE 512
+#define BYTES_PER_SEC (44100 * 4)
+#define MAX_BITPOOL 53U
+#define MIN_BITPOOL 32U
+#define DEC_STEP 5U
+#define INC_STEP 2U
+
+#define SNDBUF (64 * 1024)
+#define TICK_USEC PA_USEC_PER_MSEC
+
+struct sim {
+    pa_a2dp_bitrate *b;
+    unsigned bitpool;
+    pa_usec_t now, next_write;
+    size_t queued;
+    double credit;
+
+    unsigned misses;
+    unsigned decreases, increases;
+};
+
+static size_t frame_length(unsigned bitpool) {
+    return 4 + 8 + (8 + 16 * bitpool + 7) / 8;
+}
+
+static size_t packet_size(unsigned bitpool) {
+    return RTP_OVERHEAD + (LINK_MTU - RTP_OVERHEAD) / frame_length(bitpool) * frame_length(bitpool);
+}
+
+static size_t block_size(unsigned bitpool) {
+    return (LINK_MTU - RTP_OVERHEAD) / frame_length(bitpool) * CODESIZE;
+}
+
+/* Bytes per second on the link the given bitpool needs */
+static unsigned link_rate(unsigned bitpool) {
+    return (unsigned) ((uint64_t) BYTES_PER_SEC * packet_size(bitpool) / block_size(bitpool));
+}
+
+static void apply(struct sim *s, pa_a2dp_bitrate_action_t action) {
+    if (action == PA_A2DP_BITRATE_DECREASE) {
+        s->decreases++;
+        if (s->bitpool > MIN_BITPOOL)
+            s->bitpool = PA_MAX(s->bitpool - DEC_STEP, MIN_BITPOOL);
+    } else if (action == PA_A2DP_BITRATE_INCREASE) {
+        s->increases++;
+        s->bitpool = PA_MIN(s->bitpool + INC_STEP, MAX_BITPOOL);
+    }
+}
+
+static void sim_init(struct sim *s) {
+    pa_zero(*s);
+    s->b = pa_a2dp_bitrate_new();
+    s->bitpool = MAX_BITPOOL;
+    s->now = PA_USEC_PER_SEC;
+    s->next_write = s->now;
+    pa_a2dp_bitrate_reset(s->b, s->now);
+}
+
+static void sim_done(struct sim *s) {
+    pa_a2dp_bitrate_free(s->b);
+}
+
+/* Writes a packet whenever the audio clock says so, while the link
+ * sends whole packets at the given rate */
+static void sim_run(struct sim *s, pa_usec_t duration, unsigned rate) {
+    pa_usec_t end = s->now + duration;
+
+    for (; s->now < end; s->now += TICK_USEC) {
+        size_t size = packet_size(s->bitpool);
+
+        s->credit += (double) rate * TICK_USEC / PA_USEC_PER_SEC;
+        while (s->queued > 0 && s->credit >= size) {
+            s->credit -= size;
+            s->queued -= PA_MIN(size, s->queued);
+        }
+        if (s->queued == 0)
+            s->credit = PA_MIN(s->credit, (double) size);
+
+        if (s->now < s->next_write)
+            continue;
+
+        if (s->queued + size > SNDBUF) {
+            s->misses++;
+            apply(s, pa_a2dp_bitrate_miss(s->b, s->now));
+        } else {
+            s->queued += size;
+            apply(s, pa_a2dp_bitrate_sample(s->b, s->queued, size, s->now));
+        }
+
+        /* Audio goes on whether we could write or not */
+        s->next_write += pa_bytes_to_usec(block_size(s->bitpool), &(pa_sample_spec) { PA_SAMPLE_S16LE, 44100, 2 });
+    }
+}
+
+START_TEST (fast_link_test) {
+    struct sim s;
+
+    sim_init(&s);
+
+    /* Nothing to do if the link keeps up with the highest bitpool */
+    sim_run(&s, 60 * PA_USEC_PER_SEC, link_rate(MAX_BITPOOL) * 3 / 2);
+
+    fail_unless(s.bitpool == MAX_BITPOOL);
+    fail_unless(s.decreases == 0);
+    fail_unless(s.misses == 0);
+
+    sim_done(&s);
+}
+END_TEST
+
+START_TEST (slow_link_test) {
+    struct sim s;
+    unsigned rate = (link_rate(MAX_BITPOOL) + link_rate(MIN_BITPOOL)) / 2;
+    unsigned misses, decreases;
+
+    sim_init(&s);
+
+    /* We back off before the socket ever fills up ... */
+    sim_run(&s, 30 * PA_USEC_PER_SEC, rate);
+    pa_log_debug("slow link: bitpool %u, %u misses, %u decreases, %u increases",
+                 s.bitpool, s.misses, s.decreases, s.increases);
+
+    fail_unless(s.misses == 0);
+    fail_unless(s.bitpool < MAX_BITPOOL);
+    fail_unless(s.bitpool > MIN_BITPOOL);
+
+    /* ... and then stay close to what the link can take, trying a
+     * higher bitpool less and less often */
+    misses = s.misses;
+    decreases = s.decreases;
+    sim_run(&s, 120 * PA_USEC_PER_SEC, rate);
+    pa_log_debug("slow link: bitpool %u, %u misses, %u decreases, %u increases",
+                 s.bitpool, s.misses, s.decreases, s.increases);
+
+    fail_unless(s.misses == misses);
+    fail_unless(s.decreases - decreases <= 8);
+    fail_unless(link_rate(s.bitpool) <= rate || link_rate(s.bitpool - INC_STEP) <= rate);
+    fail_unless(s.queued < 8 * (size_t) LINK_MTU);
+
+    sim_done(&s);
+}
+END_TEST
+
+START_TEST (recovery_test) {
+    struct sim s;
+
+    sim_init(&s);
+
+    sim_run(&s, 10 * PA_USEC_PER_SEC, link_rate(MAX_BITPOOL) * 3 / 2);
+    fail_unless(s.bitpool == MAX_BITPOOL);
+
+    /* Interference: only the lowest bitpool fits */
+    sim_run(&s, 30 * PA_USEC_PER_SEC, link_rate(MIN_BITPOOL) * 21 / 20);
+    pa_log_debug("interference: bitpool %u, %u misses", s.bitpool, s.misses);
+    fail_unless(s.bitpool <= MIN_BITPOOL + INC_STEP);
+
+    /* When the link recovers, so does the bitpool */
+    sim_run(&s, 180 * PA_USEC_PER_SEC, link_rate(MAX_BITPOOL) * 3 / 2);
+    pa_log_debug("recovered: bitpool %u, %u misses", s.bitpool, s.misses);
+    fail_unless(s.bitpool == MAX_BITPOOL);
+
+    sim_done(&s);
+}
+END_TEST
+
+START_TEST (miss_test) {
+    pa_a2dp_bitrate *b;
+    pa_usec_t now = PA_USEC_PER_SEC;
+
+    b = pa_a2dp_bitrate_new();
+    pa_a2dp_bitrate_reset(b, now);
+
+    /* A burst of failed writes only counts once */
+    fail_unless(pa_a2dp_bitrate_miss(b, now) == PA_A2DP_BITRATE_DECREASE);
+    fail_unless(pa_a2dp_bitrate_miss(b, now + PA_USEC_PER_MSEC) == PA_A2DP_BITRATE_KEEP);
+    fail_unless(pa_a2dp_bitrate_miss(b, now + PA_USEC_PER_SEC) == PA_A2DP_BITRATE_DECREASE);
+
+    /* Nothing changes right after the stream was set up */
+    now += 10 * PA_USEC_PER_SEC;
+    pa_a2dp_bitrate_reset(b, now);
+    fail_unless(pa_a2dp_bitrate_sample(b, 50 * LINK_MTU, LINK_MTU, now) == PA_A2DP_BITRATE_KEEP);
+
+    pa_a2dp_bitrate_free(b);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("A2DP bitrate");
+    tc = tcase_create("a2dp-bitrate");
+    tcase_add_test(tc, fast_link_test);
+    tcase_add_test(tc, slow_link_test);
+    tcase_add_test(tc, recovery_test);
+    tcase_add_test(tc, miss_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
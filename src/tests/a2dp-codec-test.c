@@ -0,0 +1,340 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblock.h>
+
+#include <modules/bluetooth/a2dp-codecs.h>
+#include <modules/bluetooth/a2dp-codec-util.h>
+#include <modules/bluetooth/a2dp-encoder.h>
+#include <modules/bluetooth/rtp.h>
+
+#include "runtime-test-util.h"
+
+/* A typical EDR link */
+#define LINK_MTU 895
+
+/* Raw s16le stereo at 44.1kHz to encode instead of the test signal,
+ * see main() */
+static const char *input_file = NULL;
+
+static const a2dp_sbc_t sbc_config = {
+    .frequency = SBC_SAMPLING_FREQ_44100,
+    .channel_mode = SBC_CHANNEL_MODE_JOINT_STEREO,
+    .allocation_method = SBC_ALLOCATION_LOUDNESS,
+    .subbands = SBC_SUBBANDS_8,
+    .block_length = SBC_BLOCK_LENGTH_16,
+    .min_bitpool = MIN_BITPOOL,
+    .max_bitpool = 53,
+};
+
+/* One second of a 1kHz sine at -6dB, or the input file */
+static int16_t *get_signal(size_t *n_frames) {
+    int16_t *s;
+    size_t i;
+
+    if (input_file) {
+        FILE *f;
+        long size;
+
+        pa_assert_se(f = fopen(input_file, "rb"));
+        pa_assert_se(fseek(f, 0, SEEK_END) == 0);
+        pa_assert_se((size = ftell(f)) > 0);
+        rewind(f);
+
+        *n_frames = (size_t) size / (2 * sizeof(int16_t));
+        s = pa_xnew(int16_t, *n_frames * 2);
+        pa_assert_se(fread(s, 2 * sizeof(int16_t), *n_frames, f) == *n_frames);
+        fclose(f);
+
+        return s;
+    }
+
+    *n_frames = 44100;
+    s = pa_xnew(int16_t, *n_frames * 2);
+
+    for (i = 0; i < *n_frames; i++)
+        s[2*i] = s[2*i+1] = (int16_t) (16384 * sin(2 * M_PI * 1000 * i / 44100));
+
+    return s;
+}
+
+/* The decoded signal is delayed by the filterbanks, so we try all
+ * delays up to max_delay and return the best SNR in dB */
+static double snr(const int16_t *ref, const int16_t *decoded, size_t n_samples, size_t max_delay) {
+    double best = -INFINITY;
+    size_t d, i;
+
+    for (d = 0; d < max_delay && d < n_samples; d++) {
+        double signal = 0, noise = 0, r;
+
+        for (i = 0; i < n_samples - d; i++) {
+            double e = (double) decoded[i + d] - ref[i];
+
+            signal += (double) ref[i] * ref[i];
+            noise += e * e;
+        }
+
+        r = noise > 0 ? 10 * log10(signal / noise) : INFINITY;
+        best = PA_MAX(best, r);
+    }
+
+    return best;
+}
+
+START_TEST (sbc_roundtrip_test) {
+    const pa_a2dp_codec *codec;
+    void *encoder, *decoder;
+    pa_sample_spec ss;
+    int16_t *signal, *decoded;
+    uint8_t packet[LINK_MTU];
+    size_t n_frames, block_size, offset = 0, decoded_length = 0;
+    uint16_t seq = 0;
+    double r;
+
+    fail_unless((codec = pa_bluetooth_get_a2dp_codec("sbc")) != NULL);
+    fail_unless(pa_bluetooth_get_a2dp_codec_by_id(A2DP_CODEC_SBC) == codec);
+
+    fail_unless((encoder = codec->init(true, (const uint8_t *) &sbc_config, sizeof(sbc_config), &ss)) != NULL);
+    fail_unless(ss.format == PA_SAMPLE_S16LE);
+    fail_unless(ss.rate == 44100);
+    fail_unless(ss.channels == 2);
+
+    fail_unless((decoder = codec->init(false, (const uint8_t *) &sbc_config, sizeof(sbc_config), &ss)) != NULL);
+
+    block_size = codec->get_block_size(encoder, LINK_MTU);
+    fail_unless(block_size > 0);
+    fail_unless(block_size % pa_frame_size(&ss) == 0);
+
+    signal = get_signal(&n_frames);
+    decoded = pa_xnew0(int16_t, n_frames * 2 + block_size);
+
+    while (offset + block_size <= n_frames * pa_frame_size(&ss)) {
+        const struct rtp_header *header = (const struct rtp_header *) packet;
+        size_t packet_size, processed, written;
+
+        packet_size = codec->encode_buffer(encoder, offset / pa_frame_size(&ss), (const uint8_t *) signal + offset,
+                                           block_size, packet, sizeof(packet), &processed);
+
+        fail_unless(packet_size > sizeof(struct rtp_header) + sizeof(struct rtp_payload));
+        fail_unless(packet_size <= LINK_MTU);
+        fail_unless(processed == block_size);
+
+        fail_unless(header->v == 2);
+        fail_unless(header->pt == 1);
+        fail_unless(ntohs(header->sequence_number) == seq++);
+        fail_unless(ntohl(header->timestamp) == offset / pa_frame_size(&ss));
+
+        written = codec->decode_buffer(decoder, packet, packet_size, (uint8_t *) decoded + decoded_length,
+                                       block_size, &processed);
+
+        fail_unless(written == block_size);
+        fail_unless(processed == packet_size);
+
+        offset += block_size;
+        decoded_length += written;
+    }
+
+    r = snr(signal, decoded, decoded_length / sizeof(int16_t), 1024);
+    pa_log_debug("SNR at bitpool %u: %0.1f dB", sbc_config.max_bitpool, r);
+
+    if (!input_file)
+        fail_unless(r > 30);
+
+    pa_xfree(signal);
+    pa_xfree(decoded);
+
+    codec->deinit(encoder);
+    codec->deinit(decoder);
+}
+END_TEST
+
+START_TEST (sbc_bitrate_test) {
+    const pa_a2dp_codec *codec;
+    void *encoder;
+    pa_sample_spec ss;
+    size_t block_size, reduced, last;
+    a2dp_sbc_t bad_config = sbc_config;
+
+    fail_unless((codec = pa_bluetooth_get_a2dp_codec("sbc")) != NULL);
+
+    bad_config.min_bitpool = 60;
+    fail_unless(codec->init(true, (const uint8_t *) &bad_config, sizeof(bad_config), &ss) == NULL);
+    fail_unless(codec->init(true, (const uint8_t *) &sbc_config, sizeof(sbc_config) - 1, &ss) == NULL);
+
+    fail_unless((encoder = codec->init(true, (const uint8_t *) &sbc_config, sizeof(sbc_config), &ss)) != NULL);
+
+    /* Lower bitrates fit more audio into a packet, down to a limit */
+    last = block_size = codec->get_block_size(encoder, LINK_MTU);
+
+    while ((reduced = codec->reduce_encoder_bitrate(encoder, LINK_MTU)) > 0) {
+        fail_unless(reduced >= last);
+        fail_unless(reduced == codec->get_block_size(encoder, LINK_MTU));
+        last = reduced;
+    }
+
+    fail_unless(last > block_size);
+
+    /* ... and we can go back up all the way */
+    while ((reduced = codec->increase_encoder_bitrate(encoder, LINK_MTU)) > 0) {
+        fail_unless(reduced <= last);
+        last = reduced;
+    }
+
+    fail_unless(last == block_size);
+
+    codec->reduce_encoder_bitrate(encoder, LINK_MTU);
+    codec->reset(encoder);
+    fail_unless(codec->get_block_size(encoder, LINK_MTU) == block_size);
+
+    codec->deinit(encoder);
+}
+END_TEST
+
+START_TEST (encoder_thread_test) {
+    const pa_a2dp_codec *codec;
+    void *threaded_info, *inline_info;
+    pa_a2dp_encoder *e;
+    pa_mempool *pool;
+    pa_sample_spec ss;
+    int16_t *signal;
+    size_t n_frames, block_size, offset = 0;
+
+    fail_unless((codec = pa_bluetooth_get_a2dp_codec("sbc")) != NULL);
+    fail_unless((threaded_info = codec->init(true, (const uint8_t *) &sbc_config, sizeof(sbc_config), &ss)) != NULL);
+    fail_unless((inline_info = codec->init(true, (const uint8_t *) &sbc_config, sizeof(sbc_config), &ss)) != NULL);
+
+    fail_unless((pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true)) != NULL);
+    block_size = codec->get_block_size(inline_info, LINK_MTU);
+    signal = get_signal(&n_frames);
+
+    fail_unless((e = pa_a2dp_encoder_new(codec, threaded_info, LINK_MTU, 0)) != NULL);
+    fail_unless(!pa_a2dp_encoder_busy(e));
+
+    /* Both paths have to produce the very same packets */
+    while (offset + block_size <= n_frames * pa_frame_size(&ss)) {
+        pa_memchunk chunk;
+        uint8_t expected[LINK_MTU];
+        const uint8_t *packet;
+        size_t expected_size, packet_size, processed, pcm_length;
+
+        chunk.memblock = pa_memblock_new(pool, block_size);
+        chunk.index = 0;
+        chunk.length = block_size;
+        memcpy(pa_memblock_acquire(chunk.memblock), (uint8_t *) signal + offset, block_size);
+        pa_memblock_release(chunk.memblock);
+
+        pa_a2dp_encoder_submit(e, &chunk, offset / pa_frame_size(&ss));
+        pa_memblock_unref(chunk.memblock);
+        fail_unless(pa_a2dp_encoder_busy(e));
+
+        expected_size = codec->encode_buffer(inline_info, offset / pa_frame_size(&ss), (const uint8_t *) signal + offset,
+                                             block_size, expected, sizeof(expected), &processed);
+
+        packet_size = pa_a2dp_encoder_wait(e, &packet, &pcm_length);
+        fail_unless(packet_size == expected_size);
+        fail_unless(pcm_length == block_size);
+        fail_unless(memcmp(packet, expected, packet_size) == 0);
+
+        /* Waiting again gives us the same packet */
+        fail_unless(pa_a2dp_encoder_wait(e, NULL, NULL) == packet_size);
+
+        pa_a2dp_encoder_release(e);
+        fail_unless(!pa_a2dp_encoder_busy(e));
+
+        offset += block_size;
+    }
+
+    pa_a2dp_encoder_free(e);
+    pa_xfree(signal);
+    pa_mempool_unref(pool);
+
+    codec->deinit(threaded_info);
+    codec->deinit(inline_info);
+}
+END_TEST
+
+START_TEST (sbc_benchmark_test) {
+    const pa_a2dp_codec *codec;
+    void *encoder;
+    pa_sample_spec ss;
+    int16_t *signal;
+    uint8_t packet[LINK_MTU];
+    size_t n_frames, block_size, offset, processed;
+
+    fail_unless((codec = pa_bluetooth_get_a2dp_codec("sbc")) != NULL);
+    fail_unless((encoder = codec->init(true, (const uint8_t *) &sbc_config, sizeof(sbc_config), &ss)) != NULL);
+
+    block_size = codec->get_block_size(encoder, LINK_MTU);
+    signal = get_signal(&n_frames);
+
+    /* This is what the IO or the encoder thread spends per second of
+     * audio */
+    PA_RUNTIME_TEST_RUN_START("sbc encode", 1, 10) {
+        for (offset = 0; offset + block_size <= n_frames * pa_frame_size(&ss); offset += block_size)
+            codec->encode_buffer(encoder, 0, (const uint8_t *) signal + offset, block_size,
+                                 packet, sizeof(packet), &processed);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_xfree(signal);
+    codec->deinit(encoder);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    /* Encode a recording instead of the test signal */
+    if (argc > 1)
+        input_file = argv[1];
+
+    s = suite_create("A2DP codec");
+    tc = tcase_create("a2dp-codec");
+    tcase_add_test(tc, sbc_roundtrip_test);
+    tcase_add_test(tc, sbc_bitrate_test);
+    tcase_add_test(tc, encoder_thread_test);
+    tcase_add_test(tc, sbc_benchmark_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,275 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/log.h>
+
+#include <modules/alsa/alsa-probe-cache.h>
+
+#define KEY "HDA Intel PCH at 0xf7f10000 irq 32"
+
+#define CARD_STATE \
+    "snd_hda_intel|HDA Intel PCH|" KEY "|Realtek ALC892|HDA:10ec0892\n" \
+    "2 0 0 Master Playback Volume 0\n" \
+    "3 3 0 ELD 0 100008006a1000000000000000000000"
+
+#define CARD_STATE_OTHER_MONITOR \
+    "snd_hda_intel|HDA Intel PCH|" KEY "|Realtek ALC892|HDA:10ec0892\n" \
+    "2 0 0 Master Playback Volume 0\n" \
+    "3 3 0 ELD 0 100008006a1000000000000000000001"
+
+static char *dir;
+static pa_database *cache;
+
+static pa_sample_spec ss = {
+    .format = PA_SAMPLE_S16LE,
+    .rate = 44100,
+    .channels = 2
+};
+
+static void mapping_free(pa_alsa_mapping *m) {
+    pa_xfree(m->name);
+    pa_xstrfreev(m->device_strings);
+    pa_xfree(m);
+}
+
+static void profile_free(pa_alsa_profile *p) {
+    pa_xfree(p->name);
+    pa_idxset_free(p->output_mappings, NULL);
+    pa_xfree(p);
+}
+
+static void mapping_add(pa_alsa_profile_set *ps, const char *name, const char *device_string, unsigned channels) {
+    pa_alsa_mapping *m;
+    pa_alsa_profile *p;
+
+    m = pa_xnew0(pa_alsa_mapping, 1);
+    m->profile_set = ps;
+    m->name = pa_xstrdup(name);
+    m->device_strings = pa_split_spaces_strv(device_string);
+    pa_channel_map_init_auto(&m->channel_map, channels, PA_CHANNEL_MAP_ALSA);
+    pa_hashmap_put(ps->mappings, m->name, m);
+
+    p = pa_xnew0(pa_alsa_profile, 1);
+    p->profile_set = ps;
+    p->name = pa_sprintf_malloc("output:%s", name);
+    p->output_mappings = pa_idxset_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+    pa_idxset_put(p->output_mappings, m, NULL);
+    pa_hashmap_put(ps->profiles, p->name, p);
+}
+
+/* A card with a stereo and an HDMI surround output, nothing probed yet */
+static pa_alsa_profile_set *profile_set_new(void) {
+    pa_alsa_profile_set *ps;
+
+    ps = pa_xnew0(pa_alsa_profile_set, 1);
+    ps->mappings = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, (pa_free_cb_t) mapping_free);
+    ps->profiles = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, (pa_free_cb_t) profile_free);
+
+    mapping_add(ps, "analog-stereo", "front:%f", 2);
+    mapping_add(ps, "hdmi-surround", "hdmi:%f", 6);
+
+    return ps;
+}
+
+static void profile_set_free(pa_alsa_profile_set *ps) {
+    pa_hashmap_free(ps->profiles);
+    pa_hashmap_free(ps->mappings);
+    pa_xfree(ps);
+}
+
+static void set_supported(pa_alsa_profile_set *ps, const char *name, bool supported) {
+    pa_alsa_mapping *m;
+    pa_alsa_profile *p;
+    char *t;
+
+    pa_assert_se(m = pa_hashmap_get(ps->mappings, name));
+    t = pa_sprintf_malloc("output:%s", name);
+    pa_assert_se(p = pa_hashmap_get(ps->profiles, t));
+    pa_xfree(t);
+
+    m->supported = supported;
+    p->supported = supported;
+}
+
+static bool is_supported(pa_alsa_profile_set *ps, const char *name) {
+    pa_alsa_mapping *m;
+    pa_alsa_profile *p;
+    char *t;
+
+    pa_assert_se(m = pa_hashmap_get(ps->mappings, name));
+    t = pa_sprintf_malloc("output:%s", name);
+    pa_assert_se(p = pa_hashmap_get(ps->profiles, t));
+    pa_xfree(t);
+
+    fail_unless(!!m->supported == p->supported);
+    return p->supported;
+}
+
+/* Probes the card in the given state, storing a result in which all
+ * profiles but hdmi-surround work */
+static void probe(const char *card_state) {
+    pa_alsa_profile_set *ps;
+    uint64_t hash;
+
+    ps = profile_set_new();
+    hash = pa_alsa_probe_cache_hash(ps, card_state, &ss, 4, 25);
+
+    set_supported(ps, "analog-stereo", true);
+    set_supported(ps, "hdmi-surround", false);
+    pa_alsa_probe_cache_save(ps, cache, KEY, hash);
+
+    profile_set_free(ps);
+}
+
+static void setup(void) {
+    char *fn;
+
+    dir = pa_sprintf_malloc("%s" PA_PATH_SEP "alsa-probe-cache-test-XXXXXX", pa_get_temp_dir());
+    fail_unless(mkdtemp(dir) != NULL);
+
+    fn = pa_sprintf_malloc("%s" PA_PATH_SEP "cache", dir);
+    cache = pa_database_open(fn, true);
+    fail_unless(cache != NULL);
+    pa_xfree(fn);
+}
+
+static void teardown(void) {
+    DIR *d;
+    struct dirent *de;
+
+    pa_database_close(cache);
+
+    /* The database backend decides which files it creates */
+    pa_assert_se(d = opendir(dir));
+    while ((de = readdir(d))) {
+        char *fn;
+
+        if (pa_streq(de->d_name, ".") || pa_streq(de->d_name, ".."))
+            continue;
+
+        fn = pa_sprintf_malloc("%s" PA_PATH_SEP "%s", dir, de->d_name);
+        unlink(fn);
+        pa_xfree(fn);
+    }
+    closedir(d);
+
+    rmdir(dir);
+    pa_xfree(dir);
+}
+
+START_TEST (hit_test) {
+    pa_alsa_profile_set *ps;
+    uint64_t hash;
+
+    setup();
+
+    /* Nothing stored yet */
+    ps = profile_set_new();
+    hash = pa_alsa_probe_cache_hash(ps, CARD_STATE, &ss, 4, 25);
+    fail_unless(!pa_alsa_probe_cache_load(ps, cache, KEY, hash));
+    profile_set_free(ps);
+
+    probe(CARD_STATE);
+
+    /* The next start finds the result */
+    ps = profile_set_new();
+    fail_unless(hash == pa_alsa_probe_cache_hash(ps, CARD_STATE, &ss, 4, 25));
+    fail_unless(pa_alsa_probe_cache_load(ps, cache, KEY, hash));
+    fail_unless(is_supported(ps, "analog-stereo"));
+    fail_unless(!is_supported(ps, "hdmi-surround"));
+    profile_set_free(ps);
+
+    teardown();
+}
+END_TEST
+
+START_TEST (invalidate_test) {
+    pa_alsa_profile_set *ps;
+    uint64_t hash;
+
+    setup();
+    probe(CARD_STATE);
+
+    /* Another monitor may allow opening the HDMI PCM with more channels */
+    ps = profile_set_new();
+    hash = pa_alsa_probe_cache_hash(ps, CARD_STATE_OTHER_MONITOR, &ss, 4, 25);
+    fail_unless(!pa_alsa_probe_cache_load(ps, cache, KEY, hash));
+    fail_unless(!is_supported(ps, "analog-stereo"));
+
+    /* So may other probing parameters */
+    fail_unless(!pa_alsa_probe_cache_load(ps, cache, KEY, pa_alsa_probe_cache_hash(ps, CARD_STATE, &ss, 2, 25)));
+    fail_unless(!pa_alsa_probe_cache_load(ps, cache, KEY, pa_alsa_probe_cache_hash(ps, CARD_STATE, &ss, 4, 10)));
+    profile_set_free(ps);
+
+    /* ... or a different profile set */
+    ps = profile_set_new();
+    mapping_add(ps, "iec958-stereo", "iec958:%f", 2);
+    hash = pa_alsa_probe_cache_hash(ps, CARD_STATE, &ss, 4, 25);
+    fail_unless(!pa_alsa_probe_cache_load(ps, cache, KEY, hash));
+    fail_unless(!pa_alsa_probe_cache_load(ps, cache, "Another card", hash));
+    fail_unless(!is_supported(ps, "analog-stereo"));
+    profile_set_free(ps);
+
+    /* Probing again replaces the old result */
+    probe(CARD_STATE_OTHER_MONITOR);
+
+    ps = profile_set_new();
+    fail_unless(!pa_alsa_probe_cache_load(ps, cache, KEY, pa_alsa_probe_cache_hash(ps, CARD_STATE, &ss, 4, 25)));
+    fail_unless(pa_alsa_probe_cache_load(ps, cache, KEY, pa_alsa_probe_cache_hash(ps, CARD_STATE_OTHER_MONITOR, &ss, 4, 25)));
+    fail_unless(is_supported(ps, "analog-stereo"));
+    profile_set_free(ps);
+
+    teardown();
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Alsa-probe-cache");
+    tc = tcase_create("alsa-probe-cache");
+    tcase_add_test(tc, hit_test);
+    tcase_add_test(tc, invalidate_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
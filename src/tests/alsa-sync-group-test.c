@@ -0,0 +1,266 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulsecore/core.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include <modules/alsa/alsa-sync-group.h>
+
+/* PCMs that are linked share a link id, like they share a substream
+ * group in the kernel */
+struct fake_pcm {
+    const char *name;
+    unsigned link_id;
+    snd_pcm_state_t state;
+};
+
+static struct fake_pcm pcms[3];
+static unsigned n_starts, n_unlinks;
+
+#define PCM(i) ((snd_pcm_t*) &pcms[i])
+#define FAKE(pcm) ((struct fake_pcm*) (pcm))
+
+static int fake_link(snd_pcm_t *pcm1, snd_pcm_t *pcm2) {
+    FAKE(pcm2)->link_id = FAKE(pcm1)->link_id;
+    return 0;
+}
+
+static int fake_unlink(snd_pcm_t *pcm) {
+    FAKE(pcm)->link_id = (unsigned) (FAKE(pcm) - pcms) + 1;
+    n_unlinks++;
+    return 0;
+}
+
+/* Starting or preparing a linked PCM acts on all of them */
+static void set_state(snd_pcm_t *pcm, snd_pcm_state_t state) {
+    unsigned i;
+
+    for (i = 0; i < PA_ELEMENTSOF(pcms); i++)
+        if (pcms[i].link_id == FAKE(pcm)->link_id)
+            pcms[i].state = state;
+}
+
+static int fake_start(snd_pcm_t *pcm) {
+    if (FAKE(pcm)->state != SND_PCM_STATE_PREPARED)
+        return -EBADFD;
+
+    set_state(pcm, SND_PCM_STATE_RUNNING);
+    n_starts++;
+    return 0;
+}
+
+static snd_pcm_state_t fake_state(snd_pcm_t *pcm) {
+    return FAKE(pcm)->state;
+}
+
+static const char *fake_name(snd_pcm_t *pcm) {
+    return FAKE(pcm)->name;
+}
+
+static const pa_alsa_sync_group_pcm_ops fake_ops = {
+    .link = fake_link,
+    .unlink = fake_unlink,
+    .start = fake_start,
+    .state = fake_state,
+    .name = fake_name
+};
+
+static pa_mainloop *mainloop;
+static pa_core *core;
+
+static pa_alsa_sync_group *group_new(unsigned n_members) {
+    static const char * const names[] = { "pcm0", "pcm1", "pcm2" };
+    pa_alsa_sync_group *g;
+    unsigned i;
+
+    mainloop = pa_mainloop_new();
+    fail_unless(mainloop != NULL);
+    core = pa_core_new(pa_mainloop_get_api(mainloop), false, false, 0);
+    fail_unless(core != NULL);
+
+    g = pa_alsa_sync_group_get(core, "test");
+    pa_alsa_sync_group_set_pcm_ops(g, &fake_ops);
+
+    n_starts = n_unlinks = 0;
+
+    for (i = 0; i < PA_ELEMENTSOF(pcms); i++) {
+        pcms[i].name = names[i];
+        pcms[i].link_id = i + 1;
+        pcms[i].state = SND_PCM_STATE_PREPARED;
+    }
+
+    for (i = 0; i < n_members; i++)
+        fail_unless(pa_alsa_sync_group_join(g, PCM(i)) == 0);
+
+    return g;
+}
+
+static void group_free(pa_alsa_sync_group *g, unsigned n_members) {
+    unsigned i;
+
+    for (i = 0; i < n_members; i++)
+        pa_alsa_sync_group_leave(g, PCM(i));
+
+    pa_alsa_sync_group_unref(g);
+    pa_core_unref(core);
+    pa_mainloop_free(mainloop);
+}
+
+START_TEST (start_test) {
+    pa_alsa_sync_group *g;
+
+    g = group_new(3);
+
+    fail_unless(pcms[0].link_id == pcms[1].link_id);
+    fail_unless(pcms[0].link_id == pcms[2].link_id);
+
+    /* Nobody starts before everybody filled up */
+    fail_unless(!pa_alsa_sync_group_start(g, PCM(1)));
+    fail_unless(!pa_alsa_sync_group_start(g, PCM(0)));
+    fail_unless(!pa_alsa_sync_group_start(g, PCM(1)));
+    fail_unless(n_starts == 0);
+
+    /* The last one starts all of them at once */
+    fail_unless(pa_alsa_sync_group_start(g, PCM(2)));
+    fail_unless(n_starts == 1);
+    fail_unless(pcms[0].state == SND_PCM_STATE_RUNNING);
+    fail_unless(pcms[1].state == SND_PCM_STATE_RUNNING);
+
+    /* ... and the others notice */
+    fail_unless(pa_alsa_sync_group_start(g, PCM(0)));
+    fail_unless(pa_alsa_sync_group_start(g, PCM(1)));
+    fail_unless(n_starts == 1);
+    fail_unless(n_unlinks == 0);
+
+    group_free(g, 3);
+}
+END_TEST
+
+START_TEST (recover_test) {
+    pa_alsa_sync_group *g;
+
+    g = group_new(2);
+
+    fail_unless(!pa_alsa_sync_group_start(g, PCM(0)));
+    fail_unless(pa_alsa_sync_group_start(g, PCM(1)));
+    fail_unless(n_starts == 1);
+
+    /* 0 underruns and recovers, which prepares 1 as well without 1
+     * seeing an error itself */
+    set_state(PCM(0), SND_PCM_STATE_PREPARED);
+    pa_alsa_sync_group_stopped(g, PCM(0));
+
+    fail_unless(!pa_alsa_sync_group_restart_needed(g, PCM(0)));
+    fail_unless(pa_alsa_sync_group_restart_needed(g, PCM(1)));
+    fail_unless(!pa_alsa_sync_group_restart_needed(g, PCM(1)));
+
+    /* 0 fills up first and waits for 1, instead of starting alone */
+    fail_unless(!pa_alsa_sync_group_start(g, PCM(0)));
+    fail_unless(pcms[0].state == SND_PCM_STATE_PREPARED);
+
+    fail_unless(pa_alsa_sync_group_start(g, PCM(1)));
+    fail_unless(n_starts == 2);
+    fail_unless(pcms[0].state == SND_PCM_STATE_RUNNING);
+    fail_unless(pcms[0].link_id == pcms[1].link_id);
+    fail_unless(n_unlinks == 0);
+
+    /* Both seeing the underrun works out the same */
+    set_state(PCM(0), SND_PCM_STATE_PREPARED);
+    pa_alsa_sync_group_stopped(g, PCM(1));
+    pa_alsa_sync_group_stopped(g, PCM(0));
+    pa_alsa_sync_group_restart_needed(g, PCM(0));
+    pa_alsa_sync_group_restart_needed(g, PCM(1));
+
+    fail_unless(!pa_alsa_sync_group_start(g, PCM(1)));
+    fail_unless(pa_alsa_sync_group_start(g, PCM(0)));
+    fail_unless(n_starts == 3);
+    fail_unless(n_unlinks == 0);
+
+    group_free(g, 2);
+}
+END_TEST
+
+START_TEST (late_join_test) {
+    pa_alsa_sync_group *g;
+
+    g = group_new(2);
+
+    fail_unless(!pa_alsa_sync_group_start(g, PCM(0)));
+    fail_unless(pa_alsa_sync_group_start(g, PCM(1)));
+
+    /* Joining a running group means starting alone, and unlinked */
+    fail_unless(pa_alsa_sync_group_join(g, PCM(2)) == 0);
+    pcms[2].state = SND_PCM_STATE_PREPARED;
+    fail_unless(pa_alsa_sync_group_start(g, PCM(2)));
+    fail_unless(n_unlinks == 1);
+    fail_unless(n_starts == 2);
+    fail_unless(pcms[2].state == SND_PCM_STATE_RUNNING);
+    fail_unless(pcms[2].link_id != pcms[0].link_id);
+
+    /* So its underruns don't concern the others ... */
+    pcms[2].state = SND_PCM_STATE_PREPARED;
+    pa_alsa_sync_group_stopped(g, PCM(2));
+    fail_unless(!pa_alsa_sync_group_restart_needed(g, PCM(0)));
+    fail_unless(!pa_alsa_sync_group_restart_needed(g, PCM(1)));
+    fail_unless(pa_alsa_sync_group_start(g, PCM(2)));
+    fail_unless(n_starts == 3);
+
+    /* ... and theirs don't concern it */
+    set_state(PCM(0), SND_PCM_STATE_PREPARED);
+    pa_alsa_sync_group_stopped(g, PCM(0));
+    fail_unless(pa_alsa_sync_group_restart_needed(g, PCM(1)));
+    fail_unless(!pa_alsa_sync_group_restart_needed(g, PCM(2)));
+    fail_unless(pcms[2].state == SND_PCM_STATE_RUNNING);
+
+    group_free(g, 3);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Alsa-sync-group");
+    tc = tcase_create("alsa-sync-group");
+    tcase_add_test(tc, start_test);
+    tcase_add_test(tc, recover_test);
+    tcase_add_test(tc, late_join_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,109 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulsecore/log.h>
+
+#include <modules/alsa/alsa-volume-cache.h>
+
+#define REQUESTED (PA_VOLUME_NORM / 2)
+#define RESULT (REQUESTED + 10)
+#define RAW (-1800)
+
+START_TEST (hit_test) {
+    pa_alsa_volume_cache c = { .valid = false };
+    pa_volume_t f = PA_VOLUME_MUTED;
+
+    /* Nothing was written yet */
+    fail_unless(!pa_alsa_volume_cache_lookup(&c, REQUESTED, false, RAW, &f));
+
+    /* Writing the same volume again gives what the last write gave */
+    pa_alsa_volume_cache_store(&c, REQUESTED, false, RESULT, RAW);
+    fail_unless(pa_alsa_volume_cache_lookup(&c, REQUESTED, false, RAW, &f));
+    fail_unless(f == RESULT);
+
+    f = PA_VOLUME_MUTED;
+    fail_unless(pa_alsa_volume_cache_lookup(&c, REQUESTED, false, RAW, &f));
+    fail_unless(f == RESULT);
+
+    /* Other volumes have to be written */
+    f = PA_VOLUME_MUTED;
+    fail_unless(!pa_alsa_volume_cache_lookup(&c, REQUESTED + 1, false, RAW, &f));
+    fail_unless(!pa_alsa_volume_cache_lookup(&c, PA_VOLUME_MUTED, false, RAW, &f));
+    fail_unless(f == PA_VOLUME_MUTED);
+
+    /* Deferred writes round differently */
+    fail_unless(!pa_alsa_volume_cache_lookup(&c, REQUESTED, true, RAW, &f));
+    pa_alsa_volume_cache_store(&c, REQUESTED, true, RESULT, RAW);
+    fail_unless(pa_alsa_volume_cache_lookup(&c, REQUESTED, true, RAW, &f));
+    fail_unless(!pa_alsa_volume_cache_lookup(&c, REQUESTED, false, RAW, &f));
+}
+END_TEST
+
+START_TEST (invalidate_test) {
+    pa_alsa_volume_cache c = { .valid = false };
+    pa_volume_t f;
+
+    pa_alsa_volume_cache_store(&c, REQUESTED, false, RESULT, RAW);
+
+    /* Somebody else changed the control, so writing the same volume
+     * again does change something */
+    fail_unless(!pa_alsa_volume_cache_lookup(&c, REQUESTED, false, RAW + 100, &f));
+
+    /* ... unless it was changed back */
+    fail_unless(pa_alsa_volume_cache_lookup(&c, REQUESTED, false, RAW, &f));
+
+    /* A failed write leaves the control in an unknown state */
+    pa_alsa_volume_cache_invalidate(&c);
+    fail_unless(!pa_alsa_volume_cache_lookup(&c, REQUESTED, false, RAW, &f));
+
+    pa_alsa_volume_cache_store(&c, REQUESTED, false, RESULT, RAW + 100);
+    fail_unless(!pa_alsa_volume_cache_lookup(&c, REQUESTED, false, RAW, &f));
+    fail_unless(pa_alsa_volume_cache_lookup(&c, REQUESTED, false, RAW + 100, &f));
+    fail_unless(f == RESULT);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Alsa-volume-cache");
+    tc = tcase_create("alsa-volume-cache");
+    tcase_add_test(tc, hit_test);
+    tcase_add_test(tc, invalidate_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
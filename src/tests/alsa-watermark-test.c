@@ -0,0 +1,272 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/timeval.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include <modules/alsa/alsa-watermark.h>
+
+#include "runtime-test-util.h"
+
+#define WAKEUP_INTERVAL_USEC (10*PA_USEC_PER_MSEC)
+#define INITIAL_WATERMARK_USEC (20*PA_USEC_PER_MSEC)
+#define MIN_WATERMARK_USEC (4*PA_USEC_PER_MSEC)
+
+/* Deterministic, so that failures can be reproduced */
+static uint32_t rnd_state;
+
+static uint32_t rnd(void) {
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return rnd_state >> 8;
+}
+
+/* Wakeup jitter plus render time: usually 1-3ms, and with the given
+ * probability (in 1/10000) a burst of 10-14ms */
+static pa_usec_t simulate_used(unsigned burst_rate) {
+    if (rnd() % 10000 < burst_rate)
+        return 10*PA_USEC_PER_MSEC + rnd() % (4*PA_USEC_PER_MSEC);
+
+    return PA_USEC_PER_MSEC + rnd() % (2*PA_USEC_PER_MSEC);
+}
+
+struct result {
+    pa_usec_t watermark, average;
+    unsigned misses;
+};
+
+/* Runs the controller the way alsa-sink does for the given number of
+ * wakeups, the average and the dropouts are over the second half */
+static void simulate(pa_alsa_watermark *w, unsigned n, unsigned burst_rate, pa_usec_t *now, struct result *r) {
+    unsigned i;
+    pa_usec_t sum = 0;
+
+    r->watermark = INITIAL_WATERMARK_USEC;
+    r->misses = 0;
+
+    for (i = 0; i < n; i++) {
+        pa_usec_t used = simulate_used(burst_rate);
+
+        *now += WAKEUP_INTERVAL_USEC;
+
+        if (used > r->watermark) {
+            pa_alsa_watermark_miss(w, r->watermark, *now);
+            r->watermark *= 2;
+
+            if (i >= n / 2)
+                r->misses++;
+        } else {
+            pa_alsa_watermark_sample(w, used);
+            r->watermark = pa_alsa_watermark_suggest(w, r->watermark, *now);
+        }
+
+        r->watermark = PA_MAX(r->watermark, MIN_WATERMARK_USEC);
+
+        if (i >= n / 2)
+            sum += r->watermark;
+    }
+
+    r->average = sum / (n - n / 2);
+}
+
+START_TEST (steady_test) {
+    pa_alsa_watermark *w;
+    pa_usec_t now = 0;
+    struct result r;
+
+    rnd_state = 1;
+    w = pa_alsa_watermark_new(PA_ALSA_WATERMARK_DEFAULT_MISS_RATE);
+
+    /* With little jitter the watermark goes down, but not below what
+     * we actually need */
+    simulate(w, 10000, 0, &now, &r);
+    pa_log_debug("steady: watermark %0.2f ms, average %0.2f ms, %u misses",
+                 (double) r.watermark / PA_USEC_PER_MSEC, (double) r.average / PA_USEC_PER_MSEC, r.misses);
+
+    fail_unless(r.watermark < 8*PA_USEC_PER_MSEC);
+    fail_unless(r.watermark >= 3*PA_USEC_PER_MSEC);
+    fail_unless(r.misses == 0);
+
+    pa_alsa_watermark_free(w);
+}
+END_TEST
+
+START_TEST (bursty_test) {
+    pa_alsa_watermark *w;
+    pa_usec_t now = 0;
+    struct result r, tolerant;
+
+    rnd_state = 2;
+    w = pa_alsa_watermark_new(PA_ALSA_WATERMARK_DEFAULT_MISS_RATE);
+
+    /* Bursts on 1% of the wakeups are frequent enough that the
+     * watermark has to cover them */
+    simulate(w, 50000, 100, &now, &r);
+    pa_log_debug("bursty: watermark %0.2f ms, average %0.2f ms, %u misses",
+                 (double) r.watermark / PA_USEC_PER_MSEC, (double) r.average / PA_USEC_PER_MSEC, r.misses);
+
+    fail_unless(r.watermark >= 14*PA_USEC_PER_MSEC);
+    fail_unless(r.watermark < 40*PA_USEC_PER_MSEC);
+    fail_unless(r.misses <= 25);
+
+    pa_alsa_watermark_free(w);
+
+    /* ... while with a more tolerant target they may be missed */
+    rnd_state = 2;
+    now = 0;
+    w = pa_alsa_watermark_new(0.05);
+
+    simulate(w, 50000, 100, &now, &tolerant);
+    pa_log_debug("bursty, tolerant: watermark %0.2f ms, average %0.2f ms, %u misses",
+                 (double) tolerant.watermark / PA_USEC_PER_MSEC, (double) tolerant.average / PA_USEC_PER_MSEC, tolerant.misses);
+
+    fail_unless(tolerant.average < r.average * 4 / 5);
+    fail_unless(tolerant.misses > r.misses);
+
+    pa_alsa_watermark_free(w);
+}
+END_TEST
+
+START_TEST (miss_test) {
+    pa_alsa_watermark *w;
+    pa_usec_t now = 0;
+    unsigned i;
+
+    w = pa_alsa_watermark_new(PA_ALSA_WATERMARK_DEFAULT_MISS_RATE);
+
+    /* Not enough data yet */
+    pa_alsa_watermark_sample(w, PA_USEC_PER_MSEC);
+    fail_unless(pa_alsa_watermark_suggest(w, INITIAL_WATERMARK_USEC, now) == INITIAL_WATERMARK_USEC);
+
+    for (i = 0; i < 5000; i++)
+        pa_alsa_watermark_sample(w, PA_USEC_PER_MSEC);
+
+    /* Decreases are limited in size and frequency */
+    fail_unless(pa_alsa_watermark_suggest(w, INITIAL_WATERMARK_USEC, now) == INITIAL_WATERMARK_USEC - INITIAL_WATERMARK_USEC / 5);
+    fail_unless(pa_alsa_watermark_suggest(w, INITIAL_WATERMARK_USEC, now) == INITIAL_WATERMARK_USEC);
+    now += PA_USEC_PER_SEC;
+    fail_unless(pa_alsa_watermark_suggest(w, INITIAL_WATERMARK_USEC, now) < INITIAL_WATERMARK_USEC);
+
+    /* A dropout within the target miss rate doesn't matter, but after
+     * more than that we don't decrease for a while */
+    pa_alsa_watermark_miss(w, INITIAL_WATERMARK_USEC, now);
+    now += PA_USEC_PER_SEC;
+    fail_unless(pa_alsa_watermark_suggest(w, INITIAL_WATERMARK_USEC, now) < INITIAL_WATERMARK_USEC);
+
+    pa_alsa_watermark_miss(w, INITIAL_WATERMARK_USEC, now);
+    pa_alsa_watermark_miss(w, INITIAL_WATERMARK_USEC, now);
+
+    for (i = 0; i < 1900; i++) {
+        now += WAKEUP_INTERVAL_USEC;
+        pa_alsa_watermark_sample(w, PA_USEC_PER_MSEC);
+        fail_unless(pa_alsa_watermark_suggest(w, INITIAL_WATERMARK_USEC, now) >= INITIAL_WATERMARK_USEC);
+    }
+
+    now += 2*PA_USEC_PER_SEC;
+    fail_unless(pa_alsa_watermark_suggest(w, INITIAL_WATERMARK_USEC, now) < INITIAL_WATERMARK_USEC);
+
+    /* Increases are suggested right away */
+    for (i = 0; i < 100; i++)
+        pa_alsa_watermark_sample(w, 30*PA_USEC_PER_MSEC);
+
+    fail_unless(pa_alsa_watermark_suggest(w, INITIAL_WATERMARK_USEC, now) > 30*PA_USEC_PER_MSEC);
+
+    /* Everything is forgotten on reset */
+    pa_alsa_watermark_reset(w);
+    fail_unless(pa_alsa_watermark_suggest(w, INITIAL_WATERMARK_USEC, now) == INITIAL_WATERMARK_USEC);
+
+    pa_alsa_watermark_free(w);
+}
+END_TEST
+
+START_TEST (stats_test) {
+    pa_alsa_watermark *w;
+    pa_alsa_watermark_stats stats;
+    unsigned i;
+
+    w = pa_alsa_watermark_new(0.005);
+
+    for (i = 0; i < 1000; i++)
+        pa_alsa_watermark_sample(w, i < 995 ? 2*PA_USEC_PER_MSEC : 50*PA_USEC_PER_MSEC);
+    pa_alsa_watermark_miss(w, 10*PA_USEC_PER_MSEC, 0);
+
+    pa_alsa_watermark_get_stats(w, &stats);
+
+    fail_unless(stats.n_samples == 1000);
+    fail_unless(stats.n_misses == 1);
+    fail_unless(stats.median >= 2*PA_USEC_PER_MSEC && stats.median < 3*PA_USEC_PER_MSEC);
+    fail_unless(stats.target >= 50*PA_USEC_PER_MSEC && stats.target < 60*PA_USEC_PER_MSEC);
+
+    pa_alsa_watermark_free(w);
+}
+END_TEST
+
+START_TEST (benchmark_test) {
+    pa_alsa_watermark *w;
+    pa_usec_t watermark = INITIAL_WATERMARK_USEC, now = 0;
+    unsigned i;
+
+    rnd_state = 3;
+    w = pa_alsa_watermark_new(PA_ALSA_WATERMARK_DEFAULT_MISS_RATE);
+
+    /* This runs on every timer wakeup in the IO thread */
+    PA_RUNTIME_TEST_RUN_START("watermark sample+suggest x1000", 1, 100) {
+        for (i = 0; i < 1000; i++) {
+            now += WAKEUP_INTERVAL_USEC;
+            pa_alsa_watermark_sample(w, simulate_used(100));
+            watermark = pa_alsa_watermark_suggest(w, watermark, now);
+        }
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_alsa_watermark_free(w);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Alsa-watermark");
+    tc = tcase_create("alsa-watermark");
+    tcase_add_test(tc, steady_test);
+    tcase_add_test(tc, bursty_test);
+    tcase_add_test(tc, miss_test);
+    tcase_add_test(tc, stats_test);
+    tcase_add_test(tc, benchmark_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -25,7 +25,10 @@
 
 #include <check.h>
 
+#include <pulse/util.h>
+
 #include <pulsecore/asyncmsgq.h>
+#include <pulsecore/core-util.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
@@ -105,6 +108,82 @@ START_TEST (asyncmsgq_test) {
 }
 END_TEST
 
+#define N_WRITERS 4
+#define N_MESSAGES 10000
+
+enum {
+    WRITER_POST,
+    WRITER_SEND
+};
+
+struct writer {
+    pa_asyncmsgq *q;
+    unsigned id;
+};
+
+static void writer_thread(void *userdata) {
+    struct writer *w = userdata;
+    unsigned i;
+
+    for (i = 0; i < N_MESSAGES; i++) {
+        void *data = PA_UINT_TO_PTR(w->id * N_MESSAGES + i);
+
+        /* Mix in some synchronous messages, they must not overtake
+         * the posted ones */
+        if (i % 1000 == 999)
+            pa_assert_se(pa_asyncmsgq_send(w->q, NULL, WRITER_SEND, data, 0, NULL) == (int) i);
+        else
+            pa_asyncmsgq_post(w->q, NULL, WRITER_POST, data, 0, NULL, NULL);
+    }
+}
+
+START_TEST (asyncmsgq_multiple_writers_test) {
+    pa_asyncmsgq *q;
+    pa_thread *t[N_WRITERS];
+    struct writer w[N_WRITERS];
+    unsigned next[N_WRITERS] = { 0 };
+    unsigned i, n;
+
+    /* A small queue, so that the writers overrun it */
+    q = pa_asyncmsgq_new(8);
+    fail_unless(q != NULL);
+
+    for (i = 0; i < N_WRITERS; i++) {
+        w[i].q = q;
+        w[i].id = i;
+        t[i] = pa_thread_new("writer", writer_thread, &w[i]);
+        fail_unless(t[i] != NULL);
+    }
+
+    /* Give the writers a head start so that they overrun the queue */
+    pa_msleep(10);
+
+    for (n = 0; n < N_WRITERS * N_MESSAGES; n++) {
+        void *data;
+        unsigned id, seq;
+
+        pa_assert_se(pa_asyncmsgq_get(q, NULL, NULL, &data, NULL, NULL, true) == 0);
+
+        id = PA_PTR_TO_UINT(data) / N_MESSAGES;
+        seq = PA_PTR_TO_UINT(data) % N_MESSAGES;
+
+        /* Messages of each writer arrive in order */
+        fail_unless(id < N_WRITERS);
+        fail_unless(seq == next[id]);
+        next[id]++;
+
+        pa_asyncmsgq_done(q, (int) seq);
+    }
+
+    fail_unless(pa_asyncmsgq_get(q, NULL, NULL, NULL, NULL, NULL, false) < 0);
+
+    for (i = 0; i < N_WRITERS; i++)
+        pa_thread_free(t[i]);
+
+    pa_asyncmsgq_unref(q);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -114,6 +193,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Async Message Queue");
     tc = tcase_create("asyncmsgq");
     tcase_add_test(tc, asyncmsgq_test);
+    tcase_add_test(tc, asyncmsgq_multiple_writers_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
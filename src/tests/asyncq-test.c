@@ -25,8 +25,11 @@
 
 #include <check.h>
 
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 #include <pulse/util.h>
 #include <pulsecore/asyncq.h>
+#include <pulsecore/core-util.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
@@ -87,6 +90,116 @@ START_TEST (asyncq_test) {
 }
 END_TEST
 
+#define N_ITEMS 200000
+#define N_PINGS 20000
+#define BATCH_SIZE 16
+
+struct benchmark {
+    pa_asyncq *q, *back;
+    unsigned batch;
+};
+
+static void batch_producer(void *userdata) {
+    struct benchmark *b = userdata;
+    void *items[BATCH_SIZE];
+    unsigned i, j;
+
+    for (i = 0; i < N_ITEMS; i += b->batch) {
+        for (j = 0; j < b->batch; j++)
+            items[j] = PA_UINT_TO_PTR(i + j + 1);
+
+        if (b->batch == 1)
+            pa_asyncq_push(b->q, items[0], true);
+        else
+            pa_assert_se(pa_asyncq_push_many(b->q, items, b->batch, true) == b->batch);
+    }
+}
+
+static void run_throughput_benchmark(unsigned batch) {
+    struct benchmark b;
+    pa_thread *t;
+    void *items[BATCH_SIZE];
+    unsigned i = 0, j, n;
+    pa_usec_t start, stop;
+
+    b.q = pa_asyncq_new(0);
+    b.batch = batch;
+
+    start = pa_rtclock_now();
+
+    t = pa_thread_new("producer", batch_producer, &b);
+    fail_unless(t != NULL);
+
+    while (i < N_ITEMS) {
+        if (batch == 1) {
+            items[0] = pa_asyncq_pop(b.q, true);
+            n = 1;
+        } else
+            n = pa_asyncq_pop_many(b.q, items, batch, true);
+
+        fail_unless(n > 0);
+
+        for (j = 0; j < n; j++)
+            fail_unless(items[j] == PA_UINT_TO_PTR(++i));
+    }
+
+    stop = pa_rtclock_now();
+
+    pa_thread_free(t);
+    pa_asyncq_free(b.q, NULL);
+
+    pa_log_info("Throughput, batches of %u: %u items in %llu usec, %0.1f items/msec",
+                batch, N_ITEMS, (unsigned long long) (stop - start),
+                (double) N_ITEMS * PA_USEC_PER_MSEC / (double) PA_MAX(stop - start, (pa_usec_t) 1));
+}
+
+static void echo(void *userdata) {
+    struct benchmark *b = userdata;
+    unsigned i;
+
+    for (i = 0; i < N_PINGS; i++)
+        pa_asyncq_push(b->back, pa_asyncq_pop(b->q, true), true);
+}
+
+static void run_latency_benchmark(void) {
+    struct benchmark b;
+    pa_thread *t;
+    unsigned i;
+    pa_usec_t start, stop;
+
+    b.q = pa_asyncq_new(0);
+    b.back = pa_asyncq_new(0);
+
+    t = pa_thread_new("echo", echo, &b);
+    fail_unless(t != NULL);
+
+    start = pa_rtclock_now();
+
+    for (i = 0; i < N_PINGS; i++) {
+        pa_asyncq_push(b.q, PA_UINT_TO_PTR(i + 1), true);
+        fail_unless(pa_asyncq_pop(b.back, true) == PA_UINT_TO_PTR(i + 1));
+    }
+
+    stop = pa_rtclock_now();
+
+    pa_thread_free(t);
+    pa_asyncq_free(b.q, NULL);
+    pa_asyncq_free(b.back, NULL);
+
+    pa_log_info("Latency: %0.2f usec per round trip", (double) (stop - start) / N_PINGS);
+}
+
+START_TEST (asyncq_benchmark_test) {
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_INFO);
+
+    run_throughput_benchmark(1);
+    run_throughput_benchmark(BATCH_SIZE);
+    run_latency_benchmark();
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -96,6 +209,8 @@ int main(int argc, char *argv[]) {
     s = suite_create("Async Queue");
     tc = tcase_create("asyncq");
     tcase_add_test(tc, asyncq_test);
+    tcase_add_test(tc, asyncq_benchmark_test);
+    tcase_set_timeout(tc, 120);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -55,6 +55,13 @@ static pa_stream *streams[NSTREAMS];
 static pa_threaded_mainloop *mainloop = NULL;
 static char *bname;
 
+/* Stream creation throughput: the time from requesting the streams of a
+ * connection until all of them are ready, summed over all connections */
+static pa_usec_t streams_requested;
+static unsigned n_streams_ready;
+static pa_usec_t create_usec;
+static unsigned n_streams_created;
+
 static const pa_sample_spec sample_spec = {
     .format = PA_SAMPLE_FLOAT32,
     .rate = SAMPLE_HZ,
@@ -139,7 +146,13 @@ static void stream_state_callback(pa_stream *s, void *userdata) {
         case PA_STREAM_UNCONNECTED:
         case PA_STREAM_CREATING:
         case PA_STREAM_TERMINATED:
+            break;
+
         case PA_STREAM_READY:
+            if (++n_streams_ready == NSTREAMS) {
+                create_usec += pa_rtclock_now() - streams_requested;
+                n_streams_created += NSTREAMS;
+            }
             break;
 
         default:
@@ -168,6 +181,9 @@ static void context_state_callback(pa_context *c, void *userdata) {
             int i;
             fprintf(stderr, "Connection (%d of %d) established.\n", (*try)+1, NTESTS);
 
+            n_streams_ready = 0;
+            streams_requested = pa_rtclock_now();
+
             for (i = 0; i < NSTREAMS; i++) {
                 char name[64];
 
@@ -208,6 +224,11 @@ START_TEST (connect_stress_test) {
         usleep(rand() % 500000);
     }
 
+    if (n_streams_created > 0)
+        fprintf(stderr, "Created %u streams in %llu usec (%.1f streams/s).\n",
+                n_streams_created, (unsigned long long) create_usec,
+                (double) n_streams_created * PA_USEC_PER_SEC / (double) PA_MAX(create_usec, 1U));
+
     fprintf(stderr, "Done.\n");
 }
 END_TEST
@@ -0,0 +1,267 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdarg.h>
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulsecore/core.h>
+#include <pulsecore/core-subscribe.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#define COALESCE_INTERVAL (20 * PA_USEC_PER_MSEC)
+
+#define SINK_INPUT_NEW (PA_SUBSCRIPTION_EVENT_SINK_INPUT | PA_SUBSCRIPTION_EVENT_NEW)
+#define SINK_INPUT_CHANGE (PA_SUBSCRIPTION_EVENT_SINK_INPUT | PA_SUBSCRIPTION_EVENT_CHANGE)
+#define SINK_INPUT_REMOVE (PA_SUBSCRIPTION_EVENT_SINK_INPUT | PA_SUBSCRIPTION_EVENT_REMOVE)
+#define SINK_CHANGE (PA_SUBSCRIPTION_EVENT_SINK | PA_SUBSCRIPTION_EVENT_CHANGE)
+
+static struct event {
+    pa_subscription_event_type_t type;
+    uint32_t index;
+} events[64];
+
+static unsigned n_events;
+
+static pa_mainloop *mainloop;
+static pa_core *core;
+
+static void subscription_cb(pa_core *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata) {
+    fail_unless(c == core);
+    fail_unless(n_events < PA_ELEMENTSOF(events));
+
+    events[n_events].type = t;
+    events[n_events].index = idx;
+    n_events++;
+}
+
+static void setup(void) {
+    mainloop = pa_mainloop_new();
+    fail_unless(mainloop != NULL);
+    core = pa_core_new(pa_mainloop_get_api(mainloop), false, false, 0);
+    fail_unless(core != NULL);
+
+    n_events = 0;
+}
+
+static void teardown(void) {
+    pa_core_unref(core);
+    pa_mainloop_free(mainloop);
+}
+
+/* Runs the main loop until nothing is left to do right now */
+static void dispatch(void) {
+    unsigned i;
+
+    for (i = 0; i < 4; i++)
+        pa_mainloop_iterate(mainloop, 0, NULL);
+}
+
+/* Runs the main loop until the current coalescing window has ended */
+static void wait_window(void) {
+    pa_usec_t end = pa_rtclock_now() + 2 * COALESCE_INTERVAL;
+
+    while (pa_rtclock_now() < end)
+        pa_mainloop_iterate(mainloop, 0, NULL);
+}
+
+/* Checks that exactly the given events were delivered since the last
+ * call, and forgets them */
+static void expect(unsigned n, ...) {
+    va_list ap;
+    unsigned i;
+
+    fail_unless(n_events == n);
+
+    va_start(ap, n);
+
+    for (i = 0; i < n; i++) {
+        pa_subscription_event_type_t type = (pa_subscription_event_type_t) va_arg(ap, int);
+        uint32_t index = (uint32_t) va_arg(ap, int);
+
+        fail_unless(events[i].type == type);
+        fail_unless(events[i].index == index);
+    }
+
+    va_end(ap);
+
+    n_events = 0;
+}
+
+START_TEST (queue_test) {
+    pa_subscription *s;
+
+    setup();
+    s = pa_subscription_new(core, PA_SUBSCRIPTION_MASK_ALL, subscription_cb, NULL);
+
+    /* Changes to an object that is still queued as new or changed are
+     * implied by the queued event */
+    pa_subscription_post(core, SINK_INPUT_NEW, 1);
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 1);
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 2);
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 2);
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 1);
+    pa_subscription_post(core, SINK_CHANGE, 1);
+    dispatch();
+    expect(3, SINK_INPUT_NEW, 1, SINK_INPUT_CHANGE, 2, SINK_CHANGE, 1);
+
+    /* Removing an object drops whatever is still queued for it */
+    pa_subscription_post(core, SINK_INPUT_NEW, 3);
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 3);
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 4);
+    pa_subscription_post(core, SINK_INPUT_REMOVE, 3);
+    dispatch();
+    expect(2, SINK_INPUT_CHANGE, 4, SINK_INPUT_REMOVE, 3);
+
+    pa_subscription_free(s);
+    dispatch();
+    teardown();
+}
+END_TEST
+
+START_TEST (coalesce_test) {
+    pa_subscription *s;
+
+    setup();
+    s = pa_subscription_new(core, PA_SUBSCRIPTION_MASK_ALL, subscription_cb, NULL);
+    pa_subscription_set_coalesce_interval(s, COALESCE_INTERVAL);
+
+    /* The first change goes out right away and opens a window */
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 1);
+    dispatch();
+    expect(1, SINK_INPUT_CHANGE, 1);
+
+    /* Changes during the window are held back, one per object */
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 1);
+    dispatch();
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 1);
+    dispatch();
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 2);
+    dispatch();
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 3);
+    dispatch();
+    expect(0);
+
+    /* ... but NEW and REMOVE are not, and a removal drops the held
+     * back change */
+    pa_subscription_post(core, SINK_INPUT_NEW, 4);
+    dispatch();
+    pa_subscription_post(core, SINK_INPUT_REMOVE, 3);
+    dispatch();
+    expect(2, SINK_INPUT_NEW, 4, SINK_INPUT_REMOVE, 3);
+
+    wait_window();
+    fail_unless(n_events == 2);
+    fail_unless(events[0].type == SINK_INPUT_CHANGE && events[1].type == SINK_INPUT_CHANGE);
+    fail_unless(events[0].index + events[1].index == 3);
+    n_events = 0;
+
+    /* A window without changes closes the window, after which changes
+     * are delivered right away again */
+    wait_window();
+    expect(0);
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 1);
+    dispatch();
+    expect(1, SINK_INPUT_CHANGE, 1);
+
+    /* Disabling coalescing delivers what was held back */
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 2);
+    dispatch();
+    expect(0);
+    pa_subscription_set_coalesce_interval(s, 0);
+    expect(1, SINK_INPUT_CHANGE, 2);
+
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 2);
+    dispatch();
+    expect(1, SINK_INPUT_CHANGE, 2);
+
+    pa_subscription_free(s);
+    dispatch();
+    teardown();
+}
+END_TEST
+
+START_TEST (filter_test) {
+    pa_subscription *s;
+    const uint32_t indexes[] = { 1, 3 };
+
+    setup();
+    s = pa_subscription_new(core, PA_SUBSCRIPTION_MASK_SINK_INPUT | PA_SUBSCRIPTION_MASK_SINK, subscription_cb, NULL);
+    pa_subscription_set_filter(s, PA_SUBSCRIPTION_EVENT_SINK_INPUT, indexes, PA_ELEMENTSOF(indexes));
+
+    /* Only the listed sink inputs get through, other facilities are
+     * not affected */
+    pa_subscription_post(core, SINK_INPUT_NEW, 1);
+    pa_subscription_post(core, SINK_INPUT_NEW, 2);
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 3);
+    pa_subscription_post(core, SINK_INPUT_REMOVE, 4);
+    pa_subscription_post(core, SINK_CHANGE, 2);
+    pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SOURCE | PA_SUBSCRIPTION_EVENT_CHANGE, 1);
+    dispatch();
+    expect(3, SINK_INPUT_NEW, 1, SINK_INPUT_CHANGE, 3, SINK_CHANGE, 2);
+
+    /* Setting a filter replaces the old one */
+    pa_subscription_set_filter(s, PA_SUBSCRIPTION_EVENT_SINK_INPUT, &indexes[1], 1);
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 1);
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 3);
+    dispatch();
+    expect(1, SINK_INPUT_CHANGE, 3);
+
+    /* An empty filter lets everything through again */
+    pa_subscription_set_filter(s, PA_SUBSCRIPTION_EVENT_SINK_INPUT, NULL, 0);
+    pa_subscription_post(core, SINK_INPUT_CHANGE, 2);
+    dispatch();
+    expect(1, SINK_INPUT_CHANGE, 2);
+
+    pa_subscription_free(s);
+    dispatch();
+    teardown();
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Core-subscribe");
+    tc = tcase_create("core-subscribe");
+    tcase_add_test(tc, queue_test);
+    tcase_add_test(tc, coalesce_test);
+    tcase_add_test(tc, filter_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
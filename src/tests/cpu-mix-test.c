@@ -52,6 +52,7 @@ static void run_mix_test(
         pa_do_mix_func_t orig_func,
         int align,
         int channels,
+        unsigned nstreams,
         bool correct,
         bool perf) {
 
@@ -68,6 +69,7 @@ static void run_mix_test(
     int i;
 
     pa_assert(channels == 1 || channels == 2 || channels == 4);
+    pa_assert(nstreams == 1 || nstreams == 2);
 
     /* Force sample alignment as requested */
     samples0 = in0 + (8 - align);
@@ -103,13 +105,13 @@ static void run_mix_test(
     }
 
     if (correct) {
-        acquire_mix_streams(m, 2);
-        orig_func(m, 2, channels, samples_ref, nsamples * sizeof(int16_t));
-        release_mix_streams(m, 2);
+        acquire_mix_streams(m, nstreams);
+        orig_func(m, nstreams, channels, samples_ref, nsamples * sizeof(int16_t));
+        release_mix_streams(m, nstreams);
 
-        acquire_mix_streams(m, 2);
-        func(m, 2, channels, samples, nsamples * sizeof(int16_t));
-        release_mix_streams(m, 2);
+        acquire_mix_streams(m, nstreams);
+        func(m, nstreams, channels, samples, nsamples * sizeof(int16_t));
+        release_mix_streams(m, nstreams);
 
         for (i = 0; i < nsamples; i++) {
             if (samples[i] != samples_ref[i]) {
@@ -124,18 +126,18 @@ static void run_mix_test(
     }
 
     if (perf) {
-        pa_log_debug("Testing %d-channel mixing performance with %d sample alignment", channels, align);
+        pa_log_debug("Testing %d-channel mixing performance of %u streams with %d sample alignment", channels, nstreams, align);
 
         PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
-            acquire_mix_streams(m, 2);
-            func(m, 2, channels, samples, nsamples * sizeof(int16_t));
-            release_mix_streams(m, 2);
+            acquire_mix_streams(m, nstreams);
+            func(m, nstreams, channels, samples, nsamples * sizeof(int16_t));
+            release_mix_streams(m, nstreams);
         } PA_RUNTIME_TEST_RUN_STOP
 
         PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
-            acquire_mix_streams(m, 2);
-            orig_func(m, 2, channels, samples_ref, nsamples * sizeof(int16_t));
-            release_mix_streams(m, 2);
+            acquire_mix_streams(m, nstreams);
+            orig_func(m, nstreams, channels, samples_ref, nsamples * sizeof(int16_t));
+            release_mix_streams(m, nstreams);
         } PA_RUNTIME_TEST_RUN_STOP
     }
 
@@ -158,13 +160,19 @@ START_TEST (mix_special_test) {
     special_func = pa_get_mix_func(PA_SAMPLE_S16NE);
 
     pa_log_debug("Checking special mix (s16, stereo)");
-    run_mix_test(special_func, orig_func, 7, 2, true, true);
+    run_mix_test(special_func, orig_func, 7, 2, 2, true, true);
 
     pa_log_debug("Checking special mix (s16, 4-channel)");
-    run_mix_test(special_func, orig_func, 7, 4, true, true);
+    run_mix_test(special_func, orig_func, 7, 4, 2, true, true);
 
     pa_log_debug("Checking special mix (s16, mono)");
-    run_mix_test(special_func, orig_func, 7, 1, true, true);
+    run_mix_test(special_func, orig_func, 7, 1, 2, true, true);
+
+    pa_log_debug("Checking special mix (s16, single stream, stereo)");
+    run_mix_test(special_func, orig_func, 7, 2, 1, true, true);
+
+    pa_log_debug("Checking special mix (s16, single stream, 4-channel)");
+    run_mix_test(special_func, orig_func, 7, 4, 1, true, true);
 }
 END_TEST
 
@@ -185,13 +193,13 @@ START_TEST (mix_neon_test) {
     neon_func = pa_get_mix_func(PA_SAMPLE_S16NE);
 
     pa_log_debug("Checking NEON mix (s16, stereo)");
-    run_mix_test(neon_func, orig_func, 7, 2, true, true);
+    run_mix_test(neon_func, orig_func, 7, 2, 2, true, true);
 
     pa_log_debug("Checking NEON mix (s16, 4-channel)");
-    run_mix_test(neon_func, orig_func, 7, 4, true, true);
+    run_mix_test(neon_func, orig_func, 7, 4, 2, true, true);
 
     pa_log_debug("Checking NEON mix (s16, mono)");
-    run_mix_test(neon_func, orig_func, 7, 1, true, true);
+    run_mix_test(neon_func, orig_func, 7, 1, 2, true, true);
 }
 END_TEST
 #endif /* defined (__arm__) && defined (__linux__) && defined (HAVE_NEON) */
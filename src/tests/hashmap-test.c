@@ -0,0 +1,259 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "runtime-test-util.h"
+
+#define N_ENTRIES 10000
+
+START_TEST (hashmap_test) {
+    pa_hashmap *h;
+    void *state;
+    void *v;
+    const void *k;
+    unsigned i, n;
+
+    h = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+    for (i = 1; i <= N_ENTRIES; i++)
+        fail_unless(pa_hashmap_put(h, PA_UINT_TO_PTR(i), PA_UINT_TO_PTR(i * 2)) == 0);
+
+    fail_unless(pa_hashmap_put(h, PA_UINT_TO_PTR(1), PA_UINT_TO_PTR(1)) < 0);
+    fail_unless(pa_hashmap_size(h) == N_ENTRIES);
+
+    for (i = 1; i <= N_ENTRIES; i++)
+        fail_unless(pa_hashmap_get(h, PA_UINT_TO_PTR(i)) == PA_UINT_TO_PTR(i * 2));
+
+    fail_unless(pa_hashmap_get(h, PA_UINT_TO_PTR(N_ENTRIES + 1)) == NULL);
+
+    /* Iteration is in insertion order, and removing the current entry
+     * while iterating is allowed */
+    n = 0;
+    PA_HASHMAP_FOREACH_KV(k, v, h, state) {
+        n++;
+        fail_unless(k == PA_UINT_TO_PTR(n));
+        fail_unless(v == PA_UINT_TO_PTR(n * 2));
+
+        if (n % 2 == 0)
+            fail_unless(pa_hashmap_remove(h, k) == v);
+    }
+
+    fail_unless(n == N_ENTRIES);
+    fail_unless(pa_hashmap_size(h) == N_ENTRIES / 2);
+
+    for (i = 1; i <= N_ENTRIES; i++)
+        fail_unless(pa_hashmap_get(h, PA_UINT_TO_PTR(i)) == (i % 2 ? PA_UINT_TO_PTR(i * 2) : NULL));
+
+    n = N_ENTRIES;
+    PA_HASHMAP_FOREACH_BACKWARDS(v, h, state) {
+        if (n % 2 == 0)
+            n--;
+        fail_unless(v == PA_UINT_TO_PTR(n * 2));
+        n -= 2;
+    }
+
+    /* Shrinking keeps everything reachable */
+    for (i = 1; i < N_ENTRIES - 10; i += 2)
+        fail_unless(pa_hashmap_remove(h, PA_UINT_TO_PTR(i)) == PA_UINT_TO_PTR(i * 2));
+
+    fail_unless(pa_hashmap_size(h) == 5);
+    fail_unless(pa_hashmap_first(h) == PA_UINT_TO_PTR((N_ENTRIES - 9) * 2));
+    fail_unless(pa_hashmap_last(h) == PA_UINT_TO_PTR((N_ENTRIES - 1) * 2));
+
+    for (i = N_ENTRIES - 9; i < N_ENTRIES; i += 2)
+        fail_unless(pa_hashmap_get(h, PA_UINT_TO_PTR(i)) == PA_UINT_TO_PTR(i * 2));
+
+    pa_hashmap_free(h);
+}
+END_TEST
+
+START_TEST (idxset_test) {
+    pa_idxset *s;
+    uint32_t idx, i;
+    void *v;
+    unsigned n;
+
+    s = pa_idxset_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+
+    for (i = 0; i < N_ENTRIES; i++) {
+        fail_unless(pa_idxset_put(s, pa_sprintf_malloc("entry %u", i), &idx) == 0);
+        fail_unless(idx == i);
+    }
+
+    fail_unless(pa_idxset_put(s, (void*) "entry 5", &idx) < 0);
+    fail_unless(idx == 5);
+
+    for (i = 0; i < N_ENTRIES; i++) {
+        char t[32];
+
+        pa_snprintf(t, sizeof(t), "entry %u", i);
+        fail_unless(pa_streq(pa_idxset_get_by_index(s, i), t));
+        fail_unless(pa_idxset_get_by_data(s, t, &idx) != NULL);
+        fail_unless(idx == i);
+    }
+
+    /* Removing entries between pa_idxset_first() and pa_idxset_next()
+     * calls is allowed */
+    n = 0;
+    PA_IDXSET_FOREACH(v, s, idx) {
+        fail_unless(idx == n * 3);
+        n++;
+
+        pa_xfree(pa_idxset_remove_by_index(s, idx));
+        pa_xfree(pa_idxset_remove_by_index(s, idx + 1));
+        pa_xfree(pa_idxset_remove_by_index(s, idx + 2));
+    }
+
+    fail_unless(pa_idxset_isempty(s));
+
+    for (i = 0; i < 3; i++)
+        fail_unless(pa_idxset_put(s, pa_sprintf_malloc("again %u", i), NULL) == 0);
+
+    idx = PA_IDXSET_INVALID;
+    fail_unless(pa_streq(pa_idxset_rrobin(s, &idx), "again 0"));
+    fail_unless(pa_streq(pa_idxset_rrobin(s, &idx), "again 1"));
+    fail_unless(pa_streq(pa_idxset_rrobin(s, &idx), "again 2"));
+    fail_unless(pa_streq(pa_idxset_rrobin(s, &idx), "again 0"));
+
+    pa_idxset_free(s, pa_xfree);
+}
+END_TEST
+
+#define RUN_TIMES 10
+
+/* Note that the benchmarks use the trivial hash functions, so they
+ * measure the table itself rather than the cost of hashing */
+static void run_hashmap_benchmark(unsigned n_entries) {
+    pa_hashmap *h;
+    void *state, *v;
+    unsigned i, sum = 0;
+    char label[64];
+
+    h = pa_hashmap_new(NULL, NULL);
+
+    pa_snprintf(label, sizeof(label), "hashmap insert/remove %u", n_entries);
+    PA_RUNTIME_TEST_RUN_START(label, 1, RUN_TIMES) {
+        for (i = 0; i < n_entries; i++)
+            pa_hashmap_put(h, PA_UINT_TO_PTR(i + 1), PA_UINT_TO_PTR(i + 1));
+        for (i = 0; i < n_entries; i++)
+            pa_hashmap_remove(h, PA_UINT_TO_PTR(i + 1));
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    for (i = 0; i < n_entries; i++)
+        pa_hashmap_put(h, PA_UINT_TO_PTR(i + 1), PA_UINT_TO_PTR(i + 1));
+
+    pa_snprintf(label, sizeof(label), "hashmap lookup %u", n_entries);
+    PA_RUNTIME_TEST_RUN_START(label, 1, RUN_TIMES) {
+        for (i = 0; i < n_entries; i++)
+            sum += PA_PTR_TO_UINT(pa_hashmap_get(h, PA_UINT_TO_PTR(i + 1)));
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_snprintf(label, sizeof(label), "hashmap iterate %u", n_entries);
+    PA_RUNTIME_TEST_RUN_START(label, 1, RUN_TIMES) {
+        PA_HASHMAP_FOREACH(v, h, state)
+            sum += PA_PTR_TO_UINT(v);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_log_debug("(checksum %u)", sum);
+    pa_hashmap_free(h);
+}
+
+static void run_idxset_benchmark(unsigned n_entries) {
+    pa_idxset *s;
+    void *v;
+    uint32_t idx, first;
+    unsigned i, sum = 0;
+    char label[64];
+
+    s = pa_idxset_new(NULL, NULL);
+
+    pa_snprintf(label, sizeof(label), "idxset insert/remove %u", n_entries);
+    PA_RUNTIME_TEST_RUN_START(label, 1, RUN_TIMES) {
+        for (i = 0; i < n_entries; i++)
+            pa_idxset_put(s, PA_UINT_TO_PTR(i + 1), NULL);
+        for (i = 0; i < n_entries; i++)
+            pa_idxset_remove_by_data(s, PA_UINT_TO_PTR(i + 1), NULL);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    for (i = 0; i < n_entries; i++)
+        pa_idxset_put(s, PA_UINT_TO_PTR(i + 1), i == 0 ? &first : NULL);
+
+    pa_snprintf(label, sizeof(label), "idxset lookup %u", n_entries);
+    PA_RUNTIME_TEST_RUN_START(label, 1, RUN_TIMES) {
+        for (i = 0; i < n_entries; i++)
+            sum += PA_PTR_TO_UINT(pa_idxset_get_by_index(s, first + i));
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_snprintf(label, sizeof(label), "idxset iterate %u", n_entries);
+    PA_RUNTIME_TEST_RUN_START(label, 1, RUN_TIMES) {
+        PA_IDXSET_FOREACH(v, s, idx)
+            sum += PA_PTR_TO_UINT(v);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_log_debug("(checksum %u)", sum);
+    pa_idxset_free(s, NULL);
+}
+
+START_TEST (benchmark_test) {
+    static const unsigned sizes[] = { 10, 1000, 100000 };
+    unsigned i;
+
+    for (i = 0; i < PA_ELEMENTSOF(sizes); i++) {
+        run_hashmap_benchmark(sizes[i]);
+        run_idxset_benchmark(sizes[i]);
+    }
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Hashmap");
+    tc = tcase_create("hashmap");
+    tcase_add_test(tc, hashmap_test);
+    tcase_add_test(tc, idxset_test);
+    tcase_add_test(tc, benchmark_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,216 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/proplist.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/info-cache.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/proplist-util.h>
+
+#define SEGMENT_NAME 0
+#define SEGMENT_PROPLIST 1
+
+static unsigned n_fills;
+
+static void fill_name(void *userdata, pa_tagstruct *t, void *object) {
+    n_fills++;
+    pa_tagstruct_puts(t, pa_proplist_gets(object, PA_PROP_DEVICE_DESCRIPTION));
+}
+
+static void fill_proplist(void *userdata, pa_tagstruct *t, void *object) {
+    n_fills++;
+    pa_tagstruct_put_proplist(t, object);
+}
+
+/* Puts the name segment of the object and returns what was appended */
+static const char *get_name(pa_info_cache *c, pa_tagstruct **t, uint32_t idx, pa_proplist *p, uint32_t version) {
+    const char *name;
+
+    if (*t)
+        pa_tagstruct_free(*t);
+    *t = pa_tagstruct_new();
+
+    pa_info_cache_put(c, *t, PA_SUBSCRIPTION_EVENT_SINK, idx, p, version, SEGMENT_NAME, fill_name, p, NULL);
+    fail_unless(pa_tagstruct_gets(*t, &name) == 0);
+    fail_unless(pa_tagstruct_eof(*t));
+
+    return name;
+}
+
+START_TEST (hit_test) {
+    pa_info_cache *c;
+    pa_proplist *a, *b;
+    pa_tagstruct *t = NULL;
+    uint64_t hits, misses;
+
+    c = pa_info_cache_new(2);
+    a = pa_proplist_new();
+    b = pa_proplist_new();
+    pa_proplist_sets(a, PA_PROP_DEVICE_DESCRIPTION, "a");
+    pa_proplist_sets(b, PA_PROP_DEVICE_DESCRIPTION, "b");
+    n_fills = 0;
+
+    fail_unless(pa_streq(get_name(c, &t, 0, a, 32), "a"));
+    fail_unless(pa_streq(get_name(c, &t, 1, b, 32), "b"));
+    fail_unless(n_fills == 2);
+
+    /* Repeated requests are served from the cache */
+    fail_unless(pa_streq(get_name(c, &t, 0, a, 32), "a"));
+    fail_unless(pa_streq(get_name(c, &t, 1, b, 32), "b"));
+    fail_unless(n_fills == 2);
+
+    pa_info_cache_get_stats(c, &hits, &misses);
+    fail_unless(hits == 2);
+    fail_unless(misses == 2);
+
+    /* Segments of the same object are cached independently */
+    pa_tagstruct_free(t);
+    t = pa_tagstruct_new();
+    pa_info_cache_put(c, t, PA_SUBSCRIPTION_EVENT_SINK, 0, a, 32, SEGMENT_PROPLIST, fill_proplist, a, NULL);
+    pa_info_cache_put(c, t, PA_SUBSCRIPTION_EVENT_SINK, 0, a, 32, SEGMENT_PROPLIST, fill_proplist, a, NULL);
+    fail_unless(n_fills == 3);
+
+    /* So are objects of different facilities with the same index */
+    pa_info_cache_put(c, t, PA_SUBSCRIPTION_EVENT_SOURCE, 0, a, 32, SEGMENT_NAME, fill_name, a, NULL);
+    fail_unless(n_fills == 4);
+
+    pa_tagstruct_free(t);
+    pa_proplist_free(a);
+    pa_proplist_free(b);
+    pa_info_cache_free(c);
+}
+END_TEST
+
+START_TEST (invalidate_test) {
+    pa_info_cache *c;
+    pa_proplist *a, *b;
+    pa_tagstruct *t = NULL;
+
+    c = pa_info_cache_new(2);
+    a = pa_proplist_new();
+    b = pa_proplist_new();
+    pa_proplist_sets(a, PA_PROP_DEVICE_DESCRIPTION, "a");
+    pa_proplist_sets(b, PA_PROP_DEVICE_DESCRIPTION, "b");
+    n_fills = 0;
+
+    get_name(c, &t, 0, a, 32);
+    get_name(c, &t, 1, b, 32);
+    fail_unless(n_fills == 2);
+
+    /* An event for one object drops only its entry */
+    pa_info_cache_invalidate(c, PA_SUBSCRIPTION_EVENT_SINK, 0);
+    get_name(c, &t, 0, a, 32);
+    get_name(c, &t, 1, b, 32);
+    fail_unless(n_fills == 3);
+
+    /* Invalidating what isn't cached is fine */
+    pa_info_cache_invalidate(c, PA_SUBSCRIPTION_EVENT_SINK, 5);
+    pa_info_cache_invalidate(c, PA_SUBSCRIPTION_EVENT_CARD, 0);
+
+    /* A proplist change that no event was posted for is noticed */
+    pa_proplist_sets(a, PA_PROP_DEVICE_DESCRIPTION, "changed");
+    fail_unless(pa_streq(get_name(c, &t, 0, a, 32), "changed"));
+    fail_unless(n_fills == 4);
+
+    pa_proplist_sets(b, "foo", "bar");
+    get_name(c, &t, 1, b, 32);
+    fail_unless(n_fills == 5);
+
+    pa_proplist_unset(b, "foo");
+    get_name(c, &t, 1, b, 32);
+    fail_unless(n_fills == 6);
+
+    pa_proplist_clear(b);
+    pa_proplist_sets(b, PA_PROP_DEVICE_DESCRIPTION, "b");
+    get_name(c, &t, 1, b, 32);
+    fail_unless(n_fills == 7);
+
+    /* Clients of another version don't get the old serialization */
+    get_name(c, &t, 1, b, 31);
+    get_name(c, &t, 1, b, 31);
+    fail_unless(n_fills == 8);
+
+    pa_tagstruct_free(t);
+    pa_proplist_free(a);
+    pa_proplist_free(b);
+    pa_info_cache_free(c);
+}
+END_TEST
+
+START_TEST (proplist_generation_test) {
+    pa_proplist *a, *b;
+    unsigned g;
+
+    a = pa_proplist_new();
+    b = pa_proplist_new();
+
+    g = pa_proplist_get_generation(a);
+    pa_proplist_sets(a, "foo", "bar");
+    fail_unless(pa_proplist_get_generation(a) != g);
+
+    /* Failed modifications don't count */
+    g = pa_proplist_get_generation(a);
+    fail_unless(pa_proplist_unset(a, "baz") < 0);
+    fail_unless(pa_proplist_sets(a, "", "bar") < 0);
+    fail_unless(pa_proplist_get_generation(a) == g);
+
+    pa_proplist_sets(b, "baz", "1");
+    pa_proplist_update(a, PA_UPDATE_MERGE, b);
+    fail_unless(pa_proplist_get_generation(a) != g);
+
+    /* Merging nothing new changes nothing */
+    g = pa_proplist_get_generation(a);
+    pa_proplist_update(a, PA_UPDATE_MERGE, b);
+    fail_unless(pa_proplist_get_generation(a) == g);
+
+    pa_proplist_free(a);
+    pa_proplist_free(b);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Info-cache");
+    tc = tcase_create("info-cache");
+    tcase_add_test(tc, hit_test);
+    tcase_add_test(tc, invalidate_test);
+    tcase_add_test(tc, proplist_generation_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <fcntl.h>
 #include <assert.h>
 #include <check.h>
 
@@ -30,6 +31,11 @@
 
 #include <pulsecore/core-util.h>
 #include <pulsecore/core-rtclock.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/random.h>
+
+#include "runtime-test-util.h"
 
 #ifdef GLIB_MAIN_LOOP
 
@@ -120,15 +126,303 @@ START_TEST (mainloop_test) {
 }
 END_TEST
 
+#ifndef GLIB_MAIN_LOOP
+
+#define N_TIME_EVENTS 200
+
+static unsigned n_fired;
+static pa_usec_t last_fired;
+static pa_time_event *freed_event;
+static unsigned n_rearmed;
+
+static void ordered_tcb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    pa_usec_t t = pa_timeval_load(tv);
+
+    /* Due events are dispatched in order of time */
+    fail_unless(t >= last_fired);
+    fail_unless(e != freed_event);
+    last_fired = t;
+
+    if (++n_fired == N_TIME_EVENTS - 1)
+        a->quit(a, 0);
+}
+
+static void rearm_tcb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    struct timeval ntv;
+
+    /* Rearming for the past must not starve the other events */
+    n_rearmed++;
+    a->time_restart(e, pa_timeval_rtstore(&ntv, 1, true));
+}
+
+START_TEST (time_event_test) {
+    pa_mainloop *m;
+    pa_mainloop_api *a;
+    pa_time_event *events[N_TIME_EVENTS], *rearm;
+    struct timeval tv;
+    pa_usec_t now;
+    unsigned i;
+
+    m = pa_mainloop_new();
+    fail_if(!m);
+    a = pa_mainloop_get_api(m);
+
+    now = pa_rtclock_now();
+
+    for (i = 0; i < N_TIME_EVENTS; i++) {
+        unsigned r;
+
+        pa_random(&r, sizeof(r));
+        events[i] = a->time_new(a, pa_timeval_rtstore(&tv, now + (r % 50) * PA_USEC_PER_MSEC, true), ordered_tcb, NULL);
+    }
+
+    /* Moving events around and freeing one keeps the heap intact */
+    for (i = 0; i < N_TIME_EVENTS; i += 7)
+        a->time_restart(events[i], pa_timeval_rtstore(&tv, now + (N_TIME_EVENTS - i) * PA_USEC_PER_MSEC / 4, true));
+    a->time_restart(events[1], NULL);
+    a->time_restart(events[1], pa_timeval_rtstore(&tv, now + 10 * PA_USEC_PER_MSEC, true));
+
+    freed_event = events[N_TIME_EVENTS / 2];
+    a->time_free(freed_event);
+
+    rearm = a->time_new(a, pa_timeval_rtstore(&tv, 1, true), rearm_tcb, NULL);
+    fail_unless(rearm != NULL);
+
+    fail_unless(pa_mainloop_run(m, NULL) == 1);
+    fail_unless(n_fired == N_TIME_EVENTS - 1);
+    fail_unless(n_rearmed > 0);
+
+    a->time_free(rearm);
+    pa_mainloop_free(m);
+}
+END_TEST
+
+static unsigned io_calls[3];
+
+static void counting_iocb(pa_mainloop_api *a, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata) {
+    fail_unless(f & PA_IO_EVENT_INPUT);
+    io_calls[PA_PTR_TO_UINT(userdata)]++;
+}
+
+START_TEST (io_event_test) {
+    pa_mainloop *m;
+    pa_mainloop_api *a;
+    pa_io_event *e1, *e2, *e3;
+    int pipe_fds[2], null_fd;
+    char c = 'x';
+
+    m = pa_mainloop_new();
+    fail_if(!m);
+    a = pa_mainloop_get_api(m);
+
+    fail_unless(pa_pipe_cloexec(pipe_fds) == 0);
+
+    /* Two io events on the same fd both get notified */
+    e1 = a->io_new(a, pipe_fds[0], PA_IO_EVENT_INPUT, counting_iocb, PA_UINT_TO_PTR(0));
+    e2 = a->io_new(a, pipe_fds[0], PA_IO_EVENT_INPUT, counting_iocb, PA_UINT_TO_PTR(1));
+
+    fail_unless(pa_mainloop_iterate(m, 0, NULL) == 0);
+    fail_unless(io_calls[0] == 0 && io_calls[1] == 0);
+
+    fail_unless(pa_write(pipe_fds[1], &c, 1, NULL) == 1);
+    fail_unless(pa_mainloop_iterate(m, 1, NULL) == 2);
+    fail_unless(io_calls[0] == 1 && io_calls[1] == 1);
+
+    /* ... unless they're disabled or gone */
+    a->io_enable(e1, PA_IO_EVENT_NULL);
+    fail_unless(pa_mainloop_iterate(m, 1, NULL) == 1);
+    fail_unless(io_calls[0] == 1 && io_calls[1] == 2);
+
+    a->io_enable(e1, PA_IO_EVENT_INPUT);
+    a->io_free(e2);
+    fail_unless(pa_mainloop_iterate(m, 1, NULL) == 1);
+    fail_unless(io_calls[0] == 2 && io_calls[1] == 2);
+
+    a->io_free(e1);
+    pa_close_pipe(pipe_fds);
+
+    /* Files epoll can't handle still work */
+    null_fd = pa_open_cloexec("/dev/null", O_RDONLY, 0);
+    fail_unless(null_fd >= 0);
+    e3 = a->io_new(a, null_fd, PA_IO_EVENT_INPUT, counting_iocb, PA_UINT_TO_PTR(2));
+    fail_unless(pa_mainloop_iterate(m, 1, NULL) == 1);
+    fail_unless(io_calls[2] == 1);
+    a->io_free(e3);
+    pa_close(null_fd);
+
+    pa_mainloop_free(m);
+}
+END_TEST
+
+static void drain_iocb(pa_mainloop_api *a, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata) {
+    char c;
+
+    pa_assert_se(pa_read(fd, &c, 1, NULL) == 1);
+}
+
+static pa_io_event *replaced_event;
+static int replaced_pipe[2], replacement_pipe[2];
+
+/* Closes the other pipe behind the back of its io event and puts a new
+ * one at the same fd, like a server accepting a new client right after
+ * another one went away */
+static void replacing_iocb(pa_mainloop_api *a, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata) {
+    char c;
+
+    pa_assert_se(pa_read(fd, &c, 1, NULL) == 1);
+
+    if (!replaced_event)
+        return;
+
+    fail_unless(pa_pipe_cloexec(replacement_pipe) == 0);
+    fail_unless(dup2(replacement_pipe[0], replaced_pipe[0]) == replaced_pipe[0]);
+    pa_close(replacement_pipe[0]);
+    replacement_pipe[0] = replaced_pipe[0];
+    pa_close(replaced_pipe[1]);
+
+    a->io_free(replaced_event);
+    replaced_event = NULL;
+
+    a->io_new(a, replacement_pipe[0], PA_IO_EVENT_INPUT, counting_iocb, PA_UINT_TO_PTR(1));
+}
+
+START_TEST (fd_reuse_test) {
+    pa_mainloop *m;
+    pa_mainloop_api *a;
+    pa_io_event *e1, *e2;
+    int old_fds[2], new_fds[2], trigger_fds[2], fd;
+    char c = 'x';
+
+    m = pa_mainloop_new();
+    fail_if(!m);
+    a = pa_mainloop_get_api(m);
+
+    io_calls[0] = io_calls[1] = 0;
+
+    /* An fd is closed before its io event is freed, and a new file gets
+     * the same number and an io event with the same flags */
+    fail_unless(pa_pipe_cloexec(old_fds) == 0);
+    e1 = a->io_new(a, old_fds[0], PA_IO_EVENT_INPUT, counting_iocb, PA_UINT_TO_PTR(0));
+    fail_unless(pa_mainloop_iterate(m, 0, NULL) == 0);
+
+    fd = old_fds[0];
+    pa_close_pipe(old_fds);
+    fail_unless(pa_pipe_cloexec(new_fds) == 0);
+    if (new_fds[0] != fd) {
+        fail_unless(dup2(new_fds[0], fd) == fd);
+        pa_close(new_fds[0]);
+        new_fds[0] = fd;
+    }
+
+    e2 = a->io_new(a, new_fds[0], PA_IO_EVENT_INPUT, counting_iocb, PA_UINT_TO_PTR(1));
+    a->io_free(e1);
+
+    fail_unless(pa_write(new_fds[1], &c, 1, NULL) == 1);
+    fail_unless(pa_mainloop_iterate(m, 1, NULL) == 1);
+    fail_unless(io_calls[0] == 0 && io_calls[1] == 1);
+
+    a->io_free(e2);
+    pa_close_pipe(new_fds);
+
+    /* An io event created during dispatch doesn't get what was reported
+     * for the file that had its fd before */
+    io_calls[1] = 0;
+    fail_unless(pa_pipe_cloexec(trigger_fds) == 0);
+    fail_unless(pa_pipe_cloexec(replaced_pipe) == 0);
+    e1 = a->io_new(a, trigger_fds[0], PA_IO_EVENT_INPUT, replacing_iocb, NULL);
+    replaced_event = a->io_new(a, replaced_pipe[0], PA_IO_EVENT_INPUT, drain_iocb, NULL);
+
+    fail_unless(pa_write(trigger_fds[1], &c, 1, NULL) == 1);
+    fail_unless(pa_write(replaced_pipe[1], &c, 1, NULL) == 1);
+    fail_unless(pa_mainloop_iterate(m, 1, NULL) >= 1);
+    fail_unless(!replaced_event);
+    fail_unless(io_calls[1] == 0);
+
+    /* It does get its own events though */
+    fail_unless(pa_write(replacement_pipe[1], &c, 1, NULL) == 1);
+    fail_unless(pa_mainloop_iterate(m, 1, NULL) == 1);
+    fail_unless(io_calls[1] == 1);
+
+    a->io_free(e1);
+    pa_close_pipe(trigger_fds);
+    pa_close_pipe(replacement_pipe);
+
+    pa_mainloop_free(m);
+}
+END_TEST
+
+#define RUN_TIMES 1000
+#define MAX_CLIENTS 400
+
+/* One active client among many idle ones, which is what the daemon's
+ * main loop usually looks like */
+START_TEST (mainloop_benchmark_test) {
+    static const unsigned sizes[] = { 1, 10, 100, MAX_CLIENTS };
+    static int pipes[MAX_CLIENTS][2];
+    pa_io_event *events[MAX_CLIENTS];
+    pa_time_event *timers[MAX_CLIENTS];
+    pa_mainloop *m;
+    pa_mainloop_api *a;
+    struct timeval tv;
+    unsigned i, n;
+    char c = 'x', label[64];
+
+    for (n = 0; n < PA_ELEMENTSOF(sizes); n++) {
+        m = pa_mainloop_new();
+        fail_if(!m);
+        a = pa_mainloop_get_api(m);
+
+        for (i = 0; i < sizes[n]; i++) {
+            fail_unless(pa_pipe_cloexec(pipes[i]) == 0);
+            events[i] = a->io_new(a, pipes[i][0], PA_IO_EVENT_INPUT, drain_iocb, NULL);
+            timers[i] = a->time_new(a, pa_timeval_rtstore(&tv, pa_rtclock_now() + 3600 * PA_USEC_PER_SEC + i, true), tcb, NULL);
+        }
+
+        pa_snprintf(label, sizeof(label), "mainloop iteration with %u clients", sizes[n]);
+        PA_RUNTIME_TEST_RUN_START(label, RUN_TIMES, 1) {
+            fail_unless(pa_write(pipes[0][1], &c, 1, NULL) == 1);
+            fail_unless(pa_mainloop_iterate(m, 1, NULL) == 1);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        pa_snprintf(label, sizeof(label), "mainloop timer update with %u clients", sizes[n]);
+        PA_RUNTIME_TEST_RUN_START(label, RUN_TIMES, 1) {
+            a->time_restart(timers[_j % sizes[n]], pa_timeval_rtstore(&tv, pa_rtclock_now() + 3600 * PA_USEC_PER_SEC, true));
+            a->io_enable(events[_j % sizes[n]], PA_IO_EVENT_INPUT|PA_IO_EVENT_OUTPUT);
+            a->io_enable(events[_j % sizes[n]], PA_IO_EVENT_INPUT);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        for (i = 0; i < sizes[n]; i++) {
+            a->time_free(timers[i]);
+            a->io_free(events[i]);
+            pa_close_pipe(pipes[i]);
+        }
+
+        pa_mainloop_free(m);
+    }
+}
+END_TEST
+
+#endif /* GLIB_MAIN_LOOP */
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
     TCase *tc;
     SRunner *sr;
 
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
     s = suite_create("MainLoop");
     tc = tcase_create("mainloop");
     tcase_add_test(tc, mainloop_test);
+#ifndef GLIB_MAIN_LOOP
+    tcase_add_test(tc, time_event_test);
+    tcase_add_test(tc, io_event_test);
+    tcase_add_test(tc, fd_reuse_test);
+    tcase_add_test(tc, mainloop_benchmark_test);
+    tcase_set_timeout(tc, 120);
+#endif
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -52,6 +52,10 @@ static void print_stats(pa_mempool *p, const char *text) {
                  "\texported_size = %u\n"
                  "\tn_too_large_for_pool = %u\n"
                  "\tn_pool_full = %u\n"
+                 "\tn_zero_copy = %u\n"
+                 "\tzero_copy_size = %u\n"
+                 "\tn_made_local = %u\n"
+                 "\tmade_local_size = %u\n"
                  "}",
            text,
            (unsigned) pa_atomic_load(&s->n_allocated),
@@ -63,7 +67,11 @@ static void print_stats(pa_mempool *p, const char *text) {
            (unsigned) pa_atomic_load(&s->imported_size),
            (unsigned) pa_atomic_load(&s->exported_size),
            (unsigned) pa_atomic_load(&s->n_too_large_for_pool),
-           (unsigned) pa_atomic_load(&s->n_pool_full));
+           (unsigned) pa_atomic_load(&s->n_pool_full),
+           (unsigned) pa_atomic_load(&s->n_zero_copy),
+           (unsigned) pa_atomic_load(&s->zero_copy_size),
+           (unsigned) pa_atomic_load(&s->n_made_local),
+           (unsigned) pa_atomic_load(&s->made_local_size));
 }
 
 START_TEST (memblock_test) {
@@ -148,6 +156,9 @@ START_TEST (memblock_test) {
         print_stats(pool_b, "B");
         print_stats(pool_c, "C");
 
+        fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool_b)->n_zero_copy) > 0);
+        fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool_c)->n_zero_copy) > 0);
+
         pa_memexport_free(export_b);
         x = pa_memblock_acquire(mb_c);
         pa_log_debug("2 data=%s", x);
@@ -176,6 +187,97 @@ START_TEST (memblock_test) {
 }
 END_TEST
 
+START_TEST (zero_copy_stat_test) {
+    pa_mempool *pool_a, *pool_b;
+    pa_memexport *export_a;
+    pa_memimport *import_b;
+    pa_memblock *mb_a, *mb_1, *mb_2;
+    const pa_mempool_stat *stat;
+    pa_mem_type_t mem_type;
+    uint32_t id, shm_id;
+    size_t offset, size;
+
+    pool_a = pa_mempool_new(PA_MEM_TYPE_SHARED_POSIX, 0, true);
+    fail_unless(pool_a != NULL);
+    pool_b = pa_mempool_new(PA_MEM_TYPE_SHARED_POSIX, 0, true);
+    fail_unless(pool_b != NULL);
+    stat = pa_mempool_get_stat(pool_b);
+
+    export_a = pa_memexport_new(pool_a, revoke_cb, (void*) "A");
+    fail_unless(export_a != NULL);
+    import_b = pa_memimport_new(pool_b, release_cb, (void*) "B");
+    fail_unless(import_b != NULL);
+
+    mb_a = pa_memblock_new(pool_a, 1024);
+    fail_unless(pa_memexport_put(export_a, mb_a, &mem_type, &id, &shm_id, &offset, &size) >= 0);
+
+    /* Importing the same block twice is one block passed by reference */
+    mb_1 = pa_memimport_get(import_b, PA_MEM_TYPE_SHARED_POSIX, id, shm_id, offset, size, false);
+    fail_unless(mb_1 != NULL);
+    mb_2 = pa_memimport_get(import_b, PA_MEM_TYPE_SHARED_POSIX, id, shm_id, offset, size, false);
+    fail_unless(mb_2 == mb_1);
+    pa_memblock_unref(mb_2);
+
+    fail_unless(pa_atomic_load(&stat->n_zero_copy) == 1);
+    fail_unless(pa_atomic_load(&stat->zero_copy_size) == (int) size);
+
+    /* The block is still referenced when the import goes away, so it has
+     * to be copied after all */
+    pa_memimport_free(import_b);
+    print_stats(pool_b, "B");
+
+    fail_unless(pa_atomic_load(&stat->n_zero_copy) == 0);
+    fail_unless(pa_atomic_load(&stat->zero_copy_size) == 0);
+    fail_unless(pa_atomic_load(&stat->n_made_local) == 1);
+    fail_unless(pa_atomic_load(&stat->made_local_size) == (int) size);
+
+    pa_memblock_unref(mb_1);
+    pa_memblock_unref(mb_a);
+    pa_memexport_free(export_a);
+
+    pa_mempool_unref(pool_a);
+    pa_mempool_unref(pool_b);
+}
+END_TEST
+
+START_TEST (memexport_release_batch_test) {
+    pa_mempool *pool;
+    pa_memexport *export;
+    pa_memblock *blocks[3];
+    uint32_t ids[4];
+    pa_mem_type_t mem_type;
+    uint32_t shm_id;
+    size_t offset, size;
+    unsigned i;
+
+    pool = pa_mempool_new(PA_MEM_TYPE_SHARED_POSIX, 0, true);
+    fail_unless(pool != NULL);
+
+    export = pa_memexport_new(pool, revoke_cb, (void*) "A");
+    fail_unless(export != NULL);
+
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++) {
+        blocks[i] = pa_memblock_new_pool(pool, 16);
+        fail_unless(blocks[i] != NULL);
+        fail_unless(pa_memexport_put(export, blocks[i], &mem_type, &ids[i], &shm_id, &offset, &size) >= 0);
+        pa_memblock_unref(blocks[i]);
+    }
+
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool)->n_exported) == 3);
+
+    /* The last id was never handed out and must be reported as failed */
+    ids[3] = ids[2] + 1;
+    fail_unless(pa_memexport_process_release_batch(export, ids, 4) == 1);
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool)->n_exported) == 0);
+
+    /* Releasing twice must fail */
+    fail_unless(pa_memexport_process_release_batch(export, ids, 1) == 1);
+
+    pa_memexport_free(export);
+    pa_mempool_unref(pool);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -188,6 +290,8 @@ int main(int argc, char *argv[]) {
     s = suite_create("Memblock");
     tc = tcase_create("memblock");
     tcase_add_test(tc, memblock_test);
+    tcase_add_test(tc, zero_copy_stat_test);
+    tcase_add_test(tc, memexport_release_batch_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -96,6 +96,56 @@ START_TEST (proplist_test) {
 }
 END_TEST
 
+START_TEST (proplist_copy_test) {
+    pa_proplist *a, *b;
+    const char *title, *key;
+    void *state = NULL;
+    unsigned n = 0;
+
+    a = pa_proplist_new();
+    fail_unless(pa_proplist_sets(a, PA_PROP_MEDIA_TITLE, "Wohltemperiertes Klavier") == 0);
+    fail_unless(pa_proplist_sets(a, "custom.key", "eins") == 0);
+    fail_unless(pa_proplist_setf(a, PA_PROP_APPLICATION_PROCESS_ID, "%u", 42u) == 0);
+
+    /* Copies share the values with the original, but changing either side
+     * must not be visible on the other one */
+    b = pa_proplist_copy(a);
+    fail_unless(pa_proplist_equal(a, b));
+
+    title = pa_proplist_gets(a, PA_PROP_MEDIA_TITLE);
+    fail_unless(pa_proplist_sets(b, PA_PROP_MEDIA_TITLE, "Kunst der Fuge") == 0);
+    fail_unless(pa_proplist_sets(b, "custom.key", "zwei") == 0);
+    fail_unless(!pa_proplist_equal(a, b));
+
+    fail_unless(pa_streq(title, "Wohltemperiertes Klavier"));
+    fail_unless(pa_streq(pa_proplist_gets(a, "custom.key"), "eins"));
+    fail_unless(pa_streq(pa_proplist_gets(b, "custom.key"), "zwei"));
+
+    pa_proplist_free(a);
+    fail_unless(pa_streq(pa_proplist_gets(b, PA_PROP_APPLICATION_PROCESS_ID), "42"));
+
+    /* Keys come back in insertion order, and the current one may be
+     * removed while iterating */
+    while ((key = pa_proplist_iterate(b, &state))) {
+        switch (n++) {
+            case 0: fail_unless(pa_streq(key, PA_PROP_MEDIA_TITLE)); break;
+            case 1: fail_unless(pa_streq(key, "custom.key")); break;
+            case 2: fail_unless(pa_streq(key, PA_PROP_APPLICATION_PROCESS_ID)); break;
+        }
+
+        if (n != 2)
+            fail_unless(pa_proplist_unset(b, key) == 0);
+    }
+
+    fail_unless(n == 3);
+    fail_unless(pa_proplist_size(b) == 1);
+    fail_unless(pa_proplist_contains(b, "custom.key") == 1);
+    fail_unless(pa_proplist_contains(b, PA_PROP_MEDIA_TITLE) == 0);
+
+    pa_proplist_free(b);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -108,6 +158,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Property List");
     tc = tcase_create("propertylist");
     tcase_add_test(tc, proplist_test);
+    tcase_add_test(tc, proplist_copy_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,682 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+#include <pulsecore/arpa-inet.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/endianmacros.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/memblockq.h>
+#include <pulsecore/socket.h>
+
+#include <modules/rtp/rtp.h>
+#include <modules/rtp/rtp-jitter.h>
+
+#include "runtime-test-util.h"
+
+#define PAYLOAD_SIZE 1200 /* What module-rtp-send uses with the default MTU */
+#define N_PACKETS 40
+#define SSRC 0x12345678
+
+static const pa_sample_spec ss = {
+    .format = PA_SAMPLE_S16BE,
+    .rate = 44100,
+    .channels = 2
+};
+
+struct loopback {
+    int send_fd, recv_fd;
+    pa_mempool *pool;
+    pa_memblockq *q;
+    pa_rtp_context rtp;
+};
+
+static void loopback_init(struct loopback *l) {
+    struct sockaddr_in sa;
+    socklen_t sa_len = sizeof(sa);
+    int rcvbuf = 4*1024*1024;
+
+    pa_zero(sa);
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sa.sin_port = 0;
+
+    fail_unless((l->recv_fd = socket(AF_INET, SOCK_DGRAM, 0)) >= 0);
+    fail_unless(bind(l->recv_fd, (struct sockaddr*) &sa, sizeof(sa)) == 0);
+    fail_unless(getsockname(l->recv_fd, (struct sockaddr*) &sa, &sa_len) == 0);
+
+    /* Everything we send has to fit in, we only read once sending is done */
+    setsockopt(l->recv_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    pa_make_fd_nonblock(l->recv_fd);
+
+    fail_unless((l->send_fd = socket(AF_INET, SOCK_DGRAM, 0)) >= 0);
+    fail_unless(connect(l->send_fd, (struct sockaddr*) &sa, sizeof(sa)) == 0);
+
+    fail_unless((l->pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true)) != NULL);
+    l->q = pa_memblockq_new("rtp-test memblockq", 0, 4*N_PACKETS*PAYLOAD_SIZE, 0, &ss, 1, 1, 0, NULL);
+
+    /* Takes ownership of send_fd */
+    pa_rtp_context_init_send(&l->rtp, l->send_fd, SSRC, pa_rtp_payload_from_sample_spec(&ss), pa_frame_size(&ss));
+}
+
+static void loopback_done(struct loopback *l) {
+    pa_rtp_context_destroy(&l->rtp);
+    pa_memblockq_free(l->q);
+    pa_mempool_unref(l->pool);
+
+    if (l->recv_fd >= 0)
+        pa_close(l->recv_fd);
+}
+
+/* Queues the given number of bytes, split into chunks of varying size so
+ * that the packets are assembled from several memblocks */
+static void push_data(struct loopback *l, size_t length, uint8_t *counter) {
+    size_t pushed = 0;
+    unsigned i = 0;
+
+    while (pushed < length) {
+        pa_memchunk chunk;
+        uint8_t *d;
+        size_t j, n;
+
+        n = PA_MIN(pa_frame_size(&ss) * (37 + 101 * (i++ % 5)), length - pushed);
+
+        chunk.memblock = pa_memblock_new(l->pool, n);
+        chunk.index = 0;
+        chunk.length = n;
+
+        d = pa_memblock_acquire(chunk.memblock);
+        for (j = 0; j < n; j++)
+            d[j] = (*counter)++;
+        pa_memblock_release(chunk.memblock);
+
+        fail_unless(pa_memblockq_push(l->q, &chunk) == 0);
+        pa_memblock_unref(chunk.memblock);
+
+        pushed += n;
+    }
+}
+
+/* Reads everything that arrived and checks the headers and the payload,
+ * returns the number of packets */
+static unsigned receive_and_check(struct loopback *l, uint16_t *sequence, uint32_t *timestamp, uint8_t *counter) {
+    uint8_t buf[PAYLOAD_SIZE + 12 + 1];
+    unsigned n = 0;
+    ssize_t r;
+
+    while ((r = recv(l->recv_fd, buf, sizeof(buf), 0)) >= 0) {
+        uint32_t header[3];
+        ssize_t i;
+
+        fail_unless(r == PAYLOAD_SIZE + 12);
+
+        memcpy(header, buf, sizeof(header));
+        fail_unless(ntohl(header[0]) >> 30 == 2);
+        fail_unless(((ntohl(header[0]) >> 16) & 127U) == l->rtp.payload);
+        fail_unless((uint16_t) ntohl(header[0]) == *sequence);
+        fail_unless(ntohl(header[1]) == *timestamp);
+        fail_unless(ntohl(header[2]) == SSRC);
+
+        for (i = 12; i < r; i++)
+            fail_unless(buf[i] == (*counter)++);
+
+        (*sequence)++;
+        *timestamp += PAYLOAD_SIZE / pa_frame_size(&ss);
+        n++;
+    }
+
+    fail_unless(errno == EAGAIN || errno == EWOULDBLOCK);
+
+    return n;
+}
+
+static void run_batch_test(bool use_gso) {
+    struct loopback l;
+    uint8_t send_counter = 0, recv_counter = 0;
+    uint16_t sequence;
+    uint32_t timestamp;
+    unsigned n;
+
+    loopback_init(&l);
+    l.rtp.use_gso = l.rtp.use_gso && use_gso;
+
+    sequence = l.rtp.sequence;
+    timestamp = l.rtp.timestamp;
+
+    /* Less than a packet stays queued */
+    push_data(&l, PAYLOAD_SIZE / 2, &send_counter);
+    fail_unless(pa_rtp_send(&l.rtp, PAYLOAD_SIZE, l.q) == 0);
+    fail_unless(l.rtp.send_calls == 0);
+
+    push_data(&l, N_PACKETS * PAYLOAD_SIZE, &send_counter);
+    fail_unless(pa_rtp_send(&l.rtp, PAYLOAD_SIZE, l.q) == 0);
+    fail_unless(pa_memblockq_get_length(l.q) == PAYLOAD_SIZE / 2);
+
+    n = receive_and_check(&l, &sequence, &timestamp, &recv_counter);
+    pa_log_debug("%s: %u packets with %llu syscalls", use_gso ? "GSO" : "no GSO", n, (unsigned long long) l.rtp.send_calls);
+
+    fail_unless(n == N_PACKETS);
+    fail_unless(l.rtp.packets_sent == N_PACKETS);
+    fail_unless(l.rtp.bytes_sent == N_PACKETS * (PAYLOAD_SIZE + 12));
+    fail_unless(l.rtp.packets_dropped == 0);
+    fail_unless(l.rtp.sequence == sequence);
+    fail_unless(l.rtp.timestamp == timestamp);
+
+#ifdef HAVE_SENDMMSG
+    /* At most one GSO attempt and one sendmmsg() per batch */
+    fail_unless(l.rtp.send_calls <= 4);
+#else
+    fail_unless(l.rtp.send_calls <= N_PACKETS + 2);
+#endif
+
+    /* A single packet works too */
+    push_data(&l, PAYLOAD_SIZE / 2, &send_counter);
+    fail_unless(pa_rtp_send(&l.rtp, PAYLOAD_SIZE, l.q) == 0);
+    fail_unless(receive_and_check(&l, &sequence, &timestamp, &recv_counter) == 1);
+    fail_unless(pa_memblockq_get_length(l.q) == 0);
+    fail_unless(l.rtp.packets_sent == N_PACKETS + 1);
+
+    loopback_done(&l);
+}
+
+START_TEST (batch_test) {
+    run_batch_test(true);
+}
+END_TEST
+
+START_TEST (no_gso_test) {
+    run_batch_test(false);
+}
+END_TEST
+
+START_TEST (benchmark_test) {
+    struct loopback l;
+    uint8_t counter = 0;
+    char buf[PAYLOAD_SIZE + 12];
+    bool use_gso;
+
+    loopback_init(&l);
+    use_gso = l.rtp.use_gso;
+
+    /* One push of module-rtp-send with 20ms of 48kHz stereo is about 3
+     * packets, so this is a burst the size of a long source latency */
+    PA_RUNTIME_TEST_RUN_START("rtp send 16 packets", 100, 10) {
+        push_data(&l, 16 * PAYLOAD_SIZE, &counter);
+        pa_rtp_send(&l.rtp, PAYLOAD_SIZE, l.q);
+
+        while (recv(l.recv_fd, buf, sizeof(buf), 0) >= 0)
+            ;
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    if (use_gso) {
+        l.rtp.use_gso = false;
+
+        PA_RUNTIME_TEST_RUN_START("rtp send 16 packets, no GSO", 100, 10) {
+            push_data(&l, 16 * PAYLOAD_SIZE, &counter);
+            pa_rtp_send(&l.rtp, PAYLOAD_SIZE, l.q);
+
+            while (recv(l.recv_fd, buf, sizeof(buf), 0) >= 0)
+                ;
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    pa_log_debug("%llu packets, %llu dropped, %llu syscalls",
+                 (unsigned long long) l.rtp.packets_sent, (unsigned long long) l.rtp.packets_dropped,
+                 (unsigned long long) l.rtp.send_calls);
+
+    loopback_done(&l);
+}
+END_TEST
+
+/* The receiving side: traces of (arrival time, packet) records are replayed
+ * over loopback, through pa_rtp_recv() and the jitter buffer */
+
+#define TRACE_PACKET_FRAMES 300
+#define TRACE_BURST 16U
+#define TRACE_SEQUENCE_BASE 65530
+#define TRACE_TIMESTAMP_BASE 0xfffff000U /* Both wrap around early on */
+
+struct trace_record {
+    pa_usec_t arrival;
+    unsigned packet;
+};
+
+struct replay_result {
+    pa_rtp_jitter_stats stats;
+    int16_t *audio;
+    size_t n_frames;
+    unsigned n_batches;
+};
+
+static int16_t pattern(size_t frame, unsigned channel) {
+    return (int16_t) ((frame * 37 + channel * 1000) % 20000) - 10000;
+}
+
+static bool packet_intact(const struct replay_result *r, unsigned packet) {
+    size_t i;
+    unsigned c;
+
+    if ((packet + 1) * TRACE_PACKET_FRAMES > r->n_frames)
+        return false;
+
+    for (i = packet * TRACE_PACKET_FRAMES; i < (packet + 1) * TRACE_PACKET_FRAMES; i++)
+        for (c = 0; c < ss.channels; c++)
+            if (PA_INT16_FROM_BE(r->audio[i * ss.channels + c]) != pattern(i, c))
+                return false;
+
+    return true;
+}
+
+static void send_packet(int fd, unsigned packet) {
+    uint8_t buf[12 + TRACE_PACKET_FRAMES * 4];
+    uint32_t header[3];
+    int16_t *d = (int16_t*) (buf + 12);
+    size_t i;
+    unsigned c;
+
+    header[0] = htonl(((uint32_t) 2 << 30) | ((uint32_t) pa_rtp_payload_from_sample_spec(&ss) << 16) | (uint16_t) (TRACE_SEQUENCE_BASE + packet));
+    header[1] = htonl(TRACE_TIMESTAMP_BASE + packet * TRACE_PACKET_FRAMES);
+    header[2] = htonl(SSRC);
+    memcpy(buf, header, sizeof(header));
+
+    for (i = 0; i < TRACE_PACKET_FRAMES; i++)
+        for (c = 0; c < ss.channels; c++)
+            *(d++) = PA_INT16_TO_BE(pattern(packet * TRACE_PACKET_FRAMES + i, c));
+
+    fail_unless(send(fd, buf, sizeof(buf), 0) == sizeof(buf));
+}
+
+static void replay(const struct trace_record *trace, unsigned n, struct replay_result *r) {
+    struct loopback l;
+    pa_rtp_context rtp;
+    pa_rtp_jitter *j;
+    pa_memblockq *q;
+    pa_memchunk silence, chunk;
+    unsigned i, k;
+    int one = 1;
+
+    loopback_init(&l);
+    fail_unless(setsockopt(l.recv_fd, SOL_SOCKET, SO_TIMESTAMP, &one, sizeof(one)) == 0);
+    pa_rtp_context_init_recv(&rtp, l.recv_fd, pa_frame_size(&ss));
+
+    silence.memblock = pa_memblock_new(l.pool, 4096);
+    silence.index = 0;
+    silence.length = 4096;
+    memset(pa_memblock_acquire(silence.memblock), 0, silence.length);
+    pa_memblock_release(silence.memblock);
+
+    q = pa_memblockq_new("rtp-test jitter memblockq", 0, 64*1024*1024, 0, &ss, 0, 1, 0, &silence);
+    j = pa_rtp_jitter_new(&ss, l.pool, PA_RTP_JITTER_DEFAULT_QUANTILE);
+
+    r->n_batches = 0;
+
+    for (i = 0; i < n; i += TRACE_BURST) {
+        unsigned burst = PA_MIN(n - i, TRACE_BURST);
+
+        for (k = 0; k < burst; k++)
+            send_packet(l.send_fd, trace[i + k].packet);
+
+        for (k = 0; k < burst; k++) {
+            struct timeval tv;
+
+            if (!pa_rtp_recv_pending(&rtp))
+                r->n_batches++;
+
+            fail_unless(pa_rtp_recv(&rtp, &chunk, l.pool, &tv) == 0);
+            fail_unless(rtp.sequence == (uint16_t) (TRACE_SEQUENCE_BASE + trace[i + k].packet));
+            fail_unless(rtp.ssrc == SSRC);
+            fail_unless(tv.tv_sec != 0);
+
+            pa_rtp_jitter_put(j, rtp.sequence, rtp.timestamp, &chunk, trace[i + k].arrival);
+            pa_memblock_unref(chunk.memblock);
+
+            pa_rtp_jitter_release(j, q, trace[i + k].arrival, false);
+        }
+    }
+
+    pa_rtp_jitter_release(j, q, trace[n - 1].arrival + PA_USEC_PER_SEC, true);
+    pa_rtp_jitter_get_stats(j, &r->stats);
+
+    r->n_frames = pa_memblockq_get_length(q) / pa_frame_size(&ss);
+    r->audio = pa_xnew(int16_t, r->n_frames * ss.channels);
+
+    /* With a silence memchunk set, peeking never fails */
+    for (k = 0; k < r->n_frames * pa_frame_size(&ss); k += chunk.length) {
+        fail_unless(pa_memblockq_peek(q, &chunk) >= 0);
+
+        chunk.length = PA_MIN(chunk.length, r->n_frames * pa_frame_size(&ss) - k);
+        memcpy((uint8_t*) r->audio + k, pa_memblock_acquire_chunk(&chunk), chunk.length);
+        pa_memblock_release(chunk.memblock);
+        pa_memblock_unref(chunk.memblock);
+
+        pa_memblockq_drop(q, chunk.length);
+    }
+
+    pa_rtp_jitter_free(j);
+    pa_memblockq_free(q);
+    pa_memblock_unref(silence.memblock);
+
+    /* Closes recv_fd */
+    pa_rtp_context_destroy(&rtp);
+    l.recv_fd = -1;
+    loopback_done(&l);
+}
+
+/* Deterministic, so that failures can be reproduced */
+static uint32_t rnd_state;
+
+static uint32_t rnd(void) {
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return rnd_state >> 8;
+}
+
+static int compare_arrival(const void *a, const void *b) {
+    const struct trace_record *x = a, *y = b;
+
+    return x->arrival < y->arrival ? -1 : x->arrival > y->arrival ? 1 : (int) x->packet - (int) y->packet;
+}
+
+/* Every packet is delayed by 5ms plus up to the given jitter, and some are
+ * lost on the way. Returns the number of records. */
+static unsigned generate_trace(struct trace_record *trace, unsigned n_packets, pa_usec_t jitter, unsigned loss_per_mille, unsigned *n_lost) {
+    unsigned i, n = 0;
+
+    *n_lost = 0;
+
+    for (i = 0; i < n_packets; i++) {
+        /* Keep the last one, so that the output has a known length */
+        if (i > 0 && i < n_packets - 1 && rnd() % 1000 < loss_per_mille) {
+            (*n_lost)++;
+            continue;
+        }
+
+        trace[n].packet = i;
+        trace[n].arrival = PA_USEC_PER_SEC + (pa_usec_t) i * TRACE_PACKET_FRAMES * PA_USEC_PER_SEC / ss.rate +
+            5 * PA_USEC_PER_MSEC + (jitter > 0 ? rnd() % jitter : 0);
+        n++;
+    }
+
+    qsort(trace, n, sizeof(struct trace_record), compare_arrival);
+
+    return n;
+}
+
+#define T(ms, packet) { (pa_usec_t) (ms) * PA_USEC_PER_MSEC, packet }
+
+START_TEST (reorder_test) {
+    /* Packets are 6.8ms apart. 3 comes before 2, 7 is lost and 4 is
+     * duplicated. */
+    static const struct trace_record trace[] = {
+        T(10, 0), T(17, 1), T(30, 3), T(31, 2), T(38, 4), T(44, 5), T(45, 4),
+        T(51, 6), T(64, 8), T(71, 9), T(78, 10), T(85, 11)
+    };
+    struct replay_result r;
+    unsigned i;
+    size_t k;
+
+    replay(trace, PA_ELEMENTSOF(trace), &r);
+
+    pa_log_debug("reorder: %llu received, %llu reordered, %llu late, %llu lost, %llu frames concealed",
+                 (unsigned long long) r.stats.packets_received, (unsigned long long) r.stats.packets_reordered,
+                 (unsigned long long) r.stats.packets_late, (unsigned long long) r.stats.packets_lost,
+                 (unsigned long long) r.stats.frames_concealed);
+
+    fail_unless(r.n_frames == 12 * TRACE_PACKET_FRAMES);
+    fail_unless(r.stats.packets_received == PA_ELEMENTSOF(trace));
+    fail_unless(r.stats.packets_reordered == 1);
+    fail_unless(r.stats.packets_late == 1);
+    fail_unless(r.stats.packets_lost == 1);
+    fail_unless(r.stats.frames_concealed == TRACE_PACKET_FRAMES);
+
+    for (i = 0; i < 12; i++)
+        fail_unless(packet_intact(&r, i) == (i != 7));
+
+    /* The lost packet is replaced by the one before it, fading out */
+    for (k = 0; k < TRACE_PACKET_FRAMES * ss.channels; k++) {
+        int16_t before = PA_INT16_FROM_BE(r.audio[6 * TRACE_PACKET_FRAMES * ss.channels + k]);
+        int16_t concealed = PA_INT16_FROM_BE(r.audio[7 * TRACE_PACKET_FRAMES * ss.channels + k]);
+
+        fail_unless(abs(concealed) <= abs(before));
+        fail_unless(abs(concealed) >= abs(before) / 2);
+        fail_unless(concealed == 0 || (concealed < 0) == (before < 0));
+    }
+
+#ifdef HAVE_RECVMMSG
+    fail_unless(r.n_batches == 1);
+#endif
+
+    pa_xfree(r.audio);
+}
+END_TEST
+
+#define OVERSIZED_FRAMES 1000 /* Doesn't fit into the initial 2 KiB slots */
+#define OVERSIZED_BATCH 32
+
+static void send_sized_packet(int fd, unsigned packet, size_t n_frames) {
+    uint8_t *buf;
+    uint32_t header[3];
+    size_t size = 12 + n_frames * pa_frame_size(&ss);
+
+    buf = pa_xmalloc0(size);
+
+    header[0] = htonl(((uint32_t) 2 << 30) | ((uint32_t) pa_rtp_payload_from_sample_spec(&ss) << 16) | (uint16_t) packet);
+    header[1] = htonl(packet * TRACE_PACKET_FRAMES);
+    header[2] = htonl(SSRC);
+    memcpy(buf, header, sizeof(header));
+
+    fail_unless(send(fd, buf, size, 0) == (ssize_t) size);
+
+    pa_xfree(buf);
+}
+
+/* Receives everything queued on the socket, returns the number of packets
+ * and checks that each has the size it was sent with */
+static unsigned receive_sized(pa_rtp_context *rtp, pa_mempool *pool, unsigned first, unsigned oversized) {
+    pa_memchunk chunk;
+    struct timeval tv;
+    unsigned n = 0;
+
+    while (pa_rtp_recv(rtp, &chunk, pool, &tv) == 0) {
+        fail_unless(rtp->sequence >= first && rtp->sequence < first + OVERSIZED_BATCH);
+        fail_unless(chunk.length == (rtp->sequence % OVERSIZED_BATCH == oversized ? OVERSIZED_FRAMES : TRACE_PACKET_FRAMES) * pa_frame_size(&ss));
+
+        pa_memblock_unref(chunk.memblock);
+        n++;
+    }
+
+    return n;
+}
+
+START_TEST (oversized_test) {
+    struct loopback l;
+    pa_rtp_context rtp;
+    unsigned i, n;
+    int one = 1;
+
+    loopback_init(&l);
+    fail_unless(setsockopt(l.recv_fd, SOL_SOCKET, SO_TIMESTAMP, &one, sizeof(one)) == 0);
+    pa_rtp_context_init_recv(&rtp, l.recv_fd, pa_frame_size(&ss));
+
+    /* A large packet in the middle of a batch is truncated and dropped,
+     * the ones around it still come through */
+    for (i = 0; i < OVERSIZED_BATCH; i++)
+        send_sized_packet(l.send_fd, i, i == 5 ? OVERSIZED_FRAMES : TRACE_PACKET_FRAMES);
+
+    n = receive_sized(&rtp, l.pool, 0, 5);
+#ifdef HAVE_RECVMMSG
+    fail_unless(n == OVERSIZED_BATCH - 1);
+#else
+    /* Every packet is first in its batch, so its size is known */
+    fail_unless(n == OVERSIZED_BATCH);
+#endif
+
+    /* The next batch has room for it, also in the slots at its end */
+    for (i = OVERSIZED_BATCH; i < 2 * OVERSIZED_BATCH; i++)
+        send_sized_packet(l.send_fd, i, i == 2 * OVERSIZED_BATCH - 2 ? OVERSIZED_FRAMES : TRACE_PACKET_FRAMES);
+
+    n = receive_sized(&rtp, l.pool, OVERSIZED_BATCH, OVERSIZED_BATCH - 2);
+    fail_unless(n == OVERSIZED_BATCH);
+
+    /* Closes recv_fd */
+    pa_rtp_context_destroy(&rtp);
+    l.recv_fd = -1;
+    loopback_done(&l);
+}
+END_TEST
+
+#define SIM_PACKETS 3000
+
+static void run_simulation(pa_usec_t jitter, unsigned loss_per_mille, struct replay_result *r, unsigned *n_lost) {
+    struct trace_record *trace;
+    unsigned n, i, intact = 0;
+
+    trace = pa_xnew(struct trace_record, SIM_PACKETS);
+    n = generate_trace(trace, SIM_PACKETS, jitter, loss_per_mille, n_lost);
+
+    replay(trace, n, r);
+
+    for (i = 0; i < SIM_PACKETS; i++)
+        if (packet_intact(r, i))
+            intact++;
+
+    pa_log_debug("jitter %llu ms, %u/1000 lost: %u intact, %llu reordered, %llu late, %llu lost, "
+                 "interarrival jitter %0.2f ms, target delay %0.2f ms, %u receive batches",
+                 (unsigned long long) (jitter / PA_USEC_PER_MSEC), loss_per_mille, intact,
+                 (unsigned long long) r->stats.packets_reordered, (unsigned long long) r->stats.packets_late,
+                 (unsigned long long) r->stats.packets_lost, (double) r->stats.jitter / PA_USEC_PER_MSEC,
+                 (double) r->stats.target_delay / PA_USEC_PER_MSEC, r->n_batches);
+
+    /* Nothing is missing or duplicated */
+    fail_unless(r->n_frames == SIM_PACKETS * TRACE_PACKET_FRAMES);
+    fail_unless(r->stats.packets_received == n);
+
+    /* Everything that we didn't wait for is counted as lost, and was
+     * concealed */
+    fail_unless(r->stats.packets_lost == *n_lost + r->stats.packets_late);
+    fail_unless(r->stats.frames_concealed == r->stats.packets_lost * TRACE_PACKET_FRAMES);
+    fail_unless(intact == SIM_PACKETS - r->stats.packets_lost);
+
+    pa_xfree(trace);
+    pa_xfree(r->audio);
+}
+
+START_TEST (simulation_test) {
+    struct replay_result r;
+    unsigned n_lost;
+    pa_usec_t packet_usec = TRACE_PACKET_FRAMES * PA_USEC_PER_SEC / ss.rate;
+
+    rnd_state = 1;
+
+    /* A quiet network needs hardly any buffering */
+    run_simulation(PA_USEC_PER_MSEC, 0, &r, &n_lost);
+    fail_unless(r.stats.packets_lost == 0);
+    fail_unless(r.stats.packets_reordered == 0);
+    fail_unless(r.stats.target_delay <= packet_usec + PA_USEC_PER_MSEC);
+
+    /* With lots of jitter packets get reordered and we have to wait for
+     * them, but not for the last few percent */
+    run_simulation(30 * PA_USEC_PER_MSEC, 20, &r, &n_lost);
+    fail_unless(n_lost > 0);
+    fail_unless(r.stats.packets_reordered > SIM_PACKETS / 4);
+    fail_unless(r.stats.packets_late > 0);
+    fail_unless(r.stats.packets_late < SIM_PACKETS / 20);
+    fail_unless(r.stats.target_delay >= packet_usec + 25 * PA_USEC_PER_MSEC);
+    fail_unless(r.stats.target_delay <= packet_usec + 31 * PA_USEC_PER_MSEC);
+}
+END_TEST
+
+START_TEST (jitter_benchmark_test) {
+    pa_mempool *pool;
+    pa_rtp_jitter *j;
+    pa_memblockq *q;
+    pa_memchunk chunk;
+    pa_usec_t arrival = 0;
+    unsigned i, packet = 0;
+
+    fail_unless((pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true)) != NULL);
+    q = pa_memblockq_new("rtp-test jitter memblockq", 0, 64*1024*1024, 0, &ss, 0, 1, 0, NULL);
+    j = pa_rtp_jitter_new(&ss, pool, PA_RTP_JITTER_DEFAULT_QUANTILE);
+
+    chunk.memblock = pa_memblock_new(pool, TRACE_PACKET_FRAMES * pa_frame_size(&ss));
+    chunk.index = 0;
+    chunk.length = TRACE_PACKET_FRAMES * pa_frame_size(&ss);
+
+    rnd_state = 2;
+
+    /* This runs for every received packet in the IO thread, every eighth
+     * pair of packets is swapped */
+    PA_RUNTIME_TEST_RUN_START("jitter put+release x1000", 1, 100) {
+        for (i = 0; i < 1000; i++, packet++) {
+            unsigned p = packet % 16 == 14 ? packet + 1 : packet % 16 == 15 ? packet - 1 : packet;
+
+            arrival += TRACE_PACKET_FRAMES * PA_USEC_PER_SEC / ss.rate;
+            pa_rtp_jitter_put(j, (uint16_t) p, p * TRACE_PACKET_FRAMES, &chunk, arrival + rnd() % (5 * PA_USEC_PER_MSEC));
+            pa_rtp_jitter_release(j, q, arrival, false);
+        }
+
+        pa_memblockq_flush_read(q);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_memblock_unref(chunk.memblock);
+    pa_rtp_jitter_free(j);
+    pa_memblockq_free(q);
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("RTP");
+    tc = tcase_create("rtp");
+    tcase_add_test(tc, batch_test);
+    tcase_add_test(tc, no_gso_test);
+    tcase_add_test(tc, benchmark_test);
+    tcase_add_test(tc, reorder_test);
+    tcase_add_test(tc, oversized_test);
+    tcase_add_test(tc, simulation_test);
+    tcase_add_test(tc, jitter_benchmark_test);
+    tcase_set_timeout(tc, 60);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -21,11 +21,19 @@
 
 #include <check.h>
 #include <signal.h>
+#include <unistd.h>
+
+#include <pulse/rtclock.h>
 
 #include <pulsecore/poll.h>
 #include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/pipe.h>
 #include <pulsecore/rtpoll.h>
 
+#include "runtime-test-util.h"
+
 static int before(pa_rtpoll_item *i) {
     pa_log("before");
     return 0;
@@ -82,15 +90,169 @@ START_TEST (rtpoll_test) {
 }
 END_TEST
 
+#define N_PIPES 64
+
+static pa_rtpoll_item *pipe_item_new(pa_rtpoll *p, int fd) {
+    pa_rtpoll_item *i;
+    struct pollfd *pollfd;
+
+    i = pa_rtpoll_item_new(p, PA_RTPOLL_NORMAL, 1);
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = fd;
+    pollfd->events = POLLIN;
+
+    return i;
+}
+
+static short pipe_item_revents(pa_rtpoll_item *i) {
+    return pa_rtpoll_item_get_pollfd(i, NULL)->revents;
+}
+
+START_TEST (rtpoll_fd_test) {
+    pa_rtpoll *p;
+    pa_rtpoll_item *items[N_PIPES], *extra;
+    int pipes[N_PIPES][2];
+    unsigned k;
+    char c = 'x';
+
+    p = pa_rtpoll_new();
+
+    for (k = 0; k < N_PIPES; k++) {
+        fail_unless(pa_pipe_cloexec(pipes[k]) == 0);
+        items[k] = pipe_item_new(p, pipes[k][0]);
+    }
+
+    /* The timer fires when nothing else happens */
+    pa_rtpoll_set_timer_relative(p, 1000);
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(pa_rtpoll_timer_elapsed(p));
+
+    for (k = 0; k < N_PIPES; k++)
+        fail_unless(pipe_item_revents(items[k]) == 0);
+
+    /* Only the readable fd is reported */
+    fail_unless(pa_write(pipes[N_PIPES/2][1], &c, 1, NULL) == 1);
+    pa_rtpoll_set_timer_relative(p, 10000000);
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(!pa_rtpoll_timer_elapsed(p));
+
+    for (k = 0; k < N_PIPES; k++)
+        fail_unless(pipe_item_revents(items[k]) == (k == N_PIPES/2 ? POLLIN : 0));
+
+    /* A second item on the same fd sees the event as well */
+    extra = pipe_item_new(p, pipes[N_PIPES/2][0]);
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(pipe_item_revents(items[N_PIPES/2]) == POLLIN);
+    fail_unless(pipe_item_revents(extra) == POLLIN);
+
+    /* ... and removing it doesn't affect the first one */
+    pa_rtpoll_item_free(extra);
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(pipe_item_revents(items[N_PIPES/2]) == POLLIN);
+
+    fail_unless(pa_read(pipes[N_PIPES/2][0], &c, 1, NULL) == 1);
+
+    /* Changes to the pollfd made behind rtpoll's back are picked up */
+    pa_rtpoll_item_get_pollfd(items[0], NULL)->fd = pipes[1][0];
+    pa_rtpoll_item_get_pollfd(items[2], NULL)->events = 0;
+    fail_unless(pa_write(pipes[1][1], &c, 1, NULL) == 1);
+    fail_unless(pa_write(pipes[2][1], &c, 1, NULL) == 1);
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(pipe_item_revents(items[0]) == POLLIN);
+    fail_unless(pipe_item_revents(items[1]) == POLLIN);
+    fail_unless(pipe_item_revents(items[2]) == 0);
+    pa_rtpoll_item_get_pollfd(items[0], NULL)->fd = pipes[0][0];
+    pa_rtpoll_item_get_pollfd(items[2], NULL)->events = POLLIN;
+    fail_unless(pa_read(pipes[1][0], &c, 1, NULL) == 1);
+    fail_unless(pa_read(pipes[2][0], &c, 1, NULL) == 1);
+
+    /* Hangups are reported even if not asked for */
+    pa_close(pipes[3][1]);
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(pipe_item_revents(items[3]) & POLLHUP);
+
+    /* Freeing an item and closing its fd; the fd number then gets
+     * reused for a fresh pipe */
+    pa_rtpoll_item_free(items[3]);
+    pa_close(pipes[3][0]);
+    fail_unless(pa_pipe_cloexec(pipes[3]) == 0);
+    items[3] = pipe_item_new(p, pipes[3][0]);
+    fail_unless(pa_write(pipes[3][1], &c, 1, NULL) == 1);
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(pipe_item_revents(items[3]) == POLLIN);
+    fail_unless(pa_read(pipes[3][0], &c, 1, NULL) == 1);
+
+    /* A timer in the past elapses right away */
+    pa_rtpoll_set_timer_absolute(p, 1);
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(pa_rtpoll_timer_elapsed(p));
+
+    for (k = 0; k < N_PIPES; k++) {
+        pa_rtpoll_item_free(items[k]);
+        pa_close_pipe(pipes[k]);
+    }
+
+    pa_rtpoll_free(p);
+}
+END_TEST
+
+#define RUN_TIMES 1000
+
+/* Wakeup latency with lots of idle fds in the set, which is what an
+ * I/O thread with many streams looks like */
+START_TEST (rtpoll_benchmark_test) {
+    static const unsigned sizes[] = { 1, 16, N_PIPES };
+    pa_rtpoll *p;
+    pa_rtpoll_item *items[N_PIPES];
+    int pipes[N_PIPES][2];
+    unsigned k, n;
+    char c = 'x', label[64];
+
+    for (n = 0; n < PA_ELEMENTSOF(sizes); n++) {
+        p = pa_rtpoll_new();
+
+        for (k = 0; k < sizes[n]; k++) {
+            fail_unless(pa_pipe_cloexec(pipes[k]) == 0);
+            items[k] = pipe_item_new(p, pipes[k][0]);
+        }
+
+        pa_snprintf(label, sizeof(label), "rtpoll wakeup with %u fds", sizes[n]);
+        PA_RUNTIME_TEST_RUN_START(label, RUN_TIMES, 1) {
+            fail_unless(pa_write(pipes[0][1], &c, 1, NULL) == 1);
+            fail_unless(pa_rtpoll_run(p) >= 0);
+            fail_unless(pa_read(pipes[0][0], &c, 1, NULL) == 1);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        pa_snprintf(label, sizeof(label), "rtpoll timer with %u fds", sizes[n]);
+        PA_RUNTIME_TEST_RUN_START(label, RUN_TIMES, 1) {
+            pa_rtpoll_set_timer_absolute(p, pa_rtclock_now());
+            fail_unless(pa_rtpoll_run(p) >= 0);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        for (k = 0; k < sizes[n]; k++) {
+            pa_rtpoll_item_free(items[k]);
+            pa_close_pipe(pipes[k]);
+        }
+
+        pa_rtpoll_free(p);
+    }
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
     TCase *tc;
     SRunner *sr;
 
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
     s = suite_create("RT Poll");
     tc = tcase_create("rtpoll");
     tcase_add_test(tc, rtpoll_test);
+    tcase_add_test(tc, rtpoll_fd_test);
+    tcase_add_test(tc, rtpoll_benchmark_test);
     /* the default timeout is too small,
      * set it to a reasonable large one.
      */
@@ -84,6 +84,37 @@ START_TEST (smoother_test) {
 }
 END_TEST
 
+/* Feeds exact data from a clock running 5% fast and returns how far off
+ * the estimate is after 300ms */
+static pa_usec_t settle(pa_usec_t adjust_time) {
+    pa_smoother *s;
+    pa_usec_t x, y;
+
+    s = pa_smoother_new(PA_USEC_PER_SEC, 10*PA_USEC_PER_SEC, true, true, 5, 0, true);
+    pa_smoother_set_adjust_time(s, adjust_time);
+    pa_smoother_resume(s, 0, true);
+
+    for (x = 0; x <= 300*PA_USEC_PER_MSEC; x += 10*PA_USEC_PER_MSEC)
+        pa_smoother_put(s, x, x + x / 20);
+
+    y = pa_smoother_get(s, x);
+    pa_smoother_free(s);
+
+    pa_log_debug("adjust time %llu ms: %lli us off", (unsigned long long) (adjust_time / PA_USEC_PER_MSEC), (long long) (y - (x + x / 20)));
+
+    return y > x + x / 20 ? y - (x + x / 20) : (x + x / 20) - y;
+}
+
+START_TEST (smoother_adjust_test) {
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    /* With precise data a short adjust time settles a lot faster */
+    fail_unless(settle(100*PA_USEC_PER_MSEC) < settle(PA_USEC_PER_SEC) / 2);
+    fail_unless(settle(100*PA_USEC_PER_MSEC) < PA_USEC_PER_MSEC);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -93,6 +124,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Smoother");
     tc = tcase_create("smoother");
     tcase_add_test(tc, smoother_test);
+    tcase_add_test(tc, smoother_adjust_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
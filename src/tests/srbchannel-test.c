@@ -24,7 +24,15 @@
 #include <unistd.h>
 #include <check.h>
 
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
 #include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/thread.h>
 #include <pulsecore/packet.h>
 #include <pulsecore/pstream.h>
 #include <pulsecore/iochannel.h>
@@ -121,6 +129,98 @@ START_TEST (srbchannel_test) {
 }
 END_TEST
 
+#define PING_PONG_ROUNDS 20000
+
+struct ping_pong {
+    pa_fdsem *ping, *pong;
+};
+
+static void pong_thread(void *userdata) {
+    struct ping_pong *pp = userdata;
+    unsigned i;
+
+    for (i = 0; i < PING_PONG_ROUNDS; i++) {
+        pa_fdsem_wait(pp->ping);
+        pa_fdsem_post(pp->pong);
+    }
+}
+
+static long context_switches(void) {
+#ifdef HAVE_SYS_RESOURCE_H
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+        return ru.ru_nvcsw + ru.ru_nivcsw;
+#endif
+
+    return 0;
+}
+
+/* Bounces a wakeup between two threads and reports the round trip
+ * time and the number of context switches, i.e. how often one of the
+ * threads actually had to go to sleep. If built with FDSEM_DEBUG, also
+ * reports the number of syscalls both fdsems made to sleep and wake up */
+static void ping_pong(const char *name, pa_fdsem *ping, pa_fdsem *pong) {
+    struct ping_pong pp = { ping, pong };
+    pa_thread *t;
+    pa_usec_t start, stop;
+#ifdef FDSEM_DEBUG
+    unsigned syscalls;
+#endif
+    long csw;
+    unsigned i;
+
+#ifdef FDSEM_DEBUG
+    syscalls = pa_fdsem_get_n_syscalls(ping) + pa_fdsem_get_n_syscalls(pong);
+#endif
+    csw = context_switches();
+    start = pa_rtclock_now();
+
+    fail_unless((t = pa_thread_new("pong", pong_thread, &pp)) != NULL);
+
+    for (i = 0; i < PING_PONG_ROUNDS; i++) {
+        pa_fdsem_post(ping);
+        pa_fdsem_wait(pong);
+    }
+
+    pa_thread_free(t);
+
+    stop = pa_rtclock_now();
+    csw = context_switches() - csw;
+
+    pa_log_info("%s: %0.2f usec and %0.2f context switches per round trip",
+                name, (double) (stop - start) / PING_PONG_ROUNDS, (double) csw / PING_PONG_ROUNDS);
+
+#ifdef FDSEM_DEBUG
+    syscalls = pa_fdsem_get_n_syscalls(ping) + pa_fdsem_get_n_syscalls(pong) - syscalls;
+    pa_log_info("%s: %0.2f syscalls per round trip", name, (double) syscalls / PING_PONG_ROUNDS);
+#endif
+}
+
+START_TEST (fdsem_wakeup_test) {
+    pa_fdsem_data *ping_data, *pong_data;
+    pa_fdsem *ping, *pong;
+
+    /* Process-private fdsems sleep on a futex where available */
+    fail_unless((ping = pa_fdsem_new()) != NULL);
+    fail_unless((pong = pa_fdsem_new()) != NULL);
+    ping_pong("private fdsem", ping, pong);
+    pa_fdsem_free(ping);
+    pa_fdsem_free(pong);
+
+    /* fdsems in shared memory, as used by the srbchannel, always go
+     * through the eventfd */
+    ping_data = pa_xnew0(pa_fdsem_data, 1);
+    pong_data = pa_xnew0(pa_fdsem_data, 1);
+    fail_unless((ping = pa_fdsem_new_shm(ping_data)) != NULL);
+    fail_unless((pong = pa_fdsem_new_shm(pong_data)) != NULL);
+    ping_pong("shared fdsem", ping, pong);
+    pa_fdsem_free(ping);
+    pa_fdsem_free(pong);
+    pa_xfree(ping_data);
+    pa_xfree(pong_data);
+}
+END_TEST
 
 int main(int argc, char *argv[]) {
     int failed = 0;
@@ -134,6 +234,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("srbchannel");
     tc = tcase_create("srbchannel");
     tcase_add_test(tc, srbchannel_test);
+    tcase_add_test(tc, fdsem_wakeup_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -92,6 +92,21 @@ static pa_sample_spec sample_spec;
 static pa_channel_map channel_map;
 static size_t sample_length = 0;
 
+/* Commands read from stdin by the "batch" subcommand. The fields mirror the
+ * globals above that the corresponding single-shot commands use. */
+struct batch_command {
+    unsigned line;
+    int action;
+    char *name;
+    char *arg;
+    uint32_t idx;
+    pa_cvolume volume;
+    int mute;
+};
+
+static struct batch_command *batch_commands = NULL;
+static unsigned n_batch_commands = 0;
+
 /* This variable tracks the number of ongoing asynchronous operations. When a
  * new operation begins, this is incremented simply with actions++, and when
  * an operation finishes, this is decremented with the complete_action()
@@ -130,7 +145,8 @@ static enum {
     SET_SOURCE_OUTPUT_MUTE,
     SET_SINK_FORMATS,
     SET_PORT_LATENCY_OFFSET,
-    SUBSCRIBE
+    SUBSCRIBE,
+    BATCH
 } action = NONE;
 
 static void quit(int ret) {
@@ -822,6 +838,29 @@ static void simple_callback(pa_context *c, int success, void *userdata) {
     complete_action();
 }
 
+static void batch_callback(pa_context *c, int success, const int *errors, unsigned n, void *userdata) {
+    unsigned i;
+
+    if (!errors) {
+        pa_log(_("Failure: %s"), pa_strerror(pa_context_errno(c)));
+        quit(1);
+        return;
+    }
+
+    pa_assert(n == n_batch_commands);
+
+    for (i = 0; i < n; i++)
+        if (errors[i] != PA_OK)
+            pa_log(_("Line %u: failure: %s"), batch_commands[i].line, pa_strerror(errors[i]));
+
+    if (!success) {
+        quit(1);
+        return;
+    }
+
+    complete_action();
+}
+
 static void index_callback(pa_context *c, uint32_t idx, void *userdata) {
     if (idx == PA_INVALID_INDEX) {
         pa_log(_("Failure: %s"), pa_strerror(pa_context_errno(c)));
@@ -1184,6 +1223,95 @@ static void context_subscribe_callback(pa_context *c, pa_subscription_event_type
     fflush(stdout);
 }
 
+static pa_operation* send_batch(pa_context *c) {
+    pa_batch *b;
+    pa_operation *o;
+    unsigned i;
+
+    b = pa_batch_new(c);
+
+    for (i = 0; i < n_batch_commands; i++) {
+        struct batch_command *bc = &batch_commands[i];
+        int r = -PA_ERR_INVALID;
+
+        switch (bc->action) {
+            case MOVE_SINK_INPUT:
+                r = pa_batch_move_sink_input_by_name(b, bc->idx, bc->name);
+                break;
+
+            case MOVE_SOURCE_OUTPUT:
+                r = pa_batch_move_source_output_by_name(b, bc->idx, bc->name);
+                break;
+
+            case SET_CARD_PROFILE:
+                r = pa_batch_set_card_profile_by_name(b, bc->name, bc->arg);
+                break;
+
+            case SET_SINK_PORT:
+                r = pa_batch_set_sink_port_by_name(b, bc->name, bc->arg);
+                break;
+
+            case SET_DEFAULT_SINK:
+                r = pa_batch_set_default_sink(b, bc->name);
+                break;
+
+            case SET_SOURCE_PORT:
+                r = pa_batch_set_source_port_by_name(b, bc->name, bc->arg);
+                break;
+
+            case SET_DEFAULT_SOURCE:
+                r = pa_batch_set_default_source(b, bc->name);
+                break;
+
+            case SET_SINK_VOLUME:
+                r = pa_batch_set_sink_volume_by_name(b, bc->name, &bc->volume);
+                break;
+
+            case SET_SOURCE_VOLUME:
+                r = pa_batch_set_source_volume_by_name(b, bc->name, &bc->volume);
+                break;
+
+            case SET_SINK_INPUT_VOLUME:
+                r = pa_batch_set_sink_input_volume(b, bc->idx, &bc->volume);
+                break;
+
+            case SET_SOURCE_OUTPUT_VOLUME:
+                r = pa_batch_set_source_output_volume(b, bc->idx, &bc->volume);
+                break;
+
+            case SET_SINK_MUTE:
+                r = pa_batch_set_sink_mute_by_name(b, bc->name, bc->mute);
+                break;
+
+            case SET_SOURCE_MUTE:
+                r = pa_batch_set_source_mute_by_name(b, bc->name, bc->mute);
+                break;
+
+            case SET_SINK_INPUT_MUTE:
+                r = pa_batch_set_sink_input_mute(b, bc->idx, bc->mute);
+                break;
+
+            case SET_SOURCE_OUTPUT_MUTE:
+                r = pa_batch_set_source_output_mute(b, bc->idx, bc->mute);
+                break;
+
+            default:
+                pa_assert_not_reached();
+        }
+
+        if (r < 0) {
+            pa_log(_("Line %u: %s"), bc->line, pa_strerror(-r));
+            pa_batch_free(b);
+            return NULL;
+        }
+    }
+
+    o = pa_batch_send(b, batch_callback, NULL);
+    pa_batch_free(b);
+
+    return o;
+}
+
 static void context_state_callback(pa_context *c, void *userdata) {
     pa_operation *o = NULL;
 
@@ -1421,6 +1549,10 @@ static void context_state_callback(pa_context *c, void *userdata) {
                                              NULL);
                     break;
 
+                case BATCH:
+                    o = send_batch(c);
+                    break;
+
                 default:
                     pa_assert_not_reached();
             }
@@ -1558,6 +1690,175 @@ static enum mute_flags parse_mute(const char *mute_text) {
     }
 }
 
+static int parse_batch_command(char *args[], unsigned n, struct batch_command *bc) {
+    pa_assert(args);
+    pa_assert(n > 0);
+    pa_assert(bc);
+
+    if (pa_streq(args[0], "move-sink-input") || pa_streq(args[0], "move-source-output")) {
+        bc->action = pa_streq(args[0], "move-sink-input") ? MOVE_SINK_INPUT : MOVE_SOURCE_OUTPUT;
+
+        if (n != 3 || pa_atou(args[1], &bc->idx) < 0) {
+            pa_log(_("You have to specify a stream index and a sink/source"));
+            return -1;
+        }
+
+        bc->name = pa_xstrdup(args[2]);
+
+    } else if (pa_streq(args[0], "set-card-profile") ||
+               pa_streq(args[0], "set-sink-port") ||
+               pa_streq(args[0], "set-source-port")) {
+
+        if (pa_streq(args[0], "set-card-profile"))
+            bc->action = SET_CARD_PROFILE;
+        else
+            bc->action = pa_streq(args[0], "set-sink-port") ? SET_SINK_PORT : SET_SOURCE_PORT;
+
+        if (n != 3) {
+            pa_log(_("You have to specify a name/index and a profile or port name"));
+            return -1;
+        }
+
+        bc->name = pa_xstrdup(args[1]);
+        bc->arg = pa_xstrdup(args[2]);
+
+    } else if (pa_streq(args[0], "set-default-sink") || pa_streq(args[0], "set-default-source")) {
+        bc->action = pa_streq(args[0], "set-default-sink") ? SET_DEFAULT_SINK : SET_DEFAULT_SOURCE;
+
+        if (n != 2) {
+            pa_log(_("You have to specify a sink/source name"));
+            return -1;
+        }
+
+        bc->name = pa_xstrdup(args[1]);
+
+    } else if (pa_streq(args[0], "set-sink-volume") ||
+               pa_streq(args[0], "set-source-volume") ||
+               pa_streq(args[0], "set-sink-input-volume") ||
+               pa_streq(args[0], "set-source-output-volume")) {
+
+        if (pa_streq(args[0], "set-sink-volume"))
+            bc->action = SET_SINK_VOLUME;
+        else if (pa_streq(args[0], "set-source-volume"))
+            bc->action = SET_SOURCE_VOLUME;
+        else
+            bc->action = pa_streq(args[0], "set-sink-input-volume") ? SET_SINK_INPUT_VOLUME : SET_SOURCE_OUTPUT_VOLUME;
+
+        if (n < 3) {
+            pa_log(_("You have to specify a name/index and a volume"));
+            return -1;
+        }
+
+        if (bc->action == SET_SINK_VOLUME || bc->action == SET_SOURCE_VOLUME)
+            bc->name = pa_xstrdup(args[1]);
+        else if (pa_atou(args[1], &bc->idx) < 0) {
+            pa_log(_("Invalid stream index"));
+            return -1;
+        }
+
+        if (parse_volumes(args + 2, n - 2) < 0)
+            return -1;
+
+        /* Relative changes need the current volume, which would require a
+         * round trip per command and defeat the point of batching. */
+        if (volume_flags & VOL_RELATIVE) {
+            pa_log(_("Relative volumes are not supported in batch mode"));
+            return -1;
+        }
+
+        bc->volume = volume;
+
+    } else if (pa_streq(args[0], "set-sink-mute") ||
+               pa_streq(args[0], "set-source-mute") ||
+               pa_streq(args[0], "set-sink-input-mute") ||
+               pa_streq(args[0], "set-source-output-mute")) {
+
+        if (pa_streq(args[0], "set-sink-mute"))
+            bc->action = SET_SINK_MUTE;
+        else if (pa_streq(args[0], "set-source-mute"))
+            bc->action = SET_SOURCE_MUTE;
+        else
+            bc->action = pa_streq(args[0], "set-sink-input-mute") ? SET_SINK_INPUT_MUTE : SET_SOURCE_OUTPUT_MUTE;
+
+        if (n != 3) {
+            pa_log(_("You have to specify a name/index and a mute action (0 or 1)"));
+            return -1;
+        }
+
+        if (bc->action == SET_SINK_MUTE || bc->action == SET_SOURCE_MUTE)
+            bc->name = pa_xstrdup(args[1]);
+        else if (pa_atou(args[1], &bc->idx) < 0) {
+            pa_log(_("Invalid stream index"));
+            return -1;
+        }
+
+        /* Toggling needs the current state as well */
+        if ((bc->mute = parse_mute(args[2])) == INVALID_MUTE || bc->mute == TOGGLE_MUTE) {
+            pa_log(_("Invalid mute specification"));
+            return -1;
+        }
+
+    } else {
+        pa_log(_("Command %s is not supported in batch mode"), args[0]);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Reads one command per line in the same syntax as on the command line.
+ * Empty lines and lines starting with '#' are ignored. */
+static int parse_batch(FILE *f) {
+    char line[2048];
+    unsigned line_no = 0, allocated = 0;
+
+    while (fgets(line, sizeof(line), f)) {
+        struct batch_command *bc;
+        char **args;
+        unsigned n;
+        int r;
+
+        line_no++;
+
+        if (!(args = pa_split_spaces_strv(line)))
+            continue;
+
+        if (args[0][0] == '#') {
+            pa_xstrfreev(args);
+            continue;
+        }
+
+        if (n_batch_commands >= PA_BATCH_MAX_COMMANDS) {
+            pa_log(_("Line %u: too many commands, a batch holds at most %u"), line_no, PA_BATCH_MAX_COMMANDS);
+            pa_xstrfreev(args);
+            return -1;
+        }
+
+        for (n = 0; args[n]; n++)
+            ;
+
+        if (n_batch_commands >= allocated) {
+            allocated = allocated ? allocated * 2 : 16;
+            batch_commands = pa_xrenew(struct batch_command, batch_commands, allocated);
+        }
+
+        bc = &batch_commands[n_batch_commands++];
+        memset(bc, 0, sizeof(*bc));
+        bc->line = line_no;
+        bc->idx = PA_INVALID_INDEX;
+
+        r = parse_batch_command(args, n, bc);
+        pa_xstrfreev(args);
+
+        if (r < 0) {
+            pa_log(_("Failed to parse line %u"), line_no);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 static void help(const char *argv0) {
 
     printf("%s %s %s\n",    argv0, _("[options]"), "stat");
@@ -1581,6 +1882,7 @@ static void help(const char *argv0) {
     printf("%s %s %s %s\n", argv0, _("[options]"), "set-sink-formats", _("#N FORMATS"));
     printf("%s %s %s %s\n", argv0, _("[options]"), "set-port-latency-offset", _("CARD-NAME|CARD-#N PORT OFFSET"));
     printf("%s %s %s\n",    argv0, _("[options]"), "subscribe");
+    printf("%s %s %s\n",    argv0, _("[options]"), "batch");
     printf(_("\nThe special names @DEFAULT_SINK@, @DEFAULT_SOURCE@ and @DEFAULT_MONITOR@\n"
              "can be used to specify the default sink, source and monitor.\n"));
 
@@ -2015,6 +2317,22 @@ int main(int argc, char *argv[]) {
                 goto quit;
             }
 
+        } else if (pa_streq(argv[optind], "batch")) {
+            action = BATCH;
+
+            if (argc != optind+1) {
+                pa_log(_("batch takes no arguments, commands are read from standard input"));
+                goto quit;
+            }
+
+            if (parse_batch(stdin) < 0)
+                goto quit;
+
+            if (n_batch_commands == 0) {
+                ret = 0;
+                goto quit;
+            }
+
         } else if (pa_streq(argv[optind], "subscribe"))
 
             action = SUBSCRIBE;
@@ -2101,6 +2419,16 @@ quit:
     pa_xfree(server);
     pa_xfree(list_type);
     pa_xfree(sample_name);
+    if (batch_commands) {
+        unsigned i;
+
+        for (i = 0; i < n_batch_commands; i++) {
+            pa_xfree(batch_commands[i].name);
+            pa_xfree(batch_commands[i].arg);
+        }
+        pa_xfree(batch_commands);
+    }
+
     pa_xfree(sink_name);
     pa_xfree(source_name);
     pa_xfree(module_args);